@@ -0,0 +1,81 @@
+#include "ast.h"
+
+// arena块大小, 足够放下几千个结点
+#define AST_CHUNK_SIZE (64 * 1024)
+
+struct AstChunk {
+    struct AstChunk* next;
+    size_t used;
+    size_t size;
+    // 数据紧跟在结构体之后
+};
+
+// 按8字节对齐从arena分配
+static void* ast_alloc(Ast* ast, size_t n) {
+    n = (n + 7) & ~(size_t)7;
+    AstChunk* chunk = ast->chunks;
+    if (!chunk || chunk->used + n > chunk->size) {
+        size_t size = n > AST_CHUNK_SIZE ? n : AST_CHUNK_SIZE;
+        chunk = (AstChunk*)malloc(sizeof(AstChunk) + size);
+        if (!chunk) {
+            fprintf(stderr, "Memory allocation error\n");
+            exit(1);
+        }
+        chunk->size = size;
+        chunk->used = 0;
+        chunk->next = ast->chunks;
+        ast->chunks = chunk;
+    }
+    void* p = (char*)(chunk + 1) + chunk->used;
+    chunk->used += n;
+    return p;
+}
+
+void ast_init(Ast* ast) {
+    ast->chunks = NULL;
+    ast->root = NULL;
+    ast->node_count = 0;
+}
+
+void ast_free(Ast* ast) {
+    AstChunk* chunk = ast->chunks;
+    while (chunk) {
+        AstChunk* next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    ast_init(ast);
+}
+
+AstNode* ast_new_node(Ast* ast, AstKind kind, SourceLoc loc) {
+    AstNode* node = (AstNode*)ast_alloc(ast, sizeof(AstNode));
+    memset(node, 0, sizeof(AstNode));
+    node->kind = kind;
+    node->loc = loc;
+    ast->node_count++;
+    return node;
+}
+
+const char* ast_strdup(Ast* ast, const char* s) {
+    size_t len = strlen(s);
+    char* p = (char*)ast_alloc(ast, len + 1);
+    memcpy(p, s, len + 1);
+    return p;
+}
+
+const char* ast_kind_to_str(AstKind kind) {
+    switch (kind) {
+        case AST_BLOCK: return "BLOCK";
+        case AST_ASSIGN: return "ASSIGN";
+        case AST_IF: return "IF";
+        case AST_WHILE: return "WHILE";
+        case AST_DO_WHILE: return "DO_WHILE";
+        case AST_BREAK: return "BREAK";
+        case AST_BINARY: return "BINARY";
+        case AST_UNARY: return "UNARY";
+        case AST_IDENT: return "IDENT";
+        case AST_NUMBER: return "NUMBER";
+        case AST_ERROR: return "ERROR";
+        default: return "UNKNOWN";
+    }
+}
@@ -0,0 +1,55 @@
+#ifndef AST_H
+#define AST_H
+
+#include "lexer.h"
+
+// 语法树结点类型
+typedef enum {
+    // 语句
+    AST_BLOCK,        // { stmts }
+    AST_ASSIGN,       // id = expr ;
+    AST_IF,           // if ( bool ) stmt [ else stmt ]
+    AST_WHILE,        // while ( bool ) stmt
+    AST_DO_WHILE,     // do stmt while ( bool ) ;
+    AST_BREAK,        // break ;
+
+    // 表达式
+    AST_BINARY,       // expr op expr
+    AST_UNARY,        // - factor
+    AST_IDENT,        // id
+    AST_NUMBER,       // num
+    AST_ERROR         // 出错位置的占位结点
+} AstKind;
+
+// 语法树结点
+// 语句链表通过next串联; 表达式只使用left/right
+typedef struct AstNode {
+    AstKind kind;
+    TokenType op;             // AST_BINARY / AST_UNARY 的运算符
+    SourceLoc loc;            // 对应token的位置
+    const char* name;         // AST_IDENT 的名字 / AST_NUMBER 的词素
+    struct AstNode* left;     // 赋值: 目标id; 二元: 左操作数; 单目: 操作数
+    struct AstNode* right;    // 赋值: 右部表达式; 二元: 右操作数
+    struct AstNode* cond;     // if / while / do-while 的条件
+    struct AstNode* body;     // 块内第一条语句 / 循环体 / then分支
+    struct AstNode* else_body;
+    struct AstNode* next;     // 同一块内的下一条语句
+} AstNode;
+
+// 结点与字符串统一从arena中分配, 整棵树一次释放
+typedef struct AstChunk AstChunk;
+
+typedef struct {
+    AstChunk* chunks;
+    AstNode* root;
+    int node_count;
+} Ast;
+
+void ast_init(Ast* ast);
+void ast_free(Ast* ast);
+AstNode* ast_new_node(Ast* ast, AstKind kind, SourceLoc loc);
+const char* ast_strdup(Ast* ast, const char* s);
+
+const char* ast_kind_to_str(AstKind kind);
+
+#endif
@@ -0,0 +1,441 @@
+#define _POSIX_C_SOURCE 200809L
+#include "astcache.h"
+#include "tokcache.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+struct AstCache {
+    unsigned char* map;          // 映射(或读入)的缓存文件
+    size_t map_size;
+    bool mapped;                 // true: mmap映射; false: malloc读入
+    const AstCacheHeader* header;
+    const AstCacheNode* nodes;
+    const AstCacheDiag* diags;
+    const char* strings;
+    const char* steps;
+};
+
+// 缓存文件的key: 语法规则或词法规则改变后旧的缓存自然不再命中
+static uint64_t content_key(const Lexer* lexer) {
+    return tokcache_hash(lexer->buffer, lexer->length, ((uint64_t)LEXER_VERSION << 32) | PARSER_VERSION);
+}
+
+static void cache_path(char* path, size_t size, uint64_t key) {
+    snprintf(path, size, "%s/%016llx.ast", lexer_get_cache_dir(), (unsigned long long)key);
+}
+
+// NOTE - 读取
+
+static void unmap(AstCache* c) {
+    if (!c->map) return;
+#ifndef _WIN32
+    if (c->mapped) munmap(c->map, c->map_size);
+    else
+#endif
+    free(c->map);
+    c->map = NULL;
+}
+
+static bool map_file(AstCache* c, const char* path) {
+#ifdef _WIN32
+    FILE* f = fopen(path, "rb");
+    if (!f) return false;
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    if (size < (long)sizeof(AstCacheHeader)) {
+        fclose(f);
+        return false;
+    }
+    c->map = (unsigned char*)malloc((size_t)size);
+    if (!c->map || fread(c->map, 1, (size_t)size, f) != (size_t)size) {
+        free(c->map);
+        c->map = NULL;
+        fclose(f);
+        return false;
+    }
+    fclose(f);
+    c->map_size = (size_t)size;
+    c->mapped = false;
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(AstCacheHeader)) {
+        close(fd);
+        return false;
+    }
+    void* p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) return false;
+    c->map = (unsigned char*)p;
+    c->map_size = (size_t)st.st_size;
+    c->mapped = true;
+#endif
+    return true;
+}
+
+// 区域在文件之内且按4字节对齐(结点表和诊断表在映射的内存上直接按结构体访问)
+static bool region_ok(const AstCache* c, uint32_t offset, uint64_t size) {
+    return offset % 4 == 0 && (uint64_t)offset + size <= c->map_size;
+}
+
+// 字符串区和推导过程都以'\0'结尾, 其中的任何偏移都能安全地当作字符串使用
+static bool strings_ok(const AstCache* c, uint32_t offset, uint32_t size, uint32_t count) {
+    if ((uint64_t)offset + size > c->map_size) return false;
+    if (size == 0) return count == 0;
+    const char* p = (const char*)c->map + offset;
+    if (p[size - 1] != '\0') return false;
+    uint32_t n = 0;
+    for (const char* end = p + size; p < end && n < count; p += strlen(p) + 1) n++;
+    return n == count;
+}
+
+static uint64_t hash_area(const void* p, size_t size, uint64_t seed) {
+    return size ? tokcache_hash((const char*)p, size, seed) : seed;
+}
+
+// 头部和各区域依次求哈希, 每一段的结果作为下一段的种子; 发现磁盘上的损坏, 而不只是越界
+static uint64_t checksum(const AstCacheHeader* h, const void* nodes, const void* diags,
+                         const char* strings, const char* steps) {
+    AstCacheHeader copy = *h;
+    copy.checksum = 0;
+    uint64_t sum = hash_area(&copy, sizeof(copy), 0);
+    sum = hash_area(nodes, (size_t)h->node_count * sizeof(AstCacheNode), sum);
+    sum = hash_area(diags, (size_t)h->diag_count * sizeof(AstCacheDiag), sum);
+    sum = hash_area(strings, h->string_size, sum);
+    return hash_area(steps, h->step_size, sum);
+}
+
+AstCache* astcache_load(const Lexer* lexer) {
+    if (!lexer_get_cache_dir()) return NULL;
+    AstCache* c = (AstCache*)calloc(1, sizeof(AstCache));
+    if (!c) return NULL;
+    uint64_t key = content_key(lexer);
+    char path[1024];
+    cache_path(path, sizeof(path), key);
+    if (!map_file(c, path)) {
+        free(c);
+        return NULL;
+    }
+
+    const AstCacheHeader* h = (const AstCacheHeader*)c->map;
+    bool ok = h->magic == ASTCACHE_MAGIC &&
+              h->format_version == ASTCACHE_FORMAT_VERSION &&
+              h->parser_version == PARSER_VERSION &&
+              h->lexer_version == LEXER_VERSION &&
+              h->content_hash == key &&
+              h->content_length == lexer->length &&
+              h->root <= h->node_count &&
+              region_ok(c, h->node_offset, (uint64_t)h->node_count * sizeof(AstCacheNode)) &&
+              region_ok(c, h->diag_offset, (uint64_t)h->diag_count * sizeof(AstCacheDiag)) &&
+              strings_ok(c, h->string_offset, h->string_size, 0) &&
+              strings_ok(c, h->step_offset, h->step_size, h->step_count) &&
+              h->checksum == checksum(h, c->map + h->node_offset, c->map + h->diag_offset,
+                                      (const char*)c->map + h->string_offset, (const char*)c->map + h->step_offset);
+    if (!ok) {
+        astcache_close(c);
+        return NULL;
+    }
+    c->header = h;
+    c->nodes = (const AstCacheNode*)(c->map + h->node_offset);
+    c->diags = (const AstCacheDiag*)(c->map + h->diag_offset);
+    c->strings = (const char*)c->map + h->string_offset;
+    c->steps = (const char*)c->map + h->step_offset;
+    return c;
+}
+
+void astcache_close(AstCache* c) {
+    if (!c) return;
+    unmap(c);
+    free(c);
+}
+
+const AstCacheHeader* astcache_header(const AstCache* c) {
+    return c->header;
+}
+
+const AstCacheNode* astcache_child(const AstCache* c, const AstCacheNode* from, uint32_t ref) {
+    if (ref == 0 || ref > c->header->node_count) return NULL;
+    if (from && ref - 1 <= (uint32_t)(from - c->nodes)) return NULL;
+    return &c->nodes[ref - 1];
+}
+
+const char* astcache_name(const AstCache* c, const AstCacheNode* node) {
+    if (node->name == 0 || node->name > c->header->string_size) return NULL;
+    return c->strings + node->name - 1;
+}
+
+const char* astcache_steps(const AstCache* c, int* count) {
+    *count = (int)c->header->step_count;
+    return c->steps;
+}
+
+// 放在child中的是left/right还是cond/body/else_body
+static bool expr_kind(AstKind kind) {
+    return kind != AST_BLOCK && kind != AST_IF && kind != AST_WHILE &&
+           kind != AST_DO_WHILE && kind != AST_BREAK;
+}
+
+static AstNode* build_chain(const AstCache* c, Ast* ast, SourceLoc base, const AstCacheNode* from, uint32_t ref) {
+    AstNode* head = NULL;
+    AstNode** slot = &head;
+    for (const AstCacheNode* n = astcache_child(c, from, ref); n; n = astcache_child(c, n, n->next)) {
+        AstKind kind = n->kind <= AST_ERROR ? (AstKind)n->kind : AST_ERROR;
+        AstNode* node = ast_new_node(ast, kind, base + n->offset);
+        node->op = (TokenType)n->op;
+        const char* name = astcache_name(c, n);
+        if (name) node->name = ast_strdup(ast, name);
+        AstNode* a = build_chain(c, ast, base, n, n->child[0]);
+        AstNode* b = build_chain(c, ast, base, n, n->child[1]);
+        AstNode* e = build_chain(c, ast, base, n, n->child[2]);
+        if (expr_kind(kind)) {
+            node->left = a;
+            node->right = b;
+        } else {
+            node->cond = a;
+            node->body = b;
+            node->else_body = e;
+        }
+        *slot = node;
+        slot = &node->next;
+    }
+    return head;
+}
+
+AstNode* astcache_build_ast(const AstCache* c, Ast* ast, SourceLoc base) {
+    return build_chain(c, ast, base, NULL, c->header->root);
+}
+
+void astcache_replay_diags(const AstCache* c, DiagEngine* d, SourceLoc base) {
+    const AstCacheHeader* h = c->header;
+    // 先原样放进暂存的收集器, 再按与分析时相同的规则合并进d
+    DiagEngine tmp;
+    diag_init(&tmp);
+    tmp.raw = true;
+    for (uint32_t i = 0; i < h->diag_count; i++) {
+        const AstCacheDiag* e = &c->diags[i];
+        if (e->code < 0 || e->code >= DIAG_CODE_COUNT) continue;
+        const char* text = e->text > 0 && e->text <= h->string_size ? c->strings + e->text - 1 : NULL;
+        int count = tmp.count;
+        diag_report(&tmp, (DiagCode)e->code, base + e->offset, e->arg0, e->arg1, text);
+        if (tmp.count > count) {
+            tmp.entries[count].repeat = e->repeat;
+            tmp.entries[count].last_loc = base + e->last_offset;
+        }
+    }
+    tmp.suppressed = (int)h->diag_suppressed;
+    diag_append(d, &tmp);
+    diag_free(&tmp);
+}
+
+// NOTE - 写入
+
+typedef struct {
+    SourceLoc base;
+    size_t length;
+    bool failed;
+    AstCacheNode* nodes;
+    uint32_t node_count;
+    uint32_t node_cap;
+    char* strings;
+    size_t string_size;
+    size_t string_cap;
+    uint32_t* string_hash;       // 开放寻址, 存 偏移+1
+    uint32_t string_hash_cap;
+    uint32_t string_count;
+} AstWriter;
+
+static bool grow(AstWriter* w, void** p, size_t* cap, size_t need, size_t elem, size_t first) {
+    if (need <= *cap) return true;
+    size_t n = *cap ? *cap * 2 : first;
+    while (n < need) n *= 2;
+    void* q = realloc(*p, n * elem);
+    if (!q) {
+        w->failed = true;
+        return false;
+    }
+    *p = q;
+    *cap = n;
+    return true;
+}
+
+// 把字符串加入字符串区, 返回 偏移+1
+static uint32_t intern(AstWriter* w, const char* s) {
+    if ((w->string_count + 1) * 2 > w->string_hash_cap) {
+        uint32_t cap = w->string_hash_cap ? w->string_hash_cap * 2 : 256;
+        uint32_t* table = (uint32_t*)calloc(cap, sizeof(uint32_t));
+        if (!table) {
+            w->failed = true;
+            return 0;
+        }
+        for (uint32_t i = 0; i < w->string_hash_cap; i++) {
+            uint32_t ref = w->string_hash[i];
+            if (!ref) continue;
+            const char* t = w->strings + ref - 1;
+            uint32_t j = (uint32_t)tokcache_hash(t, strlen(t), 0) & (cap - 1);
+            while (table[j]) j = (j + 1) & (cap - 1);
+            table[j] = ref;
+        }
+        free(w->string_hash);
+        w->string_hash = table;
+        w->string_hash_cap = cap;
+    }
+
+    size_t len = strlen(s);
+    uint32_t j = (uint32_t)tokcache_hash(s, len, 0) & (w->string_hash_cap - 1);
+    while (w->string_hash[j]) {
+        uint32_t ref = w->string_hash[j];
+        if (strcmp(w->strings + ref - 1, s) == 0) return ref;
+        j = (j + 1) & (w->string_hash_cap - 1);
+    }
+
+    size_t cap = w->string_cap;
+    if (!grow(w, (void**)&w->strings, &cap, w->string_size + len + 1, 1, 4096)) return 0;
+    w->string_cap = cap;
+    memcpy(w->strings + w->string_size, s, len + 1);
+    uint32_t ref = (uint32_t)w->string_size + 1;
+    w->string_size += len + 1;
+    w->string_hash[j] = ref;
+    w->string_count++;
+    return ref;
+}
+
+static uint32_t file_offset(AstWriter* w, SourceLoc loc) {
+    // 位置不在这个文件中时(不应出现)放弃写缓存
+    if (loc < w->base || loc - w->base > w->length) {
+        w->failed = true;
+        return 0;
+    }
+    return loc - w->base;
+}
+
+// 先序写出n及其后的同一链上的结点, 返回第一个结点的 下标+1
+// 结点表可能在递归中重新分配, 子结点写完后再按下标回填
+static uint32_t put_chain(AstWriter* w, const AstNode* n) {
+    uint32_t first = 0;
+    uint32_t prev = 0;
+    for (; n && !w->failed; n = n->next) {
+        size_t cap = w->node_cap;
+        if (!grow(w, (void**)&w->nodes, &cap, (size_t)w->node_count + 1, sizeof(AstCacheNode), 1024)) return 0;
+        w->node_cap = (uint32_t)cap;
+        uint32_t self = ++w->node_count;
+        AstCacheNode e;
+        memset(&e, 0, sizeof(e));
+        e.kind = (uint8_t)n->kind;
+        e.op = (uint16_t)n->op;
+        e.offset = file_offset(w, n->loc);
+        e.name = n->name ? intern(w, n->name) : 0;
+        w->nodes[self - 1] = e;
+        bool expr = expr_kind(n->kind);
+        if (expr ? n->cond || n->body || n->else_body : n->left || n->right) {
+            w->failed = true;
+            return 0;
+        }
+        uint32_t a = put_chain(w, expr ? n->left : n->cond);
+        uint32_t b = put_chain(w, expr ? n->right : n->body);
+        uint32_t c = expr ? 0 : put_chain(w, n->else_body);
+        if (w->failed) return 0;
+        AstCacheNode* p = &w->nodes[self - 1];
+        p->child[0] = a;
+        p->child[1] = b;
+        p->child[2] = c;
+        if (prev) w->nodes[prev - 1].next = self;
+        else first = self;
+        prev = self;
+    }
+    return first;
+}
+
+void astcache_store(const Lexer* lexer, const AstCacheEntry* entry) {
+    if (!lexer_get_cache_dir()) return;
+    AstWriter w;
+    memset(&w, 0, sizeof(w));
+    w.base = lexer->base;
+    w.length = lexer->length;
+
+    AstCacheHeader h;
+    memset(&h, 0, sizeof(h));
+    h.magic = ASTCACHE_MAGIC;
+    h.format_version = ASTCACHE_FORMAT_VERSION;
+    h.parser_version = PARSER_VERSION;
+    h.lexer_version = LEXER_VERSION;
+    h.content_hash = content_key(lexer);
+    h.content_length = lexer->length;
+    h.result = entry->result;
+    h.root = put_chain(&w, entry->root);
+    h.node_count = w.node_count;
+
+    const DiagEngine* d = entry->diag;
+    int diag_count = d->count > entry->first_diag ? d->count - entry->first_diag : 0;
+    AstCacheDiag* diags = (AstCacheDiag*)calloc((size_t)diag_count + 1, sizeof(AstCacheDiag));
+    if (!diags) w.failed = true;
+    for (int i = 0; i < diag_count && !w.failed; i++) {
+        const Diagnostic* e = &d->entries[entry->first_diag + i];
+        diags[i].code = e->code;
+        diags[i].repeat = e->repeat;
+        diags[i].offset = file_offset(&w, e->loc);
+        diags[i].last_offset = file_offset(&w, e->last_loc);
+        diags[i].arg0 = e->arg0;
+        diags[i].arg1 = e->arg1;
+        diags[i].text = e->text >= 0 ? intern(&w, d->pool + e->text) : 0;
+    }
+    h.diag_count = (uint32_t)diag_count;
+    h.diag_suppressed = (uint32_t)(entry->suppressed > 0 ? entry->suppressed : 0);
+
+    size_t step_size = 0;
+    for (int i = 0; i < entry->step_count; i++) step_size += strlen(entry->steps[i]) + 1;
+    // 推导过程先连成一块, 与读取时按同样的区域求checksum
+    char* steps = (char*)malloc(step_size + 1);
+    if (!steps) w.failed = true;
+    for (size_t i = 0, at = 0; steps && i < (size_t)entry->step_count; i++) {
+        size_t n = strlen(entry->steps[i]) + 1;
+        memcpy(steps + at, entry->steps[i], n);
+        at += n;
+    }
+    h.step_count = (uint32_t)entry->step_count;
+    h.step_size = (uint32_t)step_size;
+    h.speculations = (uint32_t)entry->memo.speculations;
+    h.memo_lookups = (uint32_t)entry->memo.lookups;
+    h.memo_hits = (uint32_t)entry->memo.hits;
+
+    // 结点表和诊断表在前, 保持4字节对齐
+    h.node_offset = (uint32_t)sizeof(AstCacheHeader);
+    h.diag_offset = h.node_offset + h.node_count * (uint32_t)sizeof(AstCacheNode);
+    h.string_offset = h.diag_offset + h.diag_count * (uint32_t)sizeof(AstCacheDiag);
+    h.string_size = (uint32_t)w.string_size;
+    h.step_offset = h.string_offset + h.string_size;
+    uint64_t total = (uint64_t)h.step_offset + step_size;
+    if (!w.failed) h.checksum = checksum(&h, w.nodes, diags, w.strings, steps);
+
+    if (!w.failed && total <= UINT32_MAX) {
+        char path[1024];
+        char tmp[1100];
+        cache_path(path, sizeof(path), h.content_hash);
+        snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+        FILE* f = fopen(tmp, "wb");
+        if (f) {
+            bool ok = fwrite(&h, sizeof(h), 1, f) == 1;
+            if (h.node_count) ok = ok && fwrite(w.nodes, sizeof(AstCacheNode), h.node_count, f) == h.node_count;
+            if (h.diag_count) ok = ok && fwrite(diags, sizeof(AstCacheDiag), h.diag_count, f) == h.diag_count;
+            if (w.string_size) ok = ok && fwrite(w.strings, 1, w.string_size, f) == w.string_size;
+            if (step_size) ok = ok && fwrite(steps, 1, step_size, f) == step_size;
+            ok = (fclose(f) == 0) && ok;
+            if (ok) {
+                remove(path);  // Windows下rename不能覆盖已有文件
+                ok = rename(tmp, path) == 0;
+            }
+            if (!ok) remove(tmp);
+        }
+    }
+    free(diags);
+    free(steps);
+    free(w.nodes);
+    free(w.strings);
+    free(w.string_hash);
+}
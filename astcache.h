@@ -0,0 +1,111 @@
+#ifndef ASTCACHE_H
+#define ASTCACHE_H
+
+#include <stdint.h>
+#include "parser.h"
+
+// NOTE - 磁盘语法树缓存
+// 与token缓存使用同一个缓存目录(lexer_set_cache_dir, 语法分析器的 --cache-dir), 每个文件对应一个 <key>.ast,
+// key由文件内容哈希、PARSER_VERSION与LEXER_VERSION共同决定; 保存一次完整解析的结果:
+// 语法树、诊断、推导过程和推测性分析的统计, 内容未变的文件不再做词法和语法分析
+// 文件中没有指针, 位置都是文件内的偏移, 结点之间用下标引用, 以只读方式映射后直接使用, 不做反序列化;
+// 需要AstNode指针的分析(cfg_build等)由astcache_build_ast一遍顺序扫描重建, 位置加上文件当前的base
+// 使用了预处理指令(结果还取决于其他文件)、设置了资源上限或事件式解析时不读也不写缓存
+// 文件格式(整数均为小端序, 偏移相对文件开头):
+//   头部      AstCacheHeader, checksum是头部(checksum记为0)和之后各区域的哈希, 不符时当作未命中
+//   结点表    node_count个AstCacheNode, 按先序排列, 每个引用都指向排在它之后的结点
+//   诊断表    diag_count个AstCacheDiag
+//   字符串区  以'\0'结尾的字符串(标识符、数值词素和诊断的文本参数), 按内容去重
+//   推导过程  step_count个以'\0'结尾的推导式
+
+#define ASTCACHE_MAGIC 0x54534143u  // "CAST"
+#define ASTCACHE_FORMAT_VERSION 2
+
+typedef struct {
+    uint32_t magic;
+    uint32_t format_version;
+    uint32_t parser_version;
+    uint32_t lexer_version;
+    uint64_t content_hash;
+    uint64_t content_length;
+    int32_t result;               // 解析的返回值(0或2)
+    uint32_t root;                // 第一条语句, 结点下标+1, 0表示空程序
+    uint32_t node_count;
+    uint32_t node_offset;
+    uint32_t diag_count;
+    uint32_t diag_offset;
+    uint32_t diag_suppressed;     // 超出每个文件的上限被丢弃的诊断条数
+    uint32_t string_offset;
+    uint32_t string_size;
+    uint32_t step_count;
+    uint32_t step_offset;
+    uint32_t step_size;
+    uint32_t speculations;        // 同ParseMemoStats
+    uint32_t memo_lookups;
+    uint32_t memo_hits;
+    uint32_t reserved;
+    uint64_t checksum;
+} AstCacheHeader;
+
+// 与AstNode对应, 指针换成结点下标+1(0表示没有), 名字换成字符串区偏移+1
+// 每种结点最多用到三个子结点, 按种类放在child中: 赋值、二元、单目为 left, right;
+// 语句为 cond, body, else_body(块只有body, 即child[1])
+typedef struct {
+    uint8_t kind;                 // AstKind
+    uint8_t reserved;
+    uint16_t op;                  // TokenType
+    uint32_t offset;              // 对应token在文件中的偏移
+    uint32_t name;
+    uint32_t child[3];
+    uint32_t next;
+} AstCacheNode;
+
+// 与Diagnostic对应, 位置换成文件中的偏移, 文本参数换成字符串区偏移+1
+typedef struct {
+    int32_t code;
+    int32_t repeat;
+    uint32_t offset;
+    uint32_t last_offset;
+    int32_t arg0;
+    int32_t arg1;
+    uint32_t text;
+} AstCacheDiag;
+
+typedef struct AstCache AstCache;
+
+// 一次解析的结果, 写入缓存用
+typedef struct {
+    int result;
+    const AstNode* root;
+    const DiagEngine* diag;       // 本次解析的诊断是diag中从first_diag起的条目
+    int first_diag;
+    int suppressed;
+    const char* const* steps;
+    int step_count;
+    ParseMemoStats memo;
+} AstCacheEntry;
+
+// 查找lexer所分析的文件的缓存, 未启用缓存目录、未命中或缓存文件无效时返回NULL
+AstCache* astcache_load(const Lexer* lexer);
+void astcache_close(AstCache* cache);
+
+// 写出缓存文件(先写临时文件再改名); 失败时不影响解析结果
+void astcache_store(const Lexer* lexer, const AstCacheEntry* entry);
+
+// NOTE - 直接在映射的内容上访问
+const AstCacheHeader* astcache_header(const AstCache* cache);
+// ref为from中的引用(from为NULL时ref可以是头部的root); ref为0、越界或不在from之后时返回NULL,
+// 因此沿引用遍历总会结束, 损坏的文件也不会造成死循环
+const AstCacheNode* astcache_child(const AstCache* cache, const AstCacheNode* from, uint32_t ref);
+// 结点的名字, 没有时返回NULL
+const char* astcache_name(const AstCache* cache, const AstCacheNode* node);
+// 第一条推导式, 之后的每一条紧跟在上一条的'\0'之后; count为条数
+const char* astcache_steps(const AstCache* cache, int* count);
+
+// 重建语法树: 结点和名字分配在ast中, 位置为base加上偏移, 返回第一条语句
+AstNode* astcache_build_ast(const AstCache* cache, Ast* ast, SourceLoc base);
+
+// 把缓存的诊断按原来的顺序加入d, 位置为base加上偏移
+void astcache_replay_diags(const AstCache* cache, DiagEngine* d, SourceLoc base);
+
+#endif
@@ -0,0 +1,76 @@
+#include "baseline.h"
+#include <stdio.h>
+#include <string.h>
+
+void baseline_add(BaselineSet* set, const char* group, const char* name, double value) {
+    if (set->count >= BASELINE_MAX_METRICS) return;
+    BaselineMetric* m = &set->items[set->count++];
+    snprintf(m->group, sizeof(m->group), "%s", group);
+    snprintf(m->name, sizeof(m->name), "%s", name);
+    m->value = value;
+}
+
+bool baseline_save(const char* path, const BaselineSet* set, const char* tool, int version, const char* note) {
+    FILE* f = fopen(path, "w");
+    if (!f) {
+        fprintf(stderr, "Cannot open file: %s\n", path);
+        return false;
+    }
+    fprintf(f, "# %s baseline %d\n", tool, version);
+    if (note) fprintf(f, "# %s\n", note);
+    for (int i = 0; i < set->count; i++) {
+        fprintf(f, "%s %s %.6g\n", set->items[i].group, set->items[i].name, set->items[i].value);
+    }
+    fclose(f);
+    return true;
+}
+
+static const BaselineMetric* find_metric(const BaselineSet* set, const char* group, const char* name) {
+    for (int i = 0; i < set->count; i++) {
+        const BaselineMetric* m = &set->items[i];
+        if (strcmp(m->group, group) == 0 && (!name || strcmp(m->name, name) == 0)) return m;
+    }
+    return NULL;
+}
+
+int baseline_compare(const char* path, const BaselineSet* set, const char* group_title, double threshold) {
+    FILE* f = fopen(path, "r");
+    if (!f) {
+        fprintf(stderr, "Cannot open file: %s\n", path);
+        return -1;
+    }
+    // 列宽取本次各项名字的最大长度
+    int group_width = (int)strlen(group_title);
+    int name_width = 6;
+    for (int i = 0; i < set->count; i++) {
+        int g = (int)strlen(set->items[i].group);
+        int n = (int)strlen(set->items[i].name);
+        if (g > group_width) group_width = g;
+        if (n > name_width) name_width = n;
+    }
+    printf("\nBaseline: %s (threshold %.1f%%)\n", path, threshold);
+    printf("%-*s %-*s %12s %12s %9s\n", group_width, group_title, name_width, "Metric", "Baseline", "Current", "Change");
+    int regressions = 0;
+    char line[256];
+    while (fgets(line, sizeof(line), f)) {
+        char group[32], name[32];
+        double old;
+        if (line[0] == '#' || sscanf(line, "%31s %31s %lf", group, name, &old) != 3) continue;
+        if (!find_metric(set, group, NULL)) continue;
+        const BaselineMetric* cur = find_metric(set, group, name);
+        if (!cur) {
+            printf("%-*s %-*s %12.4g %12s %9s\n", group_width, group, name_width, name, old, "-", "-");
+            continue;
+        }
+        double change = old > 0 ? (cur->value - old) / old * 100.0 : 0.0;
+        bool worse = change > threshold;
+        if (worse) regressions++;
+        printf("%-*s %-*s %12.4g %12.4g %+8.1f%%%s\n", group_width, group, name_width, name, old, cur->value,
+               change, worse ? " *" : "");
+    }
+    fclose(f);
+    if (regressions > 0) {
+        printf("%d metric(s) regressed by more than %.1f%%\n", regressions, threshold);
+    }
+    return regressions;
+}
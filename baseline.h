@@ -0,0 +1,32 @@
+#ifndef BASELINE_H
+#define BASELINE_H
+
+#include <stdbool.h>
+
+// NOTE - 性能基线文件(perfbench、patbench的--save/--compare)
+// 每行"分组 指标 数值", 分组是阶段或用例; 以'#'开始的行是注释. 指标的数值越小越好
+
+#define BASELINE_MAX_METRICS 64
+
+typedef struct {
+    char group[32];
+    char name[32];
+    double value;
+} BaselineMetric;
+
+typedef struct {
+    BaselineMetric items[BASELINE_MAX_METRICS];
+    int count;
+} BaselineSet;
+
+// 超出BASELINE_MAX_METRICS的指标忽略
+void baseline_add(BaselineSet* set, const char* group, const char* name, double value);
+
+// 第一行注释为"# <tool> baseline <version>", note不为NULL时作为第二行注释; 失败时返回false
+bool baseline_save(const char* path, const BaselineSet* set, const char* tool, int version, const char* note);
+
+// 与基线逐项对比并打印, group_title是第一列的表头; 返回变差超过threshold(百分比)的指标数, 文件打不开时返回-1
+// 本次测量了该分组但没有该指标(例如计数器不可用)时打印"-", 本次没有测量的分组不打印
+int baseline_compare(const char* path, const BaselineSet* set, const char* group_title, double threshold);
+
+#endif
@@ -0,0 +1,34 @@
+#define _POSIX_C_SOURCE 200809L
+#include "budget.h"
+#include <stdio.h>
+#include <time.h>
+
+const char* limit_kind_name(LimitKind kind) {
+    switch (kind) {
+        case LIMIT_BYTES: return "byte";
+        case LIMIT_TOKENS: return "token";
+        case LIMIT_DEPTH: return "nesting depth";
+        case LIMIT_ERRORS: return "error";
+        case LIMIT_DEADLINE: return "time";
+        default: return "none";
+    }
+}
+
+double budget_now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1000.0 + (double)ts.tv_nsec / 1e6;
+}
+
+void budget_report(DiagEngine* d, const ParseLimits* limits, LimitKind kind, SourceLoc loc) {
+    char value[64];
+    switch (kind) {
+        case LIMIT_BYTES: snprintf(value, sizeof(value), "%lu bytes", (unsigned long)limits->max_bytes); break;
+        case LIMIT_TOKENS: snprintf(value, sizeof(value), "%lu tokens", (unsigned long)limits->max_tokens); break;
+        case LIMIT_DEPTH: snprintf(value, sizeof(value), "%d levels", limits->max_depth); break;
+        case LIMIT_ERRORS: snprintf(value, sizeof(value), "%d diagnostics", limits->max_errors); break;
+        case LIMIT_DEADLINE: snprintf(value, sizeof(value), "%.1f ms", limits->deadline_ms); break;
+        default: value[0] = '\0'; break;
+    }
+    diag_report(d, DIAG_LIMIT_EXCEEDED, loc, (int)kind, 0, value);
+}
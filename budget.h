@@ -0,0 +1,41 @@
+#ifndef BUDGET_H
+#define BUDGET_H
+
+#include <stddef.h>
+#include "diag.h"
+
+// NOTE - 分析的资源上限
+// 用于分析用户提交的代码: 深层嵌套、巨大的未闭合注释、成串的错误token等病态输入
+// 也能在有限的时间和栈空间内结束. 超出任一上限时分析提前结束, 已有的诊断照常输出,
+// 再加一条说明超出了哪个上限; 语法分析返回PARSE_LIMIT
+// 各项为0表示不限制
+
+typedef struct {
+    size_t max_bytes;       // 主文件的字节数, 超出时不做分析
+    size_t max_tokens;      // 语法分析读到的token数(预处理之后)
+    int max_depth;          // 块、控制语句和括号的嵌套层数, 限制递归下降占用的栈
+    int max_errors;         // 诊断条数
+    double deadline_ms;     // 从开始分析起的时间预算(毫秒)
+    int check_interval;     // 每多少个token看一次时钟, 0表示BUDGET_CHECK_INTERVAL
+} ParseLimits;
+
+#define BUDGET_CHECK_INTERVAL 256
+
+typedef enum {
+    LIMIT_NONE,
+    LIMIT_BYTES,
+    LIMIT_TOKENS,
+    LIMIT_DEPTH,
+    LIMIT_ERRORS,
+    LIMIT_DEADLINE
+} LimitKind;
+
+const char* limit_kind_name(LimitKind kind);
+
+// 报告超出了哪个上限(DIAG_LIMIT_EXCEEDED)
+void budget_report(DiagEngine* d, const ParseLimits* limits, LimitKind kind, SourceLoc loc);
+
+// 单调时钟, 毫秒
+double budget_now_ms(void);
+
+#endif
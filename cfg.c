@@ -0,0 +1,302 @@
+#include "cfg.h"
+
+// 动态数组扩容
+static void* grow(void* ptr, int* cap, int need, size_t elem) {
+    if (need <= *cap) return ptr;
+    int new_cap = *cap ? *cap : 16;
+    while (new_cap < need) new_cap *= 2;
+    void* p = realloc(ptr, (size_t)new_cap * elem);
+    if (!p) {
+        fprintf(stderr, "Memory allocation error\n");
+        exit(1);
+    }
+    *cap = new_cap;
+    return p;
+}
+
+// FNV-1a 字符串哈希
+static unsigned int hash_name(const char* s) {
+    unsigned int h = 2166136261u;
+    while (*s) {
+        h ^= (unsigned char)*s++;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+int cfg_lookup_var(const Cfg* cfg, const char* name) {
+    if (cfg->var_hash_cap == 0) return -1;
+    unsigned int mask = (unsigned int)cfg->var_hash_cap - 1;
+    unsigned int i = hash_name(name) & mask;
+    while (cfg->var_hash[i]) {
+        int id = cfg->var_hash[i] - 1;
+        if (strcmp(cfg->vars[id], name) == 0) return id;
+        i = (i + 1) & mask;
+    }
+    return -1;
+}
+
+// 查找变量, 不存在时分配新编号
+static int intern_var(Cfg* cfg, const char* name) {
+    int id = cfg_lookup_var(cfg, name);
+    if (id >= 0) return id;
+
+    // 装载因子超过1/2时重建哈希表
+    if ((cfg->var_count + 1) * 2 > cfg->var_hash_cap) {
+        int new_cap = cfg->var_hash_cap ? cfg->var_hash_cap * 2 : 64;
+        int* table = (int*)calloc((size_t)new_cap, sizeof(int));
+        if (!table) {
+            fprintf(stderr, "Memory allocation error\n");
+            exit(1);
+        }
+        for (int v = 0; v < cfg->var_count; v++) {
+            unsigned int i = hash_name(cfg->vars[v]) & (unsigned int)(new_cap - 1);
+            while (table[i]) i = (i + 1) & (unsigned int)(new_cap - 1);
+            table[i] = v + 1;
+        }
+        free(cfg->var_hash);
+        cfg->var_hash = table;
+        cfg->var_hash_cap = new_cap;
+    }
+
+    cfg->vars = (const char**)grow((void*)cfg->vars, &cfg->var_cap, cfg->var_count + 1, sizeof(char*));
+    id = cfg->var_count++;
+    cfg->vars[id] = name;
+
+    unsigned int mask = (unsigned int)cfg->var_hash_cap - 1;
+    unsigned int i = hash_name(name) & mask;
+    while (cfg->var_hash[i]) i = (i + 1) & mask;
+    cfg->var_hash[i] = id + 1;
+    return id;
+}
+
+static int new_block(Cfg* cfg) {
+    cfg->blocks = (CfgBlock*)grow(cfg->blocks, &cfg->block_cap, cfg->block_count + 1, sizeof(CfgBlock));
+    CfgBlock* b = &cfg->blocks[cfg->block_count];
+    b->instr_start = cfg->instr_count;
+    b->instr_count = 0;
+    b->succ_count = 0;
+    b->loc = SOURCE_LOC_INVALID;
+    return cfg->block_count++;
+}
+
+static void add_edge(Cfg* cfg, int from, int to) {
+    if (from < 0) return;  // 不可达位置(break之后)没有出边
+    CfgBlock* b = &cfg->blocks[from];
+    b->succ[b->succ_count++] = to;
+}
+
+// 按求值顺序收集表达式中读取的变量
+static void collect_uses(Cfg* cfg, const AstNode* e) {
+    while (e) {
+        if (e->kind == AST_IDENT) {
+            cfg->uses = (int*)grow(cfg->uses, &cfg->use_cap, cfg->use_count + 1, sizeof(int));
+            cfg->uses[cfg->use_count++] = intern_var(cfg, e->name);
+            return;
+        }
+        if (e->kind == AST_UNARY) {
+            e = e->left;
+            continue;
+        }
+        if (e->kind != AST_BINARY) return;
+        collect_uses(cfg, e->left);
+        e = e->right;  // 右操作数迭代处理, 长的右结合链不会加深递归
+    }
+}
+
+// 向块中追加一条指令
+static void append_instr(Cfg* cfg, int block, const AstNode* node, const AstNode* target) {
+    cfg->instrs = (CfgInstr*)grow(cfg->instrs, &cfg->instr_cap, cfg->instr_count + 1, sizeof(CfgInstr));
+    CfgInstr* ins = &cfg->instrs[cfg->instr_count++];
+    ins->node = node;
+    ins->use_start = cfg->use_count;
+    collect_uses(cfg, target ? node->right : node);
+    ins->use_count = cfg->use_count - ins->use_start;
+    ins->def = target ? intern_var(cfg, target->name) : -1;
+
+    // 块的起始下标在第一条指令到来时确定: 块可能先于其它块的指令创建(如循环出口块)
+    CfgBlock* b = &cfg->blocks[block];
+    if (b->instr_count == 0) {
+        b->instr_start = cfg->instr_count - 1;
+        b->loc = node->loc;
+    }
+    b->instr_count++;
+}
+
+// 当前位置不可达时(break之后)为后续语句新开一个无前驱的块
+static int ensure_block(Cfg* cfg, int cur) {
+    return cur >= 0 ? cur : new_block(cfg);
+}
+
+// 为一条语句生成控制流, 返回语句之后的当前块, -1表示控制流不会落到语句之后
+// 指令只追加到当前块, 一旦离开就不再回到旧块, 因此每个块的指令在instrs中连续
+static int build_stmt(Cfg* cfg, const AstNode* s, int cur, int loop_exit) {
+    switch (s->kind) {
+        case AST_BLOCK:
+            for (const AstNode* c = s->body; c; c = c->next) {
+                cur = build_stmt(cfg, c, cur, loop_exit);
+            }
+            return cur;
+
+        case AST_ASSIGN:
+            cur = ensure_block(cfg, cur);
+            append_instr(cfg, cur, s, s->left);
+            return cur;
+
+        case AST_IF: {
+            cur = ensure_block(cfg, cur);
+            append_instr(cfg, cur, s->cond, NULL);
+            int then_b = new_block(cfg);
+            add_edge(cfg, cur, then_b);
+            int then_end = build_stmt(cfg, s->body, then_b, loop_exit);
+            int else_end = cur;
+            if (s->else_body) {
+                int else_b = new_block(cfg);
+                add_edge(cfg, cur, else_b);
+                else_end = build_stmt(cfg, s->else_body, else_b, loop_exit);
+            }
+            if (then_end < 0 && else_end < 0) return -1;
+            int join = new_block(cfg);
+            add_edge(cfg, then_end, join);
+            add_edge(cfg, else_end, join);
+            return join;
+        }
+
+        case AST_WHILE: {
+            int header = new_block(cfg);
+            add_edge(cfg, cur, header);
+            append_instr(cfg, header, s->cond, NULL);
+            int body_b = new_block(cfg);
+            int exit_b = new_block(cfg);
+            add_edge(cfg, header, body_b);
+            add_edge(cfg, header, exit_b);
+            int body_end = build_stmt(cfg, s->body, body_b, exit_b);
+            add_edge(cfg, body_end, header);
+            return exit_b;
+        }
+
+        case AST_DO_WHILE: {
+            int body_b = new_block(cfg);
+            add_edge(cfg, cur, body_b);
+            int exit_b = new_block(cfg);
+            int body_end = build_stmt(cfg, s->body, body_b, exit_b);
+            if (body_end >= 0) {
+                // 条件单独成块, 循环体中的指令不会与条件混在一起
+                int cond_b = new_block(cfg);
+                add_edge(cfg, body_end, cond_b);
+                append_instr(cfg, cond_b, s->cond, NULL);
+                add_edge(cfg, cond_b, body_b);
+                add_edge(cfg, cond_b, exit_b);
+            }
+            return exit_b;
+        }
+
+        case AST_BREAK:
+            if (loop_exit < 0) {
+                fprintf(stderr, "Error at line %d: break statement not within loop\n", source_line(s->loc));
+                cfg->error_count++;
+                return cur;
+            }
+            add_edge(cfg, cur, loop_exit);
+            return -1;
+
+        default:
+            // 语法错误留下的占位结点不产生控制流
+            return cur;
+    }
+}
+
+// 建立CSR前驱表
+static void build_preds(Cfg* cfg) {
+    int n = cfg->block_count;
+    cfg->pred_start = (int*)calloc((size_t)n + 1, sizeof(int));
+    int edges = 0;
+    for (int b = 0; b < n; b++) {
+        for (int k = 0; k < cfg->blocks[b].succ_count; k++) {
+            cfg->pred_start[cfg->blocks[b].succ[k] + 1]++;
+            edges++;
+        }
+    }
+    for (int b = 0; b < n; b++) cfg->pred_start[b + 1] += cfg->pred_start[b];
+    cfg->preds = (int*)malloc((size_t)(edges ? edges : 1) * sizeof(int));
+    int* fill = (int*)malloc((size_t)n * sizeof(int));
+    memcpy(fill, cfg->pred_start, (size_t)n * sizeof(int));
+    for (int b = 0; b < n; b++) {
+        for (int k = 0; k < cfg->blocks[b].succ_count; k++) {
+            int t = cfg->blocks[b].succ[k];
+            cfg->preds[fill[t]++] = b;
+        }
+    }
+    free(fill);
+}
+
+// 用显式栈做深度优先遍历求逆后序, 深层嵌套也不会耗尽调用栈
+static void build_rpo(Cfg* cfg) {
+    int n = cfg->block_count;
+    cfg->rpo = (int*)malloc((size_t)n * sizeof(int));
+    int* stack = (int*)malloc((size_t)n * sizeof(int));
+    int* next_succ = (int*)calloc((size_t)n, sizeof(int));
+    char* visited = (char*)calloc((size_t)n, 1);
+    int sp = 0;
+    int post = n;
+
+    stack[sp++] = cfg->entry;
+    visited[cfg->entry] = 1;
+    while (sp > 0) {
+        int b = stack[sp - 1];
+        if (next_succ[b] < cfg->blocks[b].succ_count) {
+            int t = cfg->blocks[b].succ[next_succ[b]++];
+            if (!visited[t]) {
+                visited[t] = 1;
+                stack[sp++] = t;
+            }
+        } else {
+            cfg->rpo[--post] = b;
+            sp--;
+        }
+    }
+    // 可达块占据rpo数组的尾部, 移到开头
+    cfg->rpo_count = n - post;
+    memmove(cfg->rpo, cfg->rpo + post, (size_t)cfg->rpo_count * sizeof(int));
+
+    free(stack);
+    free(next_succ);
+    free(visited);
+}
+
+int cfg_build(Cfg* cfg, const AstNode* root) {
+    memset(cfg, 0, sizeof(Cfg));
+    cfg->entry = new_block(cfg);
+    int end = root ? build_stmt(cfg, root, cfg->entry, -1) : cfg->entry;
+    cfg->exit = new_block(cfg);
+    add_edge(cfg, end, cfg->exit);
+
+    build_preds(cfg);
+    build_rpo(cfg);
+    return cfg->error_count ? 1 : 0;
+}
+
+void cfg_free(Cfg* cfg) {
+    free(cfg->blocks);
+    free(cfg->instrs);
+    free(cfg->uses);
+    free(cfg->pred_start);
+    free(cfg->preds);
+    free(cfg->rpo);
+    free((void*)cfg->vars);
+    free(cfg->var_hash);
+    memset(cfg, 0, sizeof(Cfg));
+}
+
+void cfg_print(const Cfg* cfg, FILE* out) {
+    for (int b = 0; b < cfg->block_count; b++) {
+        const CfgBlock* blk = &cfg->blocks[b];
+        fprintf(out, "B%d", b);
+        if (b == cfg->entry) fprintf(out, " (entry)");
+        if (b == cfg->exit) fprintf(out, " (exit)");
+        if (blk->loc != SOURCE_LOC_INVALID) fprintf(out, " line %d", source_line(blk->loc));
+        fprintf(out, ": %d instr ->", blk->instr_count);
+        for (int k = 0; k < blk->succ_count; k++) fprintf(out, " B%d", blk->succ[k]);
+        fprintf(out, "\n");
+    }
+}
@@ -0,0 +1,68 @@
+#ifndef CFG_H
+#define CFG_H
+
+#include "ast.h"
+
+// 基本块中的一条指令: 赋值语句或条件求值
+typedef struct {
+    const AstNode* node;  // AST_ASSIGN 结点, 或 if/while/do-while 的条件表达式
+    int def;              // 被赋值变量的编号, 条件求值为-1
+    int use_start;        // 在Cfg.uses中的起始下标
+    int use_count;        // 读取的变量个数(按出现顺序, 可重复)
+} CfgInstr;
+
+// 基本块
+typedef struct {
+    int instr_start;      // 在Cfg.instrs中的起始下标(同一块的指令连续存放)
+    int instr_count;
+    int succ[2];          // 后继块, 条件分支时succ[0]为真分支
+    int succ_count;
+    SourceLoc loc;        // 块内第一条指令的位置, 空块为SOURCE_LOC_INVALID
+} CfgBlock;
+
+// 控制流图
+// 指令中的AstNode指针指向构建时使用的语法树, 语法树释放后不可再访问
+typedef struct {
+    CfgBlock* blocks;
+    int block_count;
+    int block_cap;
+    int entry;
+    int exit;
+
+    CfgInstr* instrs;
+    int instr_count;
+    int instr_cap;
+
+    int* uses;
+    int use_count;
+    int use_cap;
+
+    // 前驱表(CSR格式): 块b的前驱为 preds[pred_start[b] .. pred_start[b+1])
+    int* pred_start;
+    int* preds;
+
+    // 逆后序(从入口可达的块), 数据流求解按此顺序初始化工作表
+    int* rpo;
+    int rpo_count;
+
+    // 变量表: 编号 -> 名字, 名字指向语法树中的字符串
+    const char** vars;
+    int var_count;
+    int var_cap;
+    int* var_hash;        // 开放寻址哈希表, 存 编号+1, 0表示空槽
+    int var_hash_cap;
+
+    int error_count;      // 构建时发现的错误(循环外的break等)
+} Cfg;
+
+// 由语法树构建控制流图, 返回0表示成功
+int cfg_build(Cfg* cfg, const AstNode* root);
+void cfg_free(Cfg* cfg);
+
+// 查询变量编号, 不存在返回-1
+int cfg_lookup_var(const Cfg* cfg, const char* name);
+
+// 打印各基本块及其后继
+void cfg_print(const Cfg* cfg, FILE* out);
+
+#endif
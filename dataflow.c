@@ -0,0 +1,306 @@
+#include "dataflow.h"
+
+static BitWord* alloc_sets(int count, int nwords) {
+    size_t n = (size_t)count * (size_t)nwords;
+    BitWord* p = (BitWord*)calloc(n ? n : 1, sizeof(BitWord));
+    if (!p) {
+        fprintf(stderr, "Memory allocation error\n");
+        exit(1);
+    }
+    return p;
+}
+
+void df_problem_init(DfProblem* p, const Cfg* cfg, int nbits, DfDirection dir, DfMeet meet) {
+    p->direction = dir;
+    p->meet = meet;
+    p->nbits = nbits;
+    p->nwords = BITSET_WORDS(nbits);
+    p->block_count = cfg->block_count;
+    p->gen = alloc_sets(cfg->block_count, p->nwords);
+    p->kill = alloc_sets(cfg->block_count, p->nwords);
+    p->in = alloc_sets(cfg->block_count, p->nwords);
+    p->out = alloc_sets(cfg->block_count, p->nwords);
+    p->boundary = alloc_sets(1, p->nwords);
+    p->visits = 0;
+}
+
+void df_problem_free(DfProblem* p) {
+    free(p->gen);
+    free(p->kill);
+    free(p->in);
+    free(p->out);
+    free(p->boundary);
+    memset(p, 0, sizeof(DfProblem));
+}
+
+// 全集: 最后一个字中超出nbits的位保持为0
+static void fill_universe(BitWord* s, int nbits, int nwords) {
+    for (int i = 0; i < nwords; i++) s[i] = ~(BitWord)0;
+    if (nbits % BITWORD_BITS) {
+        s[nwords - 1] = ((BitWord)1 << (nbits % BITWORD_BITS)) - 1;
+    }
+}
+
+void df_solve(DfProblem* p, const Cfg* cfg) {
+    int n = cfg->block_count;
+    int w = p->nwords;
+    bool forward = p->direction == DF_FORWARD;
+    bool intersect = p->meet == DF_MEET_INTERSECT;
+    // input为交汇得到的一侧, output为传递函数计算的一侧
+    BitWord* input = forward ? p->in : p->out;
+    BitWord* output = forward ? p->out : p->in;
+    int boundary_block = forward ? cfg->entry : cfg->exit;
+
+    // 初值: 并集问题为空集, 交集问题为全集
+    if (intersect) {
+        for (int b = 0; b < n; b++) fill_universe(df_row(output, p, b), p->nbits, w);
+    }
+
+    BitWord* universe = alloc_sets(1, w);
+    fill_universe(universe, p->nbits, w);
+    BitWord* tmp = alloc_sets(1, w);
+
+    // 循环队列工作表, 初始按逆后序(backward为其反序)排列, 不可达块排在最后
+    int* queue = (int*)malloc((size_t)(n + 1) * sizeof(int));
+    char* queued = (char*)calloc((size_t)n, 1);
+    int head = 0, count = 0;
+    for (int i = 0; i < cfg->rpo_count; i++) {
+        int b = forward ? cfg->rpo[i] : cfg->rpo[cfg->rpo_count - 1 - i];
+        queue[count++] = b;
+        queued[b] = 1;
+    }
+    for (int b = 0; b < n; b++) {
+        if (!queued[b]) {
+            queue[count++] = b;
+            queued[b] = 1;
+        }
+    }
+
+    while (count > 0) {
+        int b = queue[head];
+        head = (head + 1) % (n + 1);
+        count--;
+        queued[b] = 0;
+        p->visits++;
+
+        // 交汇: forward取前驱的out, backward取后继的in
+        BitWord* in_b = df_row(input, p, b);
+        if (b == boundary_block) {
+            memcpy(in_b, p->boundary, (size_t)w * sizeof(BitWord));
+        } else {
+            const int* nb;
+            int nb_count;
+            if (forward) {
+                nb = cfg->preds + cfg->pred_start[b];
+                nb_count = cfg->pred_start[b + 1] - cfg->pred_start[b];
+            } else {
+                nb = cfg->blocks[b].succ;
+                nb_count = cfg->blocks[b].succ_count;
+            }
+            if (nb_count == 0) {
+                memcpy(in_b, intersect ? universe : p->boundary, (size_t)w * sizeof(BitWord));
+            } else {
+                memcpy(in_b, df_row(output, p, nb[0]), (size_t)w * sizeof(BitWord));
+                for (int k = 1; k < nb_count; k++) {
+                    const BitWord* o = df_row(output, p, nb[k]);
+                    if (intersect) {
+                        for (int i = 0; i < w; i++) in_b[i] &= o[i];
+                    } else {
+                        for (int i = 0; i < w; i++) in_b[i] |= o[i];
+                    }
+                }
+            }
+        }
+
+        // 传递函数
+        const BitWord* gen = df_row(p->gen, p, b);
+        const BitWord* kill = df_row(p->kill, p, b);
+        BitWord* out_b = df_row(output, p, b);
+        BitWord diff = 0;
+        for (int i = 0; i < w; i++) {
+            tmp[i] = gen[i] | (in_b[i] & ~kill[i]);
+            diff |= tmp[i] ^ out_b[i];
+        }
+        if (!diff) continue;
+        memcpy(out_b, tmp, (size_t)w * sizeof(BitWord));
+
+        // 结果变化, 把依赖本块的块加入工作表
+        const int* dep;
+        int dep_count;
+        if (forward) {
+            dep = cfg->blocks[b].succ;
+            dep_count = cfg->blocks[b].succ_count;
+        } else {
+            dep = cfg->preds + cfg->pred_start[b];
+            dep_count = cfg->pred_start[b + 1] - cfg->pred_start[b];
+        }
+        for (int k = 0; k < dep_count; k++) {
+            int d = dep[k];
+            if (!queued[d]) {
+                queued[d] = 1;
+                queue[(head + count) % (n + 1)] = d;
+                count++;
+            }
+        }
+    }
+
+    free(queue);
+    free(queued);
+    free(universe);
+    free(tmp);
+}
+
+// TODO - 活跃变量
+void df_liveness(DfProblem* p, const Cfg* cfg) {
+    df_problem_init(p, cfg, cfg->var_count, DF_BACKWARD, DF_MEET_UNION);
+
+    for (int b = 0; b < cfg->block_count; b++) {
+        const CfgBlock* blk = &cfg->blocks[b];
+        BitWord* use = df_row(p->gen, p, b);
+        BitWord* def = df_row(p->kill, p, b);
+        // 块内顺序扫描: 先于定值的读取是向上暴露的使用
+        for (int k = 0; k < blk->instr_count; k++) {
+            const CfgInstr* ins = &cfg->instrs[blk->instr_start + k];
+            for (int u = 0; u < ins->use_count; u++) {
+                int v = cfg->uses[ins->use_start + u];
+                if (!bitset_test(def, v)) bitset_set(use, v);
+            }
+            if (ins->def >= 0) bitset_set(def, ins->def);
+        }
+    }
+
+    df_solve(p, cfg);
+}
+
+// TODO - 到达定值
+void df_reaching_defs(ReachingDefs* rd, const Cfg* cfg) {
+    // 给每条赋值指令编号
+    rd->def_count = 0;
+    for (int i = 0; i < cfg->instr_count; i++) {
+        if (cfg->instrs[i].def >= 0) rd->def_count++;
+    }
+    rd->def_instrs = (int*)malloc((size_t)(rd->def_count > 0 ? rd->def_count : 1) * sizeof(int));
+    int* def_id = (int*)malloc((size_t)(cfg->instr_count > 0 ? cfg->instr_count : 1) * sizeof(int));
+    int d = 0;
+    for (int i = 0; i < cfg->instr_count; i++) {
+        if (cfg->instrs[i].def >= 0) {
+            def_id[i] = d;
+            rd->def_instrs[d++] = i;
+        } else {
+            def_id[i] = -1;
+        }
+    }
+
+    DfProblem* p = &rd->problem;
+    df_problem_init(p, cfg, rd->def_count, DF_FORWARD, DF_MEET_UNION);
+
+    // 每个变量的全部定值
+    BitWord* defs_of_var = alloc_sets(cfg->var_count, p->nwords);
+    for (int k = 0; k < rd->def_count; k++) {
+        int v = cfg->instrs[rd->def_instrs[k]].def;
+        bitset_set(df_row(defs_of_var, p, v), k);
+    }
+
+    // seen[v] == b+1 表示变量v在块b中已处理过
+    int* seen = (int*)calloc((size_t)(cfg->var_count > 0 ? cfg->var_count : 1), sizeof(int));
+    for (int b = 0; b < cfg->block_count; b++) {
+        const CfgBlock* blk = &cfg->blocks[b];
+        BitWord* gen = df_row(p->gen, p, b);
+        BitWord* kill = df_row(p->kill, p, b);
+        // 逆序扫描, 每个变量只有块内最后一次定值能到达块尾
+        for (int k = blk->instr_count - 1; k >= 0; k--) {
+            int i = blk->instr_start + k;
+            int v = cfg->instrs[i].def;
+            if (v < 0 || seen[v] == b + 1) continue;
+            seen[v] = b + 1;
+            bitset_set(gen, def_id[i]);
+            const BitWord* all = df_row(defs_of_var, p, v);
+            for (int j = 0; j < p->nwords; j++) kill[j] |= all[j];
+        }
+    }
+    free(seen);
+    free(defs_of_var);
+    free(def_id);
+
+    df_solve(p, cfg);
+}
+
+void df_reaching_defs_free(ReachingDefs* rd) {
+    df_problem_free(&rd->problem);
+    free(rd->def_instrs);
+    rd->def_instrs = NULL;
+    rd->def_count = 0;
+}
+
+// TODO - 使用前必定赋值
+int df_check_definite_assignment(const Cfg* cfg, FILE* report) {
+    DfProblem p;
+    df_problem_init(&p, cfg, cfg->var_count, DF_FORWARD, DF_MEET_INTERSECT);
+    for (int b = 0; b < cfg->block_count; b++) {
+        const CfgBlock* blk = &cfg->blocks[b];
+        BitWord* gen = df_row(p.gen, &p, b);
+        for (int k = 0; k < blk->instr_count; k++) {
+            int v = cfg->instrs[blk->instr_start + k].def;
+            if (v >= 0) bitset_set(gen, v);
+        }
+    }
+    df_solve(&p, cfg);
+
+    // 从块入口的已赋值集合出发逐条检查
+    int problems = 0;
+    BitWord* assigned = alloc_sets(1, p.nwords);
+    for (int b = 0; b < cfg->block_count; b++) {
+        const CfgBlock* blk = &cfg->blocks[b];
+        memcpy(assigned, df_row(p.in, &p, b), (size_t)p.nwords * sizeof(BitWord));
+        for (int k = 0; k < blk->instr_count; k++) {
+            const CfgInstr* ins = &cfg->instrs[blk->instr_start + k];
+            for (int u = 0; u < ins->use_count; u++) {
+                int v = cfg->uses[ins->use_start + u];
+                if (!bitset_test(assigned, v)) {
+                    if (report) {
+                        fprintf(report, "Warning at line %d: variable '%s' may be used before assignment\n",
+                                source_line(ins->node->loc), cfg->vars[v]);
+                    }
+                    problems++;
+                    // 同一位置只报告一次
+                    bitset_set(assigned, v);
+                }
+            }
+            if (ins->def >= 0) bitset_set(assigned, ins->def);
+        }
+    }
+    free(assigned);
+    df_problem_free(&p);
+    return problems;
+}
+
+static void print_var_set(const Cfg* cfg, const BitWord* s, FILE* out) {
+    bool first = true;
+    fprintf(out, "{");
+    for (int v = 0; v < cfg->var_count; v++) {
+        if (bitset_test(s, v)) {
+            fprintf(out, first ? "%s" : ", %s", cfg->vars[v]);
+            first = false;
+        }
+    }
+    fprintf(out, "}");
+}
+
+void df_print_results(const Cfg* cfg, const DfProblem* live, const ReachingDefs* rd, FILE* out) {
+    for (int b = 0; b < cfg->block_count; b++) {
+        fprintf(out, "B%d live-in: ", b);
+        print_var_set(cfg, df_row(live->in, live, b), out);
+        fprintf(out, " live-out: ");
+        print_var_set(cfg, df_row(live->out, live, b), out);
+        fprintf(out, " reach-in: {");
+        const BitWord* reach = df_row(rd->problem.in, &rd->problem, b);
+        bool first = true;
+        for (int k = 0; k < rd->def_count; k++) {
+            if (!bitset_test(reach, k)) continue;
+            const CfgInstr* ins = &cfg->instrs[rd->def_instrs[k]];
+            fprintf(out, first ? "%s@%d" : ", %s@%d", cfg->vars[ins->def], source_line(ins->node->loc));
+            first = false;
+        }
+        fprintf(out, "}\n");
+    }
+}
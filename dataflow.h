@@ -0,0 +1,79 @@
+#ifndef DATAFLOW_H
+#define DATAFLOW_H
+
+#include <stdint.h>
+#include "cfg.h"
+
+// NOTE - 稠密位集合: 每次处理一个64位字, 循环写法便于编译器(-O2)自动向量化
+typedef uint64_t BitWord;
+
+#define BITWORD_BITS 64
+#define BITSET_WORDS(nbits) (((nbits) + BITWORD_BITS - 1) / BITWORD_BITS)
+
+static inline void bitset_set(BitWord* s, int i) {
+    s[i / BITWORD_BITS] |= (BitWord)1 << (i % BITWORD_BITS);
+}
+
+static inline void bitset_clear(BitWord* s, int i) {
+    s[i / BITWORD_BITS] &= ~((BitWord)1 << (i % BITWORD_BITS));
+}
+
+static inline bool bitset_test(const BitWord* s, int i) {
+    return (s[i / BITWORD_BITS] >> (i % BITWORD_BITS)) & 1;
+}
+
+// 数据流方向与交汇运算
+typedef enum { DF_FORWARD, DF_BACKWARD } DfDirection;
+typedef enum { DF_MEET_UNION, DF_MEET_INTERSECT } DfMeet;
+
+// 一个gen/kill形式的数据流问题
+// 传递函数: forward  out = gen | (in & ~kill)
+//           backward in  = gen | (out & ~kill)
+// 所有集合按块号连续存放, 块b的集合从 b * nwords 开始
+typedef struct {
+    DfDirection direction;
+    DfMeet meet;
+    int nbits;
+    int nwords;
+    int block_count;
+    BitWord* gen;
+    BitWord* kill;
+    BitWord* in;
+    BitWord* out;
+    BitWord* boundary;  // 入口块的in(forward) / 出口块的out(backward), 初始为空集
+    long visits;        // 求解时处理块的次数
+} DfProblem;
+
+void df_problem_init(DfProblem* p, const Cfg* cfg, int nbits, DfDirection dir, DfMeet meet);
+void df_problem_free(DfProblem* p);
+
+// 工作表迭代求解到不动点
+void df_solve(DfProblem* p, const Cfg* cfg);
+
+static inline BitWord* df_row(BitWord* sets, const DfProblem* p, int block) {
+    return sets + (size_t)block * p->nwords;
+}
+
+// NOTE - 具体的分析
+
+// 活跃变量: backward/并集, 位为变量编号
+void df_liveness(DfProblem* p, const Cfg* cfg);
+
+// 到达定值: forward/并集, 位为定值编号(即赋值指令在def_instrs中的下标)
+typedef struct {
+    DfProblem problem;
+    int* def_instrs;    // 定值编号 -> 指令下标
+    int def_count;
+} ReachingDefs;
+
+void df_reaching_defs(ReachingDefs* rd, const Cfg* cfg);
+void df_reaching_defs_free(ReachingDefs* rd);
+
+// 使用前必定赋值: forward/交集, 位为变量编号
+// 返回可能未赋值就被读取的次数, report非空时逐条打印
+int df_check_definite_assignment(const Cfg* cfg, FILE* report);
+
+// 打印每个基本块的活跃变量与到达定值
+void df_print_results(const Cfg* cfg, const DfProblem* live, const ReachingDefs* rd, FILE* out);
+
+#endif
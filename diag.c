@@ -0,0 +1,355 @@
+#include "diag.h"
+#include "lexer.h"
+#include "output.h"
+
+void diag_init(DiagEngine* d) {
+    memset(d, 0, sizeof(DiagEngine));
+    d->limit = DIAG_DEFAULT_LIMIT;
+}
+
+DiagEngine* diag_default(void) {
+    static DiagEngine engine;
+    static bool initialized = false;
+    if (!initialized) {
+        diag_init(&engine);
+        initialized = true;
+    }
+    return &engine;
+}
+
+void diag_free(DiagEngine* d) {
+    free(d->entries);
+    free(d->pool);
+    int limit = d->limit;
+    FILE* output = d->output;
+    diag_init(d);
+    d->limit = limit;
+    d->output = output;
+}
+
+void diag_set_limit(DiagEngine* d, int limit) {
+    d->limit = limit;
+}
+
+void diag_begin_file(DiagEngine* d) {
+    d->file_count = 0;
+}
+
+static const char* pool_str(const DiagEngine* d, int offset) {
+    return offset >= 0 ? d->pool + offset : "";
+}
+
+static int pool_add(DiagEngine* d, const char* text) {
+    size_t len = strlen(text) + 1;
+    if (d->pool_len + len > d->pool_cap) {
+        size_t cap = d->pool_cap ? d->pool_cap * 2 : 1024;
+        while (cap < d->pool_len + len) cap *= 2;
+        char* p = (char*)realloc(d->pool, cap);
+        if (!p) return -1;
+        d->pool = p;
+        d->pool_cap = cap;
+    }
+    memcpy(d->pool + d->pool_len, text, len);
+    int offset = (int)d->pool_len;
+    d->pool_len += len;
+    return offset;
+}
+
+// 记录一条诊断, 返回记录(或合并)到的条目, 超出上限时返回NULL
+static Diagnostic* add_entry(DiagEngine* d, int code, SourceLoc loc, int arg0, int arg1, const char* text) {
+    // 与上一条完全相同(级联错误)时只计数
+    if (!d->raw && d->count > 0 && d->file_count > 0) {
+        Diagnostic* last = &d->entries[d->count - 1];
+        if (last->code == code && last->arg0 == arg0 && last->arg1 == arg1 &&
+            strcmp(pool_str(d, last->text), text ? text : "") == 0) {
+            last->repeat++;
+            last->last_loc = loc;
+            return last;
+        }
+    }
+    if (!d->raw && d->file_count >= d->limit) {
+        d->suppressed++;
+        return NULL;
+    }
+    if (d->count == d->cap) {
+        int cap = d->cap ? d->cap * 2 : 32;
+        Diagnostic* p = (Diagnostic*)realloc(d->entries, (size_t)cap * sizeof(Diagnostic));
+        if (!p) {
+            d->suppressed++;
+            return NULL;
+        }
+        d->entries = p;
+        d->cap = cap;
+    }
+    Diagnostic* e = &d->entries[d->count++];
+    e->code = code;
+    e->repeat = 0;
+    e->loc = loc;
+    e->last_loc = loc;
+    e->arg0 = arg0;
+    e->arg1 = arg1;
+    e->text = text ? pool_add(d, text) : -1;
+    d->file_count++;
+    return e;
+}
+
+void diag_report(DiagEngine* d, DiagCode code, SourceLoc loc, int arg0, int arg1, const char* text) {
+    add_entry(d, (int)code, loc, arg0, arg1, text);
+}
+
+void diag_mark(const DiagEngine* d, DiagMark* m) {
+    m->count = d->count;
+    m->file_count = d->file_count;
+    m->suppressed = d->suppressed;
+    m->pool_len = d->pool_len;
+    m->last_repeat = d->count > 0 ? d->entries[d->count - 1].repeat : 0;
+    m->last_loc = d->count > 0 ? d->entries[d->count - 1].last_loc : SOURCE_LOC_INVALID;
+}
+
+void diag_rollback(DiagEngine* d, const DiagMark* m) {
+    d->count = m->count;
+    d->file_count = m->file_count;
+    d->suppressed = m->suppressed;
+    d->pool_len = m->pool_len;
+    if (d->count > 0) {
+        d->entries[d->count - 1].repeat = m->last_repeat;
+        d->entries[d->count - 1].last_loc = m->last_loc;
+    }
+}
+
+static void append_entries(DiagEngine* dst, const DiagEngine* src, int from) {
+    for (int i = from; i < src->count; i++) {
+        const Diagnostic* e = &src->entries[i];
+        Diagnostic* r = add_entry(dst, e->code, e->loc, e->arg0, e->arg1,
+                                  e->text >= 0 ? src->pool + e->text : NULL);
+        if (r) {
+            r->repeat += e->repeat;
+            if (e->repeat) r->last_loc = e->last_loc;
+        } else {
+            dst->suppressed += e->repeat;
+        }
+    }
+}
+
+void diag_append(DiagEngine* dst, const DiagEngine* src) {
+    append_entries(dst, src, 0);
+    dst->suppressed += src->suppressed;
+}
+
+bool diag_append_since(DiagEngine* dst, const DiagEngine* src, const DiagMark* since) {
+    // 之后的诊断合并进了mark之前的条目: 无法分开
+    if (since->count > 0 && src->entries[since->count - 1].repeat != since->last_repeat) return false;
+    // 之后有诊断因为src的上限被丢弃: 丢弃的是哪些取决于src中的条目, 逐条记入dst时不一定相同
+    if (src->suppressed > since->suppressed) return false;
+    append_entries(dst, src, since->count);
+    dst->suppressed += src->suppressed - since->suppressed;
+    return true;
+}
+
+static const char* number_error_message(int kind) {
+    switch (kind) {
+        case NUMBER_NO_HEX_DIGITS: return "Hexadecimal constant has no digits";
+        case NUMBER_NO_EXPONENT_DIGITS: return "Exponent has no digits";
+        case NUMBER_BAD_FLOAT_SUFFIX: return "Invalid suffix on floating constant";
+        case NUMBER_FLOAT_OUT_OF_RANGE: return "Floating constant is out of range";
+        case NUMBER_BAD_INT_SUFFIX: return "Invalid suffix on integer constant";
+        case NUMBER_BAD_OCTAL_DIGIT: return "Invalid digit in octal constant";
+        case NUMBER_INT_TOO_LARGE: return "Integer constant is too large";
+        default: return "Invalid numeric constant";
+    }
+}
+
+// 行号前缀 "Error at line N: " / "Error at line N, column M: "
+static void error_prefix(OutWriter* w, int line, int column, bool with_column) {
+    out_str(w, "Error at line ");
+    out_int(w, line, 0);
+    if (with_column) {
+        out_str(w, ", column ");
+        out_int(w, column, 0);
+    }
+    out_str(w, ": ");
+}
+
+static void render(OutWriter* w, const DiagEngine* d, const Diagnostic* e) {
+    const char* text = pool_str(d, e->text);
+    int line, column;
+    srcmgr_decompose(srcmgr_default(), e->loc, NULL, &line, &column);
+    switch ((DiagCode)e->code) {
+        case DIAG_UNCLOSED_COMMENT:
+            error_prefix(w, line, column, false);
+            out_str(w, "Unclosed multi-line comment\n");
+            break;
+        case DIAG_INVALID_ESCAPE:
+            error_prefix(w, line, column, false);
+            out_str(w, "Invalid escape sequence\n");
+            break;
+        case DIAG_INVALID_CHAR_CONST:
+            error_prefix(w, line, column, false);
+            out_str(w, "Invalid character constant\n");
+            break;
+        case DIAG_UNCLOSED_CHAR_CONST:
+            error_prefix(w, line, column, false);
+            out_str(w, "Unclosed character constant\n");
+            break;
+        case DIAG_INVALID_STRING_ESCAPE:
+            error_prefix(w, line, column, false);
+            out_str(w, "Invalid escape sequence in string\n");
+            break;
+        case DIAG_UNCLOSED_STRING:
+            error_prefix(w, line, column, false);
+            out_str(w, "Unclosed string constant\n");
+            break;
+        case DIAG_INVALID_OPERATOR:
+            error_prefix(w, line, column, false);
+            out_str(w, "Invalid operator '");
+            out_char(w, (char)e->arg0);
+            out_str(w, "'\n");
+            break;
+        case DIAG_INVALID_CHARACTER:
+            error_prefix(w, line, column, true);
+            out_str(w, "Invalid character '");
+            if (e->text >= 0) out_str(w, text);
+            else out_char(w, (char)e->arg0);
+            out_str(w, "'\n");
+            break;
+        case DIAG_INVALID_UTF8: {
+            char hex[8];
+            snprintf(hex, sizeof(hex), "0x%02X", (unsigned int)e->arg0);
+            error_prefix(w, line, column, true);
+            out_str(w, "Invalid UTF-8 sequence (byte ");
+            out_str(w, hex);
+            out_str(w, ")\n");
+            break;
+        }
+        case DIAG_BAD_NUMBER:
+            error_prefix(w, line, column, true);
+            out_str(w, number_error_message(e->arg0));
+            out_str(w, " '");
+            out_str(w, text);
+            out_str(w, "'\n");
+            break;
+        case DIAG_PP_INCLUDE_NOT_FOUND:
+            error_prefix(w, line, column, false);
+            out_str(w, "Cannot open include file: ");
+            out_str(w, text);
+            out_char(w, '\n');
+            break;
+        case DIAG_PP_INCLUDE_DEPTH:
+            error_prefix(w, line, column, false);
+            out_str(w, "#include nested too deeply: ");
+            out_str(w, text);
+            out_char(w, '\n');
+            break;
+        case DIAG_PP_UNKNOWN_DIRECTIVE:
+            error_prefix(w, line, column, false);
+            out_str(w, "Unknown preprocessor directive '#");
+            out_str(w, text);
+            out_str(w, "'\n");
+            break;
+        case DIAG_PP_BAD_DIRECTIVE:
+            error_prefix(w, line, column, false);
+            out_str(w, "Malformed #");
+            out_str(w, text);
+            out_str(w, " directive\n");
+            break;
+        case DIAG_PP_UNMATCHED_DIRECTIVE:
+            error_prefix(w, line, column, false);
+            out_str(w, "#");
+            out_str(w, text);
+            out_str(w, " without matching #if\n");
+            break;
+        case DIAG_PP_UNTERMINATED_IF:
+            error_prefix(w, line, column, false);
+            out_str(w, "Unterminated conditional directive (missing #endif)\n");
+            break;
+        case DIAG_PP_FUNCTION_MACRO:
+            error_prefix(w, line, column, false);
+            out_str(w, "Function-like macro '");
+            out_str(w, text);
+            out_str(w, "' is not supported\n");
+            break;
+        case DIAG_PP_ERROR_DIRECTIVE:
+            error_prefix(w, line, column, false);
+            out_str(w, "#error ");
+            out_str(w, text);
+            out_char(w, '\n');
+            break;
+        case DIAG_EXPECTED_TOKEN:
+            out_str(w, "Syntax error at line ");
+            out_int(w, line, 0);
+            out_str(w, ", col ");
+            out_int(w, column, 0);
+            out_str(w, ": expected ");
+            out_str(w, token_type_to_str((TokenType)e->arg0));
+            out_str(w, " but found ");
+            out_str(w, token_type_to_str((TokenType)e->arg1));
+            out_str(w, " ('");
+            out_str(w, text);
+            out_str(w, "')\n");
+            break;
+        case DIAG_EXTRA_TOKENS:
+            out_str(w, "Warning: extra tokens after program end at line ");
+            out_int(w, line, 0);
+            out_char(w, '\n');
+            break;
+        case DIAG_EXPECTED_LBRACE:
+            out_str(w, "Syntax error: expected '{' at line ");
+            out_int(w, line, 0);
+            out_char(w, '\n');
+            break;
+        case DIAG_UNEXPECTED_IN_STMT:
+            out_str(w, "Syntax error: unexpected token ");
+            out_str(w, token_type_to_str((TokenType)e->arg0));
+            out_str(w, " ('");
+            out_str(w, text);
+            out_str(w, "') at line ");
+            out_int(w, line, 0);
+            out_str(w, " in stmt\n");
+            break;
+        case DIAG_EXPECTED_FACTOR:
+            out_str(w, "Syntax error: expected factor at line ");
+            out_int(w, line, 0);
+            out_str(w, ", found ");
+            out_str(w, token_type_to_str((TokenType)e->arg0));
+            out_str(w, " ('");
+            out_str(w, text);
+            out_str(w, "')\n");
+            break;
+        case DIAG_LIMIT_EXCEEDED:
+            error_prefix(w, line, column, true);
+            out_str(w, "Analysis aborted: ");
+            out_str(w, limit_kind_name((LimitKind)e->arg0));
+            out_str(w, " limit (");
+            out_str(w, text);
+            out_str(w, ") exceeded\n");
+            break;
+        default:
+            break;
+    }
+    if (e->repeat) {
+        out_str(w, "  (repeated ");
+        out_int(w, e->repeat, 0);
+        out_str(w, e->repeat == 1 ? " more time" : " more times");
+        out_str(w, ", last at line ");
+        out_int(w, source_line(e->last_loc), 0);
+        out_str(w, ")\n");
+    }
+}
+
+void diag_flush(DiagEngine* d, FILE* out) {
+    if (d->count == 0 && d->suppressed == 0) return;
+    static OutWriter w;
+    out_init(&w, out);
+    for (int i = 0; i < d->count; i++) {
+        render(&w, d, &d->entries[i]);
+    }
+    if (d->suppressed) {
+        out_str(&w, "... ");
+        out_int(&w, d->suppressed, 0);
+        out_str(&w, " more diagnostic(s) suppressed\n");
+    }
+    out_flush(&w);
+    d->count = 0;
+    d->suppressed = 0;
+    d->pool_len = 0;
+}
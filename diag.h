@@ -0,0 +1,123 @@
+#ifndef DIAG_H
+#define DIAG_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include "srcmgr.h"
+
+// NOTE - 诊断信息收集器
+// 位置使用源文件管理器的SourceLoc, 同一个收集器可以收集多个文件的诊断
+// 词法/语法分析时只记录紧凑的条目(错误码、位置、参数), 不做格式化;
+// 分析结束后由diag_flush统一生成文本, 一次写出
+// 同一个错误连续出现(级联)时合并为一条并计数, 每个文件记录的条数有上限
+
+// 诊断码
+typedef enum {
+    // 词法错误
+    DIAG_UNCLOSED_COMMENT,
+    DIAG_INVALID_ESCAPE,
+    DIAG_INVALID_CHAR_CONST,
+    DIAG_UNCLOSED_CHAR_CONST,
+    DIAG_INVALID_STRING_ESCAPE,
+    DIAG_UNCLOSED_STRING,
+    DIAG_INVALID_OPERATOR,        // arg0: 运算符字符
+    DIAG_INVALID_CHARACTER,       // arg0: 字符, text: 多字节字符(UTF-8)或NULL
+    DIAG_BAD_NUMBER,              // arg0: NumberError, text: 词素
+    DIAG_INVALID_UTF8,            // arg0: 出错的字节
+
+    // 预处理错误
+    DIAG_PP_INCLUDE_NOT_FOUND,    // text: 文件名
+    DIAG_PP_INCLUDE_DEPTH,        // text: 文件名
+    DIAG_PP_UNKNOWN_DIRECTIVE,    // text: 指令名
+    DIAG_PP_BAD_DIRECTIVE,        // text: 指令名
+    DIAG_PP_UNMATCHED_DIRECTIVE,  // text: 指令名(#elif/#else/#endif)
+    DIAG_PP_UNTERMINATED_IF,
+    DIAG_PP_FUNCTION_MACRO,       // text: 宏名
+    DIAG_PP_ERROR_DIRECTIVE,      // text: #error之后的内容
+
+    // 语法错误
+    DIAG_EXPECTED_TOKEN,          // arg0: 期望的TokenType, arg1: 实际的TokenType, text: 词素
+    DIAG_EXTRA_TOKENS,            // 警告
+    DIAG_EXPECTED_LBRACE,
+    DIAG_UNEXPECTED_IN_STMT,      // arg0: TokenType, text: 词素
+    DIAG_EXPECTED_FACTOR,         // arg0: TokenType, text: 词素
+
+    // 资源上限
+    DIAG_LIMIT_EXCEEDED,          // arg0: LimitKind, text: 上限的值
+
+    DIAG_CODE_COUNT
+} DiagCode;
+
+// 数值常量的错误种类(DIAG_BAD_NUMBER的arg0)
+typedef enum {
+    NUMBER_NO_HEX_DIGITS,
+    NUMBER_NO_EXPONENT_DIGITS,
+    NUMBER_BAD_FLOAT_SUFFIX,
+    NUMBER_FLOAT_OUT_OF_RANGE,
+    NUMBER_BAD_INT_SUFFIX,
+    NUMBER_BAD_OCTAL_DIGIT,
+    NUMBER_INT_TOO_LARGE
+} NumberError;
+
+typedef struct {
+    int code;
+    int repeat;                   // 合并进来的重复次数(不含第一条)
+    SourceLoc loc;                // 行号列号在输出时才换算
+    SourceLoc last_loc;           // 最后一次重复出现的位置
+    int arg0;
+    int arg1;
+    int text;                     // 文本参数在字符串池中的偏移, -1表示无
+} Diagnostic;
+
+typedef struct {
+    Diagnostic* entries;
+    int count;
+    int cap;
+    int limit;                    // 每个文件最多记录的条数
+    int file_count;               // 当前文件已记录的条数
+    int suppressed;               // 超出上限被丢弃的条数
+    char* pool;                   // 文本参数
+    size_t pool_len;
+    size_t pool_cap;
+    FILE* output;                 // free_lexer()时输出到这里, NULL表示stderr
+    bool raw;                     // 原样记录每一条, 不合并也不限制条数(转交给其他收集器之前的暂存)
+} DiagEngine;
+
+#define DIAG_DEFAULT_LIMIT 100
+
+// 进程内默认的收集器, 词法分析器默认使用它
+DiagEngine* diag_default(void);
+
+void diag_init(DiagEngine* d);
+void diag_free(DiagEngine* d);
+void diag_set_limit(DiagEngine* d, int limit);
+
+// 开始分析一个新文件: 重置每个文件的上限计数
+void diag_begin_file(DiagEngine* d);
+
+// 记录一条诊断, text可以为NULL
+void diag_report(DiagEngine* d, DiagCode code, SourceLoc loc, int arg0, int arg1, const char* text);
+
+// 记下当前状态, 之后可以撤销这之后记录的诊断(用于推测性的分析)
+typedef struct {
+    int count;
+    int file_count;
+    int suppressed;
+    size_t pool_len;
+    int last_repeat;
+    SourceLoc last_loc;
+} DiagMark;
+
+void diag_mark(const DiagEngine* d, DiagMark* m);
+void diag_rollback(DiagEngine* d, const DiagMark* m);
+
+// 把src中的诊断按顺序追加到dst(同样做级联合并和上限检查)
+void diag_append(DiagEngine* dst, const DiagEngine* src);
+// 只追加src中since之后记录的诊断, 结果与把它们逐条记入dst相同; 做不到时(它们与之前的诊断合并过,
+// 或者有的因为src的上限被丢弃)不追加, 返回false
+bool diag_append_since(DiagEngine* dst, const DiagEngine* src, const DiagMark* since);
+
+// 渲染全部诊断并清空
+void diag_flush(DiagEngine* d, FILE* out);
+
+#endif
@@ -0,0 +1,311 @@
+// 比较提前编译与解释执行: 同一个程序用 --emit-c 生成C代码、交给C编译器编译成共享库后dlopen执行,
+// 与在语法树上直接解释执行对比每次运行的耗时, 同时检查两者得到的变量值一致
+// 编译：gcc emitbench.c emitc.c cfg.c parser.c astcache.c tokring.c ast.c lexer.c lextab.c tokcache.c output.c diag.c srcmgr.c parlex.c utf8.c srcnorm.c preproc.c budget.c tokpipe.c pushsrc.c -o emitbench -pthread -ldl
+// 运行：./emitbench [--cc <compiler>] [--min-ms MS] <source_file>...
+//
+// NOTE - 解释器先把语法树降低为变量已解析成编号的结点, 运行时不再查名字, 对比的是执行方式本身
+// 每次运行前变量都清零; 每种方式的运行次数从1开始加倍, 直到总耗时不少于--min-ms(默认100ms)
+// 编译耗时单独报告, 不计入每次运行的耗时; 程序中的循环必须终止
+
+#define _POSIX_C_SOURCE 200809L
+#include "parser.h"
+#include "cfg.h"
+#include "emitc.h"
+#include <dlfcn.h>
+#include <unistd.h>
+
+#define RULE_PREFIX "rule"
+
+// NOTE - 解释执行
+// 与AstNode结构相同, 标识符换成变量编号, 字面量换成数值
+typedef struct INode {
+    AstKind kind;
+    TokenType op;
+    int slot;                     // AST_IDENT / AST_ASSIGN 的变量编号
+    long long value;              // AST_NUMBER 的值
+    struct INode* left;
+    struct INode* right;
+    struct INode* cond;
+    struct INode* body;
+    struct INode* else_body;
+    struct INode* next;
+} INode;
+
+typedef struct {
+    INode* nodes;
+    int count;
+    int cap;
+    const Cfg* cfg;
+} Lowering;
+
+static INode* lower(Lowering* l, const AstNode* n) {
+    if (!n) return NULL;
+    INode* head = NULL;
+    INode** slot = &head;
+    for (; n; n = n->next) {
+        if (l->count == l->cap) return head;
+        INode* i = &l->nodes[l->count++];
+        memset(i, 0, sizeof(INode));
+        i->kind = n->kind;
+        i->op = n->op;
+        if (n->kind == AST_IDENT) i->slot = cfg_lookup_var(l->cfg, n->name);
+        if (n->kind == AST_ASSIGN) i->slot = cfg_lookup_var(l->cfg, n->left->name);
+        if (n->kind == AST_NUMBER) i->value = emitc_literal(n->name);
+        if (n->kind != AST_ASSIGN) i->left = lower(l, n->left);
+        i->right = lower(l, n->right);
+        i->cond = lower(l, n->cond);
+        i->body = lower(l, n->body);
+        i->else_body = lower(l, n->else_body);
+        *slot = i;
+        slot = &i->next;
+    }
+    return head;
+}
+
+static long long eval(const INode* e, long long* v) {
+    switch (e->kind) {
+        case AST_IDENT: return v[e->slot];
+        case AST_NUMBER: return e->value;
+        case AST_UNARY: return (long long)(0 - (unsigned long long)eval(e->left, v));
+        case AST_BINARY:
+            if (e->op == TOKEN_AND) return eval(e->left, v) && eval(e->right, v);
+            if (e->op == TOKEN_OR) return eval(e->left, v) || eval(e->right, v);
+            {
+                long long a = eval(e->left, v);
+                long long b = eval(e->right, v);
+                switch (e->op) {
+                    case TOKEN_PLUS: return (long long)((unsigned long long)a + (unsigned long long)b);
+                    case TOKEN_MINUS: return (long long)((unsigned long long)a - (unsigned long long)b);
+                    case TOKEN_MULTIPLY: return (long long)((unsigned long long)a * (unsigned long long)b);
+                    case TOKEN_DIVIDE: return emitc_div(a, b);
+                    case TOKEN_MOD: return emitc_mod(a, b);
+                    case TOKEN_LT: return a < b;
+                    case TOKEN_LE: return a <= b;
+                    case TOKEN_GT: return a > b;
+                    case TOKEN_GE: return a >= b;
+                    case TOKEN_EQ: return a == b;
+                    case TOKEN_NE: return a != b;
+                    default: return 0;
+                }
+            }
+        default: return 0;
+    }
+}
+
+// 执行语句链, 执行到break时返回true
+static bool exec(const INode* s, long long* v) {
+    for (; s; s = s->next) {
+        switch (s->kind) {
+            case AST_BLOCK:
+                if (exec(s->body, v)) return true;
+                break;
+            case AST_ASSIGN:
+                v[s->slot] = eval(s->right, v);
+                break;
+            case AST_IF:
+                if (eval(s->cond, v)) {
+                    if (exec(s->body, v)) return true;
+                } else if (s->else_body && exec(s->else_body, v)) {
+                    return true;
+                }
+                break;
+            case AST_WHILE:
+                while (eval(s->cond, v)) {
+                    if (exec(s->body, v)) break;
+                }
+                break;
+            case AST_DO_WHILE:
+                do {
+                    if (exec(s->body, v)) break;
+                } while (eval(s->cond, v));
+                break;
+            case AST_BREAK:
+                return true;
+            default:
+                break;
+        }
+    }
+    return false;
+}
+
+// NOTE - 计时
+typedef void (*RunFn)(long long* vars);
+
+typedef struct {
+    const INode* program;         // 解释执行的程序, 为NULL时调用compiled
+    RunFn compiled;
+    long long* vars;
+    int var_count;
+} Runner;
+
+static void run_once(const Runner* r) {
+    memset(r->vars, 0, (size_t)r->var_count * sizeof(long long));
+    if (r->program) exec(r->program, r->vars);
+    else r->compiled(r->vars);
+}
+
+// 每次运行的平均耗时(纳秒)
+static double time_runs(const Runner* r, double min_ms) {
+    for (long n = 1;; n *= 2) {
+        double begin = budget_now_ms();
+        for (long i = 0; i < n; i++) run_once(r);
+        double ms = budget_now_ms() - begin;
+        if (ms >= min_ms || n >= (1L << 40)) return ms * 1e6 / (double)n;
+    }
+}
+
+// NOTE - 生成并编译
+typedef struct {
+    char dir[64];
+    char c_path[96];
+    char so_path[96];
+    void* handle;
+} Compiled;
+
+static void remove_compiled(Compiled* c) {
+    if (c->handle) dlclose(c->handle);
+    unlink(c->c_path);
+    unlink(c->so_path);
+    rmdir(c->dir);
+}
+
+// 生成C代码并编译载入, 返回编译耗时(毫秒), 失败时返回负数
+static double compile_program(const AstNode* root, const Cfg* cfg, const char* filename,
+                              const char* cc, Compiled* c) {
+    memset(c, 0, sizeof(Compiled));
+    strcpy(c->dir, "/tmp/emitbenchXXXXXX");
+    if (!mkdtemp(c->dir)) {
+        fprintf(stderr, "Cannot create temporary directory\n");
+        return -1;
+    }
+    snprintf(c->c_path, sizeof(c->c_path), "%s/%s.c", c->dir, RULE_PREFIX);
+    snprintf(c->so_path, sizeof(c->so_path), "%s/%s.so", c->dir, RULE_PREFIX);
+    FILE* out = fopen(c->c_path, "w");
+    if (!out) {
+        fprintf(stderr, "Cannot open file: %s\n", c->c_path);
+        return -1;
+    }
+    int rc = emit_c(root, cfg, RULE_PREFIX, filename, out);
+    if (fclose(out) != 0 || rc != 0) return -1;
+
+    char cmd[512];
+    snprintf(cmd, sizeof(cmd), "%s -O2 -shared -fPIC -o '%s' '%s'", cc, c->so_path, c->c_path);
+    double begin = budget_now_ms();
+    if (system(cmd) != 0) {
+        fprintf(stderr, "Compiler failed: %s\n", cmd);
+        return -1;
+    }
+    double ms = budget_now_ms() - begin;
+    c->handle = dlopen(c->so_path, RTLD_NOW | RTLD_LOCAL);
+    if (!c->handle) {
+        fprintf(stderr, "Cannot load %s: %s\n", c->so_path, dlerror());
+        return -1;
+    }
+    return ms;
+}
+
+// 测量一个文件; 成功返回0, 两种方式结果不一致返回2
+static int bench_file(const char* filename, const char* cc, double min_ms) {
+    Ast ast;
+    ast_init(&ast);
+    int rc = parse_file_ast(filename, &ast);
+    Cfg cfg;
+    if (rc == 0 && cfg_build(&cfg, ast.root) != 0) {
+        cfg_free(&cfg);
+        rc = 2;
+    }
+    if (rc != 0) {
+        fprintf(stderr, "%s: cannot be compiled (exit code %d)\n", filename, rc);
+        ast_free(&ast);
+        return 1;
+    }
+
+    Compiled c;
+    double compile_ms = compile_program(ast.root, &cfg, filename, cc, &c);
+    RunFn run = NULL;
+    const int* var_count = NULL;
+    if (compile_ms >= 0) {
+        // 数据指针转函数指针是POSIX允许的, 借memcpy避开ISO C的警告
+        void* sym = dlsym(c.handle, RULE_PREFIX "_run");
+        memcpy(&run, &sym, sizeof(run));
+        var_count = (const int*)dlsym(c.handle, RULE_PREFIX "_var_count");
+    }
+    if (!run || !var_count || *var_count != cfg.var_count) {
+        if (compile_ms >= 0) fprintf(stderr, "%s: generated library has no usable %s_run\n", filename, RULE_PREFIX);
+        remove_compiled(&c);
+        cfg_free(&cfg);
+        ast_free(&ast);
+        return 1;
+    }
+
+    Lowering l;
+    l.cap = ast.node_count;
+    l.count = 0;
+    l.cfg = &cfg;
+    l.nodes = (INode*)malloc((size_t)(l.cap > 0 ? l.cap : 1) * sizeof(INode));
+    int slots = cfg.var_count > 0 ? cfg.var_count : 1;
+    long long* interp_vars = (long long*)calloc((size_t)slots, sizeof(long long));
+    long long* compiled_vars = (long long*)calloc((size_t)slots, sizeof(long long));
+    if (!l.nodes || !interp_vars || !compiled_vars) {
+        fprintf(stderr, "Memory allocation error\n");
+        exit(1);
+    }
+    Runner interp = { lower(&l, ast.root), NULL, interp_vars, cfg.var_count };
+    Runner compiled = { NULL, run, compiled_vars, cfg.var_count };
+
+    // 先各运行一次核对结果
+    run_once(&interp);
+    run_once(&compiled);
+    rc = 0;
+    for (int v = 0; v < cfg.var_count; v++) {
+        if (interp_vars[v] != compiled_vars[v]) {
+            fprintf(stderr, "%s: %s = %lld interpreted, %lld compiled\n", filename, cfg.vars[v],
+                    interp_vars[v], compiled_vars[v]);
+            rc = 2;
+        }
+    }
+    if (rc == 0) {
+        double interp_ns = time_runs(&interp, min_ms);
+        double compiled_ns = time_runs(&compiled, min_ms);
+        printf("%-24s %6d %12.1f %16.1f %16.1f %8.1fx\n", filename, cfg.var_count, compile_ms,
+               interp_ns, compiled_ns, compiled_ns > 0 ? interp_ns / compiled_ns : 0.0);
+    }
+
+    free(l.nodes);
+    free(interp_vars);
+    free(compiled_vars);
+    remove_compiled(&c);
+    cfg_free(&cfg);
+    ast_free(&ast);
+    return rc;
+}
+
+int main(int argc, char* argv[]) {
+    const char* cc = "gcc";
+    double min_ms = 100.0;
+    int argi = 1;
+    while (argi < argc && argv[argi][0] == '-') {
+        if (strcmp(argv[argi], "--cc") == 0 && argi + 1 < argc) {
+            cc = argv[argi + 1];
+            argi += 2;
+        } else if (strcmp(argv[argi], "--min-ms") == 0 && argi + 1 < argc) {
+            min_ms = atof(argv[argi + 1]);
+            argi += 2;
+        } else {
+            break;
+        }
+    }
+    if (argi >= argc) {
+        fprintf(stderr, "Usage: %s [--cc <compiler>] [--min-ms MS] <source_file>...\n", argv[0]);
+        return 1;
+    }
+
+    printf("%-24s %6s %12s %16s %16s %9s\n", "File", "Vars", "compile(ms)", "interp(ns/run)",
+           "compiled(ns/run)", "speedup");
+    int rc = 0;
+    for (; argi < argc; argi++) {
+        int r = bench_file(argv[argi], cc, min_ms);
+        if (r > rc) rc = r;
+    }
+    return rc;
+}
@@ -0,0 +1,219 @@
+#include "emitc.h"
+
+#define INDENT_WIDTH 4
+
+long long emitc_literal(const char* lexeme) {
+    // 只取数字部分(忽略u/l后缀), 超出范围按2^64取模
+    unsigned long long value = 0;
+    for (const char* p = lexeme; *p >= '0' && *p <= '9'; p++) {
+        value = value * 10 + (unsigned long long)(*p - '0');
+    }
+    return (long long)value;
+}
+
+long long emitc_div(long long a, long long b) {
+    if (b == 0) return 0;
+    if (b == -1) return (long long)(0 - (unsigned long long)a);
+    return a / b;
+}
+
+long long emitc_mod(long long a, long long b) {
+    if (b == 0 || b == -1) return 0;
+    return a % b;
+}
+
+// 语法错误留下的占位结点(只在出错的程序中出现)
+static bool has_error(const AstNode* n) {
+    for (; n; n = n->next) {
+        if (n->kind == AST_ERROR) return true;
+        if (has_error(n->left) || has_error(n->right) || has_error(n->cond) ||
+            has_error(n->body) || has_error(n->else_body)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void indent(FILE* out, int level) {
+    fprintf(out, "%*s", level * INDENT_WIDTH, "");
+}
+
+static const char* op_text(TokenType op) {
+    switch (op) {
+        case TOKEN_PLUS: return "+";
+        case TOKEN_MINUS: return "-";
+        case TOKEN_MULTIPLY: return "*";
+        case TOKEN_LT: return "<";
+        case TOKEN_LE: return "<=";
+        case TOKEN_GT: return ">";
+        case TOKEN_GE: return ">=";
+        case TOKEN_EQ: return "==";
+        case TOKEN_NE: return "!=";
+        case TOKEN_AND: return "&&";
+        case TOKEN_OR: return "||";
+        default: return NULL;
+    }
+}
+
+// 表达式全部加括号, 不依赖C的优先级与本语言一致
+static void emit_expr(const AstNode* e, const Cfg* cfg, FILE* out) {
+    switch (e->kind) {
+        case AST_IDENT:
+            fprintf(out, "v%d", cfg_lookup_var(cfg, e->name));
+            break;
+
+        case AST_NUMBER: {
+            long long value = emitc_literal(e->name);
+            // LLONG_MIN不能直接写成字面量
+            if (value == -0x7fffffffffffffffLL - 1) fprintf(out, "(-0x7fffffffffffffffLL - 1)");
+            else if (value < 0) fprintf(out, "(%lldLL)", value);
+            else fprintf(out, "%lldLL", value);
+            break;
+        }
+
+        case AST_UNARY:
+            fprintf(out, "(i64)(0 - (u64)");
+            emit_expr(e->left, cfg, out);
+            fprintf(out, ")");
+            break;
+
+        case AST_BINARY:
+            if (e->op == TOKEN_DIVIDE || e->op == TOKEN_MOD) {
+                fprintf(out, e->op == TOKEN_DIVIDE ? "rt_div(" : "rt_mod(");
+                emit_expr(e->left, cfg, out);
+                fprintf(out, ", ");
+                emit_expr(e->right, cfg, out);
+                fprintf(out, ")");
+            } else if (e->op == TOKEN_PLUS || e->op == TOKEN_MINUS || e->op == TOKEN_MULTIPLY) {
+                // 按无符号数运算, 回绕而不是未定义行为
+                fprintf(out, "(i64)((u64)");
+                emit_expr(e->left, cfg, out);
+                fprintf(out, " %s (u64)", op_text(e->op));
+                emit_expr(e->right, cfg, out);
+                fprintf(out, ")");
+            } else {
+                fprintf(out, "(i64)(");
+                emit_expr(e->left, cfg, out);
+                fprintf(out, " %s ", op_text(e->op));
+                emit_expr(e->right, cfg, out);
+                fprintf(out, ")");
+            }
+            break;
+
+        default:
+            fprintf(out, "0");
+            break;
+    }
+}
+
+static void emit_stmts(const AstNode* s, const Cfg* cfg, int level, FILE* out);
+
+// 分支和循环体总是加花括号
+static void emit_body(const AstNode* s, const Cfg* cfg, int level, FILE* out) {
+    fprintf(out, " {\n");
+    if (s && s->kind == AST_BLOCK) emit_stmts(s->body, cfg, level + 1, out);
+    else if (s) emit_stmts(s, cfg, level + 1, out);
+    indent(out, level);
+    fprintf(out, "}");
+}
+
+// 语句及其后(同一块内)的语句
+static void emit_stmts(const AstNode* s, const Cfg* cfg, int level, FILE* out) {
+    for (; s; s = s->next) {
+        switch (s->kind) {
+            case AST_BLOCK:
+                indent(out, level);
+                fprintf(out, "{\n");
+                emit_stmts(s->body, cfg, level + 1, out);
+                indent(out, level);
+                fprintf(out, "}\n");
+                break;
+
+            case AST_ASSIGN:
+                indent(out, level);
+                fprintf(out, "v%d = ", cfg_lookup_var(cfg, s->left->name));
+                emit_expr(s->right, cfg, out);
+                fprintf(out, ";\n");
+                break;
+
+            case AST_IF:
+                indent(out, level);
+                fprintf(out, "if (");
+                emit_expr(s->cond, cfg, out);
+                fprintf(out, ")");
+                emit_body(s->body, cfg, level, out);
+                if (s->else_body) {
+                    fprintf(out, " else");
+                    emit_body(s->else_body, cfg, level, out);
+                }
+                fprintf(out, "\n");
+                break;
+
+            case AST_WHILE:
+                indent(out, level);
+                fprintf(out, "while (");
+                emit_expr(s->cond, cfg, out);
+                fprintf(out, ")");
+                emit_body(s->body, cfg, level, out);
+                fprintf(out, "\n");
+                break;
+
+            case AST_DO_WHILE:
+                indent(out, level);
+                fprintf(out, "do");
+                emit_body(s->body, cfg, level, out);
+                fprintf(out, " while (");
+                emit_expr(s->cond, cfg, out);
+                fprintf(out, ");\n");
+                break;
+
+            case AST_BREAK:
+                // 生成的代码中没有switch, C的break同样跳出最内层循环
+                indent(out, level);
+                fprintf(out, "break;\n");
+                break;
+
+            default:
+                break;
+        }
+    }
+}
+
+int emit_c(const AstNode* root, const Cfg* cfg, const char* prefix, const char* source_name, FILE* out) {
+    if (!root || has_error(root) || cfg->error_count > 0) return 1;
+
+    fprintf(out, "/* Generated by parser --emit-c from %s. Do not edit. */\n\n", source_name);
+    fprintf(out, "typedef long long i64;\n");
+    fprintf(out, "typedef unsigned long long u64;\n\n");
+    fprintf(out, "static i64 rt_div(i64 a, i64 b) {\n"
+                 "    if (b == 0) return 0;\n"
+                 "    if (b == -1) return (i64)(0 - (u64)a);\n"
+                 "    return a / b;\n"
+                 "}\n\n");
+    fprintf(out, "static i64 rt_mod(i64 a, i64 b) {\n"
+                 "    if (b == 0 || b == -1) return 0;\n"
+                 "    return a %% b;\n"
+                 "}\n\n");
+
+    // 变量表; 没有变量时数组也至少要有一个元素
+    fprintf(out, "const int %s_var_count = %d;\n", prefix, cfg->var_count);
+    fprintf(out, "const char* const %s_var_names[] = {", prefix);
+    for (int v = 0; v < cfg->var_count; v++) {
+        fprintf(out, "%s\n    \"%s\"", v > 0 ? "," : "", cfg->vars[v]);
+    }
+    fprintf(out, cfg->var_count > 0 ? "\n};\n\n" : " 0 };\n\n");
+
+    // 变量先读入局部变量, 便于编译器分配到寄存器中, 结束时写回
+    fprintf(out, "void %s_run(i64* vars) {\n", prefix);
+    for (int v = 0; v < cfg->var_count; v++) {
+        fprintf(out, "    i64 v%d = vars[%d];  /* %s */\n", v, v, cfg->vars[v]);
+    }
+    fprintf(out, "\n");
+    emit_stmts(root, cfg, 1, out);
+    fprintf(out, "\n");
+    for (int v = 0; v < cfg->var_count; v++) {
+        fprintf(out, "    vars[%d] = v%d;\n", v, v);
+    }
+    fprintf(out, "}\n");
+    return ferror(out) ? 1 : 0;
+}
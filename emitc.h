@@ -0,0 +1,27 @@
+#ifndef EMITC_H
+#define EMITC_H
+
+#include "cfg.h"
+
+// NOTE - 生成C代码(提前编译)
+// 把通过语法检查的程序翻译成独立的C翻译单元, 交给系统的C编译器(如 gcc -O2 -shared -fPIC)编译,
+// 再用dlopen载入执行, 代码质量由C编译器的优化保证. 生成的代码只依赖C99, 不包含任何头文件
+// 生成的翻译单元导出(prefix为调用者指定的名字前缀):
+//   const int <prefix>_var_count;              变量个数
+//   const char* const <prefix>_var_names[];    变量名, 下标即变量编号(与Cfg.vars一致)
+//   void <prefix>_run(long long* vars);         执行一次程序; vars[i]为第i个变量, 执行前由调用者赋初值, 执行后为结果
+// 语义: 变量和整数都是64位有符号整数, + - * 和单目 - 按2^64取模回绕, 不依赖有符号溢出的未定义行为;
+// 除数为0时 / 和 % 的结果为0, LLONG_MIN / -1 回绕为LLONG_MIN, 余数为0;
+// 关系运算和 && || 的结果为0或1, && || 短路求值; 条件非0为真; 整数字面量超出范围时按2^64取模
+// 程序中的循环不一定终止, 生成的代码不加执行步数的限制
+
+// 由语法树和它的控制流图(提供变量编号, 并已检查循环外的break)生成C代码写入out
+// source_name只写入注释; 返回0表示成功, 语法树中有出错位置的占位结点时返回非0且不输出
+int emit_c(const AstNode* root, const Cfg* cfg, const char* prefix, const char* source_name, FILE* out);
+
+// 与生成的代码相同的语义, 供解释执行等需要得到相同结果的地方使用
+long long emitc_literal(const char* lexeme);
+long long emitc_div(long long a, long long b);
+long long emitc_mod(long long a, long long b);
+
+#endif
@@ -0,0 +1,107 @@
+// 手写词法分析器与生成的表驱动扫描器的A/B对比
+// 编译：gcc lexbench.c lexer.c lextab.c tokcache.c output.c diag.c srcmgr.c parlex.c utf8.c srcnorm.c preproc.c budget.c tokpipe.c pushsrc.c -o lexbench -pthread
+// 运行：./lexbench <source_file> [rounds]
+
+#include "lexer.h"
+#include <time.h>
+
+// 手写分析器: 完整的get_token(), 含词素复制和数值转换
+static size_t run_handwritten(Lexer* lexer, TokenType* types, size_t cap) {
+    size_t n = 0;
+    reset_lexer(lexer);
+    for (;;) {
+        Token token = get_token(lexer);
+        if (n < cap) types[n] = token.type;
+        n++;
+        if (token.type == TOKEN_EOF) break;
+    }
+    return n;
+}
+
+// 生成的扫描器: 只识别token类型
+static size_t run_generated(const Lexer* lexer, TokenType* types, size_t cap) {
+    size_t n = 0;
+    size_t pos = lexer->start, start;
+    for (;;) {
+        TokenType type = lextab_scan(lexer->buffer, lexer->length, &pos, &start);
+        if (n < cap) types[n] = type;
+        n++;
+        if (type == TOKEN_EOF) break;
+    }
+    return n;
+}
+
+static double seconds_since(clock_t begin) {
+    return (double)(clock() - begin) / CLOCKS_PER_SEC;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <source_file> [rounds]\n", argv[0]);
+        return 1;
+    }
+    int rounds = argc > 2 ? atoi(argv[2]) : 20;
+    if (rounds < 1) rounds = 1;
+
+    Lexer* lexer = init_lexer(argv[1]);
+    if (!lexer) return 1;
+    // 错误信息不是对比的内容, 记到单独的收集器里, 结束时直接丢弃
+    DiagEngine quiet;
+    diag_init(&quiet);
+    lexer->diag = &quiet;
+
+    size_t cap = lexer->length + 2;
+    TokenType* hand = (TokenType*)malloc(cap * sizeof(TokenType));
+    TokenType* gen = (TokenType*)malloc(cap * sizeof(TokenType));
+    if (!hand || !gen) {
+        fprintf(stderr, "Memory allocation error\n");
+        lexer->diag = diag_default();
+        diag_free(&quiet);
+        free_lexer(lexer);
+        return 1;
+    }
+
+    size_t hand_count = 0, gen_count = 0;
+    clock_t begin = clock();
+    for (int r = 0; r < rounds; r++) hand_count = run_handwritten(lexer, hand, cap);
+    double hand_time = seconds_since(begin);
+
+    begin = clock();
+    for (int r = 0; r < rounds; r++) gen_count = run_generated(lexer, gen, cap);
+    double gen_time = seconds_since(begin);
+
+    // 逐个比较token类型, 记录第一处不一致
+    size_t common = hand_count < gen_count ? hand_count : gen_count;
+    size_t mismatches = 0, first = common;
+    for (size_t i = 0; i < common; i++) {
+        if (hand[i] != gen[i]) {
+            if (mismatches == 0) first = i;
+            mismatches++;
+        }
+    }
+
+    double mb = (double)lexer->length * rounds / (1024.0 * 1024.0);
+    printf("File: %s (%lu bytes, %d rounds)\n", argv[1], (unsigned long)lexer->length, rounds);
+    printf("%-12s %10s %10s %10s\n", "Scanner", "Tokens", "Seconds", "MB/s");
+    printf("%-12s %10lu %10.3f %10.1f\n", "handwritten", (unsigned long)hand_count, hand_time,
+           hand_time > 0 ? mb / hand_time : 0.0);
+    printf("%-12s %10lu %10.3f %10.1f\n", "generated", (unsigned long)gen_count, gen_time,
+           gen_time > 0 ? mb / gen_time : 0.0);
+    if (mismatches == 0 && hand_count == gen_count) {
+        printf("Token types agree\n");
+    } else {
+        printf("Token types differ: %lu mismatch(es)", (unsigned long)mismatches);
+        if (first < common) {
+            printf(", first at token %lu (%s vs %s)", (unsigned long)first,
+                   token_type_to_str(hand[first]), token_type_to_str(gen[first]));
+        }
+        printf("\n");
+    }
+
+    free(hand);
+    free(gen);
+    lexer->diag = diag_default();
+    diag_free(&quiet);
+    free_lexer(lexer);
+    return 0;
+}
@@ -1,101 +1,195 @@
 #include "lexer.h"
+#include "tokcache.h"
+#include "parlex.h"
+#include "preproc.h"
+#include "tokpipe.h"
+#include "pushsrc.h"
+#include "lextab.h"
+#include "utf8.h"
 
-
-
-// 保留字表
-typedef struct {
-    const char* word;
-    TokenType type;
-} Keyword;
-
-Keyword keywords[] = {
-    {"if", TOKEN_IF},
-    {"else", TOKEN_ELSE},
-    {"while", TOKEN_WHILE},
-    {"do", TOKEN_DO},
-    {"main", TOKEN_MAIN},
-    {"int", TOKEN_INT},
-    {"float", TOKEN_FLOAT},
-    {"double", TOKEN_DOUBLE},
-    {"return", TOKEN_RETURN},
-    {"const", TOKEN_CONST},
-    {"void", TOKEN_VOID},
-    {"continue", TOKEN_CONTINUE},
-    {"break", TOKEN_BREAK},
-    {"char", TOKEN_CHAR},
-    {"unsigned", TOKEN_UNSIGNED},
-    {"enum", TOKEN_ENUM},
-    {"long", TOKEN_LONG},
-    {"switch", TOKEN_SWITCH},
-    {"case", TOKEN_CASE},
-    {"auto", TOKEN_AUTO},
-    {"static", TOKEN_STATIC},
-    {NULL, TOKEN_IDENTIFIER}  // 结束标记
-};
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 // 初始化词法分析器
+// 文件由源文件管理器一次读入内存(同时建好行起点表), 之后的扫描不再逐字符调用stdio
 Lexer* init_lexer(const char* filename) {
+    int file_id = srcmgr_load(srcmgr_default(), filename);
+    if (file_id < 0) {
+        fprintf(stderr, "Cannot open file: %s\n", filename);
+        return NULL;
+    }
+    return init_lexer_source(file_id);
+}
+
+// 分析已在默认源文件管理器中的文件(包括srcmgr_add_buffer登记的内存内容)
+Lexer* init_lexer_source(int file_id) {
+    SourceFile* file = srcmgr_file(srcmgr_default(), file_id);
+    if (!file) return NULL;
     Lexer* lexer = (Lexer*)malloc(sizeof(Lexer));
     if (!lexer) {
         fprintf(stderr, "Memory allocation error\n");
         return NULL;
     }
     
-    lexer->source = fopen(filename, "r");
-    if (!lexer->source) {
-        fprintf(stderr, "Cannot open file: %s\n", filename);
-        free(lexer);
-        return NULL;
-    }
+    lexer->file_id = file_id;
+    lexer->buffer = file->buffer;
+    lexer->length = file->length;
+    lexer->base = file->base;
+    lexer->utf8_error = file->utf8_error;
+    lexer->utf8_next = file->utf8_error;
     
-    lexer->line = 1;
-    lexer->column = 0;
+    lexer->cache = NULL;
+    lexer->parallel = NULL;
+    lexer->pp = NULL;
+    lexer->pipe = NULL;
+    lexer->push = NULL;
+    lexer->diag = diag_default();
+    lexer->limits = NULL;
+    lexer->deadline = 0;
+    reset_lexer(lexer);
+    // 启用了缓存目录时, 内容未变的文件直接回放缓存中的token; 流式登记的文件内容还不完整, 不使用缓存
+    lexer->cache = file->stream ? NULL : tokcache_open(lexer);
+    return lexer;
+}
+
+// 回到文件开头
+void reset_lexer(Lexer* lexer) {
+    lexer->pos = 0;
     lexer->has_error = false;
-    lexer->current_char = fgetc(lexer->source);
+    diag_begin_file(lexer->diag);
     
     // 跳过UTF-8 BOM (如果存在)
-    if (lexer->current_char == 0xEF) {
-        int b1 = fgetc(lexer->source);
-        int b2 = fgetc(lexer->source);
-        if (b1 == 0xBB && b2 == 0xBF) {
-            lexer->current_char = fgetc(lexer->source);
-        } else {
-            ungetc(b2, lexer->source);
-            ungetc(b1, lexer->source);
-        }
+    if (lexer->length >= 3 && memcmp(lexer->buffer, "\xEF\xBB\xBF", 3) == 0) {
+        lexer->pos = 3;
     }
-    
-    return lexer;
+    lexer->start = lexer->pos;
+    lexer->token_count = 0;
+    lexer->limit_hit = LIMIT_NONE;
+    lexer->limit_loc = lexer->base + (SourceLoc)lexer->start;
+    if (lexer->limits && lexer->limits->max_bytes && lexer->length > lexer->limits->max_bytes) {
+        lexer->limit_hit = LIMIT_BYTES;
+    }
+    if (lexer->cache) tokcache_rewind(lexer->cache);
+    if (lexer->parallel) parlex_rewind(lexer->parallel);
+    if (lexer->pp) preproc_rewind(lexer->pp);
+    if (lexer->pipe) tokpipe_rewind(lexer->pipe);
+    seek_lexer(lexer, lexer->start);
+}
+
+// 把分析器放到pos处, 状态只由位置决定
+void seek_lexer(Lexer* lexer, size_t pos) {
+    // 下一个非法UTF-8序列: 在文件第一个之前直接可知; 向前移动且没有越过它时不变; 否则重新查找
+    if (pos <= lexer->utf8_error) {
+        lexer->utf8_next = lexer->utf8_error;
+    } else if (pos < lexer->pos || lexer->utf8_next < pos) {
+        lexer->utf8_next = utf8_next_invalid(lexer->buffer, pos, lexer->length);
+    }
+    lexer->pos = pos;
+    lexer->token_start = pos;
+    lexer->current_char = pos < lexer->length ? (unsigned char)lexer->buffer[pos] : EOF;
 }
 
 // 释放资源
 void free_lexer(Lexer* lexer) {
     if (lexer) {
-        if (lexer->source) {
-            fclose(lexer->source);
-        }
+        // 分析结束, 统一输出收集到的诊断
+        diag_flush(lexer->diag, lexer->diag->output ? lexer->diag->output : stderr);
+        tokcache_close(lexer->cache);
+        parlex_free(lexer->parallel);
+        preproc_free(lexer->pp);
+        tokpipe_free(lexer->pipe);
         free(lexer);
     }
 }
 
+// 超出字节数上限的文件不做分析, 直接报告
+void lexer_set_limits(Lexer* lexer, const ParseLimits* limits) {
+    lexer->limits = limits;
+    lexer->deadline = limits && limits->deadline_ms > 0 ? budget_now_ms() + limits->deadline_ms : 0;
+    lexer->limit_hit = LIMIT_NONE;
+    if (limits && limits->max_bytes && lexer->length > limits->max_bytes) {
+        lexer->limit_hit = LIMIT_BYTES;
+        budget_report(lexer->diag, limits, LIMIT_BYTES, lexer->limit_loc);
+    }
+}
+
+// 当前字符的位置, 行号列号需要时再由源文件管理器换算
+static SourceLoc current_loc(const Lexer* lexer) {
+    return lexer->base + (SourceLoc)lexer->pos;
+}
+
 // 获取下一个字符
 void advance(Lexer* lexer) {
     if (lexer->current_char != EOF) {
-        lexer->current_char = fgetc(lexer->source);
-        lexer->column++;
-        
-        if (lexer->current_char == '\n') {
-            lexer->line++;
-            lexer->column = 0;
-        }
+        lexer->pos++;
+        lexer->current_char = lexer->pos < lexer->length ? (unsigned char)lexer->buffer[lexer->pos] : EOF;
     }
 }
 
+// 一次前进n个字符
+static void advance_n(Lexer* lexer, size_t n) {
+    lexer->pos += n;
+    lexer->current_char = lexer->pos < lexer->length ? (unsigned char)lexer->buffer[lexer->pos] : EOF;
+}
+
 // 查看下一个字符而不移动指针
-char peek(Lexer* lexer) {
-    int ch = fgetc(lexer->source);
-    ungetc(ch, lexer->source);
-    return (char)ch;
+int peek(Lexer* lexer) {
+    return lexer->pos + 1 < lexer->length ? (unsigned char)lexer->buffer[lexer->pos + 1] : EOF;
+}
+
+// NOTE - 字符分类只认ASCII, 不依赖locale; 非ASCII字节按UTF-8整体处理
+static bool is_digit(int c) {
+    return c >= '0' && c <= '9';
+}
+
+static bool is_ident_start(int c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+}
+
+static bool is_ident_char(int c) {
+    return is_ident_start(c) || is_digit(c);
+}
+
+// 从pos开始找a、b、c中任一字节, 没有时返回length
+// 注释和字符串的内容只需要找结束符, 不含结束符的16字节块一次跳过(多字节字符已在载入时校验)
+static size_t find_stop(const Lexer* lexer, size_t pos, char a, char b, char c) {
+    const char* buf = lexer->buffer;
+#if defined(__SSE2__)
+    const __m128i va = _mm_set1_epi8(a);
+    const __m128i vb = _mm_set1_epi8(b);
+    const __m128i vc = _mm_set1_epi8(c);
+    for (; pos + 16 <= lexer->length; pos += 16) {
+        __m128i chunk = _mm_loadu_si128((const __m128i*)(buf + pos));
+        __m128i hit = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, va), _mm_cmpeq_epi8(chunk, vb)),
+                                   _mm_cmpeq_epi8(chunk, vc));
+        unsigned int mask = (unsigned int)_mm_movemask_epi8(hit);
+        if (mask) return pos + (size_t)__builtin_ctz(mask);
+    }
+#endif
+    for (; pos < lexer->length; pos++) {
+        if (buf[pos] == a || buf[pos] == b || buf[pos] == c) break;
+    }
+    return pos;
+}
+
+// utf8_next落在已经扫描过的位置(被字符常量等其他错误吞掉)时, 从当前位置重新查找
+static void sync_utf8(Lexer* lexer) {
+    if (lexer->utf8_next < lexer->pos) {
+        lexer->utf8_next = utf8_next_invalid(lexer->buffer, lexer->pos, lexer->length);
+    }
+}
+
+// 报告[utf8_next, end)中的非法UTF-8序列, 用于注释和字符串的内容
+static void check_utf8(Lexer* lexer, size_t end) {
+    while (lexer->utf8_next < end) {
+        size_t at = lexer->utf8_next;
+        diag_report(lexer->diag, DIAG_INVALID_UTF8, lexer->base + (SourceLoc)at,
+                    (unsigned char)lexer->buffer[at], 0, NULL);
+        lexer->has_error = true;
+        at += utf8_invalid_length(lexer->buffer + at, lexer->length - at);
+        lexer->utf8_next = utf8_next_invalid(lexer->buffer, at, lexer->length);
+    }
 }
 
 // 跳过空白符（空格、制表符）
@@ -107,9 +201,10 @@ void skip_whitespace(Lexer* lexer) {
 
 // 跳过单行注释 //
 void skip_single_line_comment(Lexer* lexer) {
-    while (lexer->current_char != '\n' && lexer->current_char != EOF) {
-        advance(lexer);
-    }
+    sync_utf8(lexer);
+    size_t end = find_stop(lexer, lexer->pos, '\n', '\n', '\n');
+    check_utf8(lexer, end);
+    advance_n(lexer, end - lexer->pos);
     if (lexer->current_char == '\n') {
         advance(lexer);
     }
@@ -120,15 +215,20 @@ void skip_multi_line_comment(Lexer* lexer) {
     // 跳过/*!
     advance(lexer);  // 跳过 /
     advance(lexer);  // 跳过 *
+    sync_utf8(lexer);
     
+    // 只有'*'可能是结束符的开始, 其余内容按块跳过
     while (!(lexer->current_char == '*' && peek(lexer) == '/')) {
         if (lexer->current_char == EOF) {
-            fprintf(stderr, "Error at line %d: Unclosed multi-line comment\n", lexer->line);
+            check_utf8(lexer, lexer->length);
+            diag_report(lexer->diag, DIAG_UNCLOSED_COMMENT, current_loc(lexer), 0, 0, NULL);
             lexer->has_error = true;
             return;
         }
-        advance(lexer);
+        size_t stop = lexer->current_char == '*' ? lexer->pos + 1 : find_stop(lexer, lexer->pos, '*', '*', '*');
+        advance_n(lexer, stop - lexer->pos);
     }
+    check_utf8(lexer, lexer->pos);
     
     // 跳过 */
     advance(lexer);  // 跳过 *
@@ -139,11 +239,10 @@ void skip_multi_line_comment(Lexer* lexer) {
 Token identifier(Lexer* lexer) {
     Token token;
     token.type = TOKEN_IDENTIFIER;
-    token.line = lexer->line;
-    token.column = lexer->column;
+    token.loc = current_loc(lexer);
     
     int i = 0;
-    while (isalnum(lexer->current_char) || lexer->current_char == '_') {
+    while (is_ident_char(lexer->current_char)) {
         if (i < 255) {
             token.lexeme[i++] = lexer->current_char;
         }
@@ -160,101 +259,254 @@ Token identifier(Lexer* lexer) {
     return token;
 }
 
+// NOTE - 数值常量在扫描的同时完成转换, 不再先拷贝到缓冲区再调用atof/strtol
+
+// 10的整数次幂, 在double中可以精确表示的部分(10^0 ~ 10^22)
+static const double exact_pow10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+    1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20,
+    1e21, 1e22
+};
+
+#define MAX_U64 18446744073709551615ULL
+#define MAX_I64 9223372036854775807ULL
+
+// 把字符追加到词素, 超出长度的部分只扫描不保存
+static void push_lexeme(Token* token, int* len, char c) {
+    if (*len < 255) token->lexeme[(*len)++] = c;
+}
+
+// SWAR: 判断8个字节是否全是十进制数字
+static bool is_eight_digits(unsigned long long v) {
+    return (((v & 0xF0F0F0F0F0F0F0F0ULL) |
+             (((v + 0x0606060606060606ULL) & 0xF0F0F0F0F0F0F0F0ULL) >> 4)) ==
+            0x3333333333333333ULL);
+}
+
+// SWAR: 把8个数字字符(小端序加载)转换为整数
+static unsigned long long parse_eight_digits(unsigned long long v) {
+    v -= 0x3030303030303030ULL;
+    v = (v * 10) + (v >> 8);
+    v = (((v & 0x000000FF000000FFULL) * (100 + (1000000ULL << 32))) +
+         (((v >> 16) & 0x000000FF000000FFULL) * (1 + (10000ULL << 32)))) >> 32;
+    return v;
+}
+
+// 扫描一串十进制数字并累加到*value, 返回扫描的位数
+// 长数字串按8位一组用SWAR处理; 溢出时置*overflow, 继续扫描但不再累加
+static int scan_decimal_digits(Lexer* lexer, Token* token, int* len,
+                               unsigned long long* value, bool* overflow) {
+    int count = 0;
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    while (lexer->pos + 8 <= lexer->length) {
+        unsigned long long chunk;
+        memcpy(&chunk, lexer->buffer + lexer->pos, 8);
+        if (!is_eight_digits(chunk)) break;
+        unsigned long long digits = parse_eight_digits(chunk);
+        if (*value > (MAX_U64 - digits) / 100000000ULL) {
+            *overflow = true;
+        } else if (!*overflow) {
+            *value = *value * 100000000ULL + digits;
+        }
+        if (*len + 8 <= 255) {
+            memcpy(token->lexeme + *len, lexer->buffer + lexer->pos, 8);
+            *len += 8;
+        } else {
+            for (int k = 0; k < 8; k++) push_lexeme(token, len, lexer->buffer[lexer->pos + k]);
+        }
+        advance_n(lexer, 8);
+        count += 8;
+    }
+#endif
+    while (is_digit(lexer->current_char)) {
+        unsigned int d = (unsigned int)(lexer->current_char - '0');
+        if (*value > (MAX_U64 - d) / 10) {
+            *overflow = true;
+        } else if (!*overflow) {
+            *value = *value * 10 + d;
+        }
+        push_lexeme(token, len, lexer->current_char);
+        advance(lexer);
+        count++;
+    }
+    return count;
+}
+
+// 整数后缀: u, l, ul, lu, ll, ull, llu (大小写均可, ll必须同为大写或小写)
+static bool valid_integer_suffix(const char* s) {
+    bool has_u = false;
+    int l_count = 0;
+    while (*s) {
+        if (*s == 'u' || *s == 'U') {
+            if (has_u) return false;
+            has_u = true;
+            s++;
+        } else if (*s == 'l' || *s == 'L') {
+            if (l_count) return false;
+            l_count = (s[1] == s[0]) ? 2 : 1;
+            s += l_count;
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+// 浮点后缀: f, F, l, L
+static bool valid_float_suffix(const char* s) {
+    return s[0] == '\0' ||
+           (s[1] == '\0' && (s[0] == 'f' || s[0] == 'F' || s[0] == 'l' || s[0] == 'L'));
+}
+
+// 数值常量错误
+static Token number_error(Lexer* lexer, Token* token, NumberError kind) {
+    diag_report(lexer->diag, DIAG_BAD_NUMBER, token->loc, kind, 0, token->lexeme);
+    lexer->has_error = true;
+    token->type = TOKEN_ERROR;
+    return *token;
+}
+
 // 识别数字（支持十进制、十六进制、八进制、浮点数）
 Token number(Lexer* lexer) {
     Token token;
-    token.line = lexer->line;
-    token.column = lexer->column;
+    token.loc = current_loc(lexer);
+    token.type = TOKEN_INTEGER;
     
-    char buffer[256];
     int i = 0;
+    unsigned long long value = 0;   // 整数值, 浮点数时为十进制尾数
+    bool overflow = false;
     bool is_float = false;
-    bool is_hex = false;
-    bool is_octal = false;
+    bool bad_octal = false;
+    int exponent = 0;               // 浮点数的十进制指数
     
     // 处理十六进制 0x 或 0X
     if (lexer->current_char == '0') {
-        buffer[i++] = lexer->current_char;
+        push_lexeme(&token, &i, lexer->current_char);
         advance(lexer);
         
         if (lexer->current_char == 'x' || lexer->current_char == 'X') {
-            buffer[i++] = lexer->current_char;
+            push_lexeme(&token, &i, lexer->current_char);
             advance(lexer);
-            is_hex = true;
             token.type = TOKEN_HEX;
-        } else if (isdigit(lexer->current_char)) {
-            is_octal = true;
+        } else if (is_digit(lexer->current_char)) {
             token.type = TOKEN_OCTAL;
-        } else {
-            // 只是0
-            token.type = TOKEN_INTEGER;
         }
-    } else {
-        token.type = TOKEN_INTEGER;
     }
     
-    // 收集数字
-    if (is_hex) {
+    if (token.type == TOKEN_HEX) {
         // 十六进制数字
-        while (isxdigit(lexer->current_char)) {
-            if (i < 255) buffer[i++] = lexer->current_char;
+        int digits = 0;
+        while (isxdigit((unsigned char)lexer->current_char)) {
+            char c = lexer->current_char;
+            unsigned int d = isdigit((unsigned char)c) ? (unsigned int)(c - '0')
+                                                       : (unsigned int)(tolower((unsigned char)c) - 'a' + 10);
+            if (value >> 60) overflow = true;
+            else value = (value << 4) | d;
+            push_lexeme(&token, &i, c);
+            advance(lexer);
+            digits++;
+        }
+        if (digits == 0) {
+            token.lexeme[i] = '\0';
+            return number_error(lexer, &token, NUMBER_NO_HEX_DIGITS);
+        }
+    } else if (token.type == TOKEN_OCTAL) {
+        // 八进制: 同时按十进制累加, 以便后面出现小数点时成为浮点数
+        unsigned long long octal = 0;
+        bool octal_overflow = false;
+        while (is_digit(lexer->current_char)) {
+            unsigned int d = (unsigned int)(lexer->current_char - '0');
+            if (d > 7) bad_octal = true;
+            if (octal >> 61) octal_overflow = true;
+            else octal = (octal << 3) | d;
+            if (value > (MAX_U64 - d) / 10) overflow = true;
+            else if (!overflow) value = value * 10 + d;
+            push_lexeme(&token, &i, lexer->current_char);
             advance(lexer);
         }
+        if (lexer->current_char != '.' && lexer->current_char != 'e' && lexer->current_char != 'E') {
+            value = octal;
+            overflow = octal_overflow;
+        }
     } else {
-        // 十进制或八进制
-        while (isdigit(lexer->current_char) || 
-               (lexer->current_char == '.' && !is_float)) {
-            
-            if (lexer->current_char == '.') {
-                is_float = true;
-                token.type = TOKEN_FLOAT_NUM;
-            }
-            
-            if (i < 255) buffer[i++] = lexer->current_char;
+        // 十进制整数部分
+        scan_decimal_digits(lexer, &token, &i, &value, &overflow);
+    }
+    
+    if (token.type != TOKEN_HEX) {
+        // 小数部分
+        if (lexer->current_char == '.') {
+            is_float = true;
+            push_lexeme(&token, &i, lexer->current_char);
             advance(lexer);
+            exponent -= scan_decimal_digits(lexer, &token, &i, &value, &overflow);
         }
         
         // 科学计数法
         if (lexer->current_char == 'e' || lexer->current_char == 'E') {
             is_float = true;
-            token.type = TOKEN_FLOAT_NUM;
-            if (i < 255) buffer[i++] = lexer->current_char;
+            push_lexeme(&token, &i, lexer->current_char);
             advance(lexer);
             
             // 指数符号
+            bool negative = false;
             if (lexer->current_char == '+' || lexer->current_char == '-') {
-                if (i < 255) buffer[i++] = lexer->current_char;
+                negative = lexer->current_char == '-';
+                push_lexeme(&token, &i, lexer->current_char);
                 advance(lexer);
             }
             
             // 指数数字
-            while (isdigit(lexer->current_char)) {
-                if (i < 255) buffer[i++] = lexer->current_char;
-                advance(lexer);
+            unsigned long long exp_value = 0;
+            bool exp_overflow = false;
+            if (scan_decimal_digits(lexer, &token, &i, &exp_value, &exp_overflow) == 0) {
+                token.lexeme[i] = '\0';
+                return number_error(lexer, &token, NUMBER_NO_EXPONENT_DIGITS);
             }
+            if (exp_overflow || exp_value > 100000) exp_value = 100000;
+            exponent += negative ? -(int)exp_value : (int)exp_value;
         }
+        if (is_float) token.type = TOKEN_FLOAT_NUM;
     }
     
     // 检查后缀（如L, U, F等）
-    while (isalpha(lexer->current_char)) {
-        if (i < 255) buffer[i++] = lexer->current_char;
+    char suffix[16];
+    int suffix_len = 0;
+    while (is_ident_char(lexer->current_char)) {
+        if (suffix_len < 15) suffix[suffix_len++] = lexer->current_char;
+        push_lexeme(&token, &i, lexer->current_char);
         advance(lexer);
     }
+    suffix[suffix_len] = '\0';
+    token.lexeme[i] = '\0';
     
-    buffer[i] = '\0';
-    strcpy(token.lexeme, buffer);
-    
-    // 转换数值
     if (is_float) {
-        token.value.float_val = atof(buffer);
-    } else {
-        if (is_hex) {
-            token.value.int_val = (int)strtol(buffer, NULL, 16);
-        } else if (is_octal) {
-            token.value.int_val = (int)strtol(buffer, NULL, 8);
+        if (!valid_float_suffix(suffix)) {
+            return number_error(lexer, &token, NUMBER_BAD_FLOAT_SUFFIX);
+        }
+        // 尾数不超过2^53且指数在±22以内时可以精确计算, 其余情况交给strtod
+        if (!overflow && value <= (1ULL << 53) && exponent >= -22 && exponent <= 22) {
+            double d = (double)value;
+            token.value.float_val = exponent < 0 ? d / exact_pow10[-exponent] : d * exact_pow10[exponent];
         } else {
-            token.value.int_val = atoi(buffer);
+            token.value.float_val = strtod(token.lexeme, NULL);
+        }
+        if (token.value.float_val > 1.7976931348623157e308) {
+            return number_error(lexer, &token, NUMBER_FLOAT_OUT_OF_RANGE);
         }
+    } else {
+        if (!valid_integer_suffix(suffix)) {
+            return number_error(lexer, &token, NUMBER_BAD_INT_SUFFIX);
+        }
+        if (bad_octal) {
+            return number_error(lexer, &token, NUMBER_BAD_OCTAL_DIGIT);
+        }
+        // 十进制常量无u后缀时必须能放进有符号64位, 十六进制/八进制可以用满64位
+        bool is_unsigned = strchr(suffix, 'u') || strchr(suffix, 'U');
+        if (overflow || (token.type == TOKEN_INTEGER && !is_unsigned && value > MAX_I64)) {
+            return number_error(lexer, &token, NUMBER_INT_TOO_LARGE);
+        }
+        token.value.int_val = (long long)value;
     }
     
     return token;
@@ -264,8 +516,7 @@ Token number(Lexer* lexer) {
 Token character(Lexer* lexer) {
     Token token;
     token.type = TOKEN_CHAR_CONST;
-    token.line = lexer->line;
-    token.column = lexer->column;
+    token.loc = current_loc(lexer);
     
     char buffer[256];
     int i = 0;
@@ -286,15 +537,36 @@ Token character(Lexer* lexer) {
             buffer[i++] = lexer->current_char;
             advance(lexer);
         } else {
-            fprintf(stderr, "Error at line %d: Invalid escape sequence\n", lexer->line);
+            diag_report(lexer->diag, DIAG_INVALID_ESCAPE, current_loc(lexer), 0, 0, NULL);
             lexer->has_error = true;
             token.type = TOKEN_ERROR;
+            buffer[i] = '\0';
+            strcpy(token.lexeme, buffer);
             return token;
         }
     } else if (lexer->current_char == '\'' || lexer->current_char == '\n' || lexer->current_char == EOF) {
-        fprintf(stderr, "Error at line %d: Invalid character constant\n", lexer->line);
+        diag_report(lexer->diag, DIAG_INVALID_CHAR_CONST, current_loc(lexer), 0, 0, NULL);
+        lexer->has_error = true;
+        token.type = TOKEN_ERROR;
+        buffer[i] = '\0';
+        strcpy(token.lexeme, buffer);
+        return token;
+    } else if (lexer->current_char >= 0x80) {
+        // 多字节字符放不进char, 整个字符(及结束的单引号)作为一个错误的常量跳过
+        size_t n = (size_t)utf8_sequence_length(lexer->buffer + lexer->pos, lexer->length - lexer->pos);
+        if (n == 0) n = 1;
+        memcpy(buffer + i, lexer->buffer + lexer->pos, n);
+        i += (int)n;
+        advance_n(lexer, n);
+        if (lexer->current_char == '\'') {
+            buffer[i++] = '\'';
+            advance(lexer);
+        }
+        diag_report(lexer->diag, DIAG_INVALID_CHAR_CONST, token.loc, 0, 0, NULL);
         lexer->has_error = true;
         token.type = TOKEN_ERROR;
+        buffer[i] = '\0';
+        strcpy(token.lexeme, buffer);
         return token;
     } else {
         // 普通字符
@@ -308,7 +580,7 @@ Token character(Lexer* lexer) {
     
     // 检查并跳过结束的单引号
     if (lexer->current_char != '\'') {
-        fprintf(stderr, "Error at line %d: Unclosed character constant\n", lexer->line);
+        diag_report(lexer->diag, DIAG_UNCLOSED_CHAR_CONST, current_loc(lexer), 0, 0, NULL);
         lexer->has_error = true;
         token.type = TOKEN_ERROR;
     } else {
@@ -325,8 +597,7 @@ Token character(Lexer* lexer) {
 Token string(Lexer* lexer) {
     Token token;
     token.type = TOKEN_STRING_CONST;
-    token.line = lexer->line;
-    token.column = lexer->column;
+    token.loc = current_loc(lexer);
     
     char buffer[256];
     int i = 0;
@@ -335,11 +606,27 @@ Token string(Lexer* lexer) {
     buffer[i++] = '"';
     
     advance(lexer);  // 跳过开头的双引号
+    sync_utf8(lexer);
     
     // 获取字符串内容
     while (lexer->current_char != '"' && lexer->current_char != EOF && 
            lexer->current_char != '\n') {
         
+        // 普通内容(包括多字节字符)到下一个引号、反斜杠或换行为止, 整段复制
+        if (lexer->current_char != '\\') {
+            size_t stop = find_stop(lexer, lexer->pos, '"', '\\', '\n');
+            size_t n = stop - lexer->pos;
+            if (i < 255) {
+                size_t room = (size_t)(255 - i);
+                size_t copy = n < room ? n : room;
+                memcpy(buffer + i, lexer->buffer + lexer->pos, copy);
+                i += (int)copy;
+            }
+            check_utf8(lexer, stop);
+            advance_n(lexer, n);
+            continue;
+        }
+        
         // 处理转义字符
         if (lexer->current_char == '\\') {
             if (i < 254) {
@@ -351,9 +638,11 @@ Token string(Lexer* lexer) {
                     buffer[i++] = lexer->current_char;
                     advance(lexer);
                 } else {
-                    fprintf(stderr, "Error at line %d: Invalid escape sequence in string\n", lexer->line);
+                    diag_report(lexer->diag, DIAG_INVALID_STRING_ESCAPE, current_loc(lexer), 0, 0, NULL);
                     lexer->has_error = true;
                     token.type = TOKEN_ERROR;
+                    buffer[i] = '\0';
+                    strcpy(token.lexeme, buffer);
                     return token;
                 }
             } else {
@@ -375,7 +664,7 @@ Token string(Lexer* lexer) {
     
     // 检查结束的双引号
     if (lexer->current_char != '"') {
-        fprintf(stderr, "Error at line %d: Unclosed string constant\n", lexer->line);
+        diag_report(lexer->diag, DIAG_UNCLOSED_STRING, current_loc(lexer), 0, 0, NULL);
         lexer->has_error = true;
         token.type = TOKEN_ERROR;
     } else {
@@ -388,32 +677,62 @@ Token string(Lexer* lexer) {
     return token;
 }
 
+// 注释和字符串以外的非ASCII字符: 合法的UTF-8字符整体作为一个非法字符报告,
+// 非法序列报告一次后整体跳过, 不再逐字节报错
+static Token non_ascii(Lexer* lexer, Token token) {
+    sync_utf8(lexer);
+    size_t avail = lexer->length - lexer->pos;
+    const char* p = lexer->buffer + lexer->pos;
+    size_t n;
+    if (lexer->pos == lexer->utf8_next) {
+        n = utf8_invalid_length(p, avail);
+        memcpy(token.lexeme, p, n);
+        token.lexeme[n] = '\0';
+        diag_report(lexer->diag, DIAG_INVALID_UTF8, token.loc, (unsigned char)p[0], 0, NULL);
+        lexer->utf8_next = utf8_next_invalid(lexer->buffer, lexer->pos + n, lexer->length);
+    } else {
+        n = (size_t)utf8_sequence_length(p, avail);
+        memcpy(token.lexeme, p, n);
+        token.lexeme[n] = '\0';
+        diag_report(lexer->diag, DIAG_INVALID_CHARACTER, token.loc, (unsigned char)p[0], 0, token.lexeme);
+    }
+    lexer->has_error = true;
+    token.type = TOKEN_ERROR;
+    advance_n(lexer, n);
+    return token;
+}
+
 // 词法分析函数
-Token get_token(Lexer* lexer) {
+static Token scan_token(Lexer* lexer) {
     Token token;
     
-    // 跳过空白符
-    skip_whitespace(lexer);
-    
-    // 处理注释
-    while (lexer->current_char == '/') {
-        char next = peek(lexer);
-        if (next == '/') {
-            // 单行注释
-            skip_single_line_comment(lexer);
-            skip_whitespace(lexer);
-        } else if (next == '*') {
-            // 多行注释
-            skip_multi_line_comment(lexer);
-            skip_whitespace(lexer);
-        } else {
-            break;
+    // 跳过空白符、注释和换行符; 换行符在循环中跳过而不是递归, 连续多少空行栈深度都不变
+    for (;;) {
+        skip_whitespace(lexer);
+        
+        // 处理注释
+        while (lexer->current_char == '/') {
+            int next = peek(lexer);
+            if (next == '/') {
+                // 单行注释
+                skip_single_line_comment(lexer);
+                skip_whitespace(lexer);
+            } else if (next == '*') {
+                // 多行注释
+                skip_multi_line_comment(lexer);
+                skip_whitespace(lexer);
+            } else {
+                break;
+            }
         }
+        
+        if (lexer->current_char != '\n') break;
+        advance(lexer);
     }
     
     // 设置基本属性
-    token.line = lexer->line;
-    token.column = lexer->column;
+    lexer->token_start = lexer->pos;
+    token.loc = current_loc(lexer);
     
     // 处理文件结束
     if (lexer->current_char == EOF) {
@@ -422,19 +741,13 @@ Token get_token(Lexer* lexer) {
         return token;
     }
     
-    // 处理换行符
-    if (lexer->current_char == '\n') {
-        advance(lexer);
-        return get_token(lexer);  // 递归获取下一个token
-    }
-    
     // 标识符：字母或下划线开头
-    if (isalpha(lexer->current_char) || lexer->current_char == '_') {
+    if (is_ident_start(lexer->current_char)) {
         return identifier(lexer);
     }
     
     // 数字
-    if (isdigit(lexer->current_char)) {
+    if (is_digit(lexer->current_char)) {
         return number(lexer);
     }
     
@@ -448,8 +761,13 @@ Token get_token(Lexer* lexer) {
         return string(lexer);
     }
     
+    // 非ASCII字符不能出现在注释和字符串以外
+    if (lexer->current_char >= 0x80) {
+        return non_ascii(lexer, token);
+    }
+    
     // 处理特殊符号
-    char current = lexer->current_char;
+    char current = (char)lexer->current_char;
     advance(lexer);
     
     // 检查双字符运算符
@@ -470,6 +788,10 @@ Token get_token(Lexer* lexer) {
             token.type = TOKEN_DIVIDE;
             strcpy(token.lexeme, "/");
             break;
+        case '%':
+            token.type = TOKEN_MOD;
+            strcpy(token.lexeme, "%");
+            break;
         case '=':
             if (lexer->current_char == '=') {
                 token.type = TOKEN_EQ;
@@ -506,7 +828,7 @@ Token get_token(Lexer* lexer) {
                 strcpy(token.lexeme, "!=");
                 advance(lexer);
             } else {
-                fprintf(stderr, "Error at line %d: Invalid operator '!'\n", token.line);
+                diag_report(lexer->diag, DIAG_INVALID_OPERATOR, token.loc, '!', 0, NULL);
                 lexer->has_error = true;
                 token.type = TOKEN_ERROR;
                 strcpy(token.lexeme, "!");
@@ -518,7 +840,7 @@ Token get_token(Lexer* lexer) {
                 strcpy(token.lexeme, "&&");
                 advance(lexer);
             } else {
-                fprintf(stderr, "Error at line %d: Invalid operator '&'\n", token.line);
+                diag_report(lexer->diag, DIAG_INVALID_OPERATOR, token.loc, '&', 0, NULL);
                 lexer->has_error = true;
                 token.type = TOKEN_ERROR;
                 strcpy(token.lexeme, "&");
@@ -530,7 +852,7 @@ Token get_token(Lexer* lexer) {
                 strcpy(token.lexeme, "||");
                 advance(lexer);
             } else {
-                fprintf(stderr, "Error at line %d: Invalid operator '|'\n", token.line);
+                diag_report(lexer->diag, DIAG_INVALID_OPERATOR, token.loc, '|', 0, NULL);
                 lexer->has_error = true;
                 token.type = TOKEN_ERROR;
                 strcpy(token.lexeme, "|");
@@ -576,23 +898,133 @@ Token get_token(Lexer* lexer) {
             token.type = TOKEN_COLON;
             strcpy(token.lexeme, ":");
             break;
+        case '#':
+            token.type = TOKEN_HASH;
+            strcpy(token.lexeme, "#");
+            break;
         default:
-            fprintf(stderr, "Error at line %d, column %d: Invalid character '%c'\n", 
-                    token.line, token.column, current);
+            diag_report(lexer->diag, DIAG_INVALID_CHARACTER, token.loc, current, 0, NULL);
             lexer->has_error = true;
             token.type = TOKEN_ERROR;
-            strcpy(token.lexeme, &current);
+            token.lexeme[0] = current;
             token.lexeme[1] = '\0';
     }
     
     return token;
 }
 
+// 超出上限之后代替剩余内容的EOF
+static Token limit_eof(const Lexer* lexer) {
+    Token token;
+    memset(&token, 0, sizeof(token));
+    token.type = TOKEN_EOF;
+    strcpy(token.lexeme, "EOF");
+    token.loc = lexer->limit_loc;
+    return token;
+}
+
+// 推送式输入: token之后不足PUSHSRC_LOOKAHEAD个字节时, 扫描结果可能受还没到达的内容影响(标识符、数字可能
+// 还会变长, 注释可能还没结束), 作废重来: 撤销这次扫描的诊断, 暂停到内容至少再增加这次扫描过的长度;
+// 按扫描过的长度加倍等待, 很长的token(注释、字符串)被重复扫描的总量仍与长度成正比
+static Token scan_pushed(Lexer* lexer) {
+    for (;;) {
+        size_t begin = lexer->pos;
+        bool had_error = lexer->has_error;
+        DiagMark mark;
+        diag_mark(lexer->diag, &mark);
+        Token token = scan_token(lexer);
+        token.length = (unsigned int)(lexer->pos - lexer->token_start);
+        if (lexer->pos + PUSHSRC_LOOKAHEAD <= lexer->length || pushsrc_complete(lexer->push)) return token;
+
+        diag_rollback(lexer->diag, &mark);
+        lexer->has_error = had_error;
+        size_t scanned = lexer->length - begin;
+        pushsrc_wait(lexer->push, lexer->length + (scanned > PUSHSRC_LOOKAHEAD ? scanned : PUSHSRC_LOOKAHEAD));
+
+        // 内容变长了, 缓冲区也可能换了位置; 开头的BOM可能刚刚到齐
+        const SourceFile* file = srcmgr_file(srcmgr_default(), lexer->file_id);
+        lexer->buffer = file->buffer;
+        lexer->length = file->length;
+        lexer->utf8_error = file->utf8_error;
+        if (begin < file->start) {
+            begin = lexer->start = file->start;
+            lexer->limit_loc = lexer->base + (SourceLoc)lexer->start;
+        }
+        seek_lexer(lexer, begin);
+        // seek_lexer只在位置变化时重新查找, 这里位置没变而内容变了
+        if (begin > lexer->utf8_error) lexer->utf8_next = utf8_next_invalid(lexer->buffer, begin, lexer->length);
+        if (lexer->limits && lexer->limits->max_bytes && lexer->length > lexer->limits->max_bytes) {
+            lexer->limit_hit = LIMIT_BYTES;
+            budget_report(lexer->diag, lexer->limits, LIMIT_BYTES, lexer->limit_loc);
+            return limit_eof(lexer);
+        }
+    }
+}
+
+// 扫描下一个token并记下它在源文件中的位置
+static Token fetch_token(Lexer* lexer) {
+    if (lexer->pipe) {
+        // 流水线模式: 按顺序取出词法线程扫描好的token
+        Token token;
+        tokpipe_next(lexer->pipe, lexer, &token);
+        return token;
+    }
+    if (lexer->pp) {
+        // 预处理器从内部的分析器取token, 处理指令并展开宏
+        return preproc_next(lexer->pp);
+    }
+    if (tokcache_replaying(lexer->cache)) {
+        return tokcache_next(lexer->cache, lexer);
+    }
+    
+    Token token;
+    if (lexer->parallel) {
+        // 并行分析的结果已经拼接好, 按顺序取出
+        parlex_next(lexer->parallel, lexer, &token);
+    } else if (lexer->push) {
+        token = scan_pushed(lexer);
+    } else {
+        token = scan_token(lexer);
+        token.length = (unsigned int)(lexer->pos - lexer->token_start);
+    }
+    if (lexer->cache) tokcache_record(lexer->cache, lexer, &token);
+    return token;
+}
+
+// 计入刚取出的token, 超出token数或时间预算时记下并报告
+static bool within_limits(Lexer* lexer, SourceLoc loc) {
+    const ParseLimits* limits = lexer->limits;
+    lexer->token_count++;
+    if (limits->max_tokens && lexer->token_count > limits->max_tokens) {
+        lexer->limit_hit = LIMIT_TOKENS;
+    } else if (lexer->deadline > 0) {
+        // 读时钟比扫描一个token还慢, 每隔若干个token才看一次
+        size_t interval = limits->check_interval > 0 ? (size_t)limits->check_interval : BUDGET_CHECK_INTERVAL;
+        if (lexer->token_count % interval == 0 && budget_now_ms() > lexer->deadline) {
+            lexer->limit_hit = LIMIT_DEADLINE;
+        }
+    }
+    if (lexer->limit_hit == LIMIT_NONE) return true;
+    lexer->limit_loc = loc;
+    budget_report(lexer->diag, limits, lexer->limit_hit, loc);
+    return false;
+}
+
+// 对应实验要求的GetToken()
+// 设置了资源上限时, 超出后不再扫描, 一直返回EOF
+Token get_token(Lexer* lexer) {
+    if (!lexer->limits) return fetch_token(lexer);
+    if (lexer->limit_hit != LIMIT_NONE) return limit_eof(lexer);
+    Token token = fetch_token(lexer);
+    if (token.type != TOKEN_EOF && !within_limits(lexer, token.loc)) return limit_eof(lexer);
+    return token;
+}
+
 // 查找保留字
 TokenType lookup_keyword(const char* lexeme) {
-    for (int i = 0; keywords[i].word != NULL; i++) {
-        if (strcmp(keywords[i].word, lexeme) == 0) {
-            return keywords[i].type;
+    for (int i = 0; i < LEXTAB_KEYWORD_COUNT; i++) {
+        if (strcmp(lextab_keywords[i].word, lexeme) == 0) {
+            return lextab_keywords[i].type;
         }
     }
     return TOKEN_IDENTIFIER;
@@ -600,70 +1032,6 @@ TokenType lookup_keyword(const char* lexeme) {
 
 // Token类型转字符串
 const char* token_type_to_str(TokenType type) {
-    switch (type) {
-        // 保留字
-        case TOKEN_IF: return "IF";
-        case TOKEN_ELSE: return "ELSE";
-        case TOKEN_WHILE: return "WHILE";
-        case TOKEN_DO: return "DO";
-        case TOKEN_MAIN: return "MAIN";
-        case TOKEN_INT: return "INT";
-        case TOKEN_FLOAT: return "FLOAT";
-        case TOKEN_DOUBLE: return "DOUBLE";
-        case TOKEN_RETURN: return "RETURN";
-        case TOKEN_CONST: return "CONST";
-        case TOKEN_VOID: return "VOID";
-        case TOKEN_CONTINUE: return "CONTINUE";
-        case TOKEN_BREAK: return "BREAK";
-        case TOKEN_CHAR: return "CHAR";
-        case TOKEN_UNSIGNED: return "UNSIGNED";
-        case TOKEN_ENUM: return "ENUM";
-        case TOKEN_LONG: return "LONG";
-        case TOKEN_SWITCH: return "SWITCH";
-        case TOKEN_CASE: return "CASE";
-        case TOKEN_AUTO: return "AUTO";
-        case TOKEN_STATIC: return "STATIC";
-        
-        // 特殊符号
-        case TOKEN_PLUS: return "PLUS";
-        case TOKEN_MINUS: return "MINUS";
-        case TOKEN_MULTIPLY: return "MULTIPLY";
-        case TOKEN_DIVIDE: return "DIVIDE";
-        case TOKEN_ASSIGN: return "ASSIGN";
-        case TOKEN_LT: return "LT";
-        case TOKEN_GT: return "GT";
-        case TOKEN_LE: return "LE";
-        case TOKEN_GE: return "GE";
-        case TOKEN_EQ: return "EQ";
-        case TOKEN_NE: return "NE";
-        case TOKEN_AND: return "AND";
-        case TOKEN_OR: return "OR";
-        case TOKEN_LBRACE: return "LBRACE";
-        case TOKEN_RBRACE: return "RBRACE";
-        case TOKEN_LPAREN: return "LPAREN";
-        case TOKEN_RPAREN: return "RPAREN";
-        case TOKEN_LBRACKET: return "LBRACKET";
-        case TOKEN_RBRACKET: return "RBRACKET";
-        case TOKEN_SEMICOLON: return "SEMICOLON";
-        case TOKEN_COMMA: return "COMMA";
-        case TOKEN_QUOTE: return "QUOTE";
-        case TOKEN_DQUOTE: return "DQUOTE";
-        case TOKEN_DOT: return "DOT";
-        case TOKEN_COLON: return "COLON";
-        
-        // 其他
-        case TOKEN_IDENTIFIER: return "IDENTIFIER";
-        case TOKEN_INTEGER: return "INTEGER";
-        case TOKEN_FLOAT_NUM: return "FLOAT_NUM";
-        case TOKEN_HEX: return "HEX";
-        case TOKEN_OCTAL: return "OCTAL";
-        case TOKEN_CHAR_CONST: return "CHAR_CONST";
-        case TOKEN_STRING_CONST: return "STRING_CONST";
-        
-        // 特殊
-        case TOKEN_EOF: return "EOF";
-        case TOKEN_ERROR: return "ERROR";
-        
-        default: return "UNKNOWN";
-    }
+    if ((int)type < 0 || (int)type >= LEXTAB_TOKEN_COUNT) return "UNKNOWN";
+    return lextab_names[type];
 }
\ No newline at end of file
@@ -6,58 +6,62 @@
 #include <string.h>
 #include <ctype.h>
 #include <stdbool.h>
+#include "srcmgr.h"
+#include "diag.h"
+#include "budget.h"
 
-// Token类型枚举
-typedef enum {
-    // 保留字
-    TOKEN_IF, TOKEN_ELSE, TOKEN_WHILE, TOKEN_DO, TOKEN_MAIN,
-    TOKEN_INT, TOKEN_FLOAT, TOKEN_DOUBLE, TOKEN_RETURN,
-    TOKEN_CONST, TOKEN_VOID, TOKEN_CONTINUE, TOKEN_BREAK,
-    TOKEN_CHAR, TOKEN_UNSIGNED, TOKEN_ENUM, TOKEN_LONG,
-    TOKEN_SWITCH, TOKEN_CASE, TOKEN_AUTO, TOKEN_STATIC,
-    
-    // 特殊符号
-    TOKEN_PLUS, TOKEN_MINUS, TOKEN_MULTIPLY, TOKEN_DIVIDE,
-    TOKEN_ASSIGN, TOKEN_LT, TOKEN_GT, TOKEN_LE, TOKEN_GE,
-    TOKEN_EQ, TOKEN_NE, TOKEN_AND, TOKEN_OR,
-    TOKEN_LBRACE, TOKEN_RBRACE, TOKEN_LPAREN, TOKEN_RPAREN,
-    TOKEN_SEMICOLON, TOKEN_COMMA, TOKEN_QUOTE, TOKEN_DQUOTE,
-    TOKEN_LBRACKET, TOKEN_RBRACKET, TOKEN_DOT, TOKEN_COLON,
-    
-    // 其他
-    TOKEN_IDENTIFIER,
-    TOKEN_INTEGER, TOKEN_FLOAT_NUM, TOKEN_HEX, TOKEN_OCTAL,
-    TOKEN_CHAR_CONST, TOKEN_STRING_CONST,
-    
-    // 特殊
-    TOKEN_EOF, TOKEN_ERROR
-} TokenType;
+// Token类型枚举、保留字表和类型名由 lexgen 根据 tokens.spec 生成
+#include "lextab.h"
+
+// 词法规则版本号, 修改扫描规则后需要加一, 使磁盘token缓存失效
+#define LEXER_VERSION 5
 
 // Token结构体
 typedef struct {
     TokenType type;
     char lexeme[256];     // 词素
-    int line;             // 所在行号
-    int column;           // 所在列号
+    SourceLoc loc;        // 起始位置(文件+偏移), 行号列号用source_line/source_column换算
+    unsigned int length;  // 在源文件中占的字节数
     union {
-        int int_val;      // 整数值
-        float float_val;  // 浮点数值
-        char char_val;    // 字符值
+        long long int_val;  // 整数值(64位, 十六进制/八进制按位存放无符号值)
+        double float_val;   // 浮点数值
+        char char_val;      // 字符值
     } value;
 } Token;
 
 // 词法分析器状态
 typedef struct {
-    FILE* source;         // 源文件指针
-    char current_char;    // 当前字符
-    int line;             // 当前行
-    int column;           // 当前列
+    char* buffer;         // 源文件内容, 由源文件管理器持有
+    size_t length;        // 内容长度
+    size_t pos;           // 当前字符在buffer中的下标
+    size_t start;         // 内容起点(跳过BOM之后)
+    size_t token_start;   // 正在扫描的token的起始下标
+    int file_id;          // 在源文件管理器中的编号
+    SourceLoc base;       // 文件在位置空间中的起点
+    struct TokenCache* cache;  // 磁盘token缓存, 未启用时为NULL
+    struct ParallelLex* parallel;  // 并行分析的结果, 未启用时为NULL
+    struct Preprocessor* pp;  // 预处理器, 未启用时为NULL
+    struct TokenPipe* pipe;  // 流水线模式下扫描token的线程, 未启用时为NULL
+    struct PushSource* push;  // 推送式输入(parser_feed), 内容还没有全部到达时暂停分析, 未启用时为NULL
+    DiagEngine* diag;     // 诊断收集器, 默认为diag_default()
+    size_t utf8_error;    // 文件中第一个非法UTF-8序列的下标, 全部合法时等于length
+    size_t utf8_next;     // pos之后下一个非法UTF-8序列的下标
+    int current_char;     // 当前字节(0~255), 到达末尾时为EOF
     bool has_error;       // 是否有错误
+    const ParseLimits* limits;  // 资源上限, NULL表示不限制
+    size_t token_count;   // 有上限时已取出的token数
+    double deadline;      // 截止时刻(budget_now_ms), 0表示没有时间预算
+    LimitKind limit_hit;  // 超出的上限, 之后get_token()只返回EOF
+    SourceLoc limit_loc;  // 超出上限的位置
 } Lexer;
 
 // 函数声明
 Lexer* init_lexer(const char* filename);
+Lexer* init_lexer_source(int file_id);  // 分析源文件管理器中的第file_id个文件
+void reset_lexer(Lexer* lexer);  // 回到文件开头重新分析
+void seek_lexer(Lexer* lexer, size_t pos);  // 从pos处(必须在token边界上)继续分析
 void free_lexer(Lexer* lexer);
+void lexer_set_limits(Lexer* lexer, const ParseLimits* limits);  // 设置资源上限(NULL取消), 时间预算从此刻算起
 Token get_token(Lexer* lexer);  // 对应实验要求的GetToken()
 const char* token_type_to_str(TokenType type);
 const char* token_type_to_code(TokenType type);  // 返回类型编码
@@ -0,0 +1,848 @@
+// 词法分析器生成器: 读入token说明文件, 生成 lextab.h / lextab.c
+// 正规式 -> NFA(Thompson构造) -> DFA(子集构造) -> 最小化(Moore划分细化) -> C转移表
+// 编译：gcc lexgen.c -o lexgen
+// 运行：./lexgen tokens.spec lextab
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#define MAX_NAME 64
+#define MAX_DEFS 128
+#define MAX_TOKENS 256
+#define MAX_RULES 512
+
+// ==================== 说明文件 ====================
+
+typedef struct {
+    char name[MAX_NAME];
+    char* regex;
+    int line;
+} Definition;
+
+typedef struct {
+    char name[MAX_NAME];
+    char word[MAX_NAME];        // 保留字的拼写, 非保留字为空
+} TokenDecl;
+
+#define ACTION_NONE (-1)
+#define ACTION_SKIP (-2)
+
+typedef struct {
+    char* regex;
+    int action;                 // token下标或ACTION_SKIP
+    int line;
+} Rule;
+
+static Definition defs[MAX_DEFS];
+static int def_count = 0;
+static TokenDecl tokens[MAX_TOKENS];
+static int token_count = 0;
+static int keyword_count = 0;
+static Rule rules[MAX_RULES];
+static int rule_count = 0;
+
+static void fail(int line, const char* message, const char* detail) {
+    fprintf(stderr, "Error at line %d: %s%s%s\n", line, message, detail ? ": " : "", detail ? detail : "");
+    exit(1);
+}
+
+static char* dup_string(const char* s) {
+    char* p = (char*)malloc(strlen(s) + 1);
+    if (!p) fail(0, "Memory allocation error", NULL);
+    strcpy(p, s);
+    return p;
+}
+
+static void* xrealloc(void* p, size_t size) {
+    p = realloc(p, size);
+    if (!p) fail(0, "Memory allocation error", NULL);
+    return p;
+}
+
+// 读出一个空白分隔的单词, 返回单词之后的位置
+static char* next_word(char* s, char* out, int line) {
+    while (*s == ' ' || *s == '\t') s++;
+    int n = 0;
+    while (*s && *s != ' ' && *s != '\t') {
+        if (n + 1 >= MAX_NAME) fail(line, "Name is too long", NULL);
+        out[n++] = *s++;
+    }
+    out[n] = '\0';
+    while (*s == ' ' || *s == '\t') s++;
+    return s;
+}
+
+static int find_token(const char* name) {
+    for (int i = 0; i < token_count; i++) {
+        if (strcmp(tokens[i].name, name) == 0) return i;
+    }
+    return -1;
+}
+
+static void add_rule(char* regex, int action, int line) {
+    if (rule_count >= MAX_RULES) fail(line, "Too many rules", NULL);
+    rules[rule_count].regex = dup_string(regex);
+    rules[rule_count].action = action;
+    rules[rule_count].line = line;
+    rule_count++;
+}
+
+static void add_token(const char* name, const char* word, int line) {
+    if (token_count >= MAX_TOKENS) fail(line, "Too many tokens", NULL);
+    if (find_token(name) >= 0) fail(line, "Duplicate token", name);
+    strcpy(tokens[token_count].name, name);
+    strcpy(tokens[token_count].word, word);
+    token_count++;
+}
+
+static void read_spec(const char* filename) {
+    FILE* f = fopen(filename, "r");
+    if (!f) {
+        fprintf(stderr, "Cannot open file: %s\n", filename);
+        exit(1);
+    }
+    char buf[4096];
+    int line = 0;
+    while (fgets(buf, sizeof(buf), f)) {
+        line++;
+        size_t len = strlen(buf);
+        while (len > 0 && (buf[len - 1] == '\n' || buf[len - 1] == '\r' || buf[len - 1] == ' ' || buf[len - 1] == '\t')) {
+            buf[--len] = '\0';
+        }
+        char* s = buf;
+        while (*s == ' ' || *s == '\t') s++;
+        if (*s == '\0' || *s == '#') continue;
+
+        char directive[MAX_NAME], name[MAX_NAME], word[MAX_NAME];
+        s = next_word(s, directive, line);
+        if (strcmp(directive, "%define") == 0) {
+            s = next_word(s, name, line);
+            if (!*name || !*s) fail(line, "Expected a name and a regular expression", NULL);
+            if (def_count >= MAX_DEFS) fail(line, "Too many definitions", NULL);
+            strcpy(defs[def_count].name, name);
+            defs[def_count].regex = dup_string(s);
+            defs[def_count].line = line;
+            def_count++;
+        } else if (strcmp(directive, "%keyword") == 0) {
+            s = next_word(s, name, line);
+            s = next_word(s, word, line);
+            if (!*name || !*word) fail(line, "Expected a token name and a word", NULL);
+            if (keyword_count != token_count) fail(line, "Keywords must be declared before other tokens", name);
+            add_token(name, word, line);
+            keyword_count++;
+            // 保留字按字面量匹配, 先于标识符声明所以优先
+            char literal[MAX_NAME + 2];
+            snprintf(literal, sizeof(literal), "\"%s\"", word);
+            add_rule(literal, token_count - 1, line);
+        } else if (strcmp(directive, "%token") == 0) {
+            s = next_word(s, name, line);
+            if (!*name) fail(line, "Expected a token name", NULL);
+            add_token(name, "", line);
+            if (*s) add_rule(s, token_count - 1, line);
+        } else if (strcmp(directive, "%skip") == 0) {
+            if (!*s) fail(line, "Expected a regular expression", NULL);
+            add_rule(s, ACTION_SKIP, line);
+        } else {
+            fail(line, "Unknown directive", directive);
+        }
+    }
+    fclose(f);
+    if (find_token("EOF") < 0 || find_token("ERROR") < 0) {
+        fail(line, "The spec must declare EOF and ERROR tokens", NULL);
+    }
+}
+
+// ==================== NFA ====================
+
+typedef struct {
+    uint8_t bits[32];
+} CharSet;
+
+typedef struct {
+    int set;                    // 字符集下标, -1表示ε转移
+    int out1;
+    int out2;                   // 只有ε转移使用
+    int accept;                 // 规则下标, -1表示非接受状态
+} NfaState;
+
+static NfaState* nfa = NULL;
+static int nfa_count = 0;
+static int nfa_cap = 0;
+static CharSet* sets = NULL;
+static int set_count = 0;
+static int set_cap = 0;
+
+static int new_state(void) {
+    if (nfa_count == nfa_cap) {
+        nfa_cap = nfa_cap ? nfa_cap * 2 : 1024;
+        nfa = (NfaState*)xrealloc(nfa, (size_t)nfa_cap * sizeof(NfaState));
+    }
+    NfaState* s = &nfa[nfa_count];
+    s->set = -1;
+    s->out1 = -1;
+    s->out2 = -1;
+    s->accept = -1;
+    return nfa_count++;
+}
+
+// 相同的字符集只保存一份, 字符分类时可以少比较
+static int intern_set(const CharSet* cs) {
+    for (int i = 0; i < set_count; i++) {
+        if (memcmp(&sets[i], cs, sizeof(CharSet)) == 0) return i;
+    }
+    if (set_count == set_cap) {
+        set_cap = set_cap ? set_cap * 2 : 64;
+        sets = (CharSet*)xrealloc(sets, (size_t)set_cap * sizeof(CharSet));
+    }
+    sets[set_count] = *cs;
+    return set_count++;
+}
+
+static void set_add(CharSet* cs, int c) {
+    cs->bits[c >> 3] |= (uint8_t)(1u << (c & 7));
+}
+
+static bool set_has(const CharSet* cs, int c) {
+    return (cs->bits[c >> 3] >> (c & 7)) & 1;
+}
+
+// NFA片段: start为入口, end为唯一出口(尚未连接)
+typedef struct {
+    int start;
+    int end;
+} Frag;
+
+static Frag frag_set(const CharSet* cs) {
+    Frag f;
+    f.start = new_state();
+    f.end = new_state();
+    nfa[f.start].set = intern_set(cs);
+    nfa[f.start].out1 = f.end;
+    return f;
+}
+
+static Frag frag_empty(void) {
+    Frag f;
+    f.start = f.end = new_state();
+    return f;
+}
+
+static Frag frag_concat(Frag a, Frag b) {
+    nfa[a.end].out1 = b.start;
+    Frag f = { a.start, b.end };
+    return f;
+}
+
+static Frag frag_alt(Frag a, Frag b) {
+    Frag f;
+    f.start = new_state();
+    f.end = new_state();
+    nfa[f.start].out1 = a.start;
+    nfa[f.start].out2 = b.start;
+    nfa[a.end].out1 = f.end;
+    nfa[b.end].out1 = f.end;
+    return f;
+}
+
+// kind: '*' '+' '?'
+static Frag frag_repeat(Frag a, char kind) {
+    Frag f;
+    f.start = new_state();
+    f.end = new_state();
+    nfa[f.start].out1 = a.start;
+    if (kind != '+') nfa[f.start].out2 = f.end;
+    nfa[a.end].out1 = f.end;
+    if (kind != '?') nfa[a.end].out2 = a.start;
+    return f;
+}
+
+// ==================== 正规式解析 ====================
+
+typedef struct {
+    const char* p;
+    int line;
+    int depth;                  // 定义引用的嵌套深度, 防止循环引用
+} RegexParser;
+
+static Frag parse_alt(RegexParser* rp);
+
+static void skip_spaces(RegexParser* rp) {
+    while (*rp->p == ' ' || *rp->p == '\t') rp->p++;
+}
+
+static int hex_value(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// 读一个(可能带转义的)字符
+static int read_char(RegexParser* rp) {
+    char c = *rp->p++;
+    if (c == '\0') fail(rp->line, "Unexpected end of regular expression", NULL);
+    if (c != '\\') return (unsigned char)c;
+    c = *rp->p++;
+    switch (c) {
+        case 'n': return '\n';
+        case 't': return '\t';
+        case 'r': return '\r';
+        case '0': return '\0';
+        case 'x': {
+            int hi = hex_value(rp->p[0]);
+            int lo = hi >= 0 ? hex_value(rp->p[1]) : -1;
+            if (lo < 0) fail(rp->line, "Invalid \\x escape", NULL);
+            rp->p += 2;
+            return hi * 16 + lo;
+        }
+        case '\0': fail(rp->line, "Unexpected end of regular expression", NULL); return 0;
+        default: return (unsigned char)c;
+    }
+}
+
+static Frag parse_class(RegexParser* rp) {
+    CharSet cs;
+    memset(&cs, 0, sizeof(cs));
+    bool negate = false;
+    if (*rp->p == '^') {
+        negate = true;
+        rp->p++;
+    }
+    bool first = true;
+    while (*rp->p != ']' || first) {
+        if (*rp->p == '\0') fail(rp->line, "Unterminated character class", NULL);
+        first = false;
+        int lo = read_char(rp);
+        int hi = lo;
+        if (rp->p[0] == '-' && rp->p[1] != ']' && rp->p[1] != '\0') {
+            rp->p++;
+            hi = read_char(rp);
+            if (hi < lo) fail(rp->line, "Invalid range in character class", NULL);
+        }
+        for (int c = lo; c <= hi; c++) set_add(&cs, c);
+    }
+    rp->p++;  // ]
+    if (negate) {
+        for (int i = 0; i < 32; i++) cs.bits[i] = (uint8_t)~cs.bits[i];
+    }
+    return frag_set(&cs);
+}
+
+static Frag parse_string(RegexParser* rp) {
+    Frag f = frag_empty();
+    while (*rp->p != '"') {
+        if (*rp->p == '\0') fail(rp->line, "Unterminated string in regular expression", NULL);
+        CharSet cs;
+        memset(&cs, 0, sizeof(cs));
+        set_add(&cs, read_char(rp));
+        f = frag_concat(f, frag_set(&cs));
+    }
+    rp->p++;  // "
+    return f;
+}
+
+static Frag parse_reference(RegexParser* rp) {
+    char name[MAX_NAME];
+    int n = 0;
+    while (*rp->p && *rp->p != '}') {
+        if (n + 1 >= MAX_NAME) fail(rp->line, "Name is too long", NULL);
+        name[n++] = *rp->p++;
+    }
+    name[n] = '\0';
+    if (*rp->p != '}') fail(rp->line, "Unterminated definition reference", name);
+    rp->p++;
+    for (int i = 0; i < def_count; i++) {
+        if (strcmp(defs[i].name, name) == 0) {
+            if (rp->depth > 32) fail(rp->line, "Definitions are nested too deeply", name);
+            // 每次引用都重新解析, 得到独立的NFA片段
+            RegexParser sub = { defs[i].regex, defs[i].line, rp->depth + 1 };
+            Frag f = parse_alt(&sub);
+            skip_spaces(&sub);
+            if (*sub.p) fail(sub.line, "Unexpected character in regular expression", sub.p);
+            return f;
+        }
+    }
+    fail(rp->line, "Undefined name", name);
+    return frag_empty();
+}
+
+static Frag parse_atom(RegexParser* rp) {
+    char c = *rp->p;
+    if (c == '(') {
+        rp->p++;
+        Frag f = parse_alt(rp);
+        skip_spaces(rp);
+        if (*rp->p != ')') fail(rp->line, "Expected ')'", NULL);
+        rp->p++;
+        return f;
+    }
+    if (c == '[') {
+        rp->p++;
+        return parse_class(rp);
+    }
+    if (c == '"') {
+        rp->p++;
+        return parse_string(rp);
+    }
+    if (c == '{') {
+        rp->p++;
+        return parse_reference(rp);
+    }
+    CharSet cs;
+    memset(&cs, 0, sizeof(cs));
+    if (c == '.') {
+        rp->p++;
+        for (int i = 0; i < 256; i++) {
+            if (i != '\n') set_add(&cs, i);
+        }
+    } else {
+        set_add(&cs, read_char(rp));
+    }
+    return frag_set(&cs);
+}
+
+static Frag parse_repeat(RegexParser* rp) {
+    Frag f = parse_atom(rp);
+    skip_spaces(rp);
+    while (*rp->p == '*' || *rp->p == '+' || *rp->p == '?') {
+        f = frag_repeat(f, *rp->p++);
+        skip_spaces(rp);
+    }
+    return f;
+}
+
+static Frag parse_concat(RegexParser* rp) {
+    skip_spaces(rp);
+    if (*rp->p == '\0' || *rp->p == '|' || *rp->p == ')') return frag_empty();
+    Frag f = parse_repeat(rp);
+    skip_spaces(rp);
+    while (*rp->p && *rp->p != '|' && *rp->p != ')') {
+        f = frag_concat(f, parse_repeat(rp));
+        skip_spaces(rp);
+    }
+    return f;
+}
+
+static Frag parse_alt(RegexParser* rp) {
+    Frag f = parse_concat(rp);
+    while (*rp->p == '|') {
+        rp->p++;
+        f = frag_alt(f, parse_concat(rp));
+    }
+    return f;
+}
+
+// 所有规则并联: 起始状态经ε转移到每条规则的入口
+static int build_nfa(void) {
+    int start = new_state();
+    int prev = start;
+    for (int i = 0; i < rule_count; i++) {
+        RegexParser rp = { rules[i].regex, rules[i].line, 0 };
+        Frag f = parse_alt(&rp);
+        skip_spaces(&rp);
+        if (*rp.p) fail(rules[i].line, "Unexpected character in regular expression", rp.p);
+        nfa[f.end].accept = i;
+        // ε转移最多两个, 用链把各规则串起来
+        int link = new_state();
+        nfa[prev].out1 = link;
+        nfa[link].out1 = f.start;
+        prev = link;
+        if (i + 1 == rule_count) break;
+        int next = new_state();
+        nfa[link].out2 = next;
+        prev = next;
+    }
+    return start;
+}
+
+// ==================== 字符分类 ====================
+
+// 对所有字符集都不可区分的字符归为一类, DFA按类而不是按字节建表
+static int char_class[256];
+static int class_count = 0;
+
+static void compute_classes(void) {
+    int rep[256];
+    for (int c = 0; c < 256; c++) {
+        int k;
+        for (k = 0; k < class_count; k++) {
+            bool same = true;
+            for (int s = 0; s < set_count && same; s++) {
+                same = set_has(&sets[s], c) == set_has(&sets[s], rep[k]);
+            }
+            if (same) break;
+        }
+        if (k == class_count) rep[class_count++] = c;
+        char_class[c] = k;
+    }
+}
+
+// ==================== 子集构造 ====================
+
+typedef struct {
+    int* members;               // 排好序的NFA状态
+    int count;
+    int action;
+} DfaState;
+
+static DfaState* dfa = NULL;
+static int dfa_count = 0;
+static int dfa_cap = 0;
+static int* dfa_next = NULL;    // dfa_count * class_count, -1表示无转移
+static int* hash_table = NULL;
+static int hash_cap = 0;
+
+static uint32_t hash_members(const int* m, int n) {
+    uint32_t h = 2166136261u;
+    for (int i = 0; i < n; i++) {
+        h ^= (uint32_t)m[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static int cmp_int(const void* a, const void* b) {
+    int x = *(const int*)a, y = *(const int*)b;
+    return (x > y) - (x < y);
+}
+
+// ε闭包, 结果排序后写回list
+static int closure(int* list, int n, bool* mark, int* stack) {
+    int top = 0;
+    for (int i = 0; i < n; i++) {
+        if (!mark[list[i]]) {
+            mark[list[i]] = true;
+            stack[top++] = list[i];
+        }
+    }
+    n = 0;
+    while (top > 0) {
+        int s = stack[--top];
+        list[n++] = s;
+        if (nfa[s].set >= 0) continue;
+        int outs[2] = { nfa[s].out1, nfa[s].out2 };
+        for (int k = 0; k < 2; k++) {
+            if (outs[k] >= 0 && !mark[outs[k]]) {
+                mark[outs[k]] = true;
+                stack[top++] = outs[k];
+            }
+        }
+    }
+    for (int i = 0; i < n; i++) mark[list[i]] = false;
+    qsort(list, (size_t)n, sizeof(int), cmp_int);
+    return n;
+}
+
+static void grow_hash(void);
+
+static int find_or_add(const int* members, int n) {
+    if ((dfa_count + 1) * 2 > hash_cap) grow_hash();
+    uint32_t h = hash_members(members, n) & (uint32_t)(hash_cap - 1);
+    while (hash_table[h] >= 0) {
+        DfaState* d = &dfa[hash_table[h]];
+        if (d->count == n && memcmp(d->members, members, (size_t)n * sizeof(int)) == 0) return hash_table[h];
+        h = (h + 1) & (uint32_t)(hash_cap - 1);
+    }
+    if (dfa_count == dfa_cap) {
+        dfa_cap = dfa_cap ? dfa_cap * 2 : 256;
+        dfa = (DfaState*)xrealloc(dfa, (size_t)dfa_cap * sizeof(DfaState));
+        dfa_next = (int*)xrealloc(dfa_next, (size_t)dfa_cap * (size_t)class_count * sizeof(int));
+    }
+    DfaState* d = &dfa[dfa_count];
+    d->members = (int*)xrealloc(NULL, (size_t)(n > 0 ? n : 1) * sizeof(int));
+    memcpy(d->members, members, (size_t)n * sizeof(int));
+    d->count = n;
+    // 多条规则同时接受时取先声明的
+    int best = -1;
+    for (int i = 0; i < n; i++) {
+        int a = nfa[members[i]].accept;
+        if (a >= 0 && (best < 0 || a < best)) best = a;
+    }
+    d->action = best >= 0 ? rules[best].action : ACTION_NONE;
+    hash_table[h] = dfa_count;
+    return dfa_count++;
+}
+
+static void grow_hash(void) {
+    hash_cap = hash_cap ? hash_cap * 2 : 1024;
+    free(hash_table);
+    hash_table = (int*)xrealloc(NULL, (size_t)hash_cap * sizeof(int));
+    for (int i = 0; i < hash_cap; i++) hash_table[i] = -1;
+    for (int i = 0; i < dfa_count; i++) {
+        uint32_t h = hash_members(dfa[i].members, dfa[i].count) & (uint32_t)(hash_cap - 1);
+        while (hash_table[h] >= 0) h = (h + 1) & (uint32_t)(hash_cap - 1);
+        hash_table[h] = i;
+    }
+}
+
+static void build_dfa(int nfa_start) {
+    int rep[256];
+    for (int c = 255; c >= 0; c--) rep[char_class[c]] = c;
+    bool* mark = (bool*)calloc((size_t)nfa_count, sizeof(bool));
+    int* stack = (int*)malloc((size_t)nfa_count * sizeof(int));
+    int* list = (int*)malloc((size_t)nfa_count * sizeof(int));
+    if (!mark || !stack || !list) fail(0, "Memory allocation error", NULL);
+
+    list[0] = nfa_start;
+    int n = closure(list, 1, mark, stack);
+    find_or_add(list, n);
+
+    // 新状态追加在末尾, 按下标顺序处理即为广度优先
+    for (int d = 0; d < dfa_count; d++) {
+        for (int k = 0; k < class_count; k++) {
+            int c = rep[k];
+            n = 0;
+            for (int i = 0; i < dfa[d].count; i++) {
+                const NfaState* s = &nfa[dfa[d].members[i]];
+                if (s->set >= 0 && set_has(&sets[s->set], c) && !mark[s->out1]) {
+                    mark[s->out1] = true;
+                    list[n++] = s->out1;
+                }
+            }
+            for (int i = 0; i < n; i++) mark[list[i]] = false;
+            int target = -1;
+            if (n > 0) {
+                n = closure(list, n, mark, stack);
+                target = find_or_add(list, n);
+            }
+            dfa_next[d * class_count + k] = target;
+        }
+    }
+    free(mark);
+    free(stack);
+    free(list);
+}
+
+// ==================== 最小化 ====================
+
+// Moore算法: 先按动作划分, 再按(所在块, 各字符类的后继块)反复细化直到块数不变
+// 死状态(无转移)记为下标dfa_count, 最小化后编号为0
+static int* block_of = NULL;
+static int block_count = 0;
+
+typedef struct {
+    int* key;
+    int state;
+} Signature;
+
+static int sig_width = 0;
+
+static int cmp_signature(const void* a, const void* b) {
+    const Signature* x = (const Signature*)a;
+    const Signature* y = (const Signature*)b;
+    for (int i = 0; i < sig_width; i++) {
+        if (x->key[i] != y->key[i]) return x->key[i] < y->key[i] ? -1 : 1;
+    }
+    return 0;
+}
+
+static void minimize(void) {
+    int total = dfa_count + 1;
+    int dead = dfa_count;
+    block_of = (int*)malloc((size_t)total * sizeof(int));
+    int* keys = (int*)malloc((size_t)total * (size_t)(class_count + 1) * sizeof(int));
+    Signature* sig = (Signature*)malloc((size_t)total * sizeof(Signature));
+    if (!block_of || !keys || !sig) fail(0, "Memory allocation error", NULL);
+
+    // 初始划分: 动作相同的状态在同一块, 死状态与其他非接受状态同块
+    sig_width = 1;
+    for (int s = 0; s < total; s++) {
+        sig[s].key = keys + (size_t)s * (size_t)(class_count + 1);
+        sig[s].key[0] = s == dead ? ACTION_NONE : dfa[s].action;
+        sig[s].state = s;
+    }
+    for (;;) {
+        qsort(sig, (size_t)total, sizeof(Signature), cmp_signature);
+        int count = 0;
+        for (int i = 0; i < total; i++) {
+            if (i > 0 && cmp_signature(&sig[i - 1], &sig[i]) != 0) count++;
+            block_of[sig[i].state] = count;
+        }
+        count++;
+        if (count == block_count) break;
+        block_count = count;
+
+        sig_width = class_count + 1;
+        for (int i = 0; i < total; i++) {
+            int s = sig[i].state;
+            int* key = keys + (size_t)s * (size_t)(class_count + 1);
+            key[0] = block_of[s];
+            for (int k = 0; k < class_count; k++) {
+                int t = s == dead ? -1 : dfa_next[s * class_count + k];
+                key[k + 1] = block_of[t < 0 ? dead : t];
+            }
+            sig[i].key = key;
+        }
+    }
+    free(keys);
+    free(sig);
+}
+
+// ==================== 输出 ====================
+
+static void write_header(FILE* out, const char* spec) {
+    fprintf(out, "// 由 lexgen 根据 %s 生成, 请勿手工修改\n", spec);
+    fprintf(out, "// 修改token定义后执行 make lextab 重新生成\n\n");
+}
+
+static void emit(const char* spec, const char* base, int nfa_states) {
+    // 重新编号: 死状态块为0, 起始状态块为1, 其余按原DFA顺序
+    int* new_id = (int*)malloc((size_t)block_count * sizeof(int));
+    int* block_rep = (int*)malloc((size_t)block_count * sizeof(int));
+    if (!new_id || !block_rep) fail(0, "Memory allocation error", NULL);
+    for (int b = 0; b < block_count; b++) new_id[b] = -1;
+    int next_id = 0;
+    new_id[block_of[dfa_count]] = next_id++;
+    block_rep[0] = dfa_count;
+    for (int s = 0; s < dfa_count; s++) {
+        int b = block_of[s];
+        if (new_id[b] < 0) {
+            block_rep[next_id] = s;
+            new_id[b] = next_id++;
+        }
+    }
+    int states = next_id;
+    const char* state_type = states <= 256 ? "unsigned char" : "unsigned short";
+
+    char path[512];
+    snprintf(path, sizeof(path), "%s.h", base);
+    FILE* h = fopen(path, "w");
+    if (!h) {
+        fprintf(stderr, "Cannot open file: %s\n", path);
+        exit(1);
+    }
+    write_header(h, spec);
+    fprintf(h, "#ifndef LEXTAB_H\n#define LEXTAB_H\n\n#include <stddef.h>\n\n");
+    fprintf(h, "// Token类型枚举\ntypedef enum {\n");
+    for (int i = 0; i < token_count; i++) {
+        fprintf(h, "    TOKEN_%s%s\n", tokens[i].name, i + 1 < token_count ? "," : "");
+    }
+    fprintf(h, "} TokenType;\n\n");
+    fprintf(h, "#define LEXTAB_TOKEN_COUNT %d\n", token_count);
+    fprintf(h, "#define LEXTAB_KEYWORD_COUNT %d\n\n", keyword_count);
+    fprintf(h, "// 保留字表\ntypedef struct {\n    const char* word;\n    TokenType type;\n} LextabKeyword;\n\n");
+    fprintf(h, "extern const LextabKeyword lextab_keywords[LEXTAB_KEYWORD_COUNT];\n");
+    fprintf(h, "// 类型名, 下标为TokenType\n");
+    fprintf(h, "extern const char* const lextab_names[LEXTAB_TOKEN_COUNT];\n\n");
+    fprintf(h, "// 表驱动扫描器: 从*pos开始跳过空白和注释, 按最长匹配识别一个token\n");
+    fprintf(h, "// *start为token起点, *pos移到token之后; 无法匹配时返回TOKEN_ERROR并前进一个字节\n");
+    fprintf(h, "TokenType lextab_scan(const char* buf, size_t length, size_t* pos, size_t* start);\n\n");
+    fprintf(h, "#endif\n");
+    fclose(h);
+
+    snprintf(path, sizeof(path), "%s.c", base);
+    FILE* c = fopen(path, "w");
+    if (!c) {
+        fprintf(stderr, "Cannot open file: %s\n", path);
+        exit(1);
+    }
+    write_header(c, spec);
+    fprintf(c, "// NFA %d个状态, DFA %d个状态, 最小化后%d个状态(含死状态), %d个字符类\n\n",
+            nfa_states, dfa_count, states, class_count);
+    fprintf(c, "#include \"%s.h\"\n#include \"utf8.h\"\n\n", base);
+
+    fprintf(c, "const LextabKeyword lextab_keywords[LEXTAB_KEYWORD_COUNT] = {\n");
+    for (int i = 0; i < keyword_count; i++) {
+        fprintf(c, "    {\"%s\", TOKEN_%s}%s\n", tokens[i].word, tokens[i].name, i + 1 < keyword_count ? "," : "");
+    }
+    fprintf(c, "};\n\n");
+
+    fprintf(c, "const char* const lextab_names[LEXTAB_TOKEN_COUNT] = {\n");
+    for (int i = 0; i < token_count; i++) {
+        fprintf(c, "    \"%s\"%s\n", tokens[i].name, i + 1 < token_count ? "," : "");
+    }
+    fprintf(c, "};\n\n");
+
+    fprintf(c, "#define LEXTAB_STATES %d\n#define LEXTAB_CLASSES %d\n", states, class_count);
+    fprintf(c, "#define LEXTAB_NONE (-1)\n#define LEXTAB_SKIP (-2)\n\n");
+
+    fprintf(c, "// 字节 -> 字符类\nstatic const unsigned char lextab_class[256] = {");
+    for (int i = 0; i < 256; i++) {
+        fprintf(c, "%s%2d%s", i % 16 == 0 ? "\n    " : "", char_class[i], i + 1 < 256 ? ", " : "");
+    }
+    fprintf(c, "\n};\n\n");
+
+    fprintf(c, "// 转移表, 状态0为死状态, 状态1为起始状态\n");
+    fprintf(c, "static const %s lextab_next[LEXTAB_STATES][LEXTAB_CLASSES] = {\n", state_type);
+    for (int id = 0; id < states; id++) {
+        int s = block_rep[id];
+        fprintf(c, "    {");
+        for (int k = 0; k < class_count; k++) {
+            int t = s == dfa_count ? -1 : dfa_next[s * class_count + k];
+            fprintf(c, "%s%d", k ? ", " : "", new_id[block_of[t < 0 ? dfa_count : t]]);
+        }
+        fprintf(c, "}%s\n", id + 1 < states ? "," : "");
+    }
+    fprintf(c, "};\n\n");
+
+    fprintf(c, "// 接受状态的动作: token类型, LEXTAB_SKIP或LEXTAB_NONE\n");
+    fprintf(c, "static const short lextab_accept[LEXTAB_STATES] = {");
+    for (int id = 0; id < states; id++) {
+        int s = block_rep[id];
+        int action = s == dfa_count ? ACTION_NONE : dfa[s].action;
+        fprintf(c, "%s%d%s", id % 16 == 0 ? "\n    " : "", action, id + 1 < states ? ", " : "");
+    }
+    fprintf(c, "\n};\n\n");
+
+    fprintf(c,
+        "TokenType lextab_scan(const char* buf, size_t length, size_t* pos, size_t* start) {\n"
+        "    size_t p = *pos;\n"
+        "    for (;;) {\n"
+        "        *start = p;\n"
+        "        if (p >= length) {\n"
+        "            *pos = p;\n"
+        "            return TOKEN_EOF;\n"
+        "        }\n"
+        "        int state = 1;\n"
+        "        int action = LEXTAB_NONE;\n"
+        "        size_t end = p;\n"
+        "        for (size_t i = p; i < length; i++) {\n"
+        "            state = lextab_next[state][lextab_class[(unsigned char)buf[i]]];\n"
+        "            if (state == 0) break;\n"
+        "            if (lextab_accept[state] != LEXTAB_NONE) {\n"
+        "                action = lextab_accept[state];\n"
+        "                end = i + 1;\n"
+        "            }\n"
+        "        }\n"
+        "        if (action == LEXTAB_NONE) {\n"
+        "            // 非ASCII字节: 整个UTF-8字符(或非法序列)作为一个错误token, 与手写分析器一致\n"
+        "            size_t n = 1;\n"
+        "            if ((unsigned char)buf[p] >= 0x80) {\n"
+        "                int k = utf8_sequence_length(buf + p, length - p);\n"
+        "                n = k ? (size_t)k : utf8_invalid_length(buf + p, length - p);\n"
+        "            }\n"
+        "            *pos = p + n;\n"
+        "            return TOKEN_ERROR;\n"
+        "        }\n"
+        "        p = end;\n"
+        "        if (action != LEXTAB_SKIP) {\n"
+        "            *pos = p;\n"
+        "            return (TokenType)action;\n"
+        "        }\n"
+        "    }\n"
+        "}\n");
+    fclose(c);
+
+    printf("%s: %d tokens, %d rules, NFA %d states, DFA %d states, minimized %d states, %d classes\n",
+           spec, token_count, rule_count, nfa_states, dfa_count, states, class_count);
+    free(new_id);
+    free(block_rep);
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 3) {
+        fprintf(stderr, "Usage: %s <spec_file> <output_base>\n", argv[0]);
+        fprintf(stderr, "Example: %s tokens.spec lextab\n", argv[0]);
+        return 1;
+    }
+    read_spec(argv[1]);
+    int start = build_nfa();
+    compute_classes();
+    build_dfa(start);
+    minimize();
+    emit(argv[1], argv[2], nfa_count);
+    return 0;
+}
@@ -0,0 +1,87 @@
+// 由 lexgen 根据 tokens.spec 生成, 请勿手工修改
+// 修改token定义后执行 make lextab 重新生成
+
+#ifndef LEXTAB_H
+#define LEXTAB_H
+
+#include <stddef.h>
+
+// Token类型枚举
+typedef enum {
+    TOKEN_IF,
+    TOKEN_ELSE,
+    TOKEN_WHILE,
+    TOKEN_DO,
+    TOKEN_MAIN,
+    TOKEN_INT,
+    TOKEN_FLOAT,
+    TOKEN_DOUBLE,
+    TOKEN_RETURN,
+    TOKEN_CONST,
+    TOKEN_VOID,
+    TOKEN_CONTINUE,
+    TOKEN_BREAK,
+    TOKEN_CHAR,
+    TOKEN_UNSIGNED,
+    TOKEN_ENUM,
+    TOKEN_LONG,
+    TOKEN_SWITCH,
+    TOKEN_CASE,
+    TOKEN_AUTO,
+    TOKEN_STATIC,
+    TOKEN_PLUS,
+    TOKEN_MINUS,
+    TOKEN_MULTIPLY,
+    TOKEN_DIVIDE,
+    TOKEN_MOD,
+    TOKEN_ASSIGN,
+    TOKEN_LT,
+    TOKEN_GT,
+    TOKEN_LE,
+    TOKEN_GE,
+    TOKEN_EQ,
+    TOKEN_NE,
+    TOKEN_AND,
+    TOKEN_OR,
+    TOKEN_LBRACE,
+    TOKEN_RBRACE,
+    TOKEN_LPAREN,
+    TOKEN_RPAREN,
+    TOKEN_SEMICOLON,
+    TOKEN_COMMA,
+    TOKEN_QUOTE,
+    TOKEN_DQUOTE,
+    TOKEN_LBRACKET,
+    TOKEN_RBRACKET,
+    TOKEN_DOT,
+    TOKEN_COLON,
+    TOKEN_HASH,
+    TOKEN_IDENTIFIER,
+    TOKEN_INTEGER,
+    TOKEN_FLOAT_NUM,
+    TOKEN_HEX,
+    TOKEN_OCTAL,
+    TOKEN_CHAR_CONST,
+    TOKEN_STRING_CONST,
+    TOKEN_EOF,
+    TOKEN_ERROR
+} TokenType;
+
+#define LEXTAB_TOKEN_COUNT 57
+#define LEXTAB_KEYWORD_COUNT 21
+
+// 保留字表
+typedef struct {
+    const char* word;
+    TokenType type;
+} LextabKeyword;
+
+extern const LextabKeyword lextab_keywords[LEXTAB_KEYWORD_COUNT];
+// 类型名, 下标为TokenType
+extern const char* const lextab_names[LEXTAB_TOKEN_COUNT];
+
+// 表驱动扫描器: 从*pos开始跳过空白和注释, 按最长匹配识别一个token
+// *start为token起点, *pos移到token之后; 无法匹配时返回TOKEN_ERROR并前进一个字节
+TokenType lextab_scan(const char* buf, size_t length, size_t* pos, size_t* start);
+
+#endif
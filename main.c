@@ -1,95 +1,157 @@
 //词法分析器运行主函数
 
 #include "lexer.h"
+#include "tokcache.h"
+#include "output.h"
+#include "parlex.h"
+#include "readahead.h"
 #include <stdio.h>
 #include <stdlib.h>
 
+// 并行词法分析的线程数, 1表示顺序分析
+static int lex_threads = 1;
+
+// 多个文件时的预读深度和方式
+static int queue_depth = READAHEAD_DEFAULT_DEPTH;
+static ReadAheadBackend io_backend = READAHEAD_AUTO;
+
 // 函数声明
-void print_source_with_line_numbers(const char* filename);
-void print_binary_form_per_line(const char* filename);
-void print_error_summary(Lexer* lexer);
+void print_source_with_line_numbers(OutWriter* out, const char* filename);
+void print_binary_form_per_line(OutWriter* out, const char* filename, OutputFormat format);
+void print_error_summary(OutWriter* out, Lexer* lexer);
+int run_batch(OutWriter* out, const char* const* files, int count);
 
 int main(int argc, char* argv[]) {
-    if (argc < 2) {
-        fprintf(stderr, "Usage: %s <source_file>\n", argv[0]);
+    OutputFormat format = OUTPUT_TEXT;
+    int argi = 1;
+    while (argi + 1 < argc && argv[argi][0] == '-') {
+        if (strcmp(argv[argi], "--cache-dir") == 0) {
+            // token缓存目录, 内容未变的文件直接回放缓存
+            lexer_set_cache_dir(argv[argi + 1]);
+        } else if (strcmp(argv[argi], "--threads") == 0) {
+            // 大文件切块后多线程扫描, 结果与顺序扫描相同
+            lex_threads = atoi(argv[argi + 1]);
+            if (lex_threads < 1) lex_threads = 1;
+        } else if (strcmp(argv[argi], "--queue-depth") == 0) {
+            // 多个文件时最多同时预读的文件数
+            queue_depth = atoi(argv[argi + 1]);
+            if (queue_depth < 1) queue_depth = 1;
+        } else if (strcmp(argv[argi], "--io") == 0) {
+            // 预读方式: auto(默认) / uring / threads
+            if (strcmp(argv[argi + 1], "auto") == 0) io_backend = READAHEAD_AUTO;
+            else if (strcmp(argv[argi + 1], "uring") == 0) io_backend = READAHEAD_URING;
+            else if (strcmp(argv[argi + 1], "threads") == 0) io_backend = READAHEAD_THREADS;
+            else {
+                fprintf(stderr, "Unknown I/O backend: %s (expected auto, uring or threads)\n", argv[argi + 1]);
+                return 1;
+            }
+        } else if (strcmp(argv[argi], "--format") == 0) {
+            // token流的输出格式: text(默认) / json / csv
+            if (!out_parse_format(argv[argi + 1], &format)) {
+                fprintf(stderr, "Unknown format: %s (expected text, json or csv)\n", argv[argi + 1]);
+                return 1;
+            }
+        } else {
+            break;
+        }
+        argi += 2;
+    }
+    if (argi >= argc) {
+        fprintf(stderr, "Usage: %s [--cache-dir <dir>] [--format text|json|csv] [--threads <n>] <source_file>\n", argv[0]);
+        fprintf(stderr, "       %s [--queue-depth <n>] [--io auto|uring|threads] <source_file>...\n", argv[0]);
         fprintf(stderr, "Example: %s test.c\n", argv[0]);
         return 1;
     }
     
-    const char* filename = argv[1];
+    static OutWriter out;
+    out_init(&out, stdout);
     
-    printf("========== Lexical Analyzer ==========\n");
-    printf("File: %s\n\n", filename);
+    // 多个文件: 批量分析, 读取与分析重叠
+    if (argc - argi > 1) {
+        int rc = run_batch(&out, (const char* const*)(argv + argi), argc - argi);
+        out_flush(&out);
+        return rc;
+    }
+    
+    const char* filename = argv[argi];
+    
+    // JSON/CSV只输出token流, 供下游工具直接读取
+    if (format != OUTPUT_TEXT) {
+        print_binary_form_per_line(&out, filename, format);
+        out_flush(&out);
+        return 0;
+    }
+    
+    out_str(&out, "========== Lexical Analyzer ==========\n");
+    out_str(&out, "File: ");
+    out_str(&out, filename);
+    out_str(&out, "\n\n");
     
     // 功能1：显示带行号的源程序
-    printf("=== Source Code with Line Numbers ===\n");
-    print_source_with_line_numbers(filename);
-    printf("\n");
+    out_str(&out, "=== Source Code with Line Numbers ===\n");
+    print_source_with_line_numbers(&out, filename);
+    out_char(&out, '\n');
     
     // 功能2：打印每行包含的记号的二元形式
-    printf("=== Binary Forms (Token Type, Value) per Line ===\n");
-    print_binary_form_per_line(filename);
-    printf("\n");
+    out_str(&out, "=== Binary Forms (Token Type, Value) per Line ===\n");
+    print_binary_form_per_line(&out, filename, format);
+    out_char(&out, '\n');
     
     // 功能3：错误统计
     Lexer* lexer = init_lexer(filename);
     if (lexer) {
-        print_error_summary(lexer);
+        parlex_start(lexer, lex_threads);
+        print_error_summary(&out, lexer);
         free_lexer(lexer);
     }
     
+    out_flush(&out);
     return 0;
 }
 
 // 显示带行号的源程序
-void print_source_with_line_numbers(const char* filename) {
-    FILE* file = fopen(filename, "r");
-    if (!file) {
+// 直接使用源文件管理器中的文件内容和行起点表, 不再重新读文件切分
+void print_source_with_line_numbers(OutWriter* out, const char* filename) {
+    SourceManager* sm = srcmgr_default();
+    int file_id = srcmgr_load(sm, filename);
+    if (file_id < 0) {
         fprintf(stderr, "Error: Cannot open file %s\n", filename);
         return;
     }
+    const SourceFile* file = srcmgr_file(sm, file_id);
     
-    char buffer[1024];
-    int line_num = 1;
-    
-    while (fgets(buffer, sizeof(buffer), file)) {
-        // 移除末尾的换行符
-        size_t len = strlen(buffer);
-        if (len > 0 && buffer[len-1] == '\n') {
-            buffer[len-1] = '\0';
-        }
-        if (len > 1 && buffer[len-2] == '\r') {  // Windows换行符
-            buffer[len-2] = '\0';
+    for (int line_num = 1; line_num <= file->line_count; line_num++) {
+        size_t len;
+        const char* start = srcmgr_line_text(file, line_num, &len);
+        // 文件以换行符结尾时, 最后的空行不输出
+        if (line_num == file->line_count && (size_t)(start - file->buffer) >= file->length) {
+            break;
         }
         
         // 打印行号和内容
-        printf("%4d: %s\n", line_num, buffer);
-        line_num++;
+        out_int(out, line_num, 4);
+        out_str(out, ": ");
+        out_write(out, start, len);
+        out_char(out, '\n');
     }
-    
-    fclose(file);
 }
 
 // 打印每行包含的记号的二元形式
-void print_binary_form_per_line(const char* filename) {
+// token按出现顺序直接写出, 不再先收集到定长数组中
+void print_binary_form_per_line(OutWriter* out, const char* filename, OutputFormat format) {
     Lexer* lexer = init_lexer(filename);
     if (!lexer) {
         fprintf(stderr, "Error: Cannot initialize lexer\n");
         return;
     }
+    parlex_start(lexer, lex_threads);
     
-    int current_line = 0;
     int token_count = 0;
     int error_count = 0;
     
-    printf("Line | Binary Forms\n");
-    printf("-----|-----------------------------------------------------\n");
-    
-    // 先收集所有token，按行分组
-    Token tokens[1000];
-    int token_index = 0;
+    TokenStreamWriter ts;
+    token_stream_begin(&ts, out, format);
     
-    // 收集token
     while (1) {
         Token token = get_token(lexer);
         
@@ -101,39 +163,24 @@ void print_binary_form_per_line(const char* filename) {
             error_count++;
         }
         
-        if (token_index < 1000) {
-            tokens[token_index++] = token;
-        }
-        
+        token_stream_write(&ts, &token);
         token_count++;
-        if (token_count > 500) break; // 防止无限循环
     }
+    token_stream_end(&ts);
     
-    // 按行打印二元式 - 使用属性名称
-    for (int i = 0; i < token_index; i++) {
-        Token token = tokens[i];
-        
-        // 开始新行
-        if (token.line != current_line) {
-            if (current_line > 0) {
-                printf("\n");
-            }
-            printf("%4d | ", token.line);
-            current_line = token.line;
-        }
-        
-        printf("(%s, %s) ", token_type_to_str(token.type), token.lexeme);
+    if (format == OUTPUT_TEXT) {
+        out_str(out, "Total tokens: ");
+        out_int(out, token_count, 0);
+        out_str(out, "\nTotal errors: ");
+        out_int(out, error_count, 0);
+        out_char(out, '\n');
     }
     
-    printf("\n\n");
-    printf("Total tokens: %d\n", token_count);
-    printf("Total errors: %d\n", error_count);
-    
     free_lexer(lexer);
 }
 
 // 打印错误摘要
-void print_error_summary(Lexer* lexer) {
+void print_error_summary(OutWriter* out, Lexer* lexer) {
     if (!lexer) return;
     
     // 重新分析以收集错误信息
@@ -141,11 +188,7 @@ void print_error_summary(Lexer* lexer) {
     int line_errors[100] = {0};
     
     // 重置词法分析器
-    fseek(lexer->source, 0, SEEK_SET);
-    lexer->line = 1;
-    lexer->column = 0;
-    lexer->has_error = false;
-    lexer->current_char = fgetc(lexer->source);
+    reset_lexer(lexer);
     
     // 收集错误
     while (1) {
@@ -157,22 +200,90 @@ void print_error_summary(Lexer* lexer) {
         
         if (token.type == TOKEN_ERROR) {
             error_count++;
-            if (token.line < 100) {
-                line_errors[token.line]++;
+            int line = source_line(token.loc);
+            if (line < 100) {
+                line_errors[line]++;
             }
         }
     }
     
-    printf("=== Error Summary ===\n");
+    out_str(out, "=== Error Summary ===\n");
     if (error_count == 0) {
-        printf("No lexical errors found.\n");
+        out_str(out, "No lexical errors found.\n");
     } else {
-        printf("Total errors: %d\n", error_count);
-        printf("Errors by line:\n");
+        out_str(out, "Total errors: ");
+        out_int(out, error_count, 0);
+        out_str(out, "\nErrors by line:\n");
         for (int i = 0; i < 100; i++) {
             if (line_errors[i] > 0) {
-                printf("  Line %d: %d error(s)\n", i, line_errors[i]);
+                out_str(out, "  Line ");
+                out_int(out, i, 0);
+                out_str(out, ": ");
+                out_int(out, line_errors[i], 0);
+                out_str(out, " error(s)\n");
             }
         }
     }
-}
\ No newline at end of file
+}
+
+// 批量分析多个文件, 每个文件输出一行统计
+// 文件由预读模块提前读入, 分析第k个文件时后面depth个文件的读取已经在进行
+int run_batch(OutWriter* out, const char* const* files, int count) {
+    ReadAhead* ra = readahead_open(files, count, queue_depth, io_backend);
+    if (!ra) {
+        fprintf(stderr, "Memory allocation error\n");
+        return 1;
+    }
+    SourceManager* sm = srcmgr_default();
+    long total_tokens = 0;
+    long total_errors = 0;
+    
+    out_str(out, "========== Lexical Analyzer (batch) ==========\n");
+    for (int i = 0; i < count; i++) {
+        char* buffer;
+        size_t length;
+        if (!readahead_next(ra, &buffer, &length)) break;
+        if (!buffer) {
+            fprintf(stderr, "Cannot open file: %s\n", files[i]);
+            continue;
+        }
+        int file_id = srcmgr_adopt(sm, files[i], buffer, length);
+        Lexer* lexer = file_id >= 0 ? init_lexer_source(file_id) : NULL;
+        if (!lexer) continue;
+        parlex_start(lexer, lex_threads);
+        
+        int token_count = 0;
+        int error_count = 0;
+        while (1) {
+            Token token = get_token(lexer);
+            if (token.type == TOKEN_EOF) break;
+            if (token.type == TOKEN_ERROR) error_count++;
+            token_count++;
+        }
+        free_lexer(lexer);
+        // 统计已经输出, 释放文件内容, 内存占用不随文件数增长
+        srcmgr_reset(sm);
+        
+        out_str(out, files[i]);
+        out_str(out, ": ");
+        out_int(out, token_count, 0);
+        out_str(out, " tokens, ");
+        out_int(out, error_count, 0);
+        out_str(out, " errors\n");
+        total_tokens += token_count;
+        total_errors += error_count;
+    }
+    
+    ReadAheadStats st;
+    readahead_stats(ra, &st);
+    readahead_close(ra);
+    
+    char line[256];
+    snprintf(line, sizeof(line), "Files: %d (%d unreadable), %llu bytes, %ld tokens, %ld errors\n",
+             st.files, st.failed, st.bytes, total_tokens, total_errors);
+    out_str(out, line);
+    snprintf(line, sizeof(line), "I/O: %s, queue depth %d, waited %.3f ms in %d stall(s)\n",
+             st.backend, st.depth, st.wait_ms, st.stalls);
+    out_str(out, line);
+    return st.failed ? 1 : 0;
+}
@@ -0,0 +1,216 @@
+#include "output.h"
+#include "utf8.h"
+
+void out_init(OutWriter* w, FILE* file) {
+    w->file = file;
+    w->len = 0;
+}
+
+void out_flush(OutWriter* w) {
+    if (w->len) {
+        fwrite(w->buf, 1, w->len, w->file);
+        w->len = 0;
+    }
+    fflush(w->file);
+}
+
+void out_write(OutWriter* w, const char* s, size_t n) {
+    if (w->len + n > OUT_BUFFER_SIZE) {
+        fwrite(w->buf, 1, w->len, w->file);
+        w->len = 0;
+        // 超过缓冲区大小的内容直接写出
+        if (n > OUT_BUFFER_SIZE) {
+            fwrite(s, 1, n, w->file);
+            return;
+        }
+    }
+    memcpy(w->buf + w->len, s, n);
+    w->len += n;
+}
+
+void out_str(OutWriter* w, const char* s) {
+    out_write(w, s, strlen(s));
+}
+
+void out_char(OutWriter* w, char c) {
+    if (w->len == OUT_BUFFER_SIZE) {
+        fwrite(w->buf, 1, w->len, w->file);
+        w->len = 0;
+    }
+    w->buf[w->len++] = c;
+}
+
+// 从低位往高位生成数字, 不经过printf的格式解析
+void out_int(OutWriter* w, long long v, int width) {
+    char tmp[24];
+    int i = sizeof(tmp);
+    unsigned long long u = v < 0 ? 0ULL - (unsigned long long)v : (unsigned long long)v;
+    do {
+        tmp[--i] = (char)('0' + u % 10);
+        u /= 10;
+    } while (u);
+    if (v < 0) tmp[--i] = '-';
+    int digits = (int)sizeof(tmp) - i;
+    for (int pad = width - digits; pad > 0; pad--) out_char(w, ' ');
+    out_write(w, tmp + i, (size_t)digits);
+}
+
+// NOTE - JSON和CSV供下游工具读取, 输出必须是合法的UTF-8
+// lexeme原样保留源文件中的字节, 可能含非法UTF-8序列(如字符串里的); 每个非法序列(见utf8_invalid_length)换成一个U+FFFD
+static const char replacement_char[] = "\xEF\xBF\xBD";
+
+void out_json_string(OutWriter* w, const char* s) {
+    static const char hex[] = "0123456789abcdef";
+    const char* end = s + strlen(s);
+    out_char(w, '"');
+    const char* run = s;
+    for (; s < end; s++) {
+        unsigned char c = (unsigned char)*s;
+        size_t bad = 0;
+        if (c >= 0x80) {
+            int n = utf8_sequence_length(s, (size_t)(end - s));
+            if (n) {
+                s += n - 1;
+                continue;
+            }
+            bad = utf8_invalid_length(s, (size_t)(end - s));
+        } else if (c >= 0x20 && c != '"' && c != '\\') {
+            continue;
+        }
+        // 先写出前面不需要转义的一段
+        out_write(w, run, (size_t)(s - run));
+        if (bad) {
+            out_str(w, "\\ufffd");
+            s += bad - 1;
+            run = s + 1;
+            continue;
+        }
+        run = s + 1;
+        switch (c) {
+            case '"': out_str(w, "\\\""); break;
+            case '\\': out_str(w, "\\\\"); break;
+            case '\n': out_str(w, "\\n"); break;
+            case '\t': out_str(w, "\\t"); break;
+            case '\r': out_str(w, "\\r"); break;
+            default:
+                out_str(w, "\\u00");
+                out_char(w, hex[c >> 4]);
+                out_char(w, hex[c & 15]);
+        }
+    }
+    out_write(w, run, (size_t)(s - run));
+    out_char(w, '"');
+}
+
+void out_csv_field(OutWriter* w, const char* s) {
+    size_t len = strlen(s);
+    bool quote = strpbrk(s, ",\"\r\n") != NULL;
+    if (!quote && utf8_next_invalid(s, 0, len) == len) {
+        out_write(w, s, len);
+        return;
+    }
+    const char* end = s + len;
+    if (quote) out_char(w, '"');
+    for (; s < end; s++) {
+        if ((unsigned char)*s >= 0x80) {
+            int n = utf8_sequence_length(s, (size_t)(end - s));
+            if (n) {
+                out_write(w, s, (size_t)n);
+                s += n - 1;
+            } else {
+                out_str(w, replacement_char);
+                s += utf8_invalid_length(s, (size_t)(end - s)) - 1;
+            }
+            continue;
+        }
+        if (*s == '"') out_char(w, '"');
+        out_char(w, *s);
+    }
+    if (quote) out_char(w, '"');
+}
+
+bool out_parse_format(const char* name, OutputFormat* format) {
+    if (strcmp(name, "text") == 0) {
+        *format = OUTPUT_TEXT;
+    } else if (strcmp(name, "json") == 0 || strcmp(name, "jsonl") == 0) {
+        *format = OUTPUT_JSON;
+    } else if (strcmp(name, "csv") == 0) {
+        *format = OUTPUT_CSV;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+void token_stream_begin(TokenStreamWriter* ts, OutWriter* w, OutputFormat format) {
+    ts->w = w;
+    ts->format = format;
+    ts->current_line = 0;
+    if (format == OUTPUT_TEXT) {
+        out_str(w, "Line | Binary Forms\n");
+        out_str(w, "-----|-----------------------------------------------------\n");
+    } else if (format == OUTPUT_CSV) {
+        out_str(w, "line,column,offset,length,type,lexeme\n");
+    }
+}
+
+void token_stream_write(TokenStreamWriter* ts, const Token* token) {
+    OutWriter* w = ts->w;
+    int line, column;
+    switch (ts->format) {
+        case OUTPUT_TEXT:
+            // 开始新行
+            line = source_line(token->loc);
+            if (line != ts->current_line) {
+                if (ts->current_line > 0) {
+                    out_char(w, '\n');
+                }
+                out_int(w, line, 4);
+                out_str(w, " | ");
+                ts->current_line = line;
+            }
+            out_char(w, '(');
+            out_str(w, token_type_to_str(token->type));
+            out_str(w, ", ");
+            out_str(w, token->lexeme);
+            out_str(w, ") ");
+            break;
+        case OUTPUT_JSON:
+            srcmgr_decompose(srcmgr_default(), token->loc, NULL, &line, &column);
+            out_str(w, "{\"line\":");
+            out_int(w, line, 0);
+            out_str(w, ",\"column\":");
+            out_int(w, column, 0);
+            out_str(w, ",\"offset\":");
+            out_int(w, source_offset(token->loc), 0);
+            out_str(w, ",\"length\":");
+            out_int(w, token->length, 0);
+            out_str(w, ",\"type\":\"");
+            out_str(w, token_type_to_str(token->type));
+            out_str(w, "\",\"lexeme\":");
+            out_json_string(w, token->lexeme);
+            out_str(w, "}\n");
+            break;
+        case OUTPUT_CSV:
+            srcmgr_decompose(srcmgr_default(), token->loc, NULL, &line, &column);
+            out_int(w, line, 0);
+            out_char(w, ',');
+            out_int(w, column, 0);
+            out_char(w, ',');
+            out_int(w, source_offset(token->loc), 0);
+            out_char(w, ',');
+            out_int(w, token->length, 0);
+            out_char(w, ',');
+            out_str(w, token_type_to_str(token->type));
+            out_char(w, ',');
+            out_csv_field(w, token->lexeme);
+            out_char(w, '\n');
+            break;
+    }
+}
+
+void token_stream_end(TokenStreamWriter* ts) {
+    if (ts->format == OUTPUT_TEXT) {
+        out_str(ts->w, "\n\n");
+    }
+}
@@ -0,0 +1,53 @@
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include "lexer.h"
+
+// NOTE - 带大缓冲区的输出模块, 代替逐行的printf
+// 内容先写入缓冲区, 满了或调用out_flush时才整体fwrite
+
+#define OUT_BUFFER_SIZE (64 * 1024)
+
+// token流的输出格式
+typedef enum {
+    OUTPUT_TEXT,   // 原有的 (TYPE, lexeme) 文本格式
+    OUTPUT_JSON,   // JSON Lines, 每行一个token对象
+    OUTPUT_CSV     // CSV, 第一行为表头
+} OutputFormat;
+
+typedef struct {
+    FILE* file;
+    size_t len;
+    char buf[OUT_BUFFER_SIZE];
+} OutWriter;
+
+void out_init(OutWriter* w, FILE* file);
+void out_flush(OutWriter* w);
+
+void out_write(OutWriter* w, const char* s, size_t n);
+void out_str(OutWriter* w, const char* s);
+void out_char(OutWriter* w, char c);
+
+// 十进制整数, width>0时左侧补空格到指定宽度(同printf的%Nd)
+void out_int(OutWriter* w, long long v, int width);
+
+// 带引号和转义的JSON字符串, 非法UTF-8序列写成\ufffd
+void out_json_string(OutWriter* w, const char* s);
+// CSV字段, 含逗号、引号或换行时加引号; 非法UTF-8序列换成U+FFFD
+void out_csv_field(OutWriter* w, const char* s);
+
+// 解析 --format 参数, 无法识别时返回false
+bool out_parse_format(const char* name, OutputFormat* format);
+
+// token流的表头/单个token/结尾, 文本格式按行分组
+typedef struct {
+    OutWriter* w;
+    OutputFormat format;
+    int current_line;
+} TokenStreamWriter;
+
+void token_stream_begin(TokenStreamWriter* ts, OutWriter* w, OutputFormat format);
+void token_stream_write(TokenStreamWriter* ts, const Token* token);
+void token_stream_end(TokenStreamWriter* ts);
+
+#endif
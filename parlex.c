@@ -0,0 +1,472 @@
+#define _POSIX_C_SOURCE 200809L
+#include "parlex.h"
+#include "tokcache.h"
+#include <stdint.h>
+#include <pthread.h>
+
+// 每块至少这么大, 更小的文件线程开销得不偿失
+#define PARLEX_MIN_CHUNK (256 * 1024)
+
+// 紧凑的token流: 每个token为 tag(类型<<1 | 词素在字符串池中) + 与上个token结尾的距离 + 长度 [+ 词素] [+ 值]
+// 大文件的token数量很多, 不能按sizeof(Token)保存
+typedef struct {
+    unsigned char* data;
+    size_t size;
+    size_t cap;
+    char* pool;                  // 与源文件片段不一致的词素
+    size_t pool_len;
+    size_t pool_cap;
+    bool failed;                 // 内存分配失败
+} TokenBuf;
+
+// 解码位置: 下一个token的编码起点, 以及上一个token的结尾(即扫描到这个token之前的位置)
+typedef struct {
+    size_t byte;
+    size_t prev_end;
+    long index;
+} TokenCursor;
+
+// 一段报错的token: 第一个之后的都只是合并进同一条诊断(重复计数)
+// 推测的起点(如落在注释或字符串中间)报的错都在汇合点之前, 汇合后只转交汇合点之后的诊断
+typedef struct {
+    long first;                  // 第一个和最后一个token的下标(EOF为token_count)
+    long last;
+    DiagMark before;             // 扫描第一个token之前的诊断状态
+    int entries;                 // 最后一个token之后的诊断条数
+} ErrorRun;
+
+typedef struct {
+    Lexer lexer;                 // 本块私有的词法分析器(共享文件内容)
+    DiagEngine diag;
+    size_t begin;                // 本块负责起点在[begin, end)中的token
+    size_t end;
+    TokenBuf buf;
+    long token_count;
+    ErrorRun* runs;
+    int run_count;
+    int run_cap;
+    bool runs_truncated;         // 之后报错的token没有记下(诊断超出上限或内存不足)
+    size_t last_end;             // 最后一个token的结尾
+    bool hit_eof;
+    size_t eof_pos;
+    TokenCursor cursor;          // 校验边界时的解码位置, 只会向后移动
+} Chunk;
+
+// 最终结果是若干段token流依次相连
+typedef struct {
+    const TokenBuf* buf;
+    size_t byte_from;
+    size_t byte_to;
+    size_t prev_end;
+} Segment;
+
+struct ParallelLex {
+    Chunk* chunks;
+    int chunk_count;
+    TokenBuf repair;             // 边界处顺序重新扫描得到的token
+    Segment* segs;
+    int seg_count;
+    int seg_cap;
+    size_t eof_pos;
+
+    // 读取位置
+    int cur_seg;
+    TokenCursor cur;
+};
+
+static void put_bytes(TokenBuf* b, const void* p, size_t n) {
+    if (b->size + n > b->cap) {
+        size_t cap = b->cap ? b->cap * 2 : 64 * 1024;
+        while (cap < b->size + n) cap *= 2;
+        unsigned char* d = (unsigned char*)realloc(b->data, cap);
+        if (!d) {
+            b->failed = true;
+            return;
+        }
+        b->data = d;
+        b->cap = cap;
+    }
+    memcpy(b->data + b->size, p, n);
+    b->size += n;
+}
+
+static void put_varint(TokenBuf* b, uint64_t v) {
+    unsigned char tmp[10];
+    int n = 0;
+    while (v >= 0x80) {
+        tmp[n++] = (unsigned char)(v | 0x80);
+        v >>= 7;
+    }
+    tmp[n++] = (unsigned char)v;
+    put_bytes(b, tmp, (size_t)n);
+}
+
+static uint64_t get_varint(const TokenBuf* b, size_t* pos) {
+    uint64_t v = 0;
+    int shift = 0;
+    while (*pos < b->size && shift < 64) {
+        unsigned char c = b->data[(*pos)++];
+        v |= (uint64_t)(c & 0x7f) << shift;
+        if (!(c & 0x80)) break;
+        shift += 7;
+    }
+    return v;
+}
+
+static size_t pool_add(TokenBuf* b, const char* s) {
+    size_t len = strlen(s) + 1;
+    if (b->pool_len + len > b->pool_cap) {
+        size_t cap = b->pool_cap ? b->pool_cap * 2 : 4096;
+        while (cap < b->pool_len + len) cap *= 2;
+        char* p = (char*)realloc(b->pool, cap);
+        if (!p) {
+            b->failed = true;
+            return 0;
+        }
+        b->pool = p;
+        b->pool_cap = cap;
+    }
+    memcpy(b->pool + b->pool_len, s, len);
+    size_t offset = b->pool_len;
+    b->pool_len += len;
+    return offset;
+}
+
+static void buf_free(TokenBuf* b) {
+    free(b->data);
+    free(b->pool);
+}
+
+// prev_end为上一个token的结尾, 写入后更新为本token的结尾
+static void encode_token(TokenBuf* b, const Lexer* lexer, const Token* token, size_t* prev_end) {
+    size_t offset = token->loc - lexer->base;
+    size_t n = token->length < 255 ? token->length : 255;
+    bool in_pool = strlen(token->lexeme) != n || memcmp(token->lexeme, lexer->buffer + offset, n) != 0;
+
+    put_varint(b, ((uint64_t)token->type << 1) | (in_pool ? 1 : 0));
+    put_varint(b, offset - *prev_end);
+    put_varint(b, token->length);
+    *prev_end = offset + token->length;
+    if (in_pool) put_varint(b, pool_add(b, token->lexeme));
+
+    switch (token->type) {
+        case TOKEN_INTEGER:
+        case TOKEN_HEX:
+        case TOKEN_OCTAL:
+            put_varint(b, (uint64_t)token->value.int_val);
+            break;
+        case TOKEN_FLOAT_NUM:
+            put_bytes(b, &token->value.float_val, 8);
+            break;
+        case TOKEN_CHAR_CONST:
+            put_bytes(b, &token->value.char_val, 1);
+            break;
+        default:
+            break;
+    }
+}
+
+// 解码一个token; token为NULL时只跳过
+static void decode_token(const TokenBuf* b, TokenCursor* cur, const Lexer* lexer, Token* token) {
+    uint64_t tag = get_varint(b, &cur->byte);
+    size_t offset = cur->prev_end + (size_t)get_varint(b, &cur->byte);
+    size_t length = (size_t)get_varint(b, &cur->byte);
+    size_t pool_offset = (tag & 1) ? (size_t)get_varint(b, &cur->byte) : 0;
+    TokenType type = (TokenType)(tag >> 1);
+    cur->prev_end = offset + length;
+    cur->index++;
+
+    if (token) {
+        token->type = type;
+        token->loc = lexer->base + (SourceLoc)offset;
+        token->length = (unsigned int)length;
+        if (tag & 1) {
+            strcpy(token->lexeme, b->pool + pool_offset);
+        } else {
+            size_t n = length < 255 ? length : 255;
+            memcpy(token->lexeme, lexer->buffer + offset, n);
+            token->lexeme[n] = '\0';
+        }
+    }
+    switch (type) {
+        case TOKEN_INTEGER:
+        case TOKEN_HEX:
+        case TOKEN_OCTAL: {
+            uint64_t v = get_varint(b, &cur->byte);
+            if (token) token->value.int_val = (long long)v;
+            break;
+        }
+        case TOKEN_FLOAT_NUM:
+            if (token) memcpy(&token->value.float_val, b->data + cur->byte, 8);
+            cur->byte += 8;
+            break;
+        case TOKEN_CHAR_CONST:
+            if (token) token->value.char_val = (char)b->data[cur->byte];
+            cur->byte += 1;
+            break;
+        default:
+            break;
+    }
+}
+
+// 记下刚扫描的报错token; before为扫描它之前的诊断状态
+static void note_error(Chunk* c, const DiagMark* before) {
+    const DiagEngine* d = &c->diag;
+    if (c->runs_truncated) return;
+    // 超出上限后诊断已经无法转交(见diag_append_since), 不必再记
+    if (d->suppressed > 0) {
+        c->runs_truncated = true;
+        return;
+    }
+    if (c->run_count > 0) {
+        ErrorRun* last = &c->runs[c->run_count - 1];
+        if (d->count == before->count && before->count == last->entries) {
+            last->last = c->token_count;
+            return;
+        }
+    }
+    if (c->run_count == c->run_cap) {
+        int cap = c->run_cap ? c->run_cap * 2 : 16;
+        ErrorRun* r = (ErrorRun*)realloc(c->runs, (size_t)cap * sizeof(ErrorRun));
+        if (!r) {
+            c->runs_truncated = true;
+            return;
+        }
+        c->runs = r;
+        c->run_cap = cap;
+    }
+    ErrorRun* r = &c->runs[c->run_count++];
+    r->first = r->last = c->token_count;
+    r->before = *before;
+    r->entries = d->count;
+}
+
+// 线程函数: 从块起点按正常状态扫描, 直到token起点越过块的终点
+static void* lex_chunk(void* arg) {
+    Chunk* c = (Chunk*)arg;
+    Lexer* lx = &c->lexer;
+    size_t prev_end = c->begin;
+    DiagMark mark;
+    seek_lexer(lx, c->begin);
+
+    for (;;) {
+        diag_mark(&c->diag, &mark);
+        lx->has_error = false;
+        Token token = get_token(lx);
+        size_t start = token.loc - lx->base;
+        if (start >= c->end) {
+            // 这个token属于下一块, 撤销扫描它时产生的诊断
+            diag_rollback(&c->diag, &mark);
+            break;
+        }
+        if (lx->has_error) note_error(c, &mark);
+        if (token.type == TOKEN_EOF) {
+            c->hit_eof = true;
+            c->eof_pos = start;
+            break;
+        }
+        encode_token(&c->buf, lx, &token, &prev_end);
+        c->token_count++;
+        if (c->buf.failed) break;
+    }
+    c->last_end = prev_end;
+    return NULL;
+}
+
+// 真实扫描位置pos是否为本块某个token之前的位置; 是则把游标停在那个token上
+static bool find_resume(Chunk* c, size_t pos) {
+    TokenCursor* cur = &c->cursor;
+    while (cur->prev_end < pos && cur->index < c->token_count) {
+        decode_token(&c->buf, cur, &c->lexer, NULL);
+    }
+    return cur->prev_end == pos;
+}
+
+static void add_segment(struct ParallelLex* p, const TokenBuf* buf, size_t from, size_t to, size_t prev_end) {
+    if (from == to) return;
+    // 重新扫描的token逐个加入, 与上一段相连时直接延长
+    if (p->seg_count > 0) {
+        Segment* last = &p->segs[p->seg_count - 1];
+        if (last->buf == buf && last->byte_to == from) {
+            last->byte_to = to;
+            return;
+        }
+    }
+    if (p->seg_count == p->seg_cap) {
+        int cap = p->seg_cap ? p->seg_cap * 2 : 16;
+        Segment* s = (Segment*)realloc(p->segs, (size_t)cap * sizeof(Segment));
+        if (!s) {
+            p->repair.failed = true;
+            return;
+        }
+        p->segs = s;
+        p->seg_cap = cap;
+    }
+    Segment* s = &p->segs[p->seg_count++];
+    s->buf = buf;
+    s->byte_from = from;
+    s->byte_to = to;
+    s->prev_end = prev_end;
+}
+
+// 在第index个token处汇合后, 把本块从这个token起的诊断转交给主收集器; 无法与之前的诊断分开时返回false
+static bool take_diags(const Chunk* c, long index, Lexer* lexer) {
+    for (int i = 0; i < c->run_count; i++) {
+        const ErrorRun* r = &c->runs[i];
+        if (r->last < index) continue;
+        // 汇合点前后的诊断合并成了同一条
+        if (r->first < index) return false;
+        if (!diag_append_since(lexer->diag, &c->diag, &r->before)) return false;
+        lexer->has_error = true;
+        return true;
+    }
+    // 没记下的报错token可能在汇合点之后
+    return !c->runs_truncated;
+}
+
+// 按顺序校验各块的起点, 拼接出与顺序扫描相同的token流
+static bool merge_chunks(struct ParallelLex* p, Lexer* lexer) {
+    Lexer rl = *lexer;           // 修补用的词法分析器, 诊断直接记入主收集器
+    rl.cache = NULL;
+    rl.parallel = NULL;
+
+    size_t pos = lexer->start;   // 真实的扫描位置
+    int k = 0;
+    for (;;) {
+        Chunk* c = &p->chunks[k];
+        if (find_resume(c, pos) && take_diags(c, c->cursor.index, lexer)) {
+            // 推测的起始状态与真实状态汇合, 本块其余token全部可用
+            add_segment(p, &c->buf, c->cursor.byte, c->buf.size, pos);
+            if (c->hit_eof) {
+                p->eof_pos = c->eof_pos;
+                break;
+            }
+            pos = c->last_end;
+            k++;
+            continue;
+        }
+
+        // 没有汇合: 从真实位置顺序扫描一个token
+        seek_lexer(&rl, pos);
+        rl.has_error = false;
+        Token token = get_token(&rl);
+        if (rl.has_error) lexer->has_error = true;
+        size_t start = token.loc - rl.base;
+        if (token.type == TOKEN_EOF) {
+            p->eof_pos = start;
+            break;
+        }
+        // 越过了本块, 后面的块从下一个位置开始校验
+        while (k + 1 < p->chunk_count && start >= p->chunks[k + 1].begin) k++;
+        size_t from = p->repair.size;
+        size_t prev_end = pos;
+        encode_token(&p->repair, &rl, &token, &prev_end);
+        add_segment(p, &p->repair, from, p->repair.size, pos);
+        pos = prev_end;
+        if (p->repair.failed) return false;
+    }
+    return !p->repair.failed;
+}
+
+void parlex_free(struct ParallelLex* p) {
+    if (!p) return;
+    for (int i = 0; i < p->chunk_count; i++) {
+        buf_free(&p->chunks[i].buf);
+        diag_free(&p->chunks[i].diag);
+        free(p->chunks[i].runs);
+    }
+    free(p->chunks);
+    buf_free(&p->repair);
+    free(p->segs);
+    free(p);
+}
+
+bool parlex_start(Lexer* lexer, int threads) {
+    if (threads <= 1 || lexer->parallel || lexer->pp || tokcache_replaying(lexer->cache)) return false;
+    size_t span = lexer->length - lexer->start;
+    int count = threads;
+    if ((size_t)count > span / PARLEX_MIN_CHUNK) count = (int)(span / PARLEX_MIN_CHUNK);
+    if (count <= 1) return false;
+
+    struct ParallelLex* p = (struct ParallelLex*)calloc(1, sizeof(struct ParallelLex));
+    if (!p) return false;
+    p->chunks = (Chunk*)calloc((size_t)count, sizeof(Chunk));
+    if (!p->chunks) {
+        free(p);
+        return false;
+    }
+
+    // 块的分界点取在换行符上, 换行符不会出现在token内部
+    size_t begin = lexer->start;
+    for (int k = 0; k < count; k++) {
+        size_t end = lexer->length + 1;
+        if (k + 1 < count) {
+            size_t target = lexer->start + span / (size_t)count * (size_t)(k + 1);
+            if (target <= begin) target = begin + 1;
+            const char* nl = target < lexer->length ? (const char*)memchr(lexer->buffer + target, '\n', lexer->length - target) : NULL;
+            if (nl) end = (size_t)(nl - lexer->buffer);
+        }
+        Chunk* c = &p->chunks[p->chunk_count++];
+        c->lexer = *lexer;
+        c->lexer.cache = NULL;
+        c->lexer.parallel = NULL;
+        c->lexer.diag = &c->diag;
+        diag_init(&c->diag);
+        diag_set_limit(&c->diag, lexer->diag->limit);
+        c->begin = begin;
+        c->end = end;
+        c->cursor.prev_end = begin;
+        if (end > lexer->length) break;
+        begin = end;
+    }
+
+    pthread_t* tids = (pthread_t*)malloc((size_t)p->chunk_count * sizeof(pthread_t));
+    bool* started = (bool*)calloc((size_t)p->chunk_count, sizeof(bool));
+    for (int k = 0; tids && started && k < p->chunk_count; k++) {
+        started[k] = pthread_create(&tids[k], NULL, lex_chunk, &p->chunks[k]) == 0;
+        // 创建线程失败时在当前线程里做
+        if (!started[k]) lex_chunk(&p->chunks[k]);
+    }
+    bool ok = tids && started;
+    for (int k = 0; ok && k < p->chunk_count; k++) {
+        if (started[k]) pthread_join(tids[k], NULL);
+        if (p->chunks[k].buf.failed) ok = false;
+    }
+    free(tids);
+    free(started);
+
+    if (!ok || !merge_chunks(p, lexer)) {
+        parlex_free(p);
+        return false;
+    }
+    lexer->parallel = p;
+    parlex_rewind(p);
+    return true;
+}
+
+void parlex_rewind(struct ParallelLex* p) {
+    p->cur_seg = 0;
+    if (p->seg_count > 0) {
+        p->cur.byte = p->segs[0].byte_from;
+        p->cur.prev_end = p->segs[0].prev_end;
+    }
+}
+
+void parlex_next(struct ParallelLex* p, const Lexer* lexer, Token* token) {
+    while (p->cur_seg < p->seg_count) {
+        const Segment* s = &p->segs[p->cur_seg];
+        if (p->cur.byte < s->byte_to) {
+            decode_token(s->buf, &p->cur, lexer, token);
+            return;
+        }
+        if (++p->cur_seg < p->seg_count) {
+            p->cur.byte = p->segs[p->cur_seg].byte_from;
+            p->cur.prev_end = p->segs[p->cur_seg].prev_end;
+        }
+    }
+    // 与顺序扫描一样, 结束后一直返回EOF
+    token->type = TOKEN_EOF;
+    strcpy(token->lexeme, "EOF");
+    token->loc = lexer->base + (SourceLoc)p->eof_pos;
+    token->length = 0;
+}
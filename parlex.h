@@ -0,0 +1,23 @@
+#ifndef PARLEX_H
+#define PARLEX_H
+
+#include "lexer.h"
+
+// NOTE - 单个大文件的并行词法分析
+// 把文件在换行符处切成若干块, 每块由一个线程从"不在注释/字符串中"的假设状态开始扫描;
+// 然后按顺序校验块边界: 词法分析器的状态只由扫描位置决定, 真实的扫描位置与某块内
+// 某个token之前的位置相同时, 该块从这个token起的结果一定正确, 否则从真实位置顺序重新扫描修补
+// 结果与顺序调用get_token()完全一致
+
+struct ParallelLex;
+
+// 用threads个线程扫描整个文件, 之后get_token()按顺序返回结果
+// 文件太小、threads<=1或已启用预处理时不启用, 返回false
+bool parlex_start(Lexer* lexer, int threads);
+
+// 取出下一个token, 直接写入调用者的token(Token较大, 避免按值复制)
+void parlex_next(struct ParallelLex* p, const Lexer* lexer, Token* token);
+void parlex_rewind(struct ParallelLex* p);
+void parlex_free(struct ParallelLex* p);
+
+#endif
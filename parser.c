@@ -1,14 +1,45 @@
 #include "parser.h"
+#include "astcache.h"
+#include "tokcache.h"
+#include "output.h"
+#include "preproc.h"
+#include "tokring.h"
+#include "tokpipe.h"
+#include "pushsrc.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdarg.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <string.h>
 
 // NOTE - 全局解析器状态
 static Lexer* lexer = NULL;
-static Token lookahead;
+static TokenRing ring;             // 向前看缓冲区
+static const Token* lookahead;     // 当前token, 即tokring_peek(&ring, 0)
 static bool parse_error = false;
+static Ast* tree = NULL;            // 事件式解析时为NULL, 不建语法树
+
+// NOTE - 提前结束: 回调要求停止或超出资源上限
+// 之后lookahead固定为EOF, 各语法函数随之尽快返回; 由此产生的语法错误在结束时撤销
+static bool halted = false;
+static Token halt_token;
+static DiagMark halt_mark;                // 停止时的诊断状态
+static ParseLimits limits;
+static bool has_limits = false;
+static LimitKind limit_hit = LIMIT_NONE;
+static int depth = 0;                     // 块、控制语句和括号的嵌套层数
+static int errors_base = 0;               // 开始时已有的诊断条数
+static bool pipelined = false;            // 词法分析在单独的线程中进行(见tokpipe.h)
+
+// NOTE - 推测性分析的状态(见binary_expr之前的说明)
+static int speculating = 0;               // 正在进行的推测层数, 推测中不产生任何输出
+static bool spec_failed = false;          // 当前这一层推测遇到了语法错误
+
+// NOTE - 事件式解析的状态
+static const ParseEvents* events = NULL;
+static void* events_user = NULL;
+static const char* events_text = NULL;   // 主文件内容在调用者缓冲区中的起点, 对应lexer->base
 
 // NOTE - 用于记录推导过程的二维数组
 #define MAX_STEPS 200
@@ -18,6 +49,8 @@ static int step_count = 0;
 
 // 记录当前推导状态
 static char current_derivation[MAX_STEP_LEN] = "program";
+// 推导式超出缓冲区后不再记录(大输入只保留前面的步骤)
+static bool derivation_overflow = false;
 
 // 保存当前步骤
 static void save_step(void) {
@@ -30,9 +63,15 @@ static void save_step(void) {
 // 替换推导式中的非终结符
 static void replace_nonterminal(const char* nonterm, const char* replacement) {
     char temp[MAX_STEP_LEN] = "";
+    if (derivation_overflow || step_count >= MAX_STEPS || speculating) return;
     char* pos = strstr(current_derivation, nonterm);
     
     if (pos) {
+        if (strlen(current_derivation) - strlen(nonterm) + strlen(replacement) >= MAX_STEP_LEN) {
+            derivation_overflow = true;
+            return;
+        }
+        
         // 复制前半部分
         int len = pos - current_derivation;
         strncpy(temp, current_derivation, len);
@@ -71,41 +110,132 @@ static void cleanup_nonterminal(const char* nonterm) {
 static void advance_token(void);
 static void match(TokenType expected);
 
-static void program(void);
-static void block(void);
-static void stmts(void);
-static void stmt(void);
+static AstNode* program(void);
+static AstNode* block(void);
+static AstNode* stmts(void);
+static AstNode* stmt(void);
+
+static AstNode* assignment_stmt(void);
+static AstNode* if_stmt(void);
+static AstNode* while_stmt(void);
+static AstNode* do_while_stmt(void);
+static AstNode* break_stmt(void);
 
-static void assignment_stmt(void);
-static void if_stmt(void);
-static void while_stmt(void);
-static void do_while_stmt(void);
-static void break_stmt(void);
+static AstNode* expr(void);
+static AstNode* bool_expr(void);
+static AstNode* binary_expr(int min_prec);
+static AstNode* unary_expr(void);
 
-static void expr(void);
-static void expr_prime(void);
-static void term(void);
-static void term_prime(void);
-static void factor(void);
+// 不建语法树时所有结点都写到这个结点上, 其内容不会被读取
+static AstNode scratch_node;
 
-static void bool_expr(void);
-static void bool_rest(void);
+// 以lookahead的位置新建语法树结点
+static AstNode* new_node(AstKind kind) {
+    if (!tree || speculating) return &scratch_node;
+    return ast_new_node(tree, kind, lookahead->loc);
+}
+
+// 二元运算结点
+static AstNode* new_binary(TokenType op, AstNode* left, AstNode* right) {
+    if (!tree || speculating) return &scratch_node;
+    AstNode* node = ast_new_node(tree, AST_BINARY, left->loc);
+    node->op = op;
+    node->left = left;
+    node->right = right;
+    return node;
+}
+
+// 标识符和数的词素
+static const char* node_name(void) {
+    return tree && !speculating ? ast_strdup(tree, lookahead->lexeme) : NULL;
+}
+
+static void halt(void) {
+    if (halted) return;
+    halted = true;
+    diag_mark(lexer->diag, &halt_mark);
+    memset(&halt_token, 0, sizeof(halt_token));
+    halt_token.type = TOKEN_EOF;
+    strcpy(halt_token.lexeme, "EOF");
+    halt_token.loc = lookahead->loc;
+    lookahead = &halt_token;
+}
+
+// 语法分析器检查的上限(嵌套层数、诊断条数), 在lookahead处报告
+static void halt_on_limit(LimitKind kind) {
+    if (halted) return;
+    budget_report(lexer->diag, &limits, kind, lookahead->loc);
+    limit_hit = kind;
+    halt();
+}
+
+// 进入一层嵌套; 超出上限时停止, 不再继续递归
+static void enter_nesting(void) {
+    depth++;
+    if (has_limits && limits.max_depth > 0 && depth > limits.max_depth) halt_on_limit(LIMIT_DEPTH);
+}
+
+static void leave_nesting(void) {
+    depth--;
+}
+
+// 每读入一个token检查一次: 词法分析器超出上限时返回的是EOF, 诊断条数由这里检查
+static void check_limits(void) {
+    if (lookahead->type == TOKEN_EOF && lexer->limit_hit != LIMIT_NONE) {
+        limit_hit = lexer->limit_hit;
+        halt();
+    } else if (limits.max_errors > 0 &&
+               lexer->diag->count + lexer->diag->suppressed - errors_base >= limits.max_errors) {
+        halt_on_limit(LIMIT_ERRORS);
+    }
+}
+
+static void emit_enter(ParseConstruct construct) {
+    if (events && events->enter && !halted && !speculating &&
+        !events->enter(events_user, construct, lookahead->loc)) {
+        halt();
+    }
+}
+
+static void emit_exit(ParseConstruct construct) {
+    if (events && events->exit && !halted && !speculating && !events->exit(events_user, construct)) {
+        halt();
+    }
+}
+
+// token在源文本中的位置: 主文件在调用者的缓冲区中, 其他文件在源文件管理器中
+static const char* token_text(const Token* token) {
+    if (events_text && token->loc >= lexer->base && token->loc - lexer->base <= lexer->length) {
+        return events_text + (token->loc - lexer->base);
+    }
+    SourceManager* sm = srcmgr_default();
+    SourceFile* file = srcmgr_file(sm, srcmgr_file_of(sm, token->loc));
+    return file ? file->buffer + (token->loc - file->base) : token->lexeme;
+}
 
 // TODO - 词法单元前进
 static void advance_token(void) {
-    lookahead = get_token(lexer);
+    if (events && events->token && !halted && !speculating) {
+        if (!events->token(events_user, lookahead, token_text(lookahead), lookahead->length)) {
+            halt();
+            return;
+        }
+    }
+    if (halted) return;
+    tokring_consume(&ring);
+    lookahead = tokring_peek(&ring, 0);
+    if (has_limits) check_limits();
 }
 
 // TODO - 匹配期望的词法单元
 static void match(TokenType expected) {
-    if (lookahead.type == expected) {
+    if (lookahead->type == expected) {
         advance_token();
+    } else if (speculating) {
+        spec_failed = true;
     } else {
-        fprintf(stderr, "Syntax error at line %d, col %d: expected %s but found %s ('%s')\n",
-                lookahead.line, lookahead.column,
-                token_type_to_str(expected),
-                token_type_to_str(lookahead.type),
-                lookahead.lexeme);
+        diag_report(lexer->diag, DIAG_EXPECTED_TOKEN, lookahead->loc,
+                    expected, lookahead->type, lookahead->lexeme);
         parse_error = true;
     }
 }
@@ -113,380 +243,826 @@ static void match(TokenType expected) {
 // NOTE - 以下为语法函数的实现：
 
 // TODO - program -> block
-static void program(void) {
+static AstNode* program(void) {
     // 保存初始状态
     save_step();
+    emit_enter(PARSE_PROGRAM);
     
     replace_nonterminal("program", "block");
     
-    block();
+    AstNode* root = block();
     
     // 清理可能的剩余非终结符
     cleanup_nonterminal("stmts");
     cleanup_nonterminal("stmt");
     
-    if (lookahead.type != TOKEN_EOF) {
-        fprintf(stderr, "Warning: extra tokens after program end at line %d\n", lookahead.line);
+    if (lookahead->type != TOKEN_EOF) {
+        diag_report(lexer->diag, DIAG_EXTRA_TOKENS, lookahead->loc, 0, 0, NULL);
     }
+    emit_exit(PARSE_PROGRAM);
+    return root;
 }
 
 // TODO - block -> '{' stmts '}'
-static void block(void) {
-    // 保存当前的推导状态
-    char saved_derivation[MAX_STEP_LEN];
-    strcpy(saved_derivation, current_derivation);
+static AstNode* block(void) {
+    AstNode* node = new_node(AST_BLOCK);
+    emit_enter(PARSE_BLOCK);
+    enter_nesting();
     
     // 先替换为block
     replace_nonterminal("block", "{ stmts }");
     
-    if (lookahead.type == TOKEN_LBRACE) {
+    if (lookahead->type == TOKEN_LBRACE) {
         match(TOKEN_LBRACE);
-        stmts();
+        node->body = stmts();
         match(TOKEN_RBRACE);
     } else {
-        fprintf(stderr, "Syntax error: expected '{' at line %d\n", lookahead.line);
+        diag_report(lexer->diag, DIAG_EXPECTED_LBRACE, lookahead->loc, 0, 0, NULL);
         parse_error = true;
     }
+    leave_nesting();
+    emit_exit(PARSE_BLOCK);
+    return node;
 }
 
 // TODO - stmts -> stmt stmts | ε
-static void stmts(void) {
+// 尾递归改为循环, 长语句序列不再占用与语句数成正比的栈
+static AstNode* stmts(void) {
+    AstNode* head = NULL;
+    AstNode** tail = &head;
+    
     // 检查是否应该应用 ε 产生式
-    if (lookahead.type == TOKEN_RBRACE) {
-        // ε 产生式：从推导式中删除 stmts
-        char* pos = strstr(current_derivation, "stmts");
-        if (pos) {
-            char temp[MAX_STEP_LEN];
-            strncpy(temp, current_derivation, pos - current_derivation);
-            temp[pos - current_derivation] = '\0';
-            strcat(temp, pos + 5); // 5是"stmts"的长度
-            strcpy(current_derivation, temp);
-            save_step();
-        }
-        return;
+    while (lookahead->type != TOKEN_RBRACE) {
+        replace_nonterminal("stmts", "stmt stmts");
+        
+        AstNode* s = stmt();
+        *tail = s;
+        tail = &s->next;
+        
+        // 出错且已到文件尾时停止, 避免死循环
+        if (lookahead->type == TOKEN_EOF) return head;
     }
     
-    replace_nonterminal("stmts", "stmt stmts");
-    
-    stmt();
-    stmts();
+    // ε 产生式：从推导式中删除 stmts
+    replace_nonterminal("stmts", "");
+    return head;
 }
 
 // TODO - stmt -> id = expr ; | if ( bool ) stmt [ else stmt ] | while ( bool ) stmt | do stmt while ( bool ) ; | break ; | block
-static void stmt(void) {
-    if (lookahead.type == TOKEN_IDENTIFIER) {
-        assignment_stmt();
-    } else if (lookahead.type == TOKEN_IF) {
-        if_stmt();
-    } else if (lookahead.type == TOKEN_WHILE) {
-        while_stmt();
-    } else if (lookahead.type == TOKEN_DO) {
-        do_while_stmt();
-    } else if (lookahead.type == TOKEN_BREAK) {
-        break_stmt();
-    } else if (lookahead.type == TOKEN_LBRACE) {
+static AstNode* stmt(void) {
+    if (lookahead->type == TOKEN_IDENTIFIER) {
+        return assignment_stmt();
+    } else if (lookahead->type == TOKEN_IF) {
+        return if_stmt();
+    } else if (lookahead->type == TOKEN_WHILE) {
+        return while_stmt();
+    } else if (lookahead->type == TOKEN_DO) {
+        return do_while_stmt();
+    } else if (lookahead->type == TOKEN_BREAK) {
+        return break_stmt();
+    } else if (lookahead->type == TOKEN_LBRACE) {
         // 这里直接调用block，因为block函数会处理替换
-        block();
+        return block();
     } else {
-        fprintf(stderr, "Syntax error: unexpected token %s ('%s') at line %d in stmt\n",
-                token_type_to_str(lookahead.type), lookahead.lexeme, lookahead.line);
+        diag_report(lexer->diag, DIAG_UNEXPECTED_IN_STMT, lookahead->loc,
+                    lookahead->type, 0, lookahead->lexeme);
         parse_error = true;
+        AstNode* node = new_node(AST_ERROR);
+        emit_enter(PARSE_ERROR);
+        // 跳过出错的词法单元, 保证语句循环前进
+        if (lookahead->type != TOKEN_EOF) advance_token();
+        emit_exit(PARSE_ERROR);
+        return node;
     }
 }
 
 // TODO - assignment_stmt -> id = expr ;
-static void assignment_stmt(void) {
+static AstNode* assignment_stmt(void) {
+    AstNode* node = new_node(AST_ASSIGN);
+    emit_enter(PARSE_ASSIGN);
     replace_nonterminal("stmt", "id = expr ;");
     
     // 匹配标识符
+    node->left = new_node(AST_IDENT);
+    node->left->name = node_name();
     match(TOKEN_IDENTIFIER);
     
     // 匹配赋值符号
     match(TOKEN_ASSIGN);
     
     // 处理表达式
-    expr();
+    node->right = expr();
     
     // 匹配分号
     match(TOKEN_SEMICOLON);
+    emit_exit(PARSE_ASSIGN);
+    return node;
 }
 
 // TODO - while_stmt -> while '(' bool ')' stmt
-static void while_stmt(void) {
-    // 保存当前推导式，以便之后替换stmt
-    char saved_derivation[MAX_STEP_LEN];
-    strcpy(saved_derivation, current_derivation);
-    
+static AstNode* while_stmt(void) {
+    AstNode* node = new_node(AST_WHILE);
+    emit_enter(PARSE_WHILE);
+    enter_nesting();
     replace_nonterminal("stmt", "while ( bool ) stmt");
     
     match(TOKEN_WHILE);
     match(TOKEN_LPAREN);
     
-    bool_expr();
+    node->cond = bool_expr();
     
     match(TOKEN_RPAREN);
     
     // 继续解析 while 循环体
     // 这里需要判断循环体是block还是单个stmt
-    if (lookahead.type == TOKEN_LBRACE) {
+    if (lookahead->type == TOKEN_LBRACE) {
         // 循环体是block
-        // 先替换stmt为block
-        char* pos = strstr(current_derivation, "stmt");
-        if (pos) {
-            char temp[MAX_STEP_LEN];
-            strncpy(temp, current_derivation, pos - current_derivation);
-            temp[pos - current_derivation] = '\0';
-            strcat(temp, "block");
-            strcat(temp, pos + 4);
-            strcpy(current_derivation, temp);
-            save_step();
-        }
-        
-        // 然后解析block
-        block();
+        // 先替换stmt为block, 然后解析block
+        replace_nonterminal("stmt", "block");
+        node->body = block();
     } else {
         // 循环体是单个stmt
-        stmt();
+        node->body = stmt();
     }
+    leave_nesting();
+    emit_exit(PARSE_WHILE);
+    return node;
 }
 
 // TODO - if_stmt -> if '(' bool ')' stmt [ else stmt ]
-static void if_stmt(void) {
+static AstNode* if_stmt(void) {
+    AstNode* node = new_node(AST_IF);
+    emit_enter(PARSE_IF);
+    enter_nesting();
     replace_nonterminal("stmt", "if ( bool ) stmt");
     
     match(TOKEN_IF);
     match(TOKEN_LPAREN);
     
-    bool_expr();
+    node->cond = bool_expr();
     
     match(TOKEN_RPAREN);
     
-    if (lookahead.type == TOKEN_ELSE) {
+    if (lookahead->type == TOKEN_ELSE) {
         // 更新推导式
-        char* pos = strstr(current_derivation, "stmt");
-        if (pos) {
-            char temp[MAX_STEP_LEN];
-            strncpy(temp, current_derivation, pos - current_derivation);
-            temp[pos - current_derivation] = '\0';
-            strcat(temp, "stmt else stmt");
-            strcat(temp, pos + 4);
-            strcpy(current_derivation, temp);
-            save_step();
-        }
+        replace_nonterminal("stmt", "stmt else stmt");
         
-        stmt();
+        node->body = stmt();
         match(TOKEN_ELSE);
-        stmt();
+        node->else_body = stmt();
     } else {
-        stmt();
+        node->body = stmt();
     }
+    leave_nesting();
+    emit_exit(PARSE_IF);
+    return node;
 }
 
 // TODO - do_while_stmt -> do stmt while '(' bool ')' ;
-static void do_while_stmt(void) {
+static AstNode* do_while_stmt(void) {
+    AstNode* node = new_node(AST_DO_WHILE);
+    emit_enter(PARSE_DO_WHILE);
+    enter_nesting();
     replace_nonterminal("stmt", "do stmt while ( bool ) ;");
     
     match(TOKEN_DO);
-    stmt();
+    node->body = stmt();
     match(TOKEN_WHILE);
     match(TOKEN_LPAREN);
-    bool_expr();
+    node->cond = bool_expr();
     match(TOKEN_RPAREN);
     match(TOKEN_SEMICOLON);
+    leave_nesting();
+    emit_exit(PARSE_DO_WHILE);
+    return node;
 }
 
 // TODO - break_stmt -> break ;
-static void break_stmt(void) {
+static AstNode* break_stmt(void) {
+    AstNode* node = new_node(AST_BREAK);
+    emit_enter(PARSE_BREAK);
     replace_nonterminal("stmt", "break ;");
     
     match(TOKEN_BREAK);
     match(TOKEN_SEMICOLON);
+    emit_exit(PARSE_BREAK);
+    return node;
 }
 
-// 表达式处理函数
-static void expr(void) {
-    replace_nonterminal("expr", "term expr'");
-    
-    term();
-    expr_prime();
+// NOTE - 表达式: 按绑定强度表的算符优先(Pratt)分析
+// 每个操作数只需 binary_expr + unary_expr 两次调用, 新增优先级只需要改表
+// 优先级从低到高: || < && < 关系运算 < + - < * / % < 单目 -
+// 关系运算不可结合(a < b < c 与原文法一样报错), 其余左结合
+enum {
+    PREC_NONE,
+    PREC_OR,      // ||
+    PREC_AND,     // &&
+    PREC_REL,     // < <= > >= == !=
+    PREC_ADD,     // + -
+    PREC_MUL,     // * / %
+    PREC_UNARY    // 单目 -, 即 factor
+};
+
+static const unsigned char binding_power[LEXTAB_TOKEN_COUNT] = {
+    [TOKEN_OR] = PREC_OR,
+    [TOKEN_AND] = PREC_AND,
+    [TOKEN_LT] = PREC_REL, [TOKEN_LE] = PREC_REL, [TOKEN_GT] = PREC_REL,
+    [TOKEN_GE] = PREC_REL, [TOKEN_EQ] = PREC_REL, [TOKEN_NE] = PREC_REL,
+    [TOKEN_PLUS] = PREC_ADD, [TOKEN_MINUS] = PREC_ADD,
+    [TOKEN_MULTIPLY] = PREC_MUL, [TOKEN_DIVIDE] = PREC_MUL, [TOKEN_MOD] = PREC_MUL
+};
+
+// 各优先级在原文法中对应的非终结符, 用于按原来的样子记录推导过程:
+// 进入一层时 nonterm -> expansion, 遇到本层运算符时 prime -> op 下一层 prime, 结束时 prime -> ε
+// || 和 && 是新增的运算, 没有对应的非终结符, 推导中在左操作数之后插入 "&& bool"
+static const struct {
+    const char* nonterm;
+    const char* expansion;
+    const char* prime;
+    bool left_assoc;
+} prec_level[] = {
+    [PREC_NONE] = { NULL, NULL, NULL, false },
+    [PREC_OR] = { NULL, NULL, NULL, true },
+    [PREC_AND] = { NULL, NULL, NULL, true },
+    [PREC_REL] = { "bool", "expr bool_rest", "bool_rest", false },
+    [PREC_ADD] = { "expr", "term expr'", "expr'", true },
+    [PREC_MUL] = { "term", "factor term'", "term'", true },
+    [PREC_UNARY] = { "factor", NULL, NULL, false }
+};
+
+// 推导过程只记录前MAX_STEPS步, 之后表达式分析不再拼接推导串
+static bool deriving(void) {
+    return !derivation_overflow && step_count < MAX_STEPS && !speculating;
 }
 
-static void expr_prime(void) {
-    if (lookahead.type == TOKEN_PLUS) {
-        replace_nonterminal("expr'", "+ term expr'");
-        
-        match(TOKEN_PLUS);
-        term();
-        expr_prime();
-    } else if (lookahead.type == TOKEN_MINUS) {
-        replace_nonterminal("expr'", "- term expr'");
-        
-        match(TOKEN_MINUS);
-        term();
-        expr_prime();
-    } else {
-        // ε 产生式：删除 expr'
-        char* pos = strstr(current_derivation, "expr'");
-        if (pos) {
-            char temp[MAX_STEP_LEN];
-            strncpy(temp, current_derivation, pos - current_derivation);
-            temp[pos - current_derivation] = '\0';
-            strcat(temp, pos + 5); // 5是"expr'"的长度
-            strcpy(current_derivation, temp);
-            save_step();
+// 条件之后的推导串长度, 逻辑运算在这个位置之前插入
+static size_t bool_suffix = 0;
+
+static void insert_logical_step(const char* op) {
+    if (!deriving()) return;
+    size_t len = strlen(current_derivation);
+    size_t add = strlen(op) + strlen(" bool") + 1;
+    if (len + add >= MAX_STEP_LEN) {
+        derivation_overflow = true;
+        return;
+    }
+    size_t at = len - bool_suffix;
+    memmove(current_derivation + at + add, current_derivation + at, bool_suffix + 1);
+    current_derivation[at] = ' ';
+    memcpy(current_derivation + at + 1, op, strlen(op));
+    memcpy(current_derivation + at + 1 + strlen(op), " bool", strlen(" bool"));
+    save_step();
+}
+
+// 赋值右部和括号内: 原文法的 expr
+static AstNode* expr(void) {
+    emit_enter(PARSE_EXPR);
+    AstNode* node = binary_expr(PREC_ADD);
+    emit_exit(PARSE_EXPR);
+    return node;
+}
+
+// 记下推导串中第一个 bool 之后的长度
+static void locate_bool(void) {
+    if (deriving()) {
+        char* pos = strstr(current_derivation, "bool");
+        bool_suffix = pos ? strlen(pos + strlen("bool")) : 0;
+    }
+}
+
+// if / while / do-while 的条件: 原文法的 bool, 另外允许用 && || 连接
+static AstNode* bool_expr(void) {
+    locate_bool();
+    emit_enter(PARSE_COND);
+    AstNode* node = binary_expr(PREC_OR);
+    emit_exit(PARSE_COND);
+    return node;
+}
+
+// NOTE - 推测性分析: 条件中的括号
+// 条件中的 ( 可能括起一个条件, 如 (a > b) && c, 也可能括起算术表达式, 如 (a + b) > c;
+// 两者要看到对应的 ) 之后的token才能区分, 不是LL(k)的. 遇到时先推测: 记下位置, 按 ( bool ) 分析,
+// 成功且之后不是算术或关系运算时就是括起的条件; 然后回到记下的位置按选定的结构正式分析
+// 推测期间不建语法树、不记录推导过程、不发事件也不报告语法错误, 只记录是否成功
+// 推测的结果按(规则, token序号)记在备忘表中(packrat): 同一位置的同一规则只推测一次,
+// 正式分析时直接查表; 推测中嵌套的推测命中成功时直接跳到记下的结束位置, 所以任意嵌套的括号总代价也是线性的
+// 推测会提前取入后面的token, 其中的词法错误可能排在前面token的语法错误之前报告
+typedef enum {
+    RULE_GROUPED_COND,    // ( bool ) 之后不是算术或关系运算
+    RULE_COUNT
+} SpecRule;
+
+typedef struct {
+    size_t pos;           // 规则开始处的token序号
+    size_t end;           // 成功时结束处的token序号
+    int rule;             // -1表示空位
+    bool success;
+} MemoEntry;
+
+#define MEMO_INIT_SIZE 64 // 初始容量, 必须是2的幂
+
+static MemoEntry* memo = NULL;
+static size_t memo_cap = 0;
+static size_t memo_count = 0;
+static ParseMemoStats memo_stats;
+
+static size_t memo_slot(size_t pos, int rule, size_t cap) {
+    uint64_t h = ((uint64_t)pos * RULE_COUNT + (uint64_t)rule) * 0x9E3779B97F4A7C15ull;
+    return (size_t)(h >> 32) & (cap - 1);
+}
+
+static void memo_reset(void) {
+    for (size_t i = 0; i < memo_cap; i++) memo[i].rule = -1;
+    memo_count = 0;
+    memset(&memo_stats, 0, sizeof(memo_stats));
+}
+
+static const MemoEntry* memo_find(size_t pos, int rule) {
+    if (memo_count == 0) return NULL;
+    for (size_t i = memo_slot(pos, rule, memo_cap); memo[i].rule >= 0; i = (i + 1) & (memo_cap - 1)) {
+        if (memo[i].pos == pos && memo[i].rule == rule) return &memo[i];
+    }
+    return NULL;
+}
+
+// 开放定址, 装满一半时加倍; 分配失败时不记录(之后再推测一次, 结果不变)
+static void memo_store(size_t pos, int rule, bool success, size_t end) {
+    if ((memo_count + 1) * 2 > memo_cap) {
+        size_t cap = memo_cap ? memo_cap * 2 : MEMO_INIT_SIZE;
+        MemoEntry* table = (MemoEntry*)malloc(cap * sizeof(MemoEntry));
+        if (!table) return;
+        for (size_t i = 0; i < cap; i++) table[i].rule = -1;
+        for (size_t i = 0; i < memo_cap; i++) {
+            if (memo[i].rule < 0) continue;
+            size_t j = memo_slot(memo[i].pos, memo[i].rule, cap);
+            while (table[j].rule >= 0) j = (j + 1) & (cap - 1);
+            table[j] = memo[i];
         }
+        free(memo);
+        memo = table;
+        memo_cap = cap;
     }
+    size_t i = memo_slot(pos, rule, memo_cap);
+    while (memo[i].rule >= 0) i = (i + 1) & (memo_cap - 1);
+    memo[i].pos = pos;
+    memo[i].end = end;
+    memo[i].rule = rule;
+    memo[i].success = success;
+    memo_count++;
 }
 
-static void term(void) {
-    replace_nonterminal("term", "factor term'");
+// lookahead处的 ( 是否括起一个条件; 是时end为 ) 之后的token序号
+static bool grouped_cond_ahead(size_t* end) {
+    size_t start = ring.head;
+    memo_stats.lookups++;
+    const MemoEntry* e = memo_find(start, RULE_GROUPED_COND);
+    if (e) {
+        memo_stats.hits++;
+        *end = e->end;
+        return e->success;
+    }
     
-    factor();
-    term_prime();
+    memo_stats.speculations++;
+    TokenMark mark = tokring_mark(&ring);
+    bool outer_failed = spec_failed;
+    spec_failed = false;
+    speculating++;
+    enter_nesting();
+    match(TOKEN_LPAREN);
+    binary_expr(PREC_OR);
+    match(TOKEN_RPAREN);
+    leave_nesting();
+    speculating--;
+    bool success = !spec_failed && binding_power[lookahead->type] < PREC_REL;
+    spec_failed = outer_failed;
+    *end = ring.head;
+    tokring_release(&ring, mark);
+    // 推测中已经停止: 停在停止处, 不再回退
+    if (halted) return false;
+    
+    memo_store(start, RULE_GROUPED_COND, success, *end);
+    tokring_rewind(&ring, mark);
+    lookahead = tokring_peek(&ring, 0);
+    return success;
 }
 
-static void term_prime(void) {
-    if (lookahead.type == TOKEN_MULTIPLY) {
-        replace_nonterminal("term'", "* factor term'");
+// bool -> ( bool ): 语法树就是括号中的条件, 不单独产生事件
+static AstNode* grouped_cond(size_t end) {
+    if (speculating) {
+        // 已知能成功, 直接跳到结束处
+        tokring_seek(&ring, end);
+        lookahead = tokring_peek(&ring, 0);
+        return &scratch_node;
+    }
+    replace_nonterminal("bool", "( bool )");
+    size_t outer_suffix = bool_suffix;
+    enter_nesting();
+    match(TOKEN_LPAREN);
+    locate_bool();
+    AstNode* node = binary_expr(PREC_OR);
+    match(TOKEN_RPAREN);
+    leave_nesting();
+    bool_suffix = outer_suffix;
+    return node;
+}
+
+static AstNode* binary_expr(int min_prec) {
+    AstNode* left;
+    int open = PREC_MUL;     // 推导串中仍未消去的最高层 prime
+    int limit = PREC_MUL;    // 本层还能接受的最高优先级
+    size_t end;
+    if (min_prec <= PREC_REL && lookahead->type == TOKEN_LPAREN && grouped_cond_ahead(&end)) {
+        // 括起的条件之后只能是 && 或 ||
+        left = grouped_cond(end);
+        open = PREC_AND;
+        limit = PREC_AND;
+    } else {
+        // 依次展开 min_prec 到 PREC_MUL 各层的非终结符
+        if (deriving()) {
+            for (int p = min_prec; p < PREC_UNARY; p++) {
+                if (prec_level[p].nonterm) replace_nonterminal(prec_level[p].nonterm, prec_level[p].expansion);
+            }
+        }
+        left = unary_expr();
+    }
+    
+    for (;;) {
+        TokenType op = lookahead->type;
+        int prec = binding_power[op];
+        if (prec == PREC_NONE || prec < min_prec || prec > limit) break;
         
-        match(TOKEN_MULTIPLY);
-        factor();
-        term_prime();
-    } else if (lookahead.type == TOKEN_DIVIDE) {
-        replace_nonterminal("term'", "/ factor term'");
+        if (deriving()) {
+            // 比当前运算符高的层都已结束: prime -> ε
+            for (; open > prec; open--) {
+                if (prec_level[open].prime) replace_nonterminal(prec_level[open].prime, "");
+            }
+            if (prec_level[prec].prime) {
+                char rewrite[64];
+                snprintf(rewrite, sizeof(rewrite), "%s %s%s%s", lookahead->lexeme,
+                         prec_level[prec + 1].nonterm,
+                         prec_level[prec].left_assoc ? " " : "",
+                         prec_level[prec].left_assoc ? prec_level[prec].prime : "");
+                replace_nonterminal(prec_level[prec].prime, rewrite);
+            } else {
+                insert_logical_step(lookahead->lexeme);
+            }
+        }
+        // 不可结合的层在运算之后不再保留 prime
+        open = prec_level[prec].left_assoc ? prec : prec - 1;
+        limit = prec_level[prec].left_assoc ? prec : prec - 1;
         
-        match(TOKEN_DIVIDE);
-        factor();
-        term_prime();
-    } else {
-        // ε 产生式：删除 term'
-        char* pos = strstr(current_derivation, "term'");
-        if (pos) {
-            char temp[MAX_STEP_LEN];
-            strncpy(temp, current_derivation, pos - current_derivation);
-            temp[pos - current_derivation] = '\0';
-            strcat(temp, pos + 5); // 5是"term'"的长度
-            strcpy(current_derivation, temp);
-            save_step();
+        match(op);
+        left = new_binary(op, left, binary_expr(prec + 1));
+    }
+    
+    if (deriving()) {
+        for (; open >= min_prec; open--) {
+            if (prec_level[open].prime) replace_nonterminal(prec_level[open].prime, "");
         }
     }
+    return left;
 }
 
-static void factor(void) {
-    if (lookahead.type == TOKEN_LPAREN) {
+// factor -> - factor | ( expr ) | id | num
+static AstNode* unary_expr(void) {
+    AstNode* head = NULL;
+    AstNode** slot = &head;
+    int negations = 0;
+    // 连续的单目负号循环处理, 逐个挂到上一个结点下面
+    while (lookahead->type == TOKEN_MINUS) {
+        replace_nonterminal("factor", "- factor");
+        emit_enter(PARSE_NEGATE);
+        negations++;
+        AstNode* neg = new_node(AST_UNARY);
+        neg->op = TOKEN_MINUS;
+        match(TOKEN_MINUS);
+        *slot = neg;
+        slot = &neg->left;
+    }
+    
+    AstNode* node;
+    if (lookahead->type == TOKEN_LPAREN) {
         replace_nonterminal("factor", "( expr )");
+        enter_nesting();
         match(TOKEN_LPAREN);
-        expr();
+        node = expr();
         match(TOKEN_RPAREN);
-    } else if (lookahead.type == TOKEN_IDENTIFIER) {
+        leave_nesting();
+    } else if (lookahead->type == TOKEN_IDENTIFIER) {
         replace_nonterminal("factor", "id");
+        node = new_node(AST_IDENT);
+        node->name = node_name();
         match(TOKEN_IDENTIFIER);
-    } else if (lookahead.type == TOKEN_INTEGER) {
+    } else if (lookahead->type == TOKEN_INTEGER) {
         replace_nonterminal("factor", "num");
+        node = new_node(AST_NUMBER);
+        node->name = node_name();
         match(TOKEN_INTEGER);
+    } else if (speculating) {
+        spec_failed = true;
+        node = new_node(AST_ERROR);
     } else {
-        fprintf(stderr, "Syntax error: expected factor at line %d, found %s ('%s')\n",
-                lookahead.line, token_type_to_str(lookahead.type), lookahead.lexeme);
+        diag_report(lexer->diag, DIAG_EXPECTED_FACTOR, lookahead->loc,
+                    lookahead->type, 0, lookahead->lexeme);
         parse_error = true;
+        node = new_node(AST_ERROR);
     }
-}
-
-static void bool_expr(void) {
-    replace_nonterminal("bool", "expr bool_rest");
-    
-    expr();
-    bool_rest();
-}
-
-static void bool_rest(void) {
-    if (lookahead.type == TOKEN_LT) {
-        replace_nonterminal("bool_rest", "< expr");
-        match(TOKEN_LT);
-        expr();
-    } else if (lookahead.type == TOKEN_LE) {
-        replace_nonterminal("bool_rest", "<= expr");
-        match(TOKEN_LE);
-        expr();
-    } else if (lookahead.type == TOKEN_GT) {
-        replace_nonterminal("bool_rest", "> expr");
-        match(TOKEN_GT);
-        expr();
-    } else if (lookahead.type == TOKEN_GE) {
-        replace_nonterminal("bool_rest", ">= expr");
-        match(TOKEN_GE);
-        expr();
-    } else if (lookahead.type == TOKEN_EQ) {
-        replace_nonterminal("bool_rest", "== expr");
-        match(TOKEN_EQ);
-        expr();
-    } else if (lookahead.type == TOKEN_NE) {
-        replace_nonterminal("bool_rest", "!= expr");
-        match(TOKEN_NE);
-        expr();
-    } else {
-        // ε 产生式：删除 bool_rest
-        char* pos = strstr(current_derivation, "bool_rest");
-        if (pos) {
-            char temp[MAX_STEP_LEN];
-            strncpy(temp, current_derivation, pos - current_derivation);
-            temp[pos - current_derivation] = '\0';
-            strcat(temp, pos + 9); // 9是"bool_rest"的长度
-            strcpy(current_derivation, temp);
-            save_step();
-        }
-    }
+    *slot = node;
+    while (negations-- > 0) emit_exit(PARSE_NEGATE);
+    return head;
 }
 
 // 打印所有步骤
 static void print_all_steps(void) {
-    printf("Derivation steps:\n");
+    static OutWriter out;
+    out_init(&out, stdout);
+    out_str(&out, "Derivation steps:\n");
     
     for (int i = 0; i < step_count; i++) {
-        if(i==0)
-        printf("%3d: %s\n", i + 1, steps[i]);
-        else
-        printf("%3d: ==> %s\n", i + 1, steps[i]);
+        out_int(&out, i + 1, 3);
+        out_str(&out, i == 0 ? ": " : ": ==> ");
+        out_str(&out, steps[i]);
+        out_char(&out, '\n');
     }
-    printf("\n");
+    out_char(&out, '\n');
+    out_flush(&out);
 }
 
-// NOTE - 对外解析函数
-int parse_file(const char* filename) {
+// NOTE - 磁盘语法树缓存(见astcache.h)
+// 结果只取决于文件内容时才使用: 没有预处理(不依赖其他文件)、没有资源上限、不是事件式解析,
+// 也不是推送式解析(开始时内容还没有到达)
+static bool cacheable(void) {
+    return !events && !has_limits && !lexer->pp && !lexer->push && lexer_get_cache_dir() != NULL;
+}
+
+// 命中时直接取出缓存的结果, 与重新解析得到的完全相同
+static int replay_cached(AstCache* cache, Ast* ast) {
+    const AstCacheHeader* h = astcache_header(cache);
+    if (ast) ast->root = astcache_build_ast(cache, ast, lexer->base);
+    int count;
+    const char* step = astcache_steps(cache, &count);
+    for (step_count = 0; step_count < count && step_count < MAX_STEPS; step_count++) {
+        size_t len = strlen(step);
+        size_t n = len < MAX_STEP_LEN - 1 ? len : MAX_STEP_LEN - 1;
+        memcpy(steps[step_count], step, n);
+        steps[step_count][n] = '\0';
+        step += len + 1;
+    }
+    astcache_replay_diags(cache, lexer->diag, lexer->base);
+    memo_stats.speculations = h->speculations;
+    memo_stats.lookups = h->memo_lookups;
+    memo_stats.hits = h->memo_hits;
+    return h->result;
+}
+
+static void store_cached(Ast* ast, int rc, const DiagMark* start) {
+    const char* step_ptrs[MAX_STEPS];
+    for (int i = 0; i < step_count; i++) step_ptrs[i] = steps[i];
+    AstCacheEntry entry;
+    entry.result = rc;
+    entry.root = ast->root;
+    entry.diag = lexer->diag;
+    entry.first_diag = start->count;
+    entry.suppressed = lexer->diag->suppressed - start->suppressed;
+    entry.steps = step_ptrs;
+    entry.step_count = step_count;
+    entry.memo = memo_stats;
+    astcache_store(lexer, &entry);
+}
+
+// 执行一次完整的解析, 语法树写入ast(为NULL时不建树); 结束时释放词法分析器
+// 调用者不需要语法树时(keep_tree为false)ast只用于写入缓存, 命中缓存时不再重建
+static int run_parser(Lexer* source, Ast* ast, bool keep_tree) {
     parse_error = false;
+    // 事件式解析不需要推导过程, 直接当作已经超出缓冲区
+    derivation_overflow = events != NULL;
     step_count = 0;
     strcpy(current_derivation, "program");
-    
-    if (lexer) {
+    tree = ast;
+    lexer = source;
+    halted = false;
+    speculating = 0;
+    memo_reset();
+    limit_hit = LIMIT_NONE;
+    depth = 0;
+    // 回调要求停止时撤销之后的全部诊断
+    DiagMark start;
+    diag_mark(lexer->diag, &start);
+    errors_base = lexer->diag->count + lexer->diag->suppressed;
+    // #include/#define等在进入语法分析前处理
+    preproc_attach(lexer);
+    AstCache* cached = cacheable() ? astcache_load(lexer) : NULL;
+    if (cached) {
+        int rc = replay_cached(cached, keep_tree ? ast : NULL);
+        astcache_close(cached);
         free_lexer(lexer);
         lexer = NULL;
+        tree = NULL;
+        return rc;
     }
-    
-    lexer = init_lexer(filename);
-    if (!lexer) {
-        fprintf(stderr, "Failed to open source file: %s\n", filename);
+    if (has_limits) lexer_set_limits(lexer, &limits);
+    if (pipelined) tokpipe_start(lexer);
+    if (!tokring_init(&ring, lexer)) {
+        free_lexer(lexer);
+        lexer = NULL;
+        tree = NULL;
         return 1;
     }
     
     // 读入第一个token
-    advance_token();
+    lookahead = tokring_peek(&ring, 0);
+    if (has_limits) check_limits();
     // 开始解析
-    program();
+    AstNode* root = program();
+    if (ast) ast->root = root;
     
-    if (lookahead.type != TOKEN_EOF) {
-        while (lookahead.type != TOKEN_EOF) advance_token();
+    if (lookahead->type != TOKEN_EOF) {
+        while (lookahead->type != TOKEN_EOF) advance_token();
     }
+    // 预处理错误不产生token, 语法分析看不到, 但同样使整个文件失败
+    if (lexer->pp && preproc_failed(lexer->pp)) parse_error = true;
     
+    // 超出上限时保留停止之前的诊断(包括说明超出上限的一条)
+    if (halted) diag_rollback(lexer->diag, limit_hit != LIMIT_NONE ? &halt_mark : &start);
+    if (ast && !halted && cacheable()) store_cached(ast, parse_error ? 2 : 0, &start);
+    tokring_free(&ring);
+    lookahead = NULL;
     free_lexer(lexer);
     lexer = NULL;
+    tree = NULL;
+    
+    if (limit_hit != LIMIT_NONE) return PARSE_LIMIT;
+    if (halted) return PARSE_STOPPED;
+    return parse_error ? 2 : 0;
+}
+
+ParseMemoStats parser_memo_stats(void) {
+    return memo_stats;
+}
+
+// NOTE - 资源上限
+void parser_set_limits(const ParseLimits* l) {
+    has_limits = l != NULL;
+    if (l) limits = *l;
+    else memset(&limits, 0, sizeof(limits));
+}
+
+void parser_set_pipeline(bool enabled) {
+    pipelined = enabled;
+}
+
+static Lexer* open_source(const char* filename) {
+    Lexer* source = init_lexer(filename);
+    if (!source) {
+        fprintf(stderr, "Failed to open source file: %s\n", filename);
+    }
+    return source;
+}
+
+// NOTE - 对外解析函数
+int parse_file(const char* filename) {
+    Lexer* source = open_source(filename);
+    if (!source) return 1;
+    Ast ast;
+    ast_init(&ast);
+    int rc = run_parser(source, &ast, false);
+    ast_free(&ast);
     
     // 打印所有推导步骤
     print_all_steps();
     
-    if (parse_error) {
+    if (rc == PARSE_LIMIT) {
+        fprintf(stderr, "Parsing aborted: resource limit exceeded.\n");
+    } else if (rc != 0) {
         fprintf(stderr, "Parsing finished: syntax errors detected.\n");
-        return 2;
     } else {
         printf("Parsing finished: no syntax errors detected.\n");
-        return 0;
     }
-}
\ No newline at end of file
+    if (memo_stats.speculations > 0) {
+        printf("Speculative parsing: %ld speculations, %ld memo lookups, %ld hits (%.1f%%)\n",
+               memo_stats.speculations, memo_stats.lookups, memo_stats.hits,
+               100.0 * (double)memo_stats.hits / (double)memo_stats.lookups);
+    }
+    return rc;
+}
+
+// NOTE - 解析并保留语法树, 不打印推导过程
+int parse_file_ast(const char* filename, Ast* ast) {
+    Lexer* source = open_source(filename);
+    if (!source) return 1;
+    return run_parser(source, ast, true);
+}
+
+int parse_source_ast(int file_id, Ast* ast) {
+    Lexer* source = init_lexer_source(file_id);
+    if (!source) return 1;
+    return run_parser(source, ast, true);
+}
+
+// NOTE - 事件式解析
+// first_file是本次解析之前已登记的文件数: 解析中登记的文件(主文件和头文件)在结束后释放,
+// 长期运行的嵌入程序反复解析时内存和位置空间不会随次数增长
+static int run_events(Lexer* source, const char* text, const ParseEvents* handlers, void* user, int first_file) {
+    static const ParseEvents none = { NULL, NULL, NULL };
+    events = handlers ? handlers : &none;
+    events_user = user;
+    events_text = text;
+    int rc = run_parser(source, NULL, false);
+    events = NULL;
+    events_user = NULL;
+    events_text = NULL;
+    srcmgr_release_from(srcmgr_default(), first_file);
+    return rc;
+}
+
+int parse_buffer_events(const char* name, const char* data, size_t length,
+                        const ParseEvents* handlers, void* user) {
+    int first_file = srcmgr_default()->count;
+    int file_id = srcmgr_add_buffer(srcmgr_default(), name, data, length);
+    if (file_id < 0) return 1;
+    Lexer* source = init_lexer_source(file_id);
+    if (!source) {
+        srcmgr_release_from(srcmgr_default(), first_file);
+        return 1;
+    }
+    // 内容经过规范化(CRLF、GBK)时偏移与调用者的缓冲区不再对应, text改为指向规范化后的内容
+    const SourceFile* file = srcmgr_file(srcmgr_default(), file_id);
+    return run_events(source, file->offset_map ? NULL : data, handlers, user, first_file);
+}
+
+int parse_file_events(const char* filename, const ParseEvents* handlers, void* user) {
+    int first_file = srcmgr_default()->count;
+    Lexer* source = open_source(filename);
+    if (!source) {
+        srcmgr_release_from(srcmgr_default(), first_file);
+        return 1;
+    }
+    return run_events(source, NULL, handlers, user, first_file);
+}
+
+int parse_source_events(int file_id, const ParseEvents* handlers, void* user) {
+    int first_file = srcmgr_default()->count;
+    Lexer* source = init_lexer_source(file_id);
+    if (!source) return 1;
+    return run_events(source, NULL, handlers, user, first_file);
+}
+
+// NOTE - 推送式解析(见pushsrc.h)
+struct PushParser {
+    struct PushSource* src;
+    Lexer* lexer;
+    Ast* ast;
+    int result;
+};
+
+static void run_pushed(void* arg) {
+    PushParser* p = (PushParser*)arg;
+    p->result = run_parser(p->lexer, p->ast, true);
+}
+
+PushParser* parser_start(const char* name, Ast* ast) {
+    PushParser* p = (PushParser*)calloc(1, sizeof(PushParser));
+    if (!p) {
+        fprintf(stderr, "Memory allocation error\n");
+        return NULL;
+    }
+    int file_id = srcmgr_begin_stream(srcmgr_default(), name);
+    if (file_id < 0) {
+        free(p);
+        return NULL;
+    }
+    p->lexer = init_lexer_source(file_id);
+    p->src = p->lexer ? pushsrc_new(file_id) : NULL;
+    if (!p->src) {
+        free_lexer(p->lexer);
+        srcmgr_end_stream(srcmgr_default(), file_id);
+        free(p);
+        return NULL;
+    }
+    p->lexer->push = p->src;
+    p->ast = ast;
+    p->result = 1;
+    // 分析到第一个token处暂停, 等待内容
+    pushsrc_run(p->src, run_pushed, p);
+    return p;
+}
+
+bool parser_feed(PushParser* p, const char* data, size_t length) {
+    return pushsrc_feed(p->src, data, length);
+}
+
+int parser_finish(PushParser* p) {
+    pushsrc_free(p->src);
+    int rc = p->result;
+    free(p);
+    return rc;
+}
+
+const char* parse_construct_name(ParseConstruct construct) {
+    static const char* names[] = {
+        "program", "block", "assign", "if", "while", "do_while", "break",
+        "expr", "cond", "negate", "error"
+    };
+    if ((int)construct < 0 || construct > PARSE_ERROR) return "unknown";
+    return names[construct];
+}
@@ -2,8 +2,91 @@
 #define PARSER_H
 
 #include"lexer.h"
+#include"ast.h"
+
+// 语法规则版本号, 修改语法树、推导过程或语法错误的报告方式后需要加一, 使磁盘语法树缓存(见astcache.h)失效
+#define PARSER_VERSION 1
 
 //返回0表示语法通过 
 int parse_file(const char* filename);
 
-#endif
\ No newline at end of file
+//同parse_file, 但不打印推导过程, 语法树写入ast(调用者负责ast_free)
+int parse_file_ast(const char* filename, Ast* ast);
+
+//同parse_file_ast, 分析源文件管理器中已有的文件(如srcmgr_add_buffer登记的内容)
+int parse_source_ast(int file_id, Ast* ast);
+
+// 之后的每次解析都受这些资源上限约束(见budget.h), NULL取消; 超出时返回PARSE_LIMIT,
+// 停止之前的诊断照常输出, 语法树只包含已分析的部分
+void parser_set_limits(const ParseLimits* limits);
+#define PARSE_LIMIT 4
+
+// 之后的每次解析把词法分析放到单独的线程中, 与语法分析流水线执行(见tokpipe.h)
+// 结果与顺序分析完全一致; 文件太小、使用了预处理指令或只有一个核时仍顺序分析
+void parser_set_pipeline(bool enabled);
+
+// 最近一次解析中推测性分析的统计(见parser.c中条件里的括号): 推测次数、查备忘表次数和命中次数
+typedef struct {
+    long speculations;
+    long lookups;
+    long hits;
+} ParseMemoStats;
+ParseMemoStats parser_memo_stats(void);
+
+// NOTE - 事件式(SAX)解析接口, 供嵌入使用(make lib生成libparser.a / libparser.so)
+// 解析过程中按顺序回调: 进入/离开语法结构, 以及语法分析器读过的每个token
+// 不建语法树, 也不记录推导过程; 诊断照常在结束时输出到diag_default()->output(NULL为stderr)
+// 解析器状态是全局的, 同一时间只能进行一个解析(包括parse_file等)
+typedef enum {
+    PARSE_PROGRAM,
+    PARSE_BLOCK,      // { stmts }
+    PARSE_ASSIGN,     // id = expr ;
+    PARSE_IF,         // if ( bool ) stmt [ else stmt ]
+    PARSE_WHILE,      // while ( bool ) stmt
+    PARSE_DO_WHILE,   // do stmt while ( bool ) ;
+    PARSE_BREAK,      // break ;
+    PARSE_EXPR,       // 赋值右部和括号内的表达式
+    PARSE_COND,       // if / while / do-while 的条件
+    PARSE_NEGATE,     // - factor
+    PARSE_ERROR       // 无法识别的语句, 其中是被跳过的token
+} ParseConstruct;
+
+// 二元运算不单独产生事件: 分析到运算符时左操作数的事件已经发出, 运算符以token事件出现在两个操作数之间
+// 回调可以为NULL; 返回false时停止解析, 之后不再有任何事件(已进入的结构也不会收到exit)
+typedef struct {
+    bool (*enter)(void* user, ParseConstruct construct, SourceLoc loc);
+    bool (*exit)(void* user, ParseConstruct construct);
+    // text指向该token在源文本中的位置, 共length字节: 主文件的token指向调用者传入的data
+    // (data含\r或是GBK编码时指向规范化后的内容, 见srcnorm.h),
+    // 头文件的token指向源文件管理器中的内容, 宏展开得到的token指向宏名出现处
+    bool (*token)(void* user, const Token* token, const char* text, size_t length);
+} ParseEvents;
+
+// 返回值同parse_file_ast, 另外回调要求停止时返回PARSE_STOPPED(此时不输出诊断)
+#define PARSE_STOPPED 3
+
+// 分析内存中的内容(name只用于显示), data在解析期间必须保持有效
+// 解析中登记到srcmgr_default()的文件(主文件和头文件)在返回前释放(见srcmgr_release_from),
+// 回调得到的SourceLoc和源文件管理器中的text只在解析期间有效; parse_source_events不释放调用者登记的file_id
+int parse_buffer_events(const char* name, const char* data, size_t length,
+                        const ParseEvents* events, void* user);
+int parse_file_events(const char* filename, const ParseEvents* events, void* user);
+int parse_source_events(int file_id, const ParseEvents* events, void* user);
+
+const char* parse_construct_name(ParseConstruct construct);
+
+// NOTE - 推送式解析: 内容分段到达(如从网络接收)时边接收边分析, 不必先收齐整个文件
+// parser_start登记一个名为name的文件, 之后用parser_feed按顺序送入内容, 最后调用parser_finish;
+// 每次parser_feed都会把已到达的内容分析到最后一个完整的token为止, 最后一段到达后只剩下很少的工作
+// 结果(语法树、推导过程、诊断、返回值)与把全部内容用srcmgr_add_buffer登记后交给parse_source_ast相同,
+// 分段方式不影响结果; 例外: 不做预处理('#'按普通字符报告), 不检测GBK编码(CRLF照常规范化), 不读写磁盘缓存;
+// 时间预算从parser_start算起, 包括等待内容的时间; 超过字节数上限时在超出的那一段到达后停止
+typedef struct PushParser PushParser;
+// 语法树写入ast(调用者负责ast_free); 失败时返回NULL
+PushParser* parser_start(const char* name, Ast* ast);
+// 分析已经结束(超出资源上限)或内容无法登记时返回false, 之后的内容不再使用
+bool parser_feed(PushParser* p, const char* data, size_t length);
+// 内容结束, 完成解析并释放p; 返回值同parse_file_ast
+int parser_finish(PushParser* p);
+
+#endif
@@ -1,25 +1,227 @@
 // 示例 main：演示如何使用 parser 与你已有的 lexer
-// 编译：gcc lexer.c parser.c parser_main.c -o parser
+// 编译：gcc lexer.c lextab.c tokcache.c output.c diag.c srcmgr.c parlex.c utf8.c srcnorm.c preproc.c budget.c tokpipe.c pushsrc.c ast.c parser.c astcache.c tokring.c cfg.c dataflow.c server.c symindex.c emitc.c parser_main.c -o parser -pthread
 // 运行：./parser test.c
+//       ./parser --dataflow test.c   (构建控制流图并做数据流分析)
+//       ./parser --emit-c test.c > rule.c   (生成C代码, 见emitc.h; gcc -O2 -shared -fPIC rule.c -o rule.so 后用dlopen载入)
+//       ./parser --cache-dir .cache test.c   (磁盘token缓存和语法树缓存, 内容未变时直接取出上次的结果, 见tokcache.h/astcache.h)
+//       ./parser --include-dir include test.c   (#include <...>的查找目录)
+//       ./parser --serve /tmp/parser.sock   (常驻服务, 协议见server.h)
+//       ./parser --pipeline test.c   (词法分析与语法分析在两个线程中流水线执行, 见tokpipe.h)
+//       ./parser --index idx.bin a.c b.c ...   (建立/增量更新跨文件的标识符索引, 见symindex.h)
+//       ./parser --query idx.bin count assign   (count被赋值的位置; 角色还有use/if/while/other, 不写表示全部)
+//       ./parser --files --query idx.bin price while   (条件中用到price的while所在的文件)
+//       ./parser --max-tokens 100000 --max-depth 200 --deadline-ms 50 test.c   (资源上限, 见budget.h)
 
 #include "parser.h"
+#include "cfg.h"
+#include "dataflow.h"
+#include "tokcache.h"
+#include "server.h"
+#include "preproc.h"
+#include "symindex.h"
+#include "emitc.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <time.h>
+
+#define MAX_DUMP_BLOCKS 200
+
+// 控制流图与数据流分析
+static int run_dataflow(const char* filename) {
+    Ast ast;
+    ast_init(&ast);
+    int rc = parse_file_ast(filename, &ast);
+    if (rc == 1) {
+        printf("Fatal: could not open file.\n");
+        return rc;
+    }
+
+    clock_t start = clock();
+    Cfg cfg;
+    if (cfg_build(&cfg, ast.root) != 0 && rc == 0) rc = 2;
+    DfProblem live;
+    df_liveness(&live, &cfg);
+    ReachingDefs rd;
+    df_reaching_defs(&rd, &cfg);
+    int undefined = df_check_definite_assignment(&cfg, stdout);
+    double ms = (double)(clock() - start) * 1000.0 / CLOCKS_PER_SEC;
+
+    // 大图只输出统计信息, 逐块结果的规模与 块数 x 定值数 成正比
+    if (cfg.block_count <= MAX_DUMP_BLOCKS) {
+        printf("=== Control Flow Graph ===\n");
+        cfg_print(&cfg, stdout);
+        printf("\n=== Dataflow ===\n");
+        df_print_results(&cfg, &live, &rd, stdout);
+    }
+    printf("\n%d blocks, %d variables, %d definitions, %d possibly unassigned uses\n",
+           cfg.block_count, cfg.var_count, rd.def_count, undefined);
+    printf("CFG + dataflow: %.3f ms (%ld + %ld block visits)\n",
+           ms, live.visits, rd.problem.visits);
+
+    df_problem_free(&live);
+    df_reaching_defs_free(&rd);
+    cfg_free(&cfg);
+    ast_free(&ast);
+    return rc;
+}
+
+// 生成C代码写到标准输出; 有语法错误或循环外的break时不生成
+static int run_emit_c(const char* filename) {
+    Ast ast;
+    ast_init(&ast);
+    int rc = parse_file_ast(filename, &ast);
+    if (rc == 1) {
+        fprintf(stderr, "Fatal: could not open file.\n");
+        return rc;
+    }
+    Cfg cfg;
+    if (cfg_build(&cfg, ast.root) != 0 && rc == 0) rc = 2;
+    if (rc == 0 && emit_c(ast.root, &cfg, "rule", filename, stdout) != 0) rc = 2;
+    if (rc != 0) fprintf(stderr, "Cannot emit C: source '%s' has errors (exit code %d).\n", filename, rc);
+    cfg_free(&cfg);
+    ast_free(&ast);
+    return rc;
+}
+
+// 建立或增量更新标识符索引
+static int run_index(const char* index_path, char** files, int count) {
+    clock_t start = clock();
+    SymIndexStats stats;
+    if (!symindex_update(index_path, (const char* const*)files, count, &stats)) {
+        printf("Fatal: could not write index '%s'.\n", index_path);
+        return 1;
+    }
+    double ms = (double)(clock() - start) * 1000.0 / CLOCKS_PER_SEC;
+    printf("Indexed %d file(s): %d parsed, %d unchanged, %d removed, %d unreadable\n",
+           stats.parsed + stats.reused, stats.parsed, stats.reused, stats.removed, stats.failed);
+    printf("%u identifiers, %llu occurrences, %llu bytes (%.3f ms)\n", stats.terms,
+           (unsigned long long)stats.postings, (unsigned long long)stats.bytes, ms);
+    return stats.failed > 0 ? 2 : 0;
+}
+
+typedef struct {
+    bool files_only;
+    int last_file;
+    int files;
+} QueryOutput;
+
+static bool print_hit(void* user, const SymHit* hit) {
+    QueryOutput* out = (QueryOutput*)user;
+    if (hit->file_index != out->last_file) {
+        out->last_file = hit->file_index;
+        out->files++;
+        if (out->files_only) printf("%s\n", hit->file);
+    }
+    if (!out->files_only) {
+        printf("%s:%u: %s (offset %u)\n", hit->file, hit->line, sym_role_name(hit->role), hit->offset);
+    }
+    return true;
+}
+
+// 查询标识符的出现位置, roles为空表示所有角色
+static int run_query(const char* index_path, const char* name, char** roles, int role_count, bool files_only) {
+    uint32_t mask = 0;
+    for (int i = 0; i < role_count; i++) {
+        int r = sym_role_from_name(roles[i]);
+        if (r < 0) {
+            fprintf(stderr, "Unknown role: %s (expected assign, use, if, while or other)\n", roles[i]);
+            return 1;
+        }
+        mask |= 1u << r;
+    }
+    clock_t start = clock();
+    SymIndex* idx = symindex_open(index_path);
+    if (!idx) {
+        printf("Fatal: could not open index '%s'.\n", index_path);
+        return 1;
+    }
+    QueryOutput out = { files_only, -1, 0 };
+    long hits = symindex_query(idx, name, mask, print_hit, &out);
+    symindex_close(idx);
+    double ms = (double)(clock() - start) * 1000.0 / CLOCKS_PER_SEC;
+    printf("%ld occurrence(s) of '%s' in %d file(s) (%.3f ms)\n", hits, name, out.files, ms);
+    return hits > 0 ? 0 : 2;
+}
 
 int main(int argc, char* argv[]) {
-    if (argc < 2) {
-        fprintf(stderr, "Usage: %s <source_file>\n", argv[0]);
+    bool dataflow = false;
+    bool emit = false;
+    bool files_only = false;
+    ParseLimits limits;
+    memset(&limits, 0, sizeof(limits));
+    bool has_limits = false;
+    int argi = 1;
+    while (argi < argc && argv[argi][0] == '-') {
+        if (strncmp(argv[argi], "--max-", 6) == 0 || strcmp(argv[argi], "--deadline-ms") == 0) {
+            if (argi + 1 >= argc) break;
+            const char* name = argv[argi] + 2;
+            const char* value = argv[argi + 1];
+            if (strcmp(name, "max-bytes") == 0) limits.max_bytes = strtoul(value, NULL, 10);
+            else if (strcmp(name, "max-tokens") == 0) limits.max_tokens = strtoul(value, NULL, 10);
+            else if (strcmp(name, "max-depth") == 0) limits.max_depth = atoi(value);
+            else if (strcmp(name, "max-errors") == 0) limits.max_errors = atoi(value);
+            else if (strcmp(name, "deadline-ms") == 0) limits.deadline_ms = atof(value);
+            else break;
+            has_limits = true;
+            argi += 2;
+        } else if (strcmp(argv[argi], "--index") == 0 && argi + 1 < argc) {
+            return run_index(argv[argi + 1], argv + argi + 2, argc - argi - 2);
+        } else if (strcmp(argv[argi], "--query") == 0 && argi + 2 < argc) {
+            return run_query(argv[argi + 1], argv[argi + 2], argv + argi + 3, argc - argi - 3, files_only);
+        } else if (strcmp(argv[argi], "--files") == 0) {
+            files_only = true;
+            argi++;
+        } else if (strcmp(argv[argi], "--pipeline") == 0) {
+            parser_set_pipeline(true);
+            argi++;
+        } else if (strcmp(argv[argi], "--dataflow") == 0) {
+            dataflow = true;
+            argi++;
+        } else if (strcmp(argv[argi], "--emit-c") == 0) {
+            emit = true;
+            argi++;
+        } else if (strcmp(argv[argi], "--cache-dir") == 0 && argi + 1 < argc) {
+            lexer_set_cache_dir(argv[argi + 1]);
+            argi += 2;
+        } else if (strcmp(argv[argi], "--include-dir") == 0 && argi + 1 < argc) {
+            // #include的查找目录, 可以多次指定
+            preproc_add_include_dir(argv[argi + 1]);
+            argi += 2;
+        } else if (strcmp(argv[argi], "--serve") == 0 && argi + 1 < argc) {
+            if (has_limits) parser_set_limits(&limits);
+            return serve_run(argv[argi + 1]);
+        } else {
+            break;
+        }
+    }
+    if (argi >= argc) {
+        fprintf(stderr, "Usage: %s [--dataflow | --emit-c] [--pipeline] [--cache-dir <dir>] [--include-dir <dir>]... [limits] <source_file>\n"
+                        "       %s [--pipeline] [--cache-dir <dir>] [--include-dir <dir>]... [limits] --serve <socket_path>\n"
+                        "       %s --index <index_file> <source_file>...\n"
+                        "       %s [--files] --query <index_file> <identifier> [assign|use|if|while|other]...\n"
+                        "limits: --max-bytes N --max-tokens N --max-depth N --max-errors N --deadline-ms MS\n",
+                argv[0], argv[0], argv[0], argv[0]);
         return 1;
     }
+    if (has_limits) parser_set_limits(&limits);
+
+    const char* filename = argv[argi];
+    if (dataflow) {
+        return run_dataflow(filename);
+    }
+    if (emit) {
+        return run_emit_c(filename);
+    }
 
-    const char* filename = argv[1];
     int rc = parse_file(filename);
     if (rc == 0) {
         printf("Success: source '%s' parsed OK.\n", filename);
     } else if (rc == 1) {
         printf("Fatal: could not open file.\n");
+    } else if (rc == PARSE_LIMIT) {
+        printf("Aborted: resource limit exceeded (exit code %d).\n", rc);
     } else {
         printf("Parsed with errors (exit code %d).\n", rc);
     }
     return rc;
-}
\ No newline at end of file
+}
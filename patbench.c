@@ -0,0 +1,368 @@
+// 病态输入的尾延迟测试: 生成对抗性的输入, 报告每个用例解析延迟的分位数、栈深度峰值和内存峰值
+// 编译：gcc patbench.c parser.c astcache.c tokring.c ast.c lexer.c lextab.c tokcache.c output.c diag.c srcmgr.c parlex.c utf8.c srcnorm.c preproc.c budget.c tokpipe.c pushsrc.c baseline.c -o patbench -pthread
+// 运行：./patbench [--rounds N] [--scale K] [--save <file>] [--compare <file>] [--threshold PCT] [case...]
+//
+// NOTE - 平均吞吐量掩盖了最坏情况, 这里每个用例单独计时每一轮, 看p50/p90/p99和最大值
+// 解析在自备栈的线程中进行: 栈用mmap分配, 没碰过的页不驻留, 结束后用mincore()找到用到的最深处;
+// 内存峰值在每个用例开始前清零(/proc/self/clear_refs写5), 结束后读VmHWM, 报告相对开始时的增量
+// --save/--compare的基线格式见baseline.h, 每行"用例 指标 数值"; 有指标变差超过阈值时返回2
+
+// mincore()和MAP_NORESERVE不在POSIX中, 需要默认的扩展声明
+#define _DEFAULT_SOURCE
+#include "parser.h"
+#include "baseline.h"
+#include <pthread.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#define BASELINE_VERSION 1
+#define WORKER_STACK (512UL * 1024 * 1024)   // 只占地址空间, 用到多少才驻留多少
+
+// NOTE - 生成输入
+typedef struct {
+    char* data;
+    size_t len;
+    size_t cap;
+    bool failed;
+} Buf;
+
+static void buf_reserve(Buf* b, size_t extra) {
+    if (b->failed || b->len + extra + 1 <= b->cap) return;
+    size_t cap = b->cap ? b->cap : 4096;
+    while (cap < b->len + extra + 1) cap *= 2;
+    char* data = (char*)realloc(b->data, cap);
+    if (!data) {
+        b->failed = true;
+        return;
+    }
+    b->data = data;
+    b->cap = cap;
+}
+
+static void put(Buf* b, const char* s) {
+    size_t n = strlen(s);
+    buf_reserve(b, n);
+    if (b->failed) return;
+    memcpy(b->data + b->len, s, n);
+    b->len += n;
+}
+
+static void put_repeat(Buf* b, const char* s, size_t times) {
+    size_t n = strlen(s);
+    buf_reserve(b, n * times);
+    if (b->failed) return;
+    for (size_t i = 0; i < times; i++) {
+        memcpy(b->data + b->len, s, n);
+        b->len += n;
+    }
+}
+
+// 每个生成函数的n已乘过--scale
+static void gen_nested_braces(Buf* b, size_t n) {
+    put_repeat(b, "{", n);
+    put(b, " x = 1; ");
+    put_repeat(b, "}", n);
+}
+
+static void gen_nested_parens(Buf* b, size_t n) {
+    put(b, "{ x = ");
+    put_repeat(b, "(", n);
+    put(b, "1");
+    put_repeat(b, ")", n);
+    put(b, "; }");
+}
+
+// 条件中括号的推测性分析: 没有备忘表时每层都要重新推测里面的各层
+static void gen_nested_conditions(Buf* b, size_t n) {
+    put(b, "{ if (");
+    put_repeat(b, "(", n);
+    put(b, "a > b");
+    put_repeat(b, " || c)", n);
+    put(b, ") x = 1; }");
+}
+
+static void gen_long_chain(Buf* b, size_t n) {
+    put(b, "{ x = a");
+    put_repeat(b, " + a", n);
+    put(b, "; }");
+}
+
+// 超过255字符的词素被截断, 但仍要扫描完
+static void gen_long_identifier(Buf* b, size_t n) {
+    put(b, "{ ");
+    put_repeat(b, "a", n);
+    put(b, " = 1; }");
+}
+
+static void gen_long_string(Buf* b, size_t n) {
+    put(b, "{ x = \"");
+    put_repeat(b, "a", n);
+    put(b, "\"; }");
+}
+
+static void gen_block_comment(Buf* b, size_t n) {
+    put(b, "{ /*");
+    put_repeat(b, " comment text * / ** \n", n / 22);
+    put(b, "*/ x = 1; }");
+}
+
+static void gen_unterminated_comment(Buf* b, size_t n) {
+    put(b, "{ x = 1; /*");
+    put_repeat(b, " comment text\n", n / 14);
+}
+
+// 每个字节都是一条错误: 非法字符、控制字符和非法UTF-8
+static void gen_invalid_chars(Buf* b, size_t n) {
+    put(b, "{ ");
+    put_repeat(b, "@$`\x01\xff", n / 5);
+    put(b, " }");
+}
+
+// 换行符走get_token()中的递归
+static void gen_newlines(Buf* b, size_t n) {
+    put(b, "{");
+    put_repeat(b, "\n", n);
+    put(b, "x = 1; }");
+}
+
+typedef struct {
+    const char* name;
+    void (*generate)(Buf* b, size_t n);
+    size_t size;                  // --scale 1时的规模(层数、项数或字节数)
+} Case;
+
+static const Case cases[] = {
+    { "nested_braces", gen_nested_braces, 5000 },
+    { "nested_parens", gen_nested_parens, 5000 },
+    { "nested_conditions", gen_nested_conditions, 5000 },
+    { "long_chain", gen_long_chain, 200000 },
+    { "long_identifier", gen_long_identifier, 1 << 20 },
+    { "long_string", gen_long_string, 1 << 20 },
+    { "block_comment", gen_block_comment, 1 << 20 },
+    { "unterminated_comment", gen_unterminated_comment, 1 << 20 },
+    { "invalid_chars", gen_invalid_chars, 1 << 20 },
+    { "newlines", gen_newlines, 1 << 20 },
+};
+
+#define CASE_COUNT ((int)(sizeof(cases) / sizeof(cases[0])))
+
+// NOTE - 测量
+typedef struct {
+    int file_id;
+    int rounds;
+    double* ms;                   // 每轮的延迟
+} Run;
+
+typedef struct {
+    size_t bytes;
+    double p50, p90, p99, max;
+    long stack_kb;                // -1表示无法测量
+    long rss_kb;
+} Result;
+
+static void* run_case(void* arg) {
+    Run* r = (Run*)arg;
+    for (int i = 0; i < r->rounds; i++) {
+        double begin = budget_now_ms();
+        Ast ast;
+        ast_init(&ast);
+        parse_source_ast(r->file_id, &ast);
+        ast_free(&ast);
+        r->ms[i] = budget_now_ms() - begin;
+    }
+    return NULL;
+}
+
+// 栈从高地址向低地址增长, 最低的驻留页即用到的最深处
+static long stack_used_kb(char* stack, size_t size) {
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t pages = size / page;
+    unsigned char* resident = (unsigned char*)malloc(pages);
+    if (!resident) return -1;
+    long used = -1;
+    if (mincore(stack, size, resident) == 0) {
+        size_t i = 0;
+        while (i < pages && !(resident[i] & 1)) i++;
+        used = (long)((pages - i) * page / 1024);
+    }
+    free(resident);
+    return used;
+}
+
+// /proc/self/status中的一项(kB), 读不到时返回-1
+static long proc_status_kb(const char* key) {
+    FILE* f = fopen("/proc/self/status", "r");
+    if (!f) return -1;
+    char line[256];
+    long value = -1;
+    size_t n = strlen(key);
+    while (fgets(line, sizeof(line), f)) {
+        if (strncmp(line, key, n) == 0 && line[n] == ':') {
+            value = atol(line + n + 1);
+            break;
+        }
+    }
+    fclose(f);
+    return value;
+}
+
+// 把内存峰值(VmHWM)清零为当前值
+static bool reset_peak_rss(void) {
+    FILE* f = fopen("/proc/self/clear_refs", "w");
+    if (!f) return false;
+    bool ok = fputs("5", f) >= 0;
+    if (fclose(f) != 0) ok = false;
+    return ok;
+}
+
+static int cmp_double(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return x < y ? -1 : x > y;
+}
+
+static double percentile(const double* sorted, int n, double p) {
+    int i = (int)(p / 100.0 * n + 0.5) - 1;
+    if (i < 0) i = 0;
+    if (i >= n) i = n - 1;
+    return sorted[i];
+}
+
+static bool measure(const Case* c, size_t scale, int rounds, Result* res) {
+    Buf b = { NULL, 0, 0, false };
+    c->generate(&b, c->size * scale);
+    if (b.failed) {
+        free(b.data);
+        fprintf(stderr, "Memory allocation error\n");
+        return false;
+    }
+    b.data[b.len] = '\0';
+    res->bytes = b.len;
+    int file_id = srcmgr_adopt(srcmgr_default(), c->name, b.data, b.len);
+    if (file_id < 0) return false;
+
+    Run run = { file_id, rounds, (double*)malloc((size_t)rounds * sizeof(double)) };
+    char* stack = (char*)mmap(NULL, WORKER_STACK, PROT_READ | PROT_WRITE,
+                              MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (!run.ms || stack == MAP_FAILED) {
+        free(run.ms);
+        if (stack != MAP_FAILED) munmap(stack, WORKER_STACK);
+        fprintf(stderr, "Memory allocation error\n");
+        return false;
+    }
+
+    bool peak_reset = reset_peak_rss();
+    long rss_before = proc_status_kb("VmRSS");
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setstack(&attr, stack, WORKER_STACK);
+    pthread_t tid;
+    bool ok = pthread_create(&tid, &attr, run_case, &run) == 0;
+    if (ok) pthread_join(tid, NULL);
+    pthread_attr_destroy(&attr);
+    long hwm = proc_status_kb("VmHWM");
+
+    if (ok) {
+        res->stack_kb = stack_used_kb(stack, WORKER_STACK);
+        res->rss_kb = peak_reset && hwm >= 0 && rss_before >= 0 ? hwm - rss_before : -1;
+        qsort(run.ms, (size_t)rounds, sizeof(double), cmp_double);
+        res->p50 = percentile(run.ms, rounds, 50);
+        res->p90 = percentile(run.ms, rounds, 90);
+        res->p99 = percentile(run.ms, rounds, 99);
+        res->max = run.ms[rounds - 1];
+    } else {
+        fprintf(stderr, "Cannot create thread for case %s\n", c->name);
+    }
+    munmap(stack, WORKER_STACK);
+    free(run.ms);
+    return ok;
+}
+
+int main(int argc, char* argv[]) {
+    int rounds = 30;
+    size_t scale = 1;
+    const char* save_path = NULL;
+    const char* compare_path = NULL;
+    double threshold = 25.0;
+    bool selected[CASE_COUNT];
+    bool any_selected = false;
+    memset(selected, 0, sizeof(selected));
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--rounds") == 0 && i + 1 < argc) {
+            rounds = atoi(argv[++i]);
+            if (rounds < 1) rounds = 1;
+        } else if (strcmp(argv[i], "--scale") == 0 && i + 1 < argc) {
+            int k = atoi(argv[++i]);
+            scale = k < 1 ? 1 : (size_t)k;
+        } else if (strcmp(argv[i], "--save") == 0 && i + 1 < argc) {
+            save_path = argv[++i];
+        } else if (strcmp(argv[i], "--compare") == 0 && i + 1 < argc) {
+            compare_path = argv[++i];
+        } else if (strcmp(argv[i], "--threshold") == 0 && i + 1 < argc) {
+            threshold = atof(argv[++i]);
+        } else if (argv[i][0] == '-') {
+            fprintf(stderr, "Usage: %s [--rounds N] [--scale K] [--save <file>] [--compare <file>] "
+                            "[--threshold PCT] [case...]\ncases:", argv[0]);
+            for (int k = 0; k < CASE_COUNT; k++) fprintf(stderr, " %s", cases[k].name);
+            fprintf(stderr, "\n");
+            return 1;
+        } else {
+            int k = 0;
+            while (k < CASE_COUNT && strcmp(cases[k].name, argv[i]) != 0) k++;
+            if (k == CASE_COUNT) {
+                fprintf(stderr, "Unknown case: %s\n", argv[i]);
+                return 1;
+            }
+            selected[k] = true;
+            any_selected = true;
+        }
+    }
+
+    // 诊断不是测量的内容, free_lexer()时输出到空设备(渲染的开销仍计入延迟)
+    FILE* sink = fopen("/dev/null", "w");
+    if (sink) diag_default()->output = sink;
+
+    printf("Scale %lu, %d rounds per case\n", (unsigned long)scale, rounds);
+    printf("%-20s %10s %9s %9s %9s %9s %10s %10s\n", "Case", "Bytes", "p50(ms)", "p90(ms)",
+           "p99(ms)", "max(ms)", "stack(KB)", "rss(KB)");
+    BaselineSet metrics;
+    metrics.count = 0;
+    int rc = 0;
+    for (int k = 0; k < CASE_COUNT; k++) {
+        if (any_selected && !selected[k]) continue;
+        Result r;
+        if (!measure(&cases[k], scale, rounds, &r)) {
+            rc = 1;
+            continue;
+        }
+        printf("%-20s %10lu %9.3f %9.3f %9.3f %9.3f", cases[k].name, (unsigned long)r.bytes,
+               r.p50, r.p90, r.p99, r.max);
+        if (r.stack_kb >= 0) printf(" %10ld", r.stack_kb);
+        else printf(" %10s", "-");
+        if (r.rss_kb >= 0) printf(" %10ld\n", r.rss_kb);
+        else printf(" %10s\n", "-");
+        fflush(stdout);
+        baseline_add(&metrics, cases[k].name, "p50_ms", r.p50);
+        baseline_add(&metrics, cases[k].name, "p99_ms", r.p99);
+        baseline_add(&metrics, cases[k].name, "max_ms", r.max);
+        if (r.stack_kb >= 0) baseline_add(&metrics, cases[k].name, "stack_kb", (double)r.stack_kb);
+        if (r.rss_kb >= 0) baseline_add(&metrics, cases[k].name, "rss_kb", (double)r.rss_kb);
+    }
+
+    diag_default()->output = NULL;
+    if (sink) fclose(sink);
+
+    if (compare_path) {
+        int regressions = baseline_compare(compare_path, &metrics, "Case", threshold);
+        if (regressions < 0) rc = 1;
+        else if (regressions > 0) rc = 2;
+    }
+    if (save_path) {
+        char note[64];
+        snprintf(note, sizeof(note), "scale %lu, %d rounds", (unsigned long)scale, rounds);
+        if (!baseline_save(save_path, &metrics, "patbench", BASELINE_VERSION, note)) rc = 1;
+        else printf("Baseline written to %s\n", save_path);
+    }
+    return rc;
+}
@@ -0,0 +1,339 @@
+// 用硬件性能计数器测量词法分析、事件式解析、语法分析和流水线语法分析: 每字节周期数、每token指令数、每token分支预测失败数、缓存未命中
+// 编译：gcc perfbench.c parser.c astcache.c tokring.c ast.c lexer.c lextab.c tokcache.c output.c diag.c srcmgr.c parlex.c utf8.c srcnorm.c preproc.c budget.c tokpipe.c pushsrc.c baseline.c -o perfbench -pthread
+// 运行：./perfbench [--rounds N] [--save <file>] [--compare <file>] [--threshold PCT] [--no-counters] <source_file>...
+//
+// NOTE - 计数器不可用时(非Linux、perf_event_paranoid过高、虚拟机没有PMU)只报告每字节纳秒数
+// --save写出基线文件, 每行"阶段 指标 数值", 以'#'开始的行是注释; --compare读入以前的基线逐项对比,
+// 有指标变差超过阈值(默认10%)时返回2, 便于在脚本中使用
+
+// syscall()不在POSIX中, 需要默认的扩展声明
+#define _DEFAULT_SOURCE
+#include "parser.h"
+#include "baseline.h"
+#include <stdint.h>
+#include <time.h>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/perf_event.h>)
+#define PERFBENCH_HAVE_PERF 1
+#endif
+#endif
+
+#ifdef PERFBENCH_HAVE_PERF
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+#define BASELINE_VERSION 1
+#define MAX_FILES 256
+
+typedef enum {
+    CNT_CYCLES,
+    CNT_INSTRUCTIONS,
+    CNT_BRANCH_MISSES,
+    CNT_L1D_MISSES,
+    CNT_LLC_MISSES,
+    CNT_COUNT
+} CounterId;
+
+static const char* counter_names[CNT_COUNT] = {
+    "cycles", "instructions", "branch-misses", "L1d-misses", "LLC-misses"
+};
+
+typedef struct {
+    int fd[CNT_COUNT];            // -1表示该计数器打不开
+    int available;                // 打开的个数
+} Counters;
+
+typedef struct {
+    double value[CNT_COUNT];
+    bool valid[CNT_COUNT];        // 计数器打不开或一直没被调度上时为false
+    double ns;
+} Sample;
+
+#ifdef PERFBENCH_HAVE_PERF
+static int open_counter(uint32_t type, uint64_t config) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    // 之后创建的线程(并行/流水线词法分析)也计入, 结束时合并到这里
+    attr.inherit = 1;
+    // 计数器比事件多时内核会轮流调度, 读数按实际运行时间放大
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static uint64_t cache_miss(uint64_t cache) {
+    return cache | ((uint64_t)PERF_COUNT_HW_CACHE_OP_READ << 8) |
+           ((uint64_t)PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+}
+#endif
+
+// 每个计数器单独打开(不组成group): 某一个不支持时其余的仍可使用
+static void counters_open(Counters* c, bool enabled) {
+    c->available = 0;
+    for (int i = 0; i < CNT_COUNT; i++) c->fd[i] = -1;
+    if (!enabled) return;
+#ifdef PERFBENCH_HAVE_PERF
+    c->fd[CNT_CYCLES] = open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+    c->fd[CNT_INSTRUCTIONS] = open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+    c->fd[CNT_BRANCH_MISSES] = open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+    c->fd[CNT_L1D_MISSES] = open_counter(PERF_TYPE_HW_CACHE, cache_miss(PERF_COUNT_HW_CACHE_L1D));
+    c->fd[CNT_LLC_MISSES] = open_counter(PERF_TYPE_HW_CACHE, cache_miss(PERF_COUNT_HW_CACHE_LL));
+    for (int i = 0; i < CNT_COUNT; i++) {
+        if (c->fd[i] < 0) c->fd[i] = -1;
+        else c->available++;
+    }
+#endif
+}
+
+static void counters_close(Counters* c) {
+#ifdef PERFBENCH_HAVE_PERF
+    for (int i = 0; i < CNT_COUNT; i++) {
+        if (c->fd[i] >= 0) close(c->fd[i]);
+    }
+#endif
+    (void)c;
+}
+
+static void counters_start(Counters* c) {
+#ifdef PERFBENCH_HAVE_PERF
+    for (int i = 0; i < CNT_COUNT; i++) {
+        if (c->fd[i] < 0) continue;
+        ioctl(c->fd[i], PERF_EVENT_IOC_RESET, 0);
+        ioctl(c->fd[i], PERF_EVENT_IOC_ENABLE, 0);
+    }
+#endif
+    (void)c;
+}
+
+static void counters_stop(Counters* c, Sample* s) {
+    for (int i = 0; i < CNT_COUNT; i++) s->valid[i] = false;
+#ifdef PERFBENCH_HAVE_PERF
+    for (int i = 0; i < CNT_COUNT; i++) {
+        if (c->fd[i] >= 0) ioctl(c->fd[i], PERF_EVENT_IOC_DISABLE, 0);
+    }
+    for (int i = 0; i < CNT_COUNT; i++) {
+        uint64_t data[3];   // 计数值, 启用时间, 实际运行时间
+        if (c->fd[i] < 0 || read(c->fd[i], data, sizeof(data)) != (ssize_t)sizeof(data)) continue;
+        if (data[2] == 0) continue;
+        s->value[i] = (double)data[0] * ((double)data[1] / (double)data[2]);
+        s->valid[i] = true;
+    }
+#endif
+    (void)c;
+}
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+// NOTE - 四个阶段
+// lex:    get_token()取完所有token
+// events: 事件式解析(不注册回调), 不建语法树、不记录推导过程
+// parse:  完整的语法分析(含其中的词法分析和语法树构建), 与lex相减即语法分析本身的开销
+// pipe:   同parse, 但词法分析在单独的线程中流水线执行(见tokpipe.h); ns/byte是墙钟时间,
+//         计数器是两个线程的总和, 与parse对比即流水线节省的时间和多付出的同步开销
+typedef enum {
+    PHASE_LEX,
+    PHASE_EVENTS,
+    PHASE_PARSE,
+    PHASE_PIPE,
+    PHASE_COUNT
+} Phase;
+
+static const char* phase_names[PHASE_COUNT] = { "lex", "events", "parse", "pipe" };
+
+static size_t lex_corpus(const int* ids, int count) {
+    size_t tokens = 0;
+    for (int i = 0; i < count; i++) {
+        Lexer* lexer = init_lexer_source(ids[i]);
+        if (!lexer) continue;
+        for (;;) {
+            Token token = get_token(lexer);
+            if (token.type == TOKEN_EOF) break;
+            tokens++;
+        }
+        free_lexer(lexer);
+    }
+    return tokens;
+}
+
+static void parse_corpus(const int* ids, int count) {
+    for (int i = 0; i < count; i++) {
+        Ast ast;
+        ast_init(&ast);
+        parse_source_ast(ids[i], &ast);
+        ast_free(&ast);
+    }
+}
+
+static void run_phase(Phase phase, const int* ids, int count) {
+    if (phase == PHASE_LEX) {
+        lex_corpus(ids, count);
+    } else if (phase == PHASE_EVENTS) {
+        for (int i = 0; i < count; i++) parse_source_events(ids[i], NULL, NULL);
+    } else if (phase == PHASE_PIPE) {
+        parser_set_pipeline(true);
+        parse_corpus(ids, count);
+        parser_set_pipeline(false);
+    } else {
+        parse_corpus(ids, count);
+    }
+}
+
+static void measure(Counters* c, Phase phase, const int* ids, int count, int rounds, Sample* s) {
+    // 先跑一轮预热缓存和分配器
+    run_phase(phase, ids, count);
+    double begin = now_ns();
+    counters_start(c);
+    for (int r = 0; r < rounds; r++) run_phase(phase, ids, count);
+    counters_stop(c, s);
+    s->ns = now_ns() - begin;
+}
+
+// NOTE - 基线中的指标(见baseline.h), 都是每轮的平均值换算后的结果
+static void derive_metrics(BaselineSet* m, const char* phase, const Sample* s, double bytes, double tokens) {
+    baseline_add(m, phase, "ns_per_byte", s->ns / bytes);
+    if (s->valid[CNT_CYCLES]) baseline_add(m, phase, "cycles_per_byte", s->value[CNT_CYCLES] / bytes);
+    if (s->valid[CNT_INSTRUCTIONS]) baseline_add(m, phase, "insns_per_token", s->value[CNT_INSTRUCTIONS] / tokens);
+    if (s->valid[CNT_BRANCH_MISSES]) baseline_add(m, phase, "branch_misses_per_token", s->value[CNT_BRANCH_MISSES] / tokens);
+    if (s->valid[CNT_L1D_MISSES]) baseline_add(m, phase, "l1d_misses_per_token", s->value[CNT_L1D_MISSES] / tokens);
+    if (s->valid[CNT_LLC_MISSES]) baseline_add(m, phase, "llc_misses_per_token", s->value[CNT_LLC_MISSES] / tokens);
+}
+
+static void print_phase(const char* phase, const Sample* s, double bytes, double tokens) {
+    printf("%-6s %10.2f", phase, s->ns / bytes);
+    if (s->valid[CNT_CYCLES]) printf(" %10.2f", s->value[CNT_CYCLES] / bytes);
+    else printf(" %10s", "-");
+    if (s->valid[CNT_INSTRUCTIONS]) printf(" %10.1f", s->value[CNT_INSTRUCTIONS] / tokens);
+    else printf(" %10s", "-");
+    if (s->valid[CNT_CYCLES] && s->valid[CNT_INSTRUCTIONS] && s->value[CNT_CYCLES] > 0) {
+        printf(" %6.2f", s->value[CNT_INSTRUCTIONS] / s->value[CNT_CYCLES]);
+    } else {
+        printf(" %6s", "-");
+    }
+    const CounterId per_token[] = { CNT_BRANCH_MISSES, CNT_L1D_MISSES, CNT_LLC_MISSES };
+    for (int i = 0; i < 3; i++) {
+        if (s->valid[per_token[i]]) printf(" %12.4f", s->value[per_token[i]] / tokens);
+        else printf(" %12s", "-");
+    }
+    printf("\n");
+}
+
+int main(int argc, char* argv[]) {
+    int rounds = 100;
+    const char* save_path = NULL;
+    const char* compare_path = NULL;
+    double threshold = 10.0;
+    bool use_counters = true;
+    const char* paths[MAX_FILES];
+    int file_count = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--rounds") == 0 && i + 1 < argc) {
+            rounds = atoi(argv[++i]);
+            if (rounds < 1) rounds = 1;
+        } else if (strcmp(argv[i], "--save") == 0 && i + 1 < argc) {
+            save_path = argv[++i];
+        } else if (strcmp(argv[i], "--compare") == 0 && i + 1 < argc) {
+            compare_path = argv[++i];
+        } else if (strcmp(argv[i], "--threshold") == 0 && i + 1 < argc) {
+            threshold = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--no-counters") == 0) {
+            use_counters = false;
+        } else if (argv[i][0] == '-' && argv[i][1] == '-') {
+            fprintf(stderr, "Unknown option: %s\n", argv[i]);
+            return 1;
+        } else if (file_count < MAX_FILES) {
+            paths[file_count++] = argv[i];
+        }
+    }
+    if (file_count == 0) {
+        fprintf(stderr, "Usage: %s [--rounds N] [--save <file>] [--compare <file>] [--threshold PCT] "
+                        "[--no-counters] <source_file>...\n", argv[0]);
+        return 1;
+    }
+
+    // 语料一次读入源文件管理器, 计时范围内没有文件I/O
+    int ids[MAX_FILES];
+    size_t bytes = 0;
+    for (int i = 0; i < file_count; i++) {
+        ids[i] = srcmgr_load(srcmgr_default(), paths[i]);
+        if (ids[i] < 0) {
+            fprintf(stderr, "Cannot open file: %s\n", paths[i]);
+            return 1;
+        }
+        bytes += srcmgr_file(srcmgr_default(), ids[i])->length;
+    }
+
+    // 诊断不是测量的内容, free_lexer()时输出到空设备
+    FILE* sink = fopen("/dev/null", "w");
+    if (sink) diag_default()->output = sink;
+
+    size_t tokens = lex_corpus(ids, file_count);
+    if (bytes == 0 || tokens == 0) {
+        fprintf(stderr, "Corpus is empty\n");
+        return 1;
+    }
+
+    Counters counters;
+    counters_open(&counters, use_counters);
+    Sample samples[PHASE_COUNT];
+    for (int p = 0; p < PHASE_COUNT; p++) {
+        measure(&counters, (Phase)p, ids, file_count, rounds, &samples[p]);
+    }
+    counters_close(&counters);
+
+    diag_default()->output = NULL;
+    if (sink) fclose(sink);
+
+    double total_bytes = (double)bytes * rounds;
+    double total_tokens = (double)tokens * rounds;
+    printf("Corpus: %d file(s), %lu bytes, %lu tokens, %d rounds\n",
+           file_count, (unsigned long)bytes, (unsigned long)tokens, rounds);
+    if (counters.available == 0) {
+        printf("Counters: unavailable, reporting wall-clock time only\n");
+    } else {
+        printf("Counters: %d/%d available (", counters.available, CNT_COUNT);
+        bool first = true;
+        for (int i = 0; i < CNT_COUNT; i++) {
+            if (counters.fd[i] < 0) continue;
+            printf("%s%s", first ? "" : ", ", counter_names[i]);
+            first = false;
+        }
+        printf(")\n");
+    }
+    printf("%-6s %10s %10s %10s %6s %12s %12s %12s\n", "Phase", "ns/byte", "cyc/byte", "insn/tok",
+           "IPC", "brmiss/tok", "L1dmiss/tok", "LLCmiss/tok");
+    BaselineSet metrics;
+    metrics.count = 0;
+    for (int p = 0; p < PHASE_COUNT; p++) {
+        print_phase(phase_names[p], &samples[p], total_bytes, total_tokens);
+        derive_metrics(&metrics, phase_names[p], &samples[p], total_bytes, total_tokens);
+    }
+
+    int rc = 0;
+    if (compare_path) {
+        int regressions = baseline_compare(compare_path, &metrics, "Phase", threshold);
+        if (regressions < 0) rc = 1;
+        else if (regressions > 0) rc = 2;
+    }
+    if (save_path) {
+        char note[128];
+        snprintf(note, sizeof(note), "corpus: %d files, %lu bytes, %lu tokens, %d rounds",
+                 file_count, (unsigned long)bytes, (unsigned long)tokens, rounds);
+        if (!baseline_save(save_path, &metrics, "perfbench", BASELINE_VERSION, note)) rc = 1;
+        else printf("Baseline written to %s\n", save_path);
+    }
+    return rc;
+}
@@ -0,0 +1,827 @@
+#include "preproc.h"
+#include "tokcache.h"
+#include "parlex.h"
+
+typedef struct Preprocessor Preprocessor;
+
+#define PP_MAX_INCLUDE_DEPTH 200
+#define PP_MAX_INCLUDE_DIRS 64
+#define PP_PATH_MAX 4096
+
+// ==================== 数据结构 ====================
+
+// token序列, 同时记录每个token是否在行首(指令只能从行首的'#'开始)
+typedef struct {
+    Token* tokens;
+    unsigned char* bol;
+    int count;
+    int cap;
+} TokenList;
+
+// 缓存的头文件, 按源文件管理器中的编号索引
+typedef struct {
+    bool loaded;
+    TokenList list;       // 词法分析结果(不含EOF)
+    char* guard;          // include guard的宏名, 没有时为NULL
+    bool once;            // 执行过#pragma once
+    int include_count;    // 本次分析中已包含的次数
+} Header;
+
+typedef struct {
+    char* name;           // NULL表示空位
+    bool defined;         // #undef之后保留位置, 只清除这个标志
+    bool active;          // 正在展开, 替换内容中再出现时不展开
+    TokenList body;
+} Macro;
+
+typedef enum {
+    FRAME_MAIN,           // 主文件, 从词法分析器读取
+    FRAME_HEADER,         // 头文件, 遍历缓存的token
+    FRAME_MACRO           // 宏的替换内容
+} FrameKind;
+
+typedef struct {
+    FrameKind kind;
+    int file_id;          // 主文件/头文件的编号
+    int next;             // 头文件/宏中下一个token的下标
+    Macro* macro;
+    SourceLoc loc;        // 宏名出现的位置, 展开得到的token都使用这个位置
+    unsigned int length;
+    int cond_base;        // 进入文件时条件栈的深度, #if不能跨文件配对
+} Frame;
+
+// 一组#if ... #endif
+typedef struct {
+    bool taking;          // 当前分支生效
+    bool taken;           // 已有分支生效过, 之后的#elif/#else不再生效
+    bool seen_else;
+    bool outer_skip;      // 外层正在跳过, 整组都跳过
+    SourceLoc loc;        // #if的位置, 用于报告没有#endif
+} Cond;
+
+struct Preprocessor {
+    Lexer main;           // 主文件的词法分析器, 接管了原分析器的缓存和并行结果
+    Token look;           // 主文件中预读的一个token
+    bool look_bol;
+    bool has_look;
+    Frame* frames;
+    int frame_count;
+    int frame_cap;
+    Cond* conds;
+    int cond_count;
+    int cond_cap;
+    Macro* macros;        // 开放寻址的散列表, 容量为2的幂
+    int macro_cap;
+    int macro_used;
+    Header* headers;
+    int header_cap;
+    TokenList line;       // 正在处理的指令行('#'之后的token)
+    PreprocStats stats;
+    bool failed;          // 报告过预处理错误
+};
+
+static char* include_dirs[PP_MAX_INCLUDE_DIRS];
+static int include_dir_count = 0;
+
+void preproc_add_include_dir(const char* dir) {
+    if (include_dir_count >= PP_MAX_INCLUDE_DIRS) return;
+    char* copy = (char*)malloc(strlen(dir) + 1);
+    if (!copy) return;
+    strcpy(copy, dir);
+    include_dirs[include_dir_count++] = copy;
+}
+
+static bool list_push(TokenList* l, const Token* token, bool bol) {
+    if (l->count == l->cap) {
+        int cap = l->cap ? l->cap * 2 : 16;
+        Token* tokens = (Token*)realloc(l->tokens, (size_t)cap * sizeof(Token));
+        if (!tokens) return false;
+        l->tokens = tokens;
+        unsigned char* flags = (unsigned char*)realloc(l->bol, (size_t)cap);
+        if (!flags) return false;
+        l->bol = flags;
+        l->cap = cap;
+    }
+    l->tokens[l->count] = *token;
+    l->bol[l->count] = bol;
+    l->count++;
+    return true;
+}
+
+static void list_free(TokenList* l) {
+    free(l->tokens);
+    free(l->bol);
+    memset(l, 0, sizeof(TokenList));
+}
+
+static char* copy_string(const char* s) {
+    char* p = (char*)malloc(strlen(s) + 1);
+    if (p) strcpy(p, s);
+    return p;
+}
+
+// offset处的token前面在同一行内只有空白
+static bool at_line_start(const char* buf, size_t begin, size_t offset) {
+    while (offset > begin && (buf[offset - 1] == ' ' || buf[offset - 1] == '\t')) offset--;
+    return offset == begin || buf[offset - 1] == '\n';
+}
+
+// ==================== 宏表 ====================
+
+static unsigned int hash_name(const char* s) {
+    unsigned int h = 2166136261u;
+    while (*s) {
+        h ^= (unsigned char)*s++;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static Macro* find_macro(Preprocessor* pp, const char* name) {
+    if (pp->macro_used == 0) return NULL;
+    unsigned int mask = (unsigned int)pp->macro_cap - 1;
+    for (unsigned int i = hash_name(name) & mask;; i = (i + 1) & mask) {
+        Macro* m = &pp->macros[i];
+        if (!m->name) return NULL;
+        if (strcmp(m->name, name) == 0) return m;
+    }
+}
+
+static bool macro_defined(Preprocessor* pp, const char* name) {
+    Macro* m = find_macro(pp, name);
+    return m && m->defined;
+}
+
+// 找到或新建name的表项; 只在没有宏正在展开时调用(扩容会移动表项)
+static Macro* insert_macro(Preprocessor* pp, const char* name) {
+    Macro* m = find_macro(pp, name);
+    if (m) return m;
+    if ((pp->macro_used + 1) * 2 > pp->macro_cap) {
+        int cap = pp->macro_cap ? pp->macro_cap * 2 : 64;
+        Macro* table = (Macro*)calloc((size_t)cap, sizeof(Macro));
+        if (!table) return NULL;
+        for (int i = 0; i < pp->macro_cap; i++) {
+            Macro* old = &pp->macros[i];
+            if (!old->name) continue;
+            unsigned int j = hash_name(old->name) & (unsigned int)(cap - 1);
+            while (table[j].name) j = (j + 1) & (unsigned int)(cap - 1);
+            table[j] = *old;
+        }
+        free(pp->macros);
+        pp->macros = table;
+        pp->macro_cap = cap;
+    }
+    unsigned int mask = (unsigned int)pp->macro_cap - 1;
+    unsigned int i = hash_name(name) & mask;
+    while (pp->macros[i].name) i = (i + 1) & mask;
+    m = &pp->macros[i];
+    m->name = copy_string(name);
+    if (!m->name) return NULL;
+    pp->macro_used++;
+    return m;
+}
+
+static void free_macros(Preprocessor* pp) {
+    for (int i = 0; i < pp->macro_cap; i++) {
+        free(pp->macros[i].name);
+        list_free(&pp->macros[i].body);
+    }
+    free(pp->macros);
+    pp->macros = NULL;
+    pp->macro_cap = 0;
+    pp->macro_used = 0;
+}
+
+// ==================== 头文件 ====================
+
+static Header* header_slot(Preprocessor* pp, int file_id) {
+    if (file_id >= pp->header_cap) {
+        int cap = pp->header_cap ? pp->header_cap : 8;
+        while (cap <= file_id) cap *= 2;
+        Header* p = (Header*)realloc(pp->headers, (size_t)cap * sizeof(Header));
+        if (!p) return NULL;
+        memset(p + pp->header_cap, 0, (size_t)(cap - pp->header_cap) * sizeof(Header));
+        pp->headers = p;
+        pp->header_cap = cap;
+    }
+    return &pp->headers[file_id];
+}
+
+static bool is_if_directive(const char* name) {
+    return strcmp(name, "if") == 0 || strcmp(name, "ifdef") == 0 || strcmp(name, "ifndef") == 0;
+}
+
+// include guard: 第一条指令是#ifndef X, 与之配对的#endif之后(除本行外)没有其他内容,
+// 且中间没有同层的#elif/#else; 这样X已定义时整个文件都不会产生token
+static char* detect_guard(const TokenList* l) {
+    const Token* t = l->tokens;
+    if (l->count < 3 || t[0].type != TOKEN_HASH || !l->bol[0] || l->bol[1] || l->bol[2] ||
+        strcmp(t[1].lexeme, "ifndef") != 0 || t[2].type != TOKEN_IDENTIFIER ||
+        (l->count > 3 && !l->bol[3])) {
+        return NULL;
+    }
+    int depth = 0;
+    for (int i = 0; i + 1 < l->count; i++) {
+        if (t[i].type != TOKEN_HASH || !l->bol[i] || l->bol[i + 1]) continue;
+        const char* name = t[i + 1].lexeme;
+        if (is_if_directive(name)) {
+            depth++;
+        } else if (strcmp(name, "endif") == 0) {
+            if (--depth > 0) continue;
+            for (int k = i + 2; k < l->count; k++) {
+                if (l->bol[k]) return NULL;
+            }
+            return copy_string(t[2].lexeme);
+        } else if (depth == 1 && (strcmp(name, "else") == 0 || strcmp(name, "elif") == 0)) {
+            return NULL;
+        }
+    }
+    return NULL;
+}
+
+// 头文件只做一次词法分析, 之后的包含直接使用缓存的token
+static Header* load_header(Preprocessor* pp, int file_id) {
+    Header* h = header_slot(pp, file_id);
+    if (!h) return NULL;
+    if (h->loaded) return h;
+
+    Lexer* lx = init_lexer_source(file_id);
+    if (!lx) return NULL;
+    lx->diag = pp->main.diag;
+    for (;;) {
+        Token token = get_token(lx);
+        if (token.type == TOKEN_EOF) break;
+        bool bol = at_line_start(lx->buffer, lx->start, token.loc - lx->base);
+        if (!list_push(&h->list, &token, bol)) {
+            fprintf(stderr, "Memory allocation error\n");
+            break;
+        }
+    }
+    // 诊断与主文件的一起输出, 这里不调用free_lexer()
+    tokcache_close(lx->cache);
+    parlex_free(lx->parallel);
+    free(lx);
+
+    h->loaded = true;
+    h->guard = detect_guard(&h->list);
+    pp->stats.headers_lexed++;
+    return h;
+}
+
+static int try_include(const char* dir, size_t dir_len, const char* name) {
+    char path[PP_PATH_MAX];
+    if (dir_len == 0) {
+        snprintf(path, sizeof(path), "%s", name);
+    } else {
+        snprintf(path, sizeof(path), "%.*s/%s", (int)dir_len, dir, name);
+    }
+    return srcmgr_load(srcmgr_default(), path);
+}
+
+// "file"先在所在文件的目录中查找, 然后和<file>一样依次查找include目录
+static int find_include(const char* name, bool quoted, int from_file) {
+    if (name[0] == '/') return srcmgr_load(srcmgr_default(), name);
+    if (quoted) {
+        const SourceFile* f = srcmgr_file(srcmgr_default(), from_file);
+        const char* dir = f ? f->name : "";
+        const char* slash = strrchr(dir, '/');
+        const char* backslash = strrchr(dir, '\\');
+        if (backslash > slash) slash = backslash;
+        int id = try_include(dir, slash ? (size_t)(slash - dir) : 0, name);
+        if (id >= 0) return id;
+    }
+    for (int i = 0; i < include_dir_count; i++) {
+        int id = try_include(include_dirs[i], strlen(include_dirs[i]), name);
+        if (id >= 0) return id;
+    }
+    return -1;
+}
+
+// ==================== token来源 ====================
+
+static Frame* top_frame(Preprocessor* pp) {
+    return &pp->frames[pp->frame_count - 1];
+}
+
+static bool push_frame(Preprocessor* pp, const Frame* frame) {
+    if (pp->frame_count == pp->frame_cap) {
+        int cap = pp->frame_cap ? pp->frame_cap * 2 : 16;
+        Frame* p = (Frame*)realloc(pp->frames, (size_t)cap * sizeof(Frame));
+        if (!p) {
+            fprintf(stderr, "Memory allocation error\n");
+            return false;
+        }
+        pp->frames = p;
+        pp->frame_cap = cap;
+    }
+    pp->frames[pp->frame_count++] = *frame;
+    return true;
+}
+
+// 当前来源的下一个token(不取出); 头文件或宏已经取完时返回NULL
+// 主文件结束时返回EOF token
+static const Token* frame_peek(Preprocessor* pp, const Frame* f, bool* bol) {
+    switch (f->kind) {
+        case FRAME_MAIN:
+            if (!pp->has_look) {
+                pp->look = get_token(&pp->main);
+                pp->look_bol = pp->look.type == TOKEN_EOF ||
+                               at_line_start(pp->main.buffer, pp->main.start, pp->look.loc - pp->main.base);
+                pp->has_look = true;
+            }
+            *bol = pp->look_bol;
+            return &pp->look;
+        case FRAME_HEADER: {
+            const TokenList* l = &pp->headers[f->file_id].list;
+            if (f->next >= l->count) return NULL;
+            *bol = l->bol[f->next];
+            return &l->tokens[f->next];
+        }
+        case FRAME_MACRO:
+            if (f->next >= f->macro->body.count) return NULL;
+            *bol = false;
+            return &f->macro->body.tokens[f->next];
+    }
+    return NULL;
+}
+
+static void frame_take(Preprocessor* pp, Frame* f) {
+    if (f->kind == FRAME_MAIN) pp->has_look = false;
+    else f->next++;
+}
+
+// 结束文件时关闭其中没有#endif的条件
+static void close_conditionals(Preprocessor* pp, int base) {
+    while (pp->cond_count > base) {
+        pp->cond_count--;
+        diag_report(pp->main.diag, DIAG_PP_UNTERMINATED_IF, pp->conds[pp->cond_count].loc, 0, 0, NULL);
+        pp->main.has_error = true;
+        pp->failed = true;
+    }
+}
+
+static void pop_frame(Preprocessor* pp) {
+    Frame* f = top_frame(pp);
+    if (f->kind == FRAME_MACRO) f->macro->active = false;
+    if (f->kind == FRAME_HEADER) close_conditionals(pp, f->cond_base);
+    pp->frame_count--;
+}
+
+// ==================== 条件 ====================
+
+static bool skipping(const Preprocessor* pp) {
+    return pp->cond_count > 0 && !pp->conds[pp->cond_count - 1].taking;
+}
+
+static void push_cond(Preprocessor* pp, bool outer_skip, bool value, SourceLoc loc) {
+    if (pp->cond_count == pp->cond_cap) {
+        int cap = pp->cond_cap ? pp->cond_cap * 2 : 16;
+        Cond* p = (Cond*)realloc(pp->conds, (size_t)cap * sizeof(Cond));
+        if (!p) {
+            fprintf(stderr, "Memory allocation error\n");
+            return;
+        }
+        pp->conds = p;
+        pp->cond_cap = cap;
+    }
+    Cond* c = &pp->conds[pp->cond_count++];
+    c->outer_skip = outer_skip;
+    c->taking = !outer_skip && value;
+    c->taken = c->taking;
+    c->seen_else = false;
+    c->loc = loc;
+}
+
+// NOTE - #if表达式: 优先级爬升, 运算按64位整数进行
+typedef struct {
+    Preprocessor* pp;
+    const Token* t;
+    int n;
+    int i;
+    bool error;
+} Expr;
+
+static long long eval_binary(Expr* e, int min_prec);
+
+static int binary_prec(TokenType type) {
+    switch (type) {
+        case TOKEN_OR: return 1;
+        case TOKEN_AND: return 2;
+        case TOKEN_EQ: case TOKEN_NE: return 3;
+        case TOKEN_LT: case TOKEN_GT: case TOKEN_LE: case TOKEN_GE: return 4;
+        case TOKEN_PLUS: case TOKEN_MINUS: return 5;
+        case TOKEN_MULTIPLY: case TOKEN_DIVIDE: case TOKEN_MOD: return 6;
+        default: return 0;
+    }
+}
+
+static bool expect(Expr* e, TokenType type) {
+    if (e->i < e->n && e->t[e->i].type == type) {
+        e->i++;
+        return true;
+    }
+    e->error = true;
+    return false;
+}
+
+static long long eval_unary(Expr* e) {
+    if (e->i >= e->n) {
+        e->error = true;
+        return 0;
+    }
+    const Token* t = &e->t[e->i++];
+    switch (t->type) {
+        case TOKEN_MINUS:
+            return (long long)(0ULL - (unsigned long long)eval_unary(e));
+        case TOKEN_PLUS:
+            return eval_unary(e);
+        case TOKEN_LPAREN: {
+            long long v = eval_binary(e, 1);
+            expect(e, TOKEN_RPAREN);
+            return v;
+        }
+        case TOKEN_INTEGER:
+        case TOKEN_HEX:
+        case TOKEN_OCTAL:
+            return t->value.int_val;
+        case TOKEN_CHAR_CONST:
+            return t->value.char_val;
+        case TOKEN_IDENTIFIER: {
+            if (strcmp(t->lexeme, "defined") == 0) {
+                bool paren = e->i < e->n && e->t[e->i].type == TOKEN_LPAREN;
+                if (paren) e->i++;
+                if (e->i >= e->n || e->t[e->i].type != TOKEN_IDENTIFIER) {
+                    e->error = true;
+                    return 0;
+                }
+                long long v = macro_defined(e->pp, e->t[e->i++].lexeme);
+                if (paren) expect(e, TOKEN_RPAREN);
+                return v;
+            }
+            // 宏按替换内容求值, 正在求值的宏再次出现时与未定义的名字一样为0
+            Macro* m = find_macro(e->pp, t->lexeme);
+            if (!m || !m->defined || m->active) return 0;
+            Expr sub = { e->pp, m->body.tokens, m->body.count, 0, false };
+            m->active = true;
+            long long v = eval_binary(&sub, 1);
+            m->active = false;
+            if (sub.error || sub.i != sub.n) e->error = true;
+            return v;
+        }
+        default:
+            e->error = true;
+            return 0;
+    }
+}
+
+static long long eval_binary(Expr* e, int min_prec) {
+    long long left = eval_unary(e);
+    while (e->i < e->n) {
+        TokenType op = e->t[e->i].type;
+        int prec = binary_prec(op);
+        if (prec == 0 || prec < min_prec) break;
+        e->i++;
+        long long right = eval_binary(e, prec + 1);
+        unsigned long long a = (unsigned long long)left, b = (unsigned long long)right;
+        switch (op) {
+            case TOKEN_OR: left = left || right; break;
+            case TOKEN_AND: left = left && right; break;
+            case TOKEN_EQ: left = left == right; break;
+            case TOKEN_NE: left = left != right; break;
+            case TOKEN_LT: left = left < right; break;
+            case TOKEN_GT: left = left > right; break;
+            case TOKEN_LE: left = left <= right; break;
+            case TOKEN_GE: left = left >= right; break;
+            case TOKEN_PLUS: left = (long long)(a + b); break;
+            case TOKEN_MINUS: left = (long long)(a - b); break;
+            case TOKEN_MULTIPLY: left = (long long)(a * b); break;
+            default:
+                // 除以0或结果溢出(最小值除以-1)都按表达式错误处理
+                if (right == 0 || (right == -1 && left == (long long)(1ULL << 63))) {
+                    e->error = true;
+                    left = 0;
+                } else {
+                    left = op == TOKEN_DIVIDE ? left / right : left % right;
+                }
+                break;
+        }
+    }
+    return left;
+}
+
+// 求#if/#elif的条件, 出错时报告并按假处理
+static bool eval_condition(Preprocessor* pp, SourceLoc loc) {
+    Expr e = { pp, pp->line.tokens + 1, pp->line.count - 1, 0, false };
+    long long v = eval_binary(&e, 1);
+    if (e.error || e.i != e.n) {
+        diag_report(pp->main.diag, DIAG_PP_BAD_DIRECTIVE, loc, 0, 0, pp->line.tokens[0].lexeme);
+        pp->main.has_error = true;
+        pp->failed = true;
+        return false;
+    }
+    return v != 0;
+}
+
+// ==================== 指令 ====================
+
+// 读入'#'之后本行的全部token
+static void read_line(Preprocessor* pp) {
+    Frame* f = top_frame(pp);
+    pp->line.count = 0;
+    for (;;) {
+        bool bol;
+        const Token* t = frame_peek(pp, f, &bol);
+        if (!t || bol || t->type == TOKEN_EOF) break;
+        if (!list_push(&pp->line, t, false)) break;
+        frame_take(pp, f);
+    }
+}
+
+static void directive_error(Preprocessor* pp, DiagCode code, SourceLoc loc, const char* text) {
+    diag_report(pp->main.diag, code, loc, 0, 0, text);
+    pp->main.has_error = true;
+    pp->failed = true;
+}
+
+// 处理条件指令, 跳过的分组中也要处理以便正确配对; 不是条件指令时返回false
+static bool conditional(Preprocessor* pp, const char* name, SourceLoc loc) {
+    const Token* t = pp->line.tokens;
+    int n = pp->line.count;
+    int base = top_frame(pp)->cond_base;
+    if (strcmp(name, "ifdef") == 0 || strcmp(name, "ifndef") == 0) {
+        bool outer = skipping(pp);
+        bool value = false;
+        if (!outer) {
+            if (n < 2 || t[1].type != TOKEN_IDENTIFIER) {
+                directive_error(pp, DIAG_PP_BAD_DIRECTIVE, loc, name);
+            } else {
+                value = macro_defined(pp, t[1].lexeme) == (name[2] == 'd');
+            }
+        }
+        push_cond(pp, outer, value, loc);
+        return true;
+    }
+    if (strcmp(name, "if") == 0) {
+        bool outer = skipping(pp);
+        push_cond(pp, outer, !outer && eval_condition(pp, loc), loc);
+        return true;
+    }
+    bool is_elif = strcmp(name, "elif") == 0;
+    bool is_else = strcmp(name, "else") == 0;
+    bool is_endif = strcmp(name, "endif") == 0;
+    if (!is_elif && !is_else && !is_endif) return false;
+
+    if (pp->cond_count <= base) {
+        directive_error(pp, DIAG_PP_UNMATCHED_DIRECTIVE, loc, name);
+        return true;
+    }
+    Cond* c = &pp->conds[pp->cond_count - 1];
+    if (is_endif) {
+        pp->cond_count--;
+        return true;
+    }
+    if (c->seen_else) {
+        directive_error(pp, DIAG_PP_UNMATCHED_DIRECTIVE, loc, name);
+        return true;
+    }
+    if (is_else) c->seen_else = true;
+    if (c->outer_skip) return true;
+    if (c->taken) {
+        c->taking = false;
+    } else {
+        c->taking = is_else || eval_condition(pp, loc);
+        c->taken = c->taking;
+    }
+    return true;
+}
+
+static void do_include(Preprocessor* pp, SourceLoc loc) {
+    const Token* t = pp->line.tokens;
+    int n = pp->line.count;
+    Frame* f = top_frame(pp);
+    char name[PP_PATH_MAX];
+    bool quoted;
+
+    if (n >= 2 && t[1].type == TOKEN_STRING_CONST && strlen(t[1].lexeme) >= 2) {
+        // "file": 去掉两边的引号
+        size_t len = strlen(t[1].lexeme) - 2;
+        memcpy(name, t[1].lexeme + 1, len);
+        name[len] = '\0';
+        quoted = true;
+    } else if (n >= 2 && t[1].type == TOKEN_LT) {
+        // <file>: 文件名可能被分成多个token, 直接取源文件中'<'与'>'之间的内容
+        const SourceFile* file = srcmgr_file(srcmgr_default(), f->file_id);
+        size_t begin = t[1].loc - file->base + 1;
+        size_t end = begin;
+        while (end < file->length && file->buffer[end] != '>' && file->buffer[end] != '\n') end++;
+        if (end >= file->length || file->buffer[end] != '>' || end - begin >= sizeof(name)) {
+            directive_error(pp, DIAG_PP_BAD_DIRECTIVE, loc, "include");
+            return;
+        }
+        memcpy(name, file->buffer + begin, end - begin);
+        name[end - begin] = '\0';
+        quoted = false;
+    } else {
+        directive_error(pp, DIAG_PP_BAD_DIRECTIVE, loc, "include");
+        return;
+    }
+
+    int depth = 0;
+    for (int i = 0; i < pp->frame_count; i++) {
+        if (pp->frames[i].kind != FRAME_MACRO) depth++;
+    }
+    if (depth >= PP_MAX_INCLUDE_DEPTH) {
+        directive_error(pp, DIAG_PP_INCLUDE_DEPTH, loc, name);
+        return;
+    }
+
+    int file_id = find_include(name, quoted, f->file_id);
+    if (file_id < 0) {
+        directive_error(pp, DIAG_PP_INCLUDE_NOT_FOUND, loc, name);
+        return;
+    }
+    Header* h = load_header(pp, file_id);
+    if (!h) return;
+    pp->stats.includes++;
+    // 重复包含: guard宏已定义或有#pragma once时整个文件不会产生token, 直接跳过
+    if ((h->once && h->include_count > 0) || (h->guard && macro_defined(pp, h->guard))) {
+        pp->stats.guard_skips++;
+        return;
+    }
+    h->include_count++;
+    Frame frame = { FRAME_HEADER, file_id, 0, NULL, 0, 0, pp->cond_count };
+    push_frame(pp, &frame);
+}
+
+static void do_define(Preprocessor* pp, SourceLoc loc) {
+    const Token* t = pp->line.tokens;
+    int n = pp->line.count;
+    if (n < 2 || t[1].type != TOKEN_IDENTIFIER) {
+        directive_error(pp, DIAG_PP_BAD_DIRECTIVE, loc, "define");
+        return;
+    }
+    // 宏名后紧跟'('是带参数的宏
+    if (n >= 3 && t[2].type == TOKEN_LPAREN && t[2].loc == t[1].loc + t[1].length) {
+        directive_error(pp, DIAG_PP_FUNCTION_MACRO, t[1].loc, t[1].lexeme);
+        return;
+    }
+    Macro* m = insert_macro(pp, t[1].lexeme);
+    if (!m) {
+        fprintf(stderr, "Memory allocation error\n");
+        return;
+    }
+    m->body.count = 0;
+    for (int i = 2; i < n; i++) {
+        if (!list_push(&m->body, &t[i], false)) break;
+    }
+    m->defined = true;
+}
+
+static void directive(Preprocessor* pp, SourceLoc loc) {
+    read_line(pp);
+    if (pp->line.count == 0) return;  // 只有'#'的空指令
+    // if/else是保留字, 指令名按词素比较
+    char name[256];
+    strcpy(name, pp->line.tokens[0].lexeme);
+    if (conditional(pp, name, loc)) return;
+    if (skipping(pp)) return;
+
+    const Token* t = pp->line.tokens;
+    int n = pp->line.count;
+    if (strcmp(name, "include") == 0) {
+        do_include(pp, loc);
+    } else if (strcmp(name, "define") == 0) {
+        do_define(pp, loc);
+    } else if (strcmp(name, "undef") == 0) {
+        Macro* m = n >= 2 ? find_macro(pp, t[1].lexeme) : NULL;
+        if (n < 2) directive_error(pp, DIAG_PP_BAD_DIRECTIVE, loc, name);
+        else if (m) m->defined = false;
+    } else if (strcmp(name, "pragma") == 0) {
+        // 只识别#pragma once, 其他pragma忽略
+        if (n >= 2 && strcmp(t[1].lexeme, "once") == 0) {
+            Header* h = header_slot(pp, top_frame(pp)->file_id);
+            if (h) {
+                h->once = true;
+                if (h->include_count == 0) h->include_count = 1;
+            }
+        }
+    } else if (strcmp(name, "error") == 0) {
+        char text[256] = "";
+        size_t len = 0;
+        for (int i = 1; i < n && len + 2 < sizeof(text); i++) {
+            int w = snprintf(text + len, sizeof(text) - len, i > 1 ? " %s" : "%s", t[i].lexeme);
+            if (w < 0) break;
+            len += (size_t)w;
+        }
+        directive_error(pp, DIAG_PP_ERROR_DIRECTIVE, loc, text);
+    } else {
+        directive_error(pp, DIAG_PP_UNKNOWN_DIRECTIVE, loc, name);
+    }
+}
+
+// ==================== 对外接口 ====================
+
+bool preproc_attach(Lexer* lexer) {
+    // 没有'#'的文件不可能有指令, 也就不会定义宏, 不经过预处理器直接分析
+    if (!memchr(lexer->buffer, '#', lexer->length)) return true;
+    Preprocessor* pp = (Preprocessor*)calloc(1, sizeof(Preprocessor));
+    if (!pp) {
+        fprintf(stderr, "Memory allocation error\n");
+        return false;
+    }
+    pp->main = *lexer;
+    pp->main.pp = NULL;
+    Frame frame = { FRAME_MAIN, lexer->file_id, 0, NULL, 0, 0, 0 };
+    if (!push_frame(pp, &frame)) {
+        free(pp);
+        return false;
+    }
+    // 主文件的token仍按原来的方式得到(缓存回放/并行结果/扫描), 外层分析器只转发预处理结果
+    lexer->cache = NULL;
+    lexer->parallel = NULL;
+    lexer->pp = pp;
+    return true;
+}
+
+Token preproc_next(Preprocessor* pp) {
+    for (;;) {
+        Frame* f = top_frame(pp);
+        bool bol;
+        const Token* t = frame_peek(pp, f, &bol);
+        if (!t) {
+            pop_frame(pp);
+            continue;
+        }
+        if (t->type == TOKEN_EOF) {
+            close_conditionals(pp, 0);
+            return *t;
+        }
+        if (bol && t->type == TOKEN_HASH) {
+            SourceLoc loc = t->loc;
+            frame_take(pp, f);
+            directive(pp, loc);
+            continue;
+        }
+        if (skipping(pp)) {
+            frame_take(pp, f);
+            continue;
+        }
+        Token token = *t;
+        frame_take(pp, f);
+        if (f->kind == FRAME_MACRO) {
+            token.loc = f->loc;
+            token.length = f->length;
+        }
+        if (token.type == TOKEN_IDENTIFIER) {
+            Macro* m = find_macro(pp, token.lexeme);
+            if (m && m->defined && !m->active) {
+                Frame frame = { FRAME_MACRO, -1, 0, m, token.loc, token.length, pp->cond_count };
+                if (push_frame(pp, &frame)) {
+                    m->active = true;
+                    pp->stats.expansions++;
+                    continue;
+                }
+            }
+        }
+        return token;
+    }
+}
+
+void preproc_rewind(Preprocessor* pp) {
+    reset_lexer(&pp->main);
+    pp->has_look = false;
+    pp->frame_count = 1;
+    pp->cond_count = 0;
+    free_macros(pp);
+    for (int i = 0; i < pp->header_cap; i++) {
+        pp->headers[i].once = false;
+        pp->headers[i].include_count = 0;
+    }
+    int lexed = pp->stats.headers_lexed;
+    memset(&pp->stats, 0, sizeof(pp->stats));
+    pp->stats.headers_lexed = lexed;
+}
+
+void preproc_free(Preprocessor* pp) {
+    if (!pp) return;
+    tokcache_close(pp->main.cache);
+    parlex_free(pp->main.parallel);
+    free_macros(pp);
+    for (int i = 0; i < pp->header_cap; i++) {
+        list_free(&pp->headers[i].list);
+        free(pp->headers[i].guard);
+    }
+    free(pp->headers);
+    free(pp->frames);
+    free(pp->conds);
+    list_free(&pp->line);
+    free(pp);
+}
+
+bool preproc_failed(const Preprocessor* pp) {
+    return pp->failed;
+}
+
+void preproc_stats(const Preprocessor* pp, PreprocStats* stats) {
+    *stats = pp->stats;
+}
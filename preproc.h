@@ -0,0 +1,46 @@
+#ifndef PREPROC_H
+#define PREPROC_H
+
+#include "lexer.h"
+
+// NOTE - 预处理器
+// 位于词法分析器与语法分析器之间, 处理行首以'#'开始的指令:
+//   #include "file" / <file>, #define NAME 替换内容(对象式宏), #undef,
+//   #ifdef / #ifndef / #if / #elif / #else / #endif, #pragma once, #error
+// 输出的token保留原始位置: 头文件中的token位置属于头文件, 宏展开得到的token位置为宏名出现处
+//
+// 每个头文件只做一次词法分析, 结果以token流缓存在预处理器中, 再次包含时直接遍历缓存;
+// 第一次分析时识别include guard(#ifndef X ... #endif包住全部内容), 之后包含时X已定义,
+// 或文件中执行过#pragma once, 则整个文件直接跳过, 连缓存的token也不再遍历
+//
+// #if的表达式支持整数、宏名(未定义为0)、defined X / defined(X)、括号、
+// 算术、比较和&& ||; 语言中没有'!', 需要取反时请用#ifndef
+// 不支持带参数的宏(报告错误并忽略该定义)
+
+struct Preprocessor;
+
+// 添加#include查找目录: "file"先在所在文件的目录中查找, 之后与<file>一样按添加顺序查找这些目录
+void preproc_add_include_dir(const char* dir);
+
+// 在lexer上启用预处理, 之后get_token()返回预处理后的token流; 文件中没有'#'时什么也不做
+// 应在parlex_start()之后调用: 主文件的缓存和并行分析结果转给内部的主文件分析器
+bool preproc_attach(Lexer* lexer);
+
+// 取出下一个预处理后的token
+Token preproc_next(struct Preprocessor* pp);
+// 回到开头: 宏定义和条件状态清空, 已缓存的头文件token保留
+void preproc_rewind(struct Preprocessor* pp);
+void preproc_free(struct Preprocessor* pp);
+// 是否报告过预处理错误(#error、找不到头文件、格式错误或不认识的指令、缺少#endif等)
+bool preproc_failed(const struct Preprocessor* pp);
+
+typedef struct {
+    int includes;         // 执行的#include次数
+    int headers_lexed;    // 做过词法分析的头文件数
+    int guard_skips;      // 因include guard或#pragma once直接跳过的次数
+    int expansions;       // 宏展开次数
+} PreprocStats;
+
+void preproc_stats(const struct Preprocessor* pp, PreprocStats* stats);
+
+#endif
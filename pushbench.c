@@ -0,0 +1,202 @@
+// 推送式解析测试: 把文件按不同大小分段用parser_feed送入, 检查语法树、诊断和返回值与一次解析完全相同;
+// 再比较最后一段到达之后还要多久才得到结果: 推送式解析 与 先收齐内容再解析
+// 编译：gcc pushbench.c parser.c astcache.c tokring.c ast.c lexer.c lextab.c tokcache.c output.c diag.c srcmgr.c parlex.c utf8.c srcnorm.c preproc.c budget.c tokpipe.c pushsrc.c -o pushbench -pthread
+// 运行：./pushbench [--chunk N] [--rounds N] <source_file>...
+//
+// NOTE - 分段大小取1、7、64、4096和整个文件, 1字节分段覆盖了CRLF、BOM和多字节字符被拆开的各种情况
+// 延迟测试按--chunk(默认4096)分段模拟网络接收, 每种方式运行--rounds轮(默认20)取最小值;
+// 同时报告推送式解析处理全部分段的总耗时, 即边接收边分析的额外开销
+
+#define _POSIX_C_SOURCE 200809L
+#include "parser.h"
+
+// NOTE - 解析结果
+typedef struct {
+    int rc;
+    Ast ast;
+    SourceLoc base;               // 文件在位置空间中的起点, 比较位置时减去
+    char* diags;                  // 输出的诊断文本
+    size_t diags_len;
+} Result;
+
+// 诊断在解析结束时输出, 收集到内存中比较
+static FILE* capture_diags(Result* r) {
+    r->diags = NULL;
+    r->diags_len = 0;
+    FILE* out = open_memstream(&r->diags, &r->diags_len);
+    if (!out) {
+        fprintf(stderr, "Memory allocation error\n");
+        exit(1);
+    }
+    diag_default()->output = out;
+    return out;
+}
+
+static void end_capture(FILE* out) {
+    fclose(out);
+    diag_default()->output = NULL;
+}
+
+static void free_result(Result* r) {
+    ast_free(&r->ast);
+    free(r->diags);
+}
+
+// 先收齐内容再解析
+static void parse_whole(const char* name, const char* data, size_t len, Result* r) {
+    FILE* out = capture_diags(r);
+    ast_init(&r->ast);
+    r->base = srcmgr_default()->next_base;
+    int file_id = srcmgr_add_buffer(srcmgr_default(), name, data, len);
+    r->rc = file_id < 0 ? 1 : parse_source_ast(file_id, &r->ast);
+    end_capture(out);
+}
+
+// 每次送入chunk字节; feed_ms不为NULL时记下送入全部内容的总耗时, 返回最后一段到达之后的耗时
+static double parse_pushed(const char* name, const char* data, size_t len, size_t chunk,
+                           Result* r, double* feed_ms) {
+    FILE* out = capture_diags(r);
+    ast_init(&r->ast);
+    r->base = srcmgr_default()->next_base;
+    double total = 0;
+    double last = 0;
+    PushParser* p = parser_start(name, &r->ast);
+    if (!p) {
+        r->rc = 1;
+        end_capture(out);
+        return 0;
+    }
+    for (size_t at = 0; at < len; at += chunk) {
+        size_t n = len - at < chunk ? len - at : chunk;
+        double begin = budget_now_ms();
+        parser_feed(p, data + at, n);
+        last = budget_now_ms() - begin;
+        total += last;
+    }
+    double begin = budget_now_ms();
+    r->rc = parser_finish(p);
+    double finish = budget_now_ms() - begin;
+    end_capture(out);
+    if (feed_ms) *feed_ms = total + finish;
+    return last + finish;
+}
+
+// NOTE - 比较
+static bool same_tree(const AstNode* a, SourceLoc abase, const AstNode* b, SourceLoc bbase) {
+    for (; a && b; a = a->next, b = b->next) {
+        if (a->kind != b->kind || a->op != b->op || a->loc - abase != b->loc - bbase) return false;
+        if ((a->name == NULL) != (b->name == NULL) || (a->name && strcmp(a->name, b->name) != 0)) return false;
+        if (!same_tree(a->left, abase, b->left, bbase) || !same_tree(a->right, abase, b->right, bbase) ||
+            !same_tree(a->cond, abase, b->cond, bbase) || !same_tree(a->body, abase, b->body, bbase) ||
+            !same_tree(a->else_body, abase, b->else_body, bbase)) {
+            return false;
+        }
+    }
+    return a == NULL && b == NULL;
+}
+
+// 与一次解析的结果不同时说明哪里不同, 返回false
+static bool check_same(const char* name, size_t chunk, const Result* whole, const Result* pushed) {
+    const char* what = NULL;
+    if (pushed->rc != whole->rc) what = "exit code";
+    else if (!same_tree(whole->ast.root, whole->base, pushed->ast.root, pushed->base)) what = "syntax tree";
+    else if (pushed->diags_len != whole->diags_len || memcmp(pushed->diags, whole->diags, whole->diags_len) != 0) {
+        what = "diagnostics";
+    }
+    if (what) fprintf(stderr, "%s: %s differs when fed in %zu-byte chunks\n", name, what, chunk);
+    return what == NULL;
+}
+
+static char* read_all(const char* filename, size_t* len) {
+    FILE* f = fopen(filename, "rb");
+    if (!f) {
+        fprintf(stderr, "Cannot open file: %s\n", filename);
+        return NULL;
+    }
+    size_t cap = 4096;
+    char* data = (char*)malloc(cap);
+    *len = 0;
+    while (data) {
+        *len += fread(data + *len, 1, cap - *len, f);
+        if (*len < cap) break;
+        cap *= 2;
+        char* bigger = (char*)realloc(data, cap);
+        if (!bigger) free(data);
+        data = bigger;
+    }
+    fclose(f);
+    if (!data) fprintf(stderr, "Memory allocation error\n");
+    return data;
+}
+
+// 测试一个文件; 成功返回0, 结果不一致返回2
+static int bench_file(const char* filename, size_t chunk, int rounds) {
+    size_t len;
+    char* data = read_all(filename, &len);
+    if (!data) return 1;
+
+    Result whole;
+    parse_whole(filename, data, len, &whole);
+    int rc = 0;
+    const size_t sizes[] = { 1, 7, 64, 4096, len > 0 ? len : 1 };
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        Result pushed;
+        parse_pushed(filename, data, len, sizes[i], &pushed, NULL);
+        if (!check_same(filename, sizes[i], &whole, &pushed)) rc = 2;
+        free_result(&pushed);
+    }
+    free_result(&whole);
+
+    double whole_ms = 0, after_ms = 0, feed_ms = 0;
+    for (int r = 0; rc == 0 && r < rounds; r++) {
+        Result res;
+        double begin = budget_now_ms();
+        parse_whole(filename, data, len, &res);
+        double ms = budget_now_ms() - begin;
+        free_result(&res);
+        double total;
+        double after = parse_pushed(filename, data, len, chunk, &res, &total);
+        free_result(&res);
+        if (r == 0 || ms < whole_ms) whole_ms = ms;
+        if (r == 0 || after < after_ms) after_ms = after;
+        if (r == 0 || total < feed_ms) feed_ms = total;
+        // 每次解析都登记一个新文件, 清掉以免内存随轮数增长
+        srcmgr_reset(srcmgr_default());
+    }
+    if (rc == 0) {
+        printf("%-24s %10zu %14.3f %16.3f %14.3f %8.1fx\n", filename, len, whole_ms, after_ms, feed_ms,
+               after_ms > 0 ? whole_ms / after_ms : 0.0);
+    }
+    free(data);
+    return rc;
+}
+
+int main(int argc, char* argv[]) {
+    size_t chunk = 4096;
+    int rounds = 20;
+    int argi = 1;
+    while (argi < argc && argv[argi][0] == '-') {
+        if (strcmp(argv[argi], "--chunk") == 0 && argi + 1 < argc) {
+            chunk = (size_t)atol(argv[argi + 1]);
+            argi += 2;
+        } else if (strcmp(argv[argi], "--rounds") == 0 && argi + 1 < argc) {
+            rounds = atoi(argv[argi + 1]);
+            argi += 2;
+        } else {
+            break;
+        }
+    }
+    if (argi >= argc || chunk == 0) {
+        fprintf(stderr, "Usage: %s [--chunk N] [--rounds N] <source_file>...\n", argv[0]);
+        return 1;
+    }
+
+    printf("%-24s %10s %14s %16s %14s %9s\n", "File", "Bytes", "buffered(ms)", "after-last(ms)",
+           "push-total(ms)", "speedup");
+    int rc = 0;
+    for (; argi < argc; argi++) {
+        int r = bench_file(argv[argi], chunk, rounds);
+        if (r > rc) rc = r;
+    }
+    return rc;
+}
@@ -0,0 +1,114 @@
+#define _POSIX_C_SOURCE 200809L
+#include "pushsrc.h"
+#include <pthread.h>
+
+struct PushSource {
+    int file_id;
+    size_t need;                 // 分析线程暂停时等待的文件长度
+    bool complete;               // 内容已全部送入
+    bool failed;                 // 内容无法登记, 之后的内容不再使用
+    bool done;                   // body已经返回
+
+    void (*body)(void*);
+    void* arg;
+    pthread_t thread;
+    bool started;
+    pthread_mutex_t lock;
+    pthread_cond_t turn_changed;
+    bool parser_turn;            // 轮到分析线程运行, 受lock保护
+};
+
+// 把控制交给对方(to_parser为true时交给分析线程), 等到再轮到自己
+static void switch_turn(struct PushSource* p, bool to_parser) {
+    pthread_mutex_lock(&p->lock);
+    p->parser_turn = to_parser;
+    pthread_cond_broadcast(&p->turn_changed);
+    while (p->parser_turn == to_parser) pthread_cond_wait(&p->turn_changed, &p->lock);
+    pthread_mutex_unlock(&p->lock);
+}
+
+static void* run_body(void* arg) {
+    struct PushSource* p = (struct PushSource*)arg;
+    p->body(p->arg);
+    pthread_mutex_lock(&p->lock);
+    p->done = true;
+    p->parser_turn = false;
+    pthread_cond_broadcast(&p->turn_changed);
+    pthread_mutex_unlock(&p->lock);
+    return NULL;
+}
+
+struct PushSource* pushsrc_new(int file_id) {
+    struct PushSource* p = (struct PushSource*)calloc(1, sizeof(struct PushSource));
+    if (!p) {
+        fprintf(stderr, "Memory allocation error\n");
+        return NULL;
+    }
+    p->file_id = file_id;
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->turn_changed, NULL);
+    return p;
+}
+
+void pushsrc_run(struct PushSource* p, void (*body)(void*), void* arg) {
+    p->body = body;
+    p->arg = arg;
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, PUSHSRC_STACK_SIZE);
+    // 线程从一开始就拥有控制权, 调用者等它第一次暂停
+    p->parser_turn = true;
+    p->started = pthread_create(&p->thread, &attr, run_body, p) == 0;
+    pthread_attr_destroy(&attr);
+    if (!p->started) {
+        // 创建线程失败时先收下全部内容, 在pushsrc_finish中一次分析
+        p->parser_turn = false;
+        return;
+    }
+    pthread_mutex_lock(&p->lock);
+    while (p->parser_turn) pthread_cond_wait(&p->turn_changed, &p->lock);
+    pthread_mutex_unlock(&p->lock);
+}
+
+bool pushsrc_feed(struct PushSource* p, const char* data, size_t length) {
+    if (p->done || p->failed || p->complete) return false;
+    SourceManager* sm = srcmgr_default();
+    if (!srcmgr_stream_append(sm, p->file_id, data, length)) {
+        p->failed = true;
+        return false;
+    }
+    if (p->started && srcmgr_file(sm, p->file_id)->length >= p->need) switch_turn(p, true);
+    return !p->done;
+}
+
+void pushsrc_finish(struct PushSource* p) {
+    if (!p->complete) {
+        srcmgr_end_stream(srcmgr_default(), p->file_id);
+        p->complete = true;
+    }
+    if (!p->started) {
+        // 内容已经完整, 分析不会再暂停
+        if (p->body && !p->done) run_body(p);
+        return;
+    }
+    if (!p->done) switch_turn(p, true);
+    pthread_join(p->thread, NULL);
+    p->started = false;
+}
+
+void pushsrc_free(struct PushSource* p) {
+    if (!p) return;
+    pushsrc_finish(p);
+    pthread_mutex_destroy(&p->lock);
+    pthread_cond_destroy(&p->turn_changed);
+    free(p);
+}
+
+bool pushsrc_complete(const struct PushSource* p) {
+    return p->complete;
+}
+
+void pushsrc_wait(struct PushSource* p, size_t need) {
+    p->need = need;
+    switch_turn(p, false);
+}
@@ -0,0 +1,36 @@
+#ifndef PUSHSRC_H
+#define PUSHSRC_H
+
+#include "lexer.h"
+
+// NOTE - 推送式输入(parser_feed, 见parser.h)
+// 内容由调用者分段送入流式登记的文件(见srcmgr_begin_stream), 语法分析在单独的线程中进行,
+// 但两个线程严格交替执行, 相当于一个协程: 送入内容后让分析线程继续并等它暂停;
+// 分析线程要扫描的token可能还没到齐时暂停, 控制交回送入内容的一方
+// 暂停时分析线程的调用栈就是保存下来的语法分析状态, 递归下降的各个语法函数不需要改写;
+// 任何时刻只有一个线程在运行, 源文件管理器、诊断收集器和解析器的全局状态都不需要加锁
+
+#define PUSHSRC_STACK_SIZE (8 * 1024 * 1024)  // 分析线程的栈, 与通常的主线程相同, 能分析同样深的嵌套
+#define PUSHSRC_LOOKAHEAD 4     // 词法分析器在token之后最多看到的字节数(一个UTF-8字符)
+
+struct PushSource;
+
+// 为流式登记的文件创建输入, 之后设为分析该文件的词法分析器的push
+struct PushSource* pushsrc_new(int file_id);
+// 启动分析线程执行body(arg), 等它第一次暂停或结束后返回
+// 无法创建线程时在pushsrc_finish中(内容已经完整)由调用者的线程执行body
+void pushsrc_run(struct PushSource* p, void (*body)(void*), void* arg);
+// 追加一段内容; 分析线程等待的内容到齐时让它继续, 等它再次暂停或结束
+// 分析已经结束(如超出资源上限)或内容无法登记时返回false, 之后送入的内容不再使用
+bool pushsrc_feed(struct PushSource* p, const char* data, size_t length);
+// 内容结束, 让分析线程执行完毕
+void pushsrc_finish(struct PushSource* p);
+void pushsrc_free(struct PushSource* p);
+
+// 以下由分析线程(词法分析器)调用
+// 内容是否已经全部送入
+bool pushsrc_complete(const struct PushSource* p);
+// 暂停, 直到文件的长度不小于need或内容结束; 之后需要从源文件管理器重新取buffer和length
+void pushsrc_wait(struct PushSource* p, size_t need);
+
+#endif
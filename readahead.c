@@ -0,0 +1,484 @@
+// syscall()不在POSIX中, 需要默认的扩展声明
+#define _DEFAULT_SOURCE
+#include "readahead.h"
+#include "budget.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define READAHEAD_HAVE_URING 1
+#endif
+#endif
+
+#ifdef READAHEAD_HAVE_URING
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#endif
+
+// 单次读请求的上限, 更大的文件分几次读
+#define READ_CHUNK (1u << 30)
+
+typedef struct {
+    char* buffer;
+    size_t length;       // 已读入的字节数
+    size_t size;         // 文件大小
+    int fd;
+    bool done;
+    bool failed;
+    bool inflight;       // 有读请求已提交给io_uring还没完成
+} Slot;
+
+#ifdef READAHEAD_HAVE_URING
+// 不依赖liburing, 直接按内核接口映射提交队列和完成队列
+typedef struct {
+    int fd;
+    unsigned* sq_head;
+    unsigned* sq_tail;
+    unsigned* sq_mask;
+    unsigned* sq_array;
+    unsigned* cq_head;
+    unsigned* cq_tail;
+    unsigned* cq_mask;
+    struct io_uring_sqe* sqes;
+    struct io_uring_cqe* cqes;
+    void* sq_ptr;
+    size_t sq_size;
+    void* cq_ptr;
+    size_t cq_size;
+    size_t sqes_size;
+    unsigned to_submit;  // 已写入提交队列但还没有通知内核的请求
+    unsigned inflight;   // 还没有收到完成事件的请求
+    bool failed;         // io_uring_enter出错, 之后全部同步读
+} Uring;
+#endif
+
+struct ReadAhead {
+    const char* const* paths;
+    int count;
+    int depth;
+    Slot* slots;
+    int next_take;       // 下一个交给调用者的文件
+    int next_start;      // 下一个开始读的文件
+    ReadAheadStats stats;
+    bool use_uring;
+#ifdef READAHEAD_HAVE_URING
+    Uring ring;
+#endif
+    // 线程方式
+    pthread_t* threads;
+    int thread_count;
+    pthread_mutex_t lock;
+    pthread_cond_t ready;   // 有文件读完
+    pthread_cond_t space;   // 调用者取走了文件, 可以继续预读
+    bool stop;
+};
+
+// 与srcmgr_load相同的读法, 线程方式和io_uring出错后的补救都用它
+static void read_whole_file(Slot* s, const char* path) {
+    FILE* f = fopen(path, "r");
+    if (!f) {
+        s->failed = true;
+        return;
+    }
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    if (size < 0) size = 0;
+    free(s->buffer);
+    s->buffer = (char*)malloc((size_t)size + 1);
+    if (!s->buffer) {
+        s->failed = true;
+        fclose(f);
+        return;
+    }
+    s->length = fread(s->buffer, 1, (size_t)size, f);
+    s->buffer[s->length] = '\0';
+    s->size = s->length;
+    fclose(f);
+}
+
+// ==================== 线程方式 ====================
+
+static void* reader_thread(void* arg) {
+    ReadAhead* ra = (ReadAhead*)arg;
+    pthread_mutex_lock(&ra->lock);
+    for (;;) {
+        while (!ra->stop && ra->next_start < ra->count && ra->next_start >= ra->next_take + ra->depth) {
+            pthread_cond_wait(&ra->space, &ra->lock);
+        }
+        if (ra->stop || ra->next_start >= ra->count) break;
+        int i = ra->next_start++;
+        pthread_mutex_unlock(&ra->lock);
+
+        read_whole_file(&ra->slots[i], ra->paths[i]);
+
+        pthread_mutex_lock(&ra->lock);
+        ra->slots[i].done = true;
+        pthread_cond_broadcast(&ra->ready);
+    }
+    pthread_mutex_unlock(&ra->lock);
+    return NULL;
+}
+
+static bool start_threads(ReadAhead* ra) {
+    // 每个线程同一时间只读一个文件, 线程数即同时在读的文件数
+    int n = ra->depth < ra->count ? ra->depth : ra->count;
+    if (n < 1) n = 1;
+    ra->threads = (pthread_t*)malloc((size_t)n * sizeof(pthread_t));
+    if (!ra->threads) return false;
+    pthread_mutex_init(&ra->lock, NULL);
+    pthread_cond_init(&ra->ready, NULL);
+    pthread_cond_init(&ra->space, NULL);
+    for (int i = 0; i < n; i++) {
+        if (pthread_create(&ra->threads[i], NULL, reader_thread, ra) != 0) break;
+        ra->thread_count++;
+    }
+    return ra->thread_count > 0;
+}
+
+// ==================== io_uring方式 ====================
+
+#ifdef READAHEAD_HAVE_URING
+
+static int uring_setup(unsigned entries, struct io_uring_params* p) {
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static void uring_close(Uring* r) {
+    if (r->sqes) munmap(r->sqes, r->sqes_size);
+    if (r->cq_ptr && r->cq_ptr != r->sq_ptr) munmap(r->cq_ptr, r->cq_size);
+    if (r->sq_ptr) munmap(r->sq_ptr, r->sq_size);
+    if (r->fd >= 0) close(r->fd);
+    memset(r, 0, sizeof(Uring));
+    r->fd = -1;
+}
+
+static bool uring_init(Uring* r, unsigned entries) {
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    memset(r, 0, sizeof(Uring));
+    r->fd = uring_setup(entries, &p);
+    if (r->fd < 0) {
+        r->fd = -1;
+        return false;
+    }
+
+    r->sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    r->cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    bool single = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single) {
+        if (r->cq_size > r->sq_size) r->sq_size = r->cq_size;
+        r->cq_size = r->sq_size;
+    }
+    r->sq_ptr = mmap(NULL, r->sq_size, PROT_READ | PROT_WRITE, MAP_SHARED, r->fd, IORING_OFF_SQ_RING);
+    if (r->sq_ptr == MAP_FAILED) {
+        r->sq_ptr = NULL;
+        uring_close(r);
+        return false;
+    }
+    if (single) {
+        r->cq_ptr = r->sq_ptr;
+    } else {
+        r->cq_ptr = mmap(NULL, r->cq_size, PROT_READ | PROT_WRITE, MAP_SHARED, r->fd, IORING_OFF_CQ_RING);
+        if (r->cq_ptr == MAP_FAILED) {
+            r->cq_ptr = NULL;
+            uring_close(r);
+            return false;
+        }
+    }
+    r->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    r->sqes = (struct io_uring_sqe*)mmap(NULL, r->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                                         r->fd, IORING_OFF_SQES);
+    if (r->sqes == MAP_FAILED) {
+        r->sqes = NULL;
+        uring_close(r);
+        return false;
+    }
+
+    char* sq = (char*)r->sq_ptr;
+    char* cq = (char*)r->cq_ptr;
+    r->sq_head = (unsigned*)(sq + p.sq_off.head);
+    r->sq_tail = (unsigned*)(sq + p.sq_off.tail);
+    r->sq_mask = (unsigned*)(sq + p.sq_off.ring_mask);
+    r->sq_array = (unsigned*)(sq + p.sq_off.array);
+    r->cq_head = (unsigned*)(cq + p.cq_off.head);
+    r->cq_tail = (unsigned*)(cq + p.cq_off.tail);
+    r->cq_mask = (unsigned*)(cq + p.cq_off.ring_mask);
+    r->cqes = (struct io_uring_cqe*)(cq + p.cq_off.cqes);
+    return true;
+}
+
+// 提交第i个文件剩余部分的读请求
+// 同时在读的文件不超过depth个, 提交队列至少有depth项, 不会写满
+static void uring_queue_read(ReadAhead* ra, int i) {
+    Uring* r = &ra->ring;
+    Slot* s = &ra->slots[i];
+    size_t remaining = s->size - s->length;
+    unsigned tail = *r->sq_tail;
+    unsigned idx = tail & *r->sq_mask;
+    struct io_uring_sqe* sqe = &r->sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = s->fd;
+    sqe->addr = (uint64_t)(uintptr_t)(s->buffer + s->length);
+    sqe->len = remaining > READ_CHUNK ? READ_CHUNK : (unsigned)remaining;
+    sqe->off = s->length;
+    sqe->user_data = (uint64_t)i;
+    r->sq_array[idx] = idx;
+    __atomic_store_n(r->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    r->to_submit++;
+    r->inflight++;
+    s->inflight = true;
+}
+
+static void finish_slot(Slot* s) {
+    s->buffer[s->length] = '\0';
+    if (s->fd >= 0) close(s->fd);
+    s->fd = -1;
+    s->done = true;
+}
+
+// 打开文件并提交读请求; 打开和取大小是同步的, 数据读取是异步的
+static void uring_start_file(ReadAhead* ra, int i) {
+    Slot* s = &ra->slots[i];
+    if (ra->ring.failed) {
+        read_whole_file(s, ra->paths[i]);
+        s->done = true;
+        return;
+    }
+    struct stat st;
+    s->fd = open(ra->paths[i], O_RDONLY);
+    if (s->fd < 0 || fstat(s->fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        // 管道等非普通文件没有可用的大小, 按原来的方式读
+        if (s->fd >= 0) close(s->fd);
+        s->fd = -1;
+        read_whole_file(s, ra->paths[i]);
+        s->done = true;
+        return;
+    }
+    s->size = (size_t)st.st_size;
+    s->buffer = (char*)malloc(s->size + 1);
+    if (!s->buffer) {
+        close(s->fd);
+        s->fd = -1;
+        s->failed = true;
+        s->done = true;
+        return;
+    }
+    if (s->size == 0) {
+        finish_slot(s);
+        return;
+    }
+    uring_queue_read(ra, i);
+}
+
+static void uring_complete(ReadAhead* ra, int i, int res) {
+    Slot* s = &ra->slots[i];
+    if (res == -EINTR || res == -EAGAIN) {
+        uring_queue_read(ra, i);
+        return;
+    }
+    if (res < 0) {
+        // 内核不支持IORING_OP_READ等情况: 这个文件改为同步读
+        close(s->fd);
+        s->fd = -1;
+        s->length = 0;
+        read_whole_file(s, ra->paths[i]);
+        s->done = true;
+        return;
+    }
+    s->length += (size_t)res;
+    // res为0表示文件在读的过程中变短了
+    if (res == 0 || s->length >= s->size) {
+        finish_slot(s);
+    } else {
+        uring_queue_read(ra, i);
+    }
+}
+
+static void uring_reap(ReadAhead* ra) {
+    Uring* r = &ra->ring;
+    unsigned head = *r->cq_head;
+    unsigned tail = __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE);
+    while (head != tail) {
+        struct io_uring_cqe* cqe = &r->cqes[head & *r->cq_mask];
+        int i = (int)cqe->user_data;
+        int res = cqe->res;
+        head++;
+        // 先让出完成队列的位置, uring_complete可能再提交
+        __atomic_store_n(r->cq_head, head, __ATOMIC_RELEASE);
+        r->inflight--;
+        ra->slots[i].inflight = false;
+        uring_complete(ra, i, res);
+    }
+}
+
+// 提交窗口内还没开始读的文件, wait为true时至少等到一个完成
+static void uring_pump(ReadAhead* ra, bool wait) {
+    while (ra->next_start < ra->count && ra->next_start < ra->next_take + ra->depth) {
+        uring_start_file(ra, ra->next_start++);
+    }
+    Uring* r = &ra->ring;
+    if (r->failed || (r->to_submit == 0 && !wait)) return;
+    int ret = uring_enter(r->fd, r->to_submit, wait ? 1 : 0, wait ? IORING_ENTER_GETEVENTS : 0);
+    if (ret >= 0) {
+        r->to_submit -= (unsigned)ret < r->to_submit ? (unsigned)ret : r->to_submit;
+    } else if (errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+        // 无法再使用io_uring: 未完成的文件改为同步读
+        // 内核可能仍会写入已提交请求的缓冲区, 这些缓冲区不再使用也不释放
+        r->failed = true;
+        for (int i = ra->next_take; i < ra->next_start; i++) {
+            Slot* s = &ra->slots[i];
+            if (s->done) continue;
+            if (s->inflight) s->buffer = NULL;
+            s->inflight = false;
+            if (s->fd >= 0) close(s->fd);
+            s->fd = -1;
+            s->length = 0;
+            read_whole_file(s, ra->paths[i]);
+            s->done = true;
+        }
+        r->to_submit = 0;
+        r->inflight = 0;
+        return;
+    }
+    uring_reap(ra);
+}
+
+#endif
+
+// ==================== 对外接口 ====================
+
+ReadAhead* readahead_open(const char* const* paths, int count, int depth, ReadAheadBackend backend) {
+    ReadAhead* ra = (ReadAhead*)calloc(1, sizeof(ReadAhead));
+    if (!ra) return NULL;
+    if (depth < 1) depth = 1;
+    if (depth > READAHEAD_MAX_DEPTH) depth = READAHEAD_MAX_DEPTH;
+    ra->paths = paths;
+    ra->count = count;
+    ra->depth = depth;
+    ra->slots = (Slot*)calloc(count > 0 ? (size_t)count : 1, sizeof(Slot));
+    if (!ra->slots) {
+        free(ra);
+        return NULL;
+    }
+    for (int i = 0; i < count; i++) ra->slots[i].fd = -1;
+    ra->stats.depth = depth;
+
+#ifdef READAHEAD_HAVE_URING
+    ra->ring.fd = -1;
+    if (backend != READAHEAD_THREADS && uring_init(&ra->ring, (unsigned)depth)) {
+        ra->use_uring = true;
+        ra->stats.backend = "io_uring";
+        uring_pump(ra, false);
+        return ra;
+    }
+#endif
+    if (backend == READAHEAD_URING) {
+        fprintf(stderr, "io_uring is not available, using reader threads\n");
+    }
+    ra->stats.backend = "threads";
+    if (!start_threads(ra)) {
+        free(ra->threads);
+        free(ra->slots);
+        free(ra);
+        return NULL;
+    }
+    return ra;
+}
+
+bool readahead_next(ReadAhead* ra, char** buffer, size_t* length) {
+    if (ra->next_take >= ra->count) return false;
+    int k = ra->next_take;
+    Slot* s = &ra->slots[k];
+
+    if (ra->use_uring) {
+#ifdef READAHEAD_HAVE_URING
+        if (!s->done) {
+            ra->stats.stalls++;
+            double begin = budget_now_ms();
+            while (!s->done) uring_pump(ra, true);
+            ra->stats.wait_ms += budget_now_ms() - begin;
+        }
+        ra->next_take++;
+        // 立即补上窗口, 分析这个文件时后面的文件在读
+        uring_pump(ra, false);
+#endif
+    } else {
+        pthread_mutex_lock(&ra->lock);
+        if (!s->done) {
+            ra->stats.stalls++;
+            double begin = budget_now_ms();
+            while (!s->done) pthread_cond_wait(&ra->ready, &ra->lock);
+            ra->stats.wait_ms += budget_now_ms() - begin;
+        }
+        ra->next_take++;
+        pthread_cond_broadcast(&ra->space);
+        pthread_mutex_unlock(&ra->lock);
+    }
+
+    ra->stats.files++;
+    if (s->failed || !s->buffer) {
+        free(s->buffer);
+        s->buffer = NULL;
+        ra->stats.failed++;
+        *buffer = NULL;
+        *length = 0;
+    } else {
+        ra->stats.bytes += s->length;
+        *buffer = s->buffer;
+        *length = s->length;
+        s->buffer = NULL;
+    }
+    return true;
+}
+
+void readahead_stats(const ReadAhead* ra, ReadAheadStats* stats) {
+    *stats = ra->stats;
+}
+
+void readahead_close(ReadAhead* ra) {
+    if (!ra) return;
+    if (ra->use_uring) {
+#ifdef READAHEAD_HAVE_URING
+        // 提前结束时还有请求在读, 等它们完成后才能释放缓冲区
+        Uring* r = &ra->ring;
+        while (!r->failed && r->inflight > 0) {
+            int ret = uring_enter(r->fd, r->to_submit, 1, IORING_ENTER_GETEVENTS);
+            if (ret < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY) break;
+            if (ret > 0) r->to_submit -= (unsigned)ret < r->to_submit ? (unsigned)ret : r->to_submit;
+            uring_reap(ra);
+        }
+        uring_close(r);
+        for (int i = 0; i < ra->count; i++) {
+            if (ra->slots[i].fd >= 0) close(ra->slots[i].fd);
+        }
+#endif
+    } else {
+        pthread_mutex_lock(&ra->lock);
+        ra->stop = true;
+        pthread_cond_broadcast(&ra->space);
+        pthread_mutex_unlock(&ra->lock);
+        for (int i = 0; i < ra->thread_count; i++) pthread_join(ra->threads[i], NULL);
+        pthread_mutex_destroy(&ra->lock);
+        pthread_cond_destroy(&ra->ready);
+        pthread_cond_destroy(&ra->space);
+        free(ra->threads);
+    }
+    for (int i = 0; i < ra->count; i++) free(ra->slots[i].buffer);
+    free(ra->slots);
+    free(ra);
+}
@@ -0,0 +1,42 @@
+#ifndef READAHEAD_H
+#define READAHEAD_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// NOTE - 批量分析时的文件预读
+// 按顺序分析第k个文件时, 第k+1到k+depth个文件的读取已经提交, I/O与词法分析重叠
+// Linux下优先使用io_uring异步读; 不可用(内核太旧、被禁止或其他平台)时改用读线程
+
+typedef enum {
+    READAHEAD_AUTO,     // 能用io_uring就用, 否则用线程
+    READAHEAD_URING,
+    READAHEAD_THREADS
+} ReadAheadBackend;
+
+#define READAHEAD_DEFAULT_DEPTH 8
+#define READAHEAD_MAX_DEPTH 256
+
+typedef struct {
+    const char* backend;    // 实际使用的方式: "io_uring" / "threads"
+    int depth;
+    int files;              // 已取出的文件数
+    int failed;             // 其中无法读取的文件数
+    unsigned long long bytes;
+    double wait_ms;         // 取文件时阻塞等待I/O的总时间
+    int stalls;             // 需要等待的次数(文件还没读完)
+} ReadAheadStats;
+
+typedef struct ReadAhead ReadAhead;
+
+// 开始预读paths中的count个文件(paths在关闭前必须保持有效), 最多depth个文件同时在读
+ReadAhead* readahead_open(const char* const* paths, int count, int depth, ReadAheadBackend backend);
+
+// 按顺序取出下一个文件的内容(以'\0'结尾, 所有权交给调用者), 读取失败时*buffer为NULL
+// 全部取完后返回false
+bool readahead_next(ReadAhead* ra, char** buffer, size_t* length);
+
+void readahead_stats(const ReadAhead* ra, ReadAheadStats* stats);
+void readahead_close(ReadAhead* ra);
+
+#endif
@@ -0,0 +1,682 @@
+#define _POSIX_C_SOURCE 200809L
+#include "server.h"
+
+#ifdef _WIN32
+
+#include <stdio.h>
+
+int serve_run(const char* socket_path) {
+    (void)socket_path;
+    fprintf(stderr, "--serve is not supported on this platform\n");
+    return 1;
+}
+
+#else
+
+#include "parser.h"
+#include "output.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define SERVER_CACHE_SIZE 256
+// 响应太大的结果不缓存(大文件的token流JSON可能是源文件的几十倍)
+#define SERVER_CACHE_MAX_BODY (4u * 1024 * 1024)
+#define SERVER_MAX_BUFFER (256u * 1024 * 1024)
+#define SERVER_MAX_LINE (64u * 1024)        // 请求行(不含LEXBUF/PARSEBUF的内容)的最大长度
+#define SERVER_MAX_CLIENTS 64
+#define SERVER_IDLE_TIMEOUT_MS 30000         // 这么久没有收发任何内容的连接被关闭
+#define SERVER_POLL_MS 1000                  // 没有事件时也每隔这么久检查一次空闲连接
+
+// 延迟直方图(微秒): 16以下每个值一格, 之后每个2的幂区间再等分8格, 相对误差不超过1/8
+#define HIST_LINEAR 16
+#define HIST_SUB 8
+#define HIST_BUCKETS (HIST_LINEAR + HIST_SUB * 40)
+
+typedef enum {
+    REQ_LEX,
+    REQ_PARSE,
+    REQ_LEXBUF,
+    REQ_PARSEBUF,
+    REQ_STATS,
+    REQ_COUNT
+} RequestKind;
+
+static const char* const request_names[REQ_COUNT] = { "LEX", "PARSE", "LEXBUF", "PARSEBUF", "STATS" };
+
+typedef struct {
+    long count;
+    uint64_t max_us;
+    long buckets[HIST_BUCKETS];
+} Histogram;
+
+// 一次分析的结果: 状态行之前的响应内容和状态行中的字段
+typedef struct {
+    char* body;
+    size_t body_len;
+    const char* status;
+    long count;               // token数或语法树结点数
+    int diagnostics;
+    int files;                // 分析用到的源文件数, 包含了头文件时结果不缓存
+} Result;
+
+typedef struct {
+    char* path;               // NULL表示空位
+    RequestKind kind;
+    long long size;
+    long long mtime_sec;
+    long mtime_nsec;
+    Result result;
+} CachedResult;
+
+// 一个连接: 收到的内容先放进in, 凑成完整的请求后才处理; 响应放进out, 套接字可写时写出
+typedef struct {
+    int fd;
+    char* in;
+    size_t in_len;
+    size_t in_cap;
+    char* out;
+    size_t out_len;
+    size_t out_cap;
+    size_t out_sent;
+    bool eof;                 // 客户端已关闭写入端: 答复完已收到的请求后关闭
+    bool broken;              // 读写出错或内存不足, 立即关闭
+    uint64_t active_us;       // 上次收到或写出内容的时刻
+} Client;
+
+typedef struct {
+    Histogram latency[REQ_COUNT];
+    CachedResult cache[SERVER_CACHE_SIZE];
+    int next_victim;          // 缓存满时轮流替换
+    long cache_hits;
+    long cache_misses;
+    uint64_t started_us;
+    bool running;
+    Client clients[SERVER_MAX_CLIENTS];
+    int client_count;
+} Server;
+
+static uint64_t now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000u + (uint64_t)ts.tv_nsec / 1000u;
+}
+
+// ==================== 延迟统计 ====================
+
+static int hist_index(uint64_t us) {
+    if (us < HIST_LINEAR) return (int)us;
+    int e = 63 - __builtin_clzll(us);  // us >= 16, e >= 4
+    int sub = (int)((us >> (e - 3)) & (HIST_SUB - 1));
+    int idx = HIST_LINEAR + (e - 4) * HIST_SUB + sub;
+    return idx < HIST_BUCKETS ? idx : HIST_BUCKETS - 1;
+}
+
+// 格子内的最大值
+static uint64_t hist_upper(int idx) {
+    if (idx < HIST_LINEAR) return (uint64_t)idx;
+    int e = 4 + (idx - HIST_LINEAR) / HIST_SUB;
+    uint64_t sub = (uint64_t)((idx - HIST_LINEAR) % HIST_SUB);
+    uint64_t width = (uint64_t)1 << (e - 3);
+    return ((HIST_SUB + sub) << (e - 3)) + width - 1;
+}
+
+static void hist_record(Histogram* h, uint64_t us) {
+    h->buckets[hist_index(us)]++;
+    h->count++;
+    if (us > h->max_us) h->max_us = us;
+}
+
+// 第p百分位所在格子的上界(不超过观测到的最大值)
+static uint64_t hist_percentile(const Histogram* h, int p) {
+    if (h->count == 0) return 0;
+    long rank = (h->count * p + 99) / 100;
+    long seen = 0;
+    for (int i = 0; i < HIST_BUCKETS; i++) {
+        seen += h->buckets[i];
+        if (seen >= rank) {
+            uint64_t upper = hist_upper(i);
+            return upper < h->max_us ? upper : h->max_us;
+        }
+    }
+    return h->max_us;
+}
+
+// ==================== 分析 ====================
+
+static bool is_lex(RequestKind kind) {
+    return kind == REQ_LEX || kind == REQ_LEXBUF;
+}
+
+// 分析源文件管理器中的file_id, 响应内容写入r->body(调用者释放)
+static bool analyze(RequestKind kind, int file_id, Result* r) {
+    memset(r, 0, sizeof(Result));
+    char* diag_text = NULL;
+    size_t diag_len = 0;
+    FILE* body = open_memstream(&r->body, &r->body_len);
+    FILE* diag_out = open_memstream(&diag_text, &diag_len);
+    if (!body || !diag_out) {
+        if (body) fclose(body);
+        if (diag_out) fclose(diag_out);
+        free(r->body);
+        free(diag_text);
+        r->body = NULL;
+        return false;
+    }
+
+    // 诊断在free_lexer()时输出, 这里改为写入内存
+    DiagEngine* d = diag_default();
+    d->output = diag_out;
+    static OutWriter w;
+    out_init(&w, body);
+
+    if (is_lex(kind)) {
+        Lexer* lexer = init_lexer_source(file_id);
+        if (lexer) {
+            TokenStreamWriter ts;
+            token_stream_begin(&ts, &w, OUTPUT_JSON);
+            for (;;) {
+                Token token = get_token(lexer);
+                if (token.type == TOKEN_EOF) break;
+                token_stream_write(&ts, &token);
+                r->count++;
+            }
+            token_stream_end(&ts);
+            free_lexer(lexer);
+        }
+        r->status = "ok";
+    } else {
+        Ast ast;
+        ast_init(&ast);
+        int rc = parse_source_ast(file_id, &ast);
+        r->count = ast.node_count;
+        ast_free(&ast);
+        r->status = rc == 0 ? "ok" : rc == PARSE_LIMIT ? "limit_exceeded" : "syntax_error";
+    }
+    d->output = NULL;
+    fclose(diag_out);
+
+    // 诊断逐行转成JSON对象, 缩进的附注行和省略提示不计入条数
+    char* line = diag_text;
+    while (line && *line) {
+        char* nl = strchr(line, '\n');
+        if (nl) *nl = '\0';
+        out_str(&w, "{\"diagnostic\":");
+        out_json_string(&w, line);
+        out_str(&w, "}\n");
+        if (line[0] != ' ' && line[0] != '.') r->diagnostics++;
+        if (!nl) break;
+        line = nl + 1;
+    }
+    free(diag_text);
+    if (is_lex(kind) && r->diagnostics > 0) r->status = "lex_error";
+
+    out_flush(&w);
+    fclose(body);
+    // 结果已经是文本, 源文件和位置不再需要
+    r->files = srcmgr_default()->count;
+    srcmgr_reset(srcmgr_default());
+    return true;
+}
+
+// ==================== 响应 ====================
+
+static void write_error(OutWriter* w, const char* command, const char* message, const char* detail) {
+    out_str(w, "{\"status\":\"error\",\"command\":");
+    out_json_string(w, command);
+    out_str(w, ",\"message\":");
+    if (detail) {
+        char text[1024];
+        snprintf(text, sizeof(text), "%s: %s", message, detail);
+        out_json_string(w, text);
+    } else {
+        out_json_string(w, message);
+    }
+    out_str(w, "}\n");
+}
+
+static void write_result(OutWriter* w, RequestKind kind, const char* name, const Result* r,
+                         bool cached, uint64_t begin) {
+    out_write(w, r->body, r->body_len);
+    out_str(w, "{\"status\":\"");
+    out_str(w, r->status);
+    out_str(w, "\",\"command\":\"");
+    out_str(w, request_names[kind]);
+    out_str(w, "\",\"file\":");
+    out_json_string(w, name);
+    out_str(w, is_lex(kind) ? ",\"tokens\":" : ",\"nodes\":");
+    out_int(w, r->count, 0);
+    out_str(w, ",\"diagnostics\":");
+    out_int(w, r->diagnostics, 0);
+    out_str(w, cached ? ",\"cached\":true" : ",\"cached\":false");
+    out_str(w, ",\"micros\":");
+    out_int(w, (long long)(now_us() - begin), 0);
+    out_str(w, "}\n");
+}
+
+static void write_stats(Server* sv, OutWriter* w) {
+    out_str(w, "{\"status\":\"ok\",\"command\":\"STATS\",\"uptime_ms\":");
+    out_int(w, (long long)((now_us() - sv->started_us) / 1000u), 0);
+    int entries = 0;
+    for (int i = 0; i < SERVER_CACHE_SIZE; i++) {
+        if (sv->cache[i].path) entries++;
+    }
+    out_str(w, ",\"cache_entries\":");
+    out_int(w, entries, 0);
+    out_str(w, ",\"cache_hits\":");
+    out_int(w, sv->cache_hits, 0);
+    out_str(w, ",\"cache_misses\":");
+    out_int(w, sv->cache_misses, 0);
+    out_str(w, ",\"requests\":[");
+    for (int k = 0; k < REQ_COUNT; k++) {
+        const Histogram* h = &sv->latency[k];
+        if (k > 0) out_char(w, ',');
+        out_str(w, "{\"command\":\"");
+        out_str(w, request_names[k]);
+        out_str(w, "\",\"count\":");
+        out_int(w, h->count, 0);
+        out_str(w, ",\"p50_us\":");
+        out_int(w, (long long)hist_percentile(h, 50), 0);
+        out_str(w, ",\"p99_us\":");
+        out_int(w, (long long)hist_percentile(h, 99), 0);
+        out_str(w, ",\"max_us\":");
+        out_int(w, (long long)h->max_us, 0);
+        out_char(w, '}');
+    }
+    out_str(w, "]}\n");
+}
+
+// ==================== 请求处理 ====================
+
+static CachedResult* cache_find(Server* sv, RequestKind kind, const char* path, const struct stat* st) {
+    for (int i = 0; i < SERVER_CACHE_SIZE; i++) {
+        CachedResult* c = &sv->cache[i];
+        if (c->path && c->kind == kind && strcmp(c->path, path) == 0) {
+            if (c->size == (long long)st->st_size && c->mtime_sec == (long long)st->st_mtim.tv_sec &&
+                c->mtime_nsec == st->st_mtim.tv_nsec) {
+                return c;
+            }
+            // 文件已修改, 旧结果作废
+            free(c->path);
+            free(c->result.body);
+            c->path = NULL;
+            return NULL;
+        }
+    }
+    return NULL;
+}
+
+static void cache_store(Server* sv, RequestKind kind, const char* path, const struct stat* st, const Result* r) {
+    // 只按主文件的修改时间判断是否有效, 头文件修改后无法察觉, 所以包含了头文件的结果不缓存
+    if (r->body_len > SERVER_CACHE_MAX_BODY || r->files > 1) return;
+    char* key = (char*)malloc(strlen(path) + 1);
+    char* body = (char*)malloc(r->body_len ? r->body_len : 1);
+    if (!key || !body) {
+        free(key);
+        free(body);
+        return;
+    }
+    strcpy(key, path);
+    memcpy(body, r->body, r->body_len);
+
+    int slot = -1;
+    for (int i = 0; i < SERVER_CACHE_SIZE && slot < 0; i++) {
+        if (!sv->cache[i].path) slot = i;
+    }
+    if (slot < 0) {
+        slot = sv->next_victim;
+        sv->next_victim = (sv->next_victim + 1) % SERVER_CACHE_SIZE;
+        free(sv->cache[slot].path);
+        free(sv->cache[slot].result.body);
+    }
+    CachedResult* c = &sv->cache[slot];
+    c->path = key;
+    c->kind = kind;
+    c->size = (long long)st->st_size;
+    c->mtime_sec = (long long)st->st_mtim.tv_sec;
+    c->mtime_nsec = st->st_mtim.tv_nsec;
+    c->result = *r;
+    c->result.body = body;
+}
+
+static void handle_file(Server* sv, OutWriter* w, RequestKind kind, const char* path, uint64_t begin) {
+    struct stat st;
+    if (stat(path, &st) != 0 || !S_ISREG(st.st_mode)) {
+        write_error(w, request_names[kind], "Cannot open file", path);
+        return;
+    }
+    CachedResult* c = cache_find(sv, kind, path, &st);
+    if (c) {
+        sv->cache_hits++;
+        write_result(w, kind, path, &c->result, true, begin);
+        return;
+    }
+    sv->cache_misses++;
+
+    int file_id = srcmgr_load(srcmgr_default(), path);
+    Result r;
+    if (file_id < 0) {
+        write_error(w, request_names[kind], "Cannot open file", path);
+        return;
+    }
+    if (!analyze(kind, file_id, &r)) {
+        srcmgr_reset(srcmgr_default());
+        write_error(w, request_names[kind], "Memory allocation error", NULL);
+        return;
+    }
+    cache_store(sv, kind, path, &st, &r);
+    write_result(w, kind, path, &r, false, begin);
+    free(r.body);
+}
+
+// data为请求行之后的len字节内容
+static void handle_buffer(OutWriter* w, RequestKind kind, const char* name, const char* data, size_t len,
+                          uint64_t begin) {
+    int file_id = srcmgr_add_buffer(srcmgr_default(), name, data, len);
+    Result r;
+    if (file_id < 0 || !analyze(kind, file_id, &r)) {
+        srcmgr_reset(srcmgr_default());
+        write_error(w, request_names[kind], "Memory allocation error", NULL);
+        return;
+    }
+    write_result(w, kind, name, &r, false, begin);
+    free(r.body);
+}
+
+// ==================== 连接 ====================
+// 所有连接和监听套接字一起poll, 收到完整的请求才在这个线程上处理(语法分析器使用全局状态, 请求必须串行),
+// 一个连接保持打开不会挡住其他连接
+
+static bool reserve_in(Client* c, size_t need) {
+    if (need <= c->in_cap) return true;
+    size_t cap = c->in_cap ? c->in_cap * 2 : 4096;
+    while (cap < need) cap *= 2;
+    char* p = (char*)realloc(c->in, cap);
+    if (!p) return false;
+    c->in = p;
+    c->in_cap = cap;
+    return true;
+}
+
+// 读出套接字中已有的全部内容(不阻塞)
+static void read_client(Client* c, uint64_t now) {
+    while (!c->eof && c->in_len < SERVER_MAX_BUFFER + SERVER_MAX_LINE) {
+        if (!reserve_in(c, c->in_len + 4096)) {
+            c->broken = true;
+            return;
+        }
+        ssize_t n = read(c->fd, c->in + c->in_len, c->in_cap - c->in_len);
+        if (n > 0) {
+            c->in_len += (size_t)n;
+            c->active_us = now;
+        } else if (n == 0) {
+            c->eof = true;
+        } else {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) c->broken = true;
+            return;
+        }
+    }
+}
+
+// 写出排队的响应, 写不下时等下次可写
+static void flush_client(Client* c, uint64_t now) {
+    while (c->out_sent < c->out_len) {
+        ssize_t n = write(c->fd, c->out + c->out_sent, c->out_len - c->out_sent);
+        if (n > 0) {
+            c->out_sent += (size_t)n;
+            c->active_us = now;
+        } else {
+            if (n < 0 && errno == EINTR) continue;
+            if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) c->broken = true;
+            return;
+        }
+    }
+    c->out_len = c->out_sent = 0;
+}
+
+static void queue_output(Client* c, const char* data, size_t len) {
+    if (c->out_len + len > c->out_cap) {
+        size_t cap = c->out_cap ? c->out_cap * 2 : 4096;
+        while (cap < c->out_len + len) cap *= 2;
+        char* p = (char*)realloc(c->out, cap);
+        if (!p) {
+            c->broken = true;
+            return;
+        }
+        c->out = p;
+        c->out_cap = cap;
+    }
+    memcpy(c->out + c->out_len, data, len);
+    c->out_len += len;
+}
+
+// 已收到的内容中是否有一个完整的请求; 有时给出请求行的长度和连同LEXBUF/PARSEBUF内容在内的总长度
+// 客户端关闭写入端之后, 剩下的内容无论是否完整都作为最后一个请求
+static bool complete_request(const Client* c, size_t* line_len, size_t* total) {
+    const char* nl = (const char*)memchr(c->in, '\n', c->in_len);
+    if (!nl) {
+        if (c->in_len == 0 || (!c->eof && c->in_len <= SERVER_MAX_LINE)) return false;
+        *line_len = *total = c->in_len;
+        return true;
+    }
+    *line_len = (size_t)(nl - c->in);
+    *total = *line_len + 1;
+    if (strncmp(c->in, "LEXBUF ", 7) == 0 || strncmp(c->in, "PARSEBUF ", 9) == 0) {
+        unsigned long len = strtoul(strchr(c->in, ' ') + 1, NULL, 10);
+        if (len > SERVER_MAX_BUFFER) return true;
+        size_t received = c->in_len - *total;
+        if (received < len && !c->eof) return false;
+        *total += received < len ? received : len;
+    }
+    return true;
+}
+
+// 处理一个已经完整收到的请求, 响应放进发送队列; 没有完整的请求时返回false
+static bool serve_request(Server* sv, Client* c) {
+    size_t line_len, total;
+    if (!complete_request(c, &line_len, &total)) return false;
+    uint64_t begin = now_us();
+    char* line = (char*)malloc(line_len + 1);
+    char* text = NULL;
+    size_t text_len = 0;
+    FILE* mem = line ? open_memstream(&text, &text_len) : NULL;
+    if (!mem) {
+        free(line);
+        c->broken = true;
+        return false;
+    }
+    memcpy(line, c->in, line_len);
+    line[line_len] = '\0';
+    // 请求行之后的内容(LEXBUF/PARSEBUF)
+    const char* body = total > line_len ? c->in + line_len + 1 : NULL;
+    size_t body_len = body ? total - line_len - 1 : 0;
+    static OutWriter w;
+    out_init(&w, mem);
+
+    size_t n = line_len;
+    while (n > 0 && line[n - 1] == '\r') line[--n] = '\0';
+    char* args = strchr(line, ' ');
+    if (args) {
+        *args++ = '\0';
+        while (*args == ' ') args++;
+    } else {
+        args = line + n;
+    }
+
+    int kind = -1;
+    for (int k = 0; k < REQ_COUNT; k++) {
+        if (strcmp(line, request_names[k]) == 0) kind = k;
+    }
+    if (line_len > SERVER_MAX_LINE) {
+        // 找不到请求的边界, 之后的内容都不再处理
+        write_error(&w, "", "Request line too long", NULL);
+        kind = -1;
+        c->eof = true;
+        total = c->in_len;
+    } else if (n == 0) {
+        // 空行
+    } else if (kind == REQ_LEX || kind == REQ_PARSE) {
+        handle_file(sv, &w, (RequestKind)kind, args, begin);
+    } else if (kind == REQ_LEXBUF || kind == REQ_PARSEBUF) {
+        char* end;
+        unsigned long len = strtoul(args, &end, 10);
+        if (end == args || len > SERVER_MAX_BUFFER) {
+            // 不知道内容有多长, 同样找不到下一个请求的边界; 内容不能当作请求执行
+            write_error(&w, request_names[kind], "Invalid buffer length", args);
+            c->eof = true;
+            total = c->in_len;
+        } else if (body_len < len) {
+            write_error(&w, request_names[kind], "Unexpected end of request body", NULL);
+        } else {
+            while (*end == ' ') end++;
+            handle_buffer(&w, (RequestKind)kind, *end ? end : "<buffer>", body ? body : "", len, begin);
+        }
+    } else if (kind == REQ_STATS) {
+        write_stats(sv, &w);
+    } else if (strcmp(line, "SHUTDOWN") == 0) {
+        out_str(&w, "{\"status\":\"ok\",\"command\":\"SHUTDOWN\"}\n");
+        sv->running = false;
+    } else {
+        write_error(&w, line, "Unknown request", NULL);
+    }
+    out_flush(&w);
+    fclose(mem);
+    queue_output(c, text, text_len);
+    free(text);
+    free(line);
+    if (kind >= 0) hist_record(&sv->latency[kind], now_us() - begin);
+
+    memmove(c->in, c->in + total, c->in_len - total);
+    c->in_len -= total;
+    return true;
+}
+
+static void accept_client(Server* sv, int listen_fd) {
+    int fd = accept(listen_fd, NULL, NULL);
+    if (fd < 0) return;
+    int flags = fcntl(fd, F_GETFL);
+    if (sv->client_count == SERVER_MAX_CLIENTS || flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) != 0) {
+        close(fd);
+        return;
+    }
+    Client* c = &sv->clients[sv->client_count++];
+    memset(c, 0, sizeof(Client));
+    c->fd = fd;
+    c->active_us = now_us();
+}
+
+static void close_client(Server* sv, int i) {
+    Client* c = &sv->clients[i];
+    close(c->fd);
+    free(c->in);
+    free(c->out);
+    sv->clients[i] = sv->clients[--sv->client_count];
+}
+
+// 关闭出错的、客户端不再发送且请求都已答复的, 以及空闲太久的连接
+static void close_finished(Server* sv, uint64_t now) {
+    for (int i = sv->client_count - 1; i >= 0; i--) {
+        const Client* c = &sv->clients[i];
+        bool answered = c->in_len == 0 && c->out_sent == c->out_len;
+        if (c->broken || (c->eof && answered) || now - c->active_us > (uint64_t)SERVER_IDLE_TIMEOUT_MS * 1000u) {
+            close_client(sv, i);
+        }
+    }
+}
+
+static void serve_loop(Server* sv, int listen_fd) {
+    static struct pollfd fds[1 + SERVER_MAX_CLIENTS];
+    while (sv->running) {
+        int count = sv->client_count;
+        fds[0].fd = listen_fd;
+        fds[0].events = POLLIN;
+        for (int i = 0; i < count; i++) {
+            const Client* c = &sv->clients[i];
+            fds[1 + i].fd = c->fd;
+            fds[1 + i].events = 0;
+            // 上一个响应还没写完时不再读入, 不读响应的客户端不能让服务积压它的请求
+            if (c->out_sent == c->out_len && !c->eof && c->in_len < SERVER_MAX_BUFFER + SERVER_MAX_LINE) {
+                fds[1 + i].events |= POLLIN;
+            }
+            if (c->out_sent < c->out_len) fds[1 + i].events |= POLLOUT;
+        }
+        if (poll(fds, (nfds_t)(1 + count), SERVER_POLL_MS) < 0) {
+            if (errno == EINTR) continue;
+            fprintf(stderr, "poll failed: %s\n", strerror(errno));
+            break;
+        }
+        uint64_t now = now_us();
+        for (int i = 0; i < count; i++) {
+            Client* c = &sv->clients[i];
+            if (fds[1 + i].revents & POLLOUT) flush_client(c, now);
+            if (fds[1 + i].revents & (POLLIN | POLLHUP | POLLERR)) read_client(c, now);
+        }
+        // 每个连接轮流处理一个请求, 一个连接上连续发来的许多请求不会让其他连接一直等待
+        for (bool progress = true; progress && sv->running;) {
+            progress = false;
+            for (int i = 0; i < sv->client_count && sv->running; i++) {
+                Client* c = &sv->clients[i];
+                if (c->broken || c->out_sent < c->out_len || !serve_request(sv, c)) continue;
+                flush_client(c, now_us());
+                progress = true;
+            }
+        }
+        close_finished(sv, now_us());
+        if (fds[0].revents & POLLIN) accept_client(sv, listen_fd);
+    }
+    // 收到SHUTDOWN: 尽量写出已有的响应, 然后关闭全部连接
+    for (int i = sv->client_count - 1; i >= 0; i--) {
+        flush_client(&sv->clients[i], now_us());
+        close_client(sv, i);
+    }
+}
+
+int serve_run(const char* socket_path) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Socket path too long: %s\n", socket_path);
+        return 1;
+    }
+    strcpy(addr.sun_path, socket_path);
+
+    // 只删除上次退出时留下的套接字文件, 不碰同名的普通文件
+    struct stat st;
+    if (stat(socket_path, &st) == 0 && S_ISSOCK(st.st_mode)) unlink(socket_path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(fd, 16) != 0) {
+        fprintf(stderr, "Cannot listen on %s: %s\n", socket_path, strerror(errno));
+        if (fd >= 0) close(fd);
+        return 1;
+    }
+    // 客户端提前断开时写入失败即可, 不要让SIGPIPE结束服务
+    signal(SIGPIPE, SIG_IGN);
+
+    static Server sv;
+    memset(&sv, 0, sizeof(sv));
+    sv.running = true;
+    sv.started_us = now_us();
+    fprintf(stderr, "Listening on %s\n", socket_path);
+
+    serve_loop(&sv, fd);
+
+    close(fd);
+    unlink(socket_path);
+    for (int i = 0; i < SERVER_CACHE_SIZE; i++) {
+        free(sv.cache[i].path);
+        free(sv.cache[i].result.body);
+    }
+    return sv.running ? 1 : 0;
+}
+
+#endif
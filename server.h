@@ -0,0 +1,24 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+// NOTE - 常驻分析服务
+// 在Unix域套接字上监听, 一个进程连续处理许多请求, 省去每个文件一次的进程启动开销;
+// 以路径请求的文件按(路径, 大小, 修改时间)缓存分析结果, 文件未变时直接返回(包含了头文件的结果不缓存)
+//
+// 可以同时有多个连接, 一个连接保持打开不影响其他连接; 请求在收齐之后逐个处理(解析器状态是全局的),
+// 各连接轮流; 超过30秒没有收发任何内容的连接被关闭(SERVER_IDLE_TIMEOUT_MS)
+// 请求每行一条, 同一连接上可以连续发送多条:
+//   LEX <path>              词法分析文件
+//   PARSE <path>            语法分析文件
+//   LEXBUF <len> [name]     词法分析随后的len字节内容
+//   PARSEBUF <len> [name]   语法分析随后的len字节内容
+//   STATS                   各类请求的次数与延迟分位数(p50/p99)
+//   SHUTDOWN                关闭服务
+// 响应为JSON Lines: LEX先逐个输出token(格式同 --format json), 之后是诊断信息
+// {"diagnostic":"..."}, 每个响应以一个带"status"字段的对象结束
+// 启动时指定了资源上限(--max-tokens、--deadline-ms等)时, PARSE超出上限的status为"limit_exceeded"
+
+// 监听socket_path直到收到SHUTDOWN, 返回进程退出码
+int serve_run(const char* socket_path);
+
+#endif
@@ -0,0 +1,368 @@
+#include "srcmgr.h"
+#include "utf8.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// 流式登记中的文件
+struct SourceStream {
+    SourceNormStream norm;
+    int line_cap;
+};
+
+SourceManager* srcmgr_default(void) {
+    static SourceManager sm = { NULL, 0, 0, 1, 0 };
+    return &sm;
+}
+
+static int push_line(SourceFile* f, size_t offset, int* cap) {
+    if (f->line_count == *cap) {
+        *cap *= 2;
+        uint32_t* p = (uint32_t*)realloc(f->line_starts, (size_t)*cap * sizeof(uint32_t));
+        if (!p) return 0;
+        f->line_starts = p;
+    }
+    f->line_starts[f->line_count++] = (uint32_t)offset;
+    return 1;
+}
+
+// 一次扫描找出[i, length)中的换行符, SSE2下每次比较16个字节
+static int index_newlines(SourceFile* f, size_t i, int* cap) {
+    const char* buf = f->buffer;
+#if defined(__SSE2__)
+    const __m128i newline = _mm_set1_epi8('\n');
+    for (; i + 16 <= f->length; i += 16) {
+        __m128i chunk = _mm_loadu_si128((const __m128i*)(buf + i));
+        unsigned int mask = (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, newline));
+        while (mask) {
+            if (!push_line(f, i + (size_t)__builtin_ctz(mask), cap)) return 0;
+            mask &= mask - 1;
+        }
+    }
+#endif
+    for (; i < f->length; i++) {
+        if (buf[i] == '\n' && !push_line(f, i, cap)) return 0;
+    }
+    return 1;
+}
+
+static int index_lines(SourceFile* f, int* cap) {
+    *cap = (int)(f->length / 32) + 16;
+    f->line_starts = (uint32_t*)malloc((size_t)*cap * sizeof(uint32_t));
+    if (!f->line_starts) return 0;
+    f->line_count = 0;
+    f->last_line = 0;
+    push_line(f, f->start, cap);
+    return index_newlines(f, f->start, cap);
+}
+
+// 登记一个已读入内存的文件, buffer(长度length, 之后有'\0')的所有权转给管理器
+static int add_file(SourceManager* sm, const char* name, char* buffer, size_t length) {
+    if (sm->count == sm->cap) {
+        int cap = sm->cap ? sm->cap * 2 : 8;
+        SourceFile* p = (SourceFile*)realloc(sm->files, (size_t)cap * sizeof(SourceFile));
+        if (!p) {
+            fprintf(stderr, "Memory allocation error\n");
+            free(buffer);
+            return -1;
+        }
+        sm->files = p;
+        sm->cap = cap;
+    }
+
+    SourceFile* f = &sm->files[sm->count];
+    memset(f, 0, sizeof(SourceFile));
+    f->name = (char*)malloc(strlen(name) + 1);
+    if (!f->name) {
+        fprintf(stderr, "Memory allocation error\n");
+        free(buffer);
+        return -1;
+    }
+    strcpy(f->name, name);
+    f->buffer = buffer;
+    f->length = length;
+    f->orig_length = length;
+
+    // 跳过UTF-8 BOM (如果存在)
+    if (f->length >= 3 && memcmp(f->buffer, "\xEF\xBB\xBF", 3) == 0) {
+        f->start = 3;
+    }
+    f->utf8_error = utf8_next_invalid(f->buffer, f->start, f->length);
+    // CRLF和GBK在这里一次转换, 长度可能变化, 所以在分配位置之前
+    SourceNormalized norm;
+    if (srcnorm_run(f->buffer, f->start, f->length, f->utf8_error, &norm)) {
+        free(f->buffer);
+        f->buffer = norm.buffer;
+        f->length = norm.length;
+        f->encoding = norm.encoding;
+        f->had_cr = norm.had_cr;
+        f->offset_map = norm.map;
+        f->offset_map_count = norm.map_count;
+        f->utf8_error = f->utf8_error < f->orig_length ? utf8_next_invalid(f->buffer, f->start, f->length) : f->length;
+    }
+
+    // 文件末尾(EOF)也要有位置, 所以占length+1个位置
+    if ((uint64_t)sm->next_base + f->length + 1 > UINT32_MAX) {
+        fprintf(stderr, "Source too large: %s\n", name);
+        free(f->name);
+        free(f->buffer);
+        free(f->offset_map);
+        return -1;
+    }
+    f->base = sm->next_base;
+    sm->next_base += (SourceLoc)(f->length + 1);
+
+    int line_cap;
+    if (!index_lines(f, &line_cap)) {
+        fprintf(stderr, "Memory allocation error\n");
+        free(f->line_starts);
+        free(f->name);
+        free(f->buffer);
+        free(f->offset_map);
+        return -1;
+    }
+    return sm->count++;
+}
+
+int srcmgr_load(SourceManager* sm, const char* filename) {
+    for (int i = 0; i < sm->count; i++) {
+        if (strcmp(sm->files[i].name, filename) == 0) return i;
+    }
+
+    FILE* source = fopen(filename, "r");
+    if (!source) return -1;
+
+    // 文本模式下实际读到的字节数可能小于文件大小(CRLF转换), 以fread返回值为准
+    fseek(source, 0, SEEK_END);
+    long size = ftell(source);
+    fseek(source, 0, SEEK_SET);
+    if (size < 0) size = 0;
+
+    char* buffer = (char*)malloc((size_t)size + 1);
+    if (!buffer) {
+        fprintf(stderr, "Memory allocation error\n");
+        fclose(source);
+        return -1;
+    }
+    size_t length = fread(buffer, 1, (size_t)size, source);
+    buffer[length] = '\0';
+    fclose(source);
+    return add_file(sm, filename, buffer, length);
+}
+
+int srcmgr_adopt(SourceManager* sm, const char* name, char* buffer, size_t length) {
+    buffer[length] = '\0';
+    return add_file(sm, name, buffer, length);
+}
+
+int srcmgr_add_buffer(SourceManager* sm, const char* name, const char* data, size_t length) {
+    char* buffer = (char*)malloc(length + 1);
+    if (!buffer) {
+        fprintf(stderr, "Memory allocation error\n");
+        return -1;
+    }
+    memcpy(buffer, data, length);
+    buffer[length] = '\0';
+    return add_file(sm, name, buffer, length);
+}
+
+// NOTE - 流式登记
+int srcmgr_begin_stream(SourceManager* sm, const char* name) {
+    struct SourceStream* stream = (struct SourceStream*)calloc(1, sizeof(struct SourceStream));
+    char* buffer = (char*)malloc(1);
+    if (!stream || !buffer) {
+        fprintf(stderr, "Memory allocation error\n");
+        free(stream);
+        free(buffer);
+        return -1;
+    }
+    buffer[0] = '\0';
+    int id = add_file(sm, name, buffer, 0);
+    if (id < 0) {
+        free(stream);
+        return -1;
+    }
+    SourceFile* f = &sm->files[id];
+    stream->norm.buffer = f->buffer;
+    stream->norm.cap = 1;
+    stream->line_cap = f->line_count;  // 之后按条数加倍扩展
+    f->stream = stream;
+    return id;
+}
+
+// 转换后的内容交给文件, 扩展行起点表和utf8_error
+static bool stream_sync(SourceManager* sm, SourceFile* f) {
+    SourceNormStream* norm = &f->stream->norm;
+    size_t old = f->length;
+    if ((uint64_t)f->base + norm->length + 1 > UINT32_MAX) {
+        fprintf(stderr, "Source too large: %s\n", f->name);
+        return false;
+    }
+    f->buffer = norm->buffer;
+    f->length = norm->length;
+    f->orig_length = norm->received;
+    f->had_cr = norm->had_cr;
+    f->offset_map = norm->map;
+    f->offset_map_count = norm->map_count;
+    // BOM要等到前3个字节都到达才能确定, 此前还没有换行符
+    if (old < 3 && f->start == 0 && f->length >= 3 && memcmp(f->buffer, "\xEF\xBB\xBF", 3) == 0) {
+        f->start = 3;
+        f->line_starts[0] = 3;
+    }
+    // 非法序列离末尾不到4个字节时可能只是没到齐, 从它(字符边界)开始重新查找
+    if (f->utf8_error + 4 > old) {
+        size_t from = f->utf8_error > f->start ? f->utf8_error : f->start;
+        f->utf8_error = utf8_next_invalid(f->buffer, from, f->length);
+    }
+    sm->next_base = f->base + (SourceLoc)(f->length + 1);
+    if (!index_newlines(f, old > f->start ? old : f->start, &f->stream->line_cap)) {
+        fprintf(stderr, "Memory allocation error\n");
+        return false;
+    }
+    return true;
+}
+
+bool srcmgr_stream_append(SourceManager* sm, int file_id, const char* data, size_t length) {
+    SourceFile* f = srcmgr_file(sm, file_id);
+    if (!f || !f->stream || file_id != sm->count - 1) return false;
+    if (!srcnorm_stream_append(&f->stream->norm, data, length)) {
+        fprintf(stderr, "Memory allocation error\n");
+        return false;
+    }
+    return stream_sync(sm, f);
+}
+
+bool srcmgr_end_stream(SourceManager* sm, int file_id) {
+    SourceFile* f = srcmgr_file(sm, file_id);
+    if (!f || !f->stream) return false;
+    bool ok = file_id == sm->count - 1 && srcnorm_stream_end(&f->stream->norm) && stream_sync(sm, f);
+    free(f->stream);
+    f->stream = NULL;
+    return ok;
+}
+
+static void free_file(SourceFile* f) {
+    free(f->name);
+    free(f->buffer);
+    free(f->line_starts);
+    free(f->offset_map);
+    free(f->stream);
+}
+
+void srcmgr_release_from(SourceManager* sm, int file_id) {
+    if (file_id < 0 || file_id >= sm->count) return;
+    // 文件按base递增排列, 释放的是最后一段位置, 之后登记的文件从这里继续
+    sm->next_base = sm->files[file_id].base;
+    for (int i = file_id; i < sm->count; i++) free_file(&sm->files[i]);
+    sm->count = file_id;
+    if (sm->last_file >= sm->count) sm->last_file = 0;
+}
+
+void srcmgr_reset(SourceManager* sm) {
+    for (int i = 0; i < sm->count; i++) free_file(&sm->files[i]);
+    free(sm->files);
+    sm->files = NULL;
+    sm->count = 0;
+    sm->cap = 0;
+    sm->next_base = 1;
+    sm->last_file = 0;
+}
+
+SourceFile* srcmgr_file(SourceManager* sm, int file_id) {
+    return file_id >= 0 && file_id < sm->count ? &sm->files[file_id] : NULL;
+}
+
+int srcmgr_file_of(SourceManager* sm, SourceLoc loc) {
+    if (sm->count == 0 || loc == SOURCE_LOC_INVALID) return -1;
+    const SourceFile* f = &sm->files[sm->last_file];
+    if (loc >= f->base && loc <= f->base + f->length) return sm->last_file;
+
+    // 文件按base递增排列, 二分查找最后一个base <= loc的文件
+    int lo = 0, hi = sm->count - 1;
+    while (lo < hi) {
+        int mid = (lo + hi + 1) / 2;
+        if (sm->files[mid].base <= loc) lo = mid;
+        else hi = mid - 1;
+    }
+    f = &sm->files[lo];
+    if (loc < f->base || loc > f->base + f->length) return -1;
+    sm->last_file = lo;
+    return lo;
+}
+
+// 偏移所在行的下标(line_starts中最后一个<=offset的元素)
+static int find_line(SourceFile* f, uint32_t offset) {
+    int n = f->line_count;
+    int hint = f->last_line;
+    // 顺序访问时多半落在上次的行或下一行
+    if (hint < n && f->line_starts[hint] <= offset) {
+        if (hint + 1 == n || offset < f->line_starts[hint + 1]) return hint;
+        if (hint + 2 == n || offset < f->line_starts[hint + 2]) {
+            f->last_line = hint + 1;
+            return hint + 1;
+        }
+    }
+    int lo = 0, hi = n - 1;
+    if (offset < f->line_starts[0]) return 0;
+    while (lo < hi) {
+        int mid = (lo + hi + 1) / 2;
+        if (f->line_starts[mid] <= offset) lo = mid;
+        else hi = mid - 1;
+    }
+    f->last_line = lo;
+    return lo;
+}
+
+void srcmgr_decompose(SourceManager* sm, SourceLoc loc, int* file_id, int* line, int* column) {
+    int id = srcmgr_file_of(sm, loc);
+    if (file_id) *file_id = id;
+    if (id < 0) {
+        if (line) *line = 0;
+        if (column) *column = 0;
+        return;
+    }
+    SourceFile* f = &sm->files[id];
+    uint32_t offset = loc - f->base;
+    int idx = find_line(f, offset);
+    if (line) *line = idx + 1;
+    if (column) {
+        uint32_t begin = f->line_starts[idx];
+        if (offset <= begin) *column = 0;
+        else if (!f->offset_map) *column = (int)(offset - begin);
+        else *column = (int)(srcmgr_original_offset(f, offset) - srcmgr_original_offset(f, begin));
+    }
+}
+
+size_t srcmgr_original_offset(const SourceFile* f, size_t offset) {
+    return f->offset_map ? srcnorm_original_offset(f->offset_map, f->offset_map_count, offset) : offset;
+}
+
+const char* srcmgr_line_text(const SourceFile* f, int line, size_t* len) {
+    if (line < 1 || line > f->line_count) return NULL;
+    size_t begin = line == 1 ? 0 : (size_t)f->line_starts[line - 1] + 1;
+    size_t end = line < f->line_count ? (size_t)f->line_starts[line] : f->length;
+    *len = end - begin;
+    return f->buffer + begin;
+}
+
+int source_line(SourceLoc loc) {
+    int line;
+    srcmgr_decompose(srcmgr_default(), loc, NULL, &line, NULL);
+    return line;
+}
+
+int source_column(SourceLoc loc) {
+    int column;
+    srcmgr_decompose(srcmgr_default(), loc, NULL, NULL, &column);
+    return column;
+}
+
+unsigned int source_offset(SourceLoc loc) {
+    SourceManager* sm = srcmgr_default();
+    int id = srcmgr_file_of(sm, loc);
+    return id < 0 ? 0 : (unsigned int)srcmgr_original_offset(&sm->files[id], loc - sm->files[id].base);
+}
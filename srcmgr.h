@@ -0,0 +1,86 @@
+#ifndef SRCMGR_H
+#define SRCMGR_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "srcnorm.h"
+
+// NOTE - 源文件管理
+// 所有源文件共用一个32位的位置空间: 每个文件占一段[base, base+length], 位置 = base + 文件内偏移
+// 这样一个SourceLoc同时确定了文件和偏移; 行号列号不在扫描时维护,
+// 而是载入文件时建一次"行起点表"(SIMD查找换行符), 需要时再二分查找
+// 载入时先做输入规范化(见srcnorm.h): buffer中总是UTF-8和\n, 偏移和列号换算回原文件
+
+typedef uint32_t SourceLoc;
+
+#define SOURCE_LOC_INVALID 0
+
+typedef struct {
+    char* name;
+    char* buffer;          // 文件内容(以'\0'结尾, 已规范化), 由管理器持有
+    size_t length;
+    size_t orig_length;    // 原文件的字节数
+    SourceEncoding encoding;     // 原文件的编码
+    bool had_cr;           // 原文件中有\r(已换成\n)
+    SourceOffsetMap* offset_map; // 规范化后偏移 -> 原文件偏移, 未做规范化时为NULL
+    int offset_map_count;
+    size_t start;          // 内容起点(跳过BOM之后)
+    size_t utf8_error;     // 第一个非法UTF-8序列的偏移, 全部合法时等于length
+    SourceLoc base;        // 本文件在位置空间中的起点
+    // 行起点表: line_starts[0]为start, line_starts[k]为第k个换行符的偏移
+    // 与词法分析器一致, 换行符本身算作下一行的第0列
+    uint32_t* line_starts;
+    int line_count;
+    int last_line;         // 上次查到的行(下标), 顺序查询时不必二分
+    struct SourceStream* stream;  // 流式登记中(见srcmgr_begin_stream)的状态, 否则为NULL
+} SourceFile;
+
+typedef struct {
+    SourceFile* files;
+    int count;
+    int cap;
+    SourceLoc next_base;
+    int last_file;
+} SourceManager;
+
+// 进程内默认的源文件管理器
+SourceManager* srcmgr_default(void);
+
+// 读入文件, 建立行起点表并校验UTF-8, 同名文件只读一次; 失败返回-1
+int srcmgr_load(SourceManager* sm, const char* filename);
+// 登记内存中的内容(复制一份), name只用于显示, 不与已有文件合并; 失败返回-1
+int srcmgr_add_buffer(SourceManager* sm, const char* name, const char* data, size_t length);
+// 登记已读入的内容, buffer(至少length+1字节)的所有权转给管理器, 失败时也会被释放
+int srcmgr_adopt(SourceManager* sm, const char* name, char* buffer, size_t length);
+// NOTE - 流式登记(推送式解析, 见parser.h的parser_feed)
+// 内容分段追加, buffer、length、行起点表和utf8_error随之扩展(buffer可能换位置); 换行符逐段转换(见srcnorm.h),
+// 不做GBK检测. 文件占用的位置随内容增长, 所以结束之前必须是最后登记的文件, 期间不能登记其他文件
+int srcmgr_begin_stream(SourceManager* sm, const char* name);
+// 追加一段内容; 期间登记了其他文件、位置空间不够或内存不足时返回false
+bool srcmgr_stream_append(SourceManager* sm, int file_id, const char* data, size_t length);
+// 内容结束, 之后与一次载入的文件相同
+bool srcmgr_end_stream(SourceManager* sm, int file_id);
+
+// 释放全部文件, 之前的SourceLoc随之失效
+void srcmgr_reset(SourceManager* sm);
+// 释放编号不小于file_id的文件(即从它开始登记的文件), 位置空间随之收回, 这些文件中的SourceLoc随之失效
+void srcmgr_release_from(SourceManager* sm, int file_id);
+
+SourceFile* srcmgr_file(SourceManager* sm, int file_id);
+// 位置所在的文件, 无效位置返回-1
+int srcmgr_file_of(SourceManager* sm, SourceLoc loc);
+// 把位置分解为文件、行号(从1开始)和列号(原文件中相对行首的字节数)
+void srcmgr_decompose(SourceManager* sm, SourceLoc loc, int* file_id, int* line, int* column);
+
+// 文件中(规范化后的)偏移对应的原文件偏移
+size_t srcmgr_original_offset(const SourceFile* f, size_t offset);
+
+// 第line行的内容(不含换行符), 行号越界返回NULL
+const char* srcmgr_line_text(const SourceFile* f, int line, size_t* len);
+
+// 基于默认管理器的便捷函数
+int source_line(SourceLoc loc);
+int source_column(SourceLoc loc);
+unsigned int source_offset(SourceLoc loc);     // 原文件中的偏移
+
+#endif
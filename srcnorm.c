@@ -0,0 +1,260 @@
+#include "srcnorm.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#if defined(__has_include)
+#if __has_include(<iconv.h>)
+#define SRCNORM_HAVE_ICONV 1
+#include <iconv.h>
+#endif
+#endif
+
+typedef struct {
+    char* data;
+    size_t len;
+    SourceOffsetMap* map;
+    int map_count;
+    int map_cap;
+    bool failed;
+} NormOut;
+
+// 从norm起对应原文件的orig; 与上一段的差值相同时不开新段. 内存不足时返回false
+static bool append_map(SourceOffsetMap** map, int* count, int* cap, size_t norm, size_t orig) {
+    if (*count > 0) {
+        SourceOffsetMap* last = &(*map)[*count - 1];
+        if ((int64_t)last->orig - (int64_t)last->norm == (int64_t)orig - (int64_t)norm) return true;
+        if (last->norm == norm) {
+            last->orig = (uint32_t)orig;
+            return true;
+        }
+    }
+    if (*count == *cap) {
+        int n = *cap ? *cap * 2 : 64;
+        SourceOffsetMap* p = (SourceOffsetMap*)realloc(*map, (size_t)n * sizeof(SourceOffsetMap));
+        if (!p) return false;
+        *map = p;
+        *cap = n;
+    }
+    (*map)[*count].norm = (uint32_t)norm;
+    (*map)[*count].orig = (uint32_t)orig;
+    (*count)++;
+    return true;
+}
+
+static void push_map(NormOut* o, size_t norm, size_t orig) {
+    if (!append_map(&o->map, &o->map_count, &o->map_cap, norm, orig)) o->failed = true;
+}
+
+// 从pos开始第一个\r(high为true时还有最高位为1的字节)的下标, 没有时返回len
+static size_t next_special(const char* buf, size_t pos, size_t len, bool high) {
+#if defined(__AVX2__)
+    const __m256i cr32 = _mm256_set1_epi8('\r');
+    for (; pos + 32 <= len; pos += 32) {
+        __m256i chunk = _mm256_loadu_si256((const __m256i*)(buf + pos));
+        unsigned int mask = (unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, cr32));
+        if (high) mask |= (unsigned int)_mm256_movemask_epi8(chunk);
+        if (mask) return pos + (size_t)__builtin_ctz(mask);
+    }
+#endif
+#if defined(__SSE2__)
+    const __m128i cr = _mm_set1_epi8('\r');
+    for (; pos + 16 <= len; pos += 16) {
+        __m128i chunk = _mm_loadu_si128((const __m128i*)(buf + pos));
+        unsigned int mask = (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, cr));
+        if (high) mask |= (unsigned int)_mm_movemask_epi8(chunk);
+        if (mask) return pos + (size_t)__builtin_ctz(mask);
+    }
+#endif
+    for (; pos < len; pos++) {
+        unsigned char c = (unsigned char)buf[pos];
+        if (c == '\r' || (high && c >= 0x80)) return pos;
+    }
+    return len;
+}
+
+// 从pos开始连续的GBK双字节字符的结束位置; 遇到不是GBK的字节时返回0
+static size_t gbk_run_end(const char* buf, size_t pos, size_t len) {
+    while (pos < len && (unsigned char)buf[pos] >= 0x80) {
+        unsigned char lead = (unsigned char)buf[pos];
+        if (lead < 0x81 || lead > 0xFE || pos + 1 >= len) return 0;
+        unsigned char trail = (unsigned char)buf[pos + 1];
+        if (trail < 0x40 || trail == 0x7F || trail == 0xFF) return 0;
+        pos += 2;
+    }
+    return pos;
+}
+
+// 一遍完成换行符和编码的转换; gbk为NULL时只处理换行符. GBK解码失败时返回false
+static bool normalize(const char* buf, size_t start, size_t length, void* gbk, NormOut* o) {
+    memcpy(o->data, buf, start);
+    o->len = start;
+    size_t i = start;
+    while (i < length) {
+        size_t j = next_special(buf, i, length, gbk != NULL);
+        memcpy(o->data + o->len, buf + i, j - i);
+        o->len += j - i;
+        if (j == length) break;
+
+        if (buf[j] == '\r') {
+            if (j + 1 < length && buf[j + 1] == '\n') {
+                // \r\n: 去掉\r, 之后的\n对应原文件的\n
+                push_map(o, o->len, j + 1);
+            } else {
+                // 单独的\r(旧Mac格式)同样是换行
+                o->data[o->len++] = '\n';
+            }
+            i = j + 1;
+            continue;
+        }
+
+        size_t k = gbk_run_end(buf, j, length);
+        if (k == 0) return false;
+#ifdef SRCNORM_HAVE_ICONV
+        char* in = (char*)buf + j;
+        size_t in_left = k - j;
+        char* out = o->data + o->len;
+        // 每个双字节字符转换后最多3字节, 输出缓冲区按1.5倍分配, 不会不够
+        size_t out_left = (k - j) / 2 * 3;
+        if (iconv((iconv_t)gbk, &in, &in_left, &out, &out_left) == (size_t)-1 || in_left != 0) return false;
+        o->len = (size_t)(out - o->data);
+#endif
+        push_map(o, o->len, k);
+        i = k;
+    }
+    o->data[o->len] = '\0';
+    return !o->failed;
+}
+
+bool srcnorm_run(const char* buf, size_t start, size_t length, size_t utf8_error, SourceNormalized* out) {
+    bool had_cr = next_special(buf, start, length, false) < length;
+    void* gbk = NULL;
+#ifdef SRCNORM_HAVE_ICONV
+    iconv_t cd = (iconv_t)-1;
+    if (utf8_error < length) {
+        cd = iconv_open("UTF-8", "GBK");
+        if (cd != (iconv_t)-1) gbk = (void*)cd;
+    }
+#else
+    (void)utf8_error;
+#endif
+    if (!had_cr && !gbk) return false;
+
+    NormOut o;
+    memset(&o, 0, sizeof(o));
+    o.data = (char*)malloc(length + (gbk ? length / 2 : 0) + 1);
+    bool ok = false;
+    if (o.data) {
+        push_map(&o, 0, 0);
+        ok = normalize(buf, start, length, gbk, &o);
+        if (!ok && gbk && had_cr) {
+            // 不是GBK: 按原编码只转换换行符
+            o.map_count = 0;
+            push_map(&o, 0, 0);
+            gbk = NULL;
+            ok = normalize(buf, start, length, NULL, &o);
+        }
+    }
+#ifdef SRCNORM_HAVE_ICONV
+    if (cd != (iconv_t)-1) iconv_close(cd);
+#endif
+    if (!ok) {
+        if (!o.data || o.failed) fprintf(stderr, "Memory allocation error\n");
+        free(o.data);
+        free(o.map);
+        return false;
+    }
+    out->buffer = o.data;
+    out->length = o.len;
+    out->encoding = gbk ? SRC_ENCODING_GBK : SRC_ENCODING_UTF8;
+    out->had_cr = had_cr;
+    out->map = o.map;
+    out->map_count = o.map_count;
+    return true;
+}
+
+// NOTE - 流式规范化
+
+static bool stream_reserve(SourceNormStream* s, size_t need) {
+    if (need <= s->cap) return true;
+    size_t cap = s->cap ? s->cap * 2 : 4096;
+    while (cap < need) cap *= 2;
+    char* p = (char*)realloc(s->buffer, cap);
+    if (!p) return false;
+    s->buffer = p;
+    s->cap = cap;
+    return true;
+}
+
+// 去掉\r\n中的\r: 之后的\n(原文件偏移orig)落在规范化后的当前末尾
+static bool stream_drop_cr(SourceNormStream* s, size_t orig) {
+    // 第一段从0起与原文件一致, 之后才有偏移
+    if (s->map_count == 0 && !append_map(&s->map, &s->map_count, &s->map_cap, 0, 0)) return false;
+    return append_map(&s->map, &s->map_count, &s->map_cap, s->length, orig);
+}
+
+bool srcnorm_stream_append(SourceNormStream* s, const char* data, size_t length) {
+    if (!stream_reserve(s, s->length + length + 2)) return false;
+    size_t base = s->received;
+    size_t i = 0;
+    if (s->pending_cr && length > 0) {
+        s->pending_cr = false;
+        if (data[0] == '\n') {
+            if (!stream_drop_cr(s, base)) return false;
+        } else {
+            s->buffer[s->length++] = '\n';
+        }
+    }
+    while (i < length) {
+        size_t j = next_special(data, i, length, false);
+        memcpy(s->buffer + s->length, data + i, j - i);
+        s->length += j - i;
+        if (j == length) break;
+        s->had_cr = true;
+        if (j + 1 == length) {
+            s->pending_cr = true;
+        } else if (data[j + 1] == '\n') {
+            if (!stream_drop_cr(s, base + j + 1)) return false;
+        } else {
+            s->buffer[s->length++] = '\n';
+        }
+        i = j + 1;
+    }
+    s->received += length;
+    s->buffer[s->length] = '\0';
+    return true;
+}
+
+bool srcnorm_stream_end(SourceNormStream* s) {
+    if (!stream_reserve(s, s->length + 2)) return false;
+    if (s->pending_cr) {
+        s->pending_cr = false;
+        s->buffer[s->length++] = '\n';
+    }
+    s->buffer[s->length] = '\0';
+    return true;
+}
+
+size_t srcnorm_original_offset(const SourceOffsetMap* map, int count, size_t offset) {
+    if (count == 0) return offset;
+    int lo = 0, hi = count - 1;
+    while (lo < hi) {
+        int mid = (lo + hi + 1) / 2;
+        if (map[mid].norm <= offset) lo = mid;
+        else hi = mid - 1;
+    }
+    size_t orig = map[lo].orig + (offset - map[lo].norm);
+    // 转换后变长的GBK字符中间: 不超过原文件中这段字符的末尾
+    if (lo + 1 < count && orig > map[lo + 1].orig) orig = map[lo + 1].orig;
+    return orig;
+}
+
+const char* srcnorm_encoding_name(SourceEncoding encoding) {
+    return encoding == SRC_ENCODING_GBK ? "GBK" : "UTF-8";
+}
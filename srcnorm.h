@@ -0,0 +1,64 @@
+#ifndef SRCNORM_H
+#define SRCNORM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// NOTE - 输入规范化
+// 载入文件时检测一次编码和换行符: 不是合法UTF-8而能按GBK解码的文件转成UTF-8, \r\n和单独的\r换成\n,
+// 词法分析器和行起点表只需要处理UTF-8和\n. 两者都不需要时不做任何复制
+// 扫描用SIMD按块查找\r和(GBK时)最高位为1的字节, 之间的ASCII整段复制; 连续的GBK字符整段交给iconv转换
+// 同时记下规范化后的偏移到原文件偏移的对应关系, 诊断中的列号和输出的偏移都按原文件计算
+
+typedef enum {
+    SRC_ENCODING_UTF8,
+    SRC_ENCODING_GBK
+} SourceEncoding;
+
+// 分段对应: 从norm起(到下一段之前)的内容对应原文件从orig起的内容, 两者之差在段内不变;
+// 只在差值变化处(去掉的\r之后、转换的GBK字符之后)开始新的一段
+typedef struct {
+    uint32_t norm;
+    uint32_t orig;
+} SourceOffsetMap;
+
+typedef struct {
+    char* buffer;                  // 规范化后的内容(以'\0'结尾), 由调用者释放
+    size_t length;
+    SourceEncoding encoding;
+    bool had_cr;                   // 原内容中有\r
+    SourceOffsetMap* map;          // 由调用者释放
+    int map_count;
+} SourceNormalized;
+
+// 规范化buf(长度length, start之前的BOM原样保留); utf8_error为第一个非法UTF-8序列的偏移(合法时等于length),
+// 有非法序列时才尝试按GBK解码. 不需要规范化(或GBK解码失败且没有\r)时返回false, out不变
+bool srcnorm_run(const char* buf, size_t start, size_t length, size_t utf8_error, SourceNormalized* out);
+
+// NOTE - 流式规范化
+// 内容分段到达(推送式解析, 见parser.h)时逐段转换, 只处理换行符: 编码要看到全部内容才能判断, 按UTF-8处理
+// 段末尾的\r要看到下一段的第一个字节才知道是不是\r\n, 先不输出, 由下一段或srcnorm_stream_end处理
+typedef struct {
+    char* buffer;                  // 已转换的全部内容(以'\0'结尾), 由调用者释放
+    size_t length;
+    size_t cap;
+    size_t received;               // 已送入的原内容字节数(含未输出的\r)
+    bool had_cr;
+    bool pending_cr;               // 最后一个字节是还没输出的\r
+    SourceOffsetMap* map;          // 同SourceNormalized, 没有去掉过\r时为NULL; 由调用者释放
+    int map_count;
+    int map_cap;
+} SourceNormStream;
+
+// 追加一段原内容(s开始时全部清零); 内存不足时返回false
+bool srcnorm_stream_append(SourceNormStream* s, const char* data, size_t length);
+// 内容结束, 输出留着的\r
+bool srcnorm_stream_end(SourceNormStream* s);
+
+// 规范化后的偏移对应的原文件偏移; 转换后的GBK字符中间的偏移不超过原文件中这段字符的末尾
+size_t srcnorm_original_offset(const SourceOffsetMap* map, int count, size_t offset);
+
+const char* srcnorm_encoding_name(SourceEncoding encoding);
+
+#endif
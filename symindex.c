@@ -0,0 +1,708 @@
+#define _POSIX_C_SOURCE 200809L
+#include "symindex.h"
+#include "tokcache.h"
+#include <sys/stat.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+static const char* role_names[SYM_ROLE_COUNT] = { "assign", "use", "if", "while", "other" };
+
+const char* sym_role_name(SymRole role) {
+    return role >= 0 && role < SYM_ROLE_COUNT ? role_names[role] : "?";
+}
+
+int sym_role_from_name(const char* name) {
+    for (int r = 0; r < SYM_ROLE_COUNT; r++) {
+        if (strcmp(role_names[r], name) == 0) return r;
+    }
+    return -1;
+}
+
+// NOTE - 建立索引时的内存结构: 标识符驻留表, 每个标识符一个未编码的倒排表
+typedef struct {
+    uint32_t file;
+    uint32_t offset;
+    uint32_t line;
+    uint32_t role;
+} Posting;
+
+typedef struct {
+    uint32_t name;               // 在builder的字符串池中的偏移
+    uint32_t name_len;
+    Posting* items;
+    uint32_t count;
+    uint32_t cap;
+} Term;
+
+typedef struct {
+    Term* terms;
+    uint32_t term_count;
+    uint32_t term_cap;
+    uint32_t* table;             // 开放寻址, 存 下标+1
+    uint32_t table_cap;
+    char* pool;
+    size_t pool_len;
+    size_t pool_cap;
+    uint32_t* file_postings;     // 每个文件的出现次数
+    bool failed;                 // 内存分配失败
+} Builder;
+
+static bool grow(void** p, size_t* cap, size_t need, size_t size) {
+    if (need <= *cap) return true;
+    size_t n = *cap ? *cap : 16;
+    while (n < need) n *= 2;
+    void* q = realloc(*p, n * size);
+    if (!q) return false;
+    *p = q;
+    *cap = n;
+    return true;
+}
+
+static bool rehash(Builder* b, uint32_t cap) {
+    uint32_t* table = (uint32_t*)calloc(cap, sizeof(uint32_t));
+    if (!table) return false;
+    for (uint32_t i = 0; i < b->term_count; i++) {
+        const Term* t = &b->terms[i];
+        uint32_t h = (uint32_t)tokcache_hash(b->pool + t->name, t->name_len, 0) & (cap - 1);
+        while (table[h]) h = (h + 1) & (cap - 1);
+        table[h] = i + 1;
+    }
+    free(b->table);
+    b->table = table;
+    b->table_cap = cap;
+    return true;
+}
+
+static Term* intern_term(Builder* b, const char* name, size_t len) {
+    if ((b->term_count + 1) * 2 > b->table_cap && !rehash(b, b->table_cap ? b->table_cap * 2 : 1024)) {
+        return NULL;
+    }
+    uint32_t mask = b->table_cap - 1;
+    uint32_t h = (uint32_t)tokcache_hash(name, len, 0) & mask;
+    for (; b->table[h]; h = (h + 1) & mask) {
+        Term* t = &b->terms[b->table[h] - 1];
+        if (t->name_len == len && memcmp(b->pool + t->name, name, len) == 0) return t;
+    }
+    size_t term_cap = b->term_cap;
+    if (!grow((void**)&b->terms, &term_cap, (size_t)b->term_count + 1, sizeof(Term)) ||
+        !grow((void**)&b->pool, &b->pool_cap, b->pool_len + len + 1, 1)) {
+        return NULL;
+    }
+    b->term_cap = (uint32_t)term_cap;
+    Term* t = &b->terms[b->term_count];
+    memset(t, 0, sizeof(*t));
+    t->name = (uint32_t)b->pool_len;
+    t->name_len = (uint32_t)len;
+    memcpy(b->pool + b->pool_len, name, len);
+    b->pool[b->pool_len + len] = '\0';
+    b->pool_len += len + 1;
+    b->table[h] = ++b->term_count;
+    return t;
+}
+
+static void add_posting(Builder* b, const char* name, size_t len, const Posting* p) {
+    if (b->failed) return;
+    Term* t = intern_term(b, name, len);
+    size_t cap = t ? t->cap : 0;
+    if (!t || !grow((void**)&t->items, &cap, (size_t)t->count + 1, sizeof(Posting))) {
+        b->failed = true;
+        return;
+    }
+    t->cap = (uint32_t)cap;
+    t->items[t->count++] = *p;
+    b->file_postings[p->file]++;
+}
+
+static void builder_free(Builder* b) {
+    for (uint32_t i = 0; i < b->term_count; i++) free(b->terms[i].items);
+    free(b->terms);
+    free(b->table);
+    free(b->pool);
+    free(b->file_postings);
+}
+
+// NOTE - 由解析事件得到标识符的角色
+// 维护进入而未离开的语法结构栈; 标识符的角色由最近的条件或赋值语句决定:
+// 条件归属于它所在的if/while/do-while, 赋值语句中进入右部表达式之前的标识符是赋值目标
+typedef struct {
+    Builder* b;
+    uint32_t file;
+    const SourceFile* source;
+    SourceLoc base;
+    size_t length;
+    ParseConstruct* stack;
+    size_t depth;
+    size_t cap;
+} Collector;
+
+static bool on_enter(void* user, ParseConstruct construct, SourceLoc loc) {
+    (void)loc;
+    Collector* c = (Collector*)user;
+    if (!grow((void**)&c->stack, &c->cap, c->depth + 1, sizeof(ParseConstruct))) {
+        c->b->failed = true;
+        return false;
+    }
+    c->stack[c->depth++] = construct;
+    return true;
+}
+
+static bool on_exit(void* user, ParseConstruct construct) {
+    (void)construct;
+    Collector* c = (Collector*)user;
+    if (c->depth > 0) c->depth--;
+    return true;
+}
+
+static SymRole current_role(const Collector* c) {
+    bool in_expr = false;
+    for (size_t i = c->depth; i-- > 0;) {
+        switch (c->stack[i]) {
+            case PARSE_COND:
+                return i > 0 && c->stack[i - 1] == PARSE_IF ? SYM_IF_COND : SYM_WHILE_COND;
+            case PARSE_EXPR:
+            case PARSE_NEGATE:
+                in_expr = true;
+                break;
+            case PARSE_ASSIGN:
+                return in_expr ? SYM_USE : SYM_ASSIGN;
+            default:
+                return SYM_OTHER;
+        }
+    }
+    return SYM_OTHER;
+}
+
+static bool on_token(void* user, const Token* token, const char* text, size_t length) {
+    Collector* c = (Collector*)user;
+    // 只记录本文件中的标识符(不含头文件和宏展开得到的)
+    if (token->type != TOKEN_IDENTIFIER || token->loc < c->base || token->loc - c->base >= c->length) {
+        return true;
+    }
+    Posting p;
+    p.file = c->file;
+    // 偏移按原文件计算(CRLF和GBK文件规范化后偏移会变)
+    p.offset = (uint32_t)srcmgr_original_offset(c->source, token->loc - c->base);
+    p.line = (uint32_t)source_line(token->loc);
+    p.role = (uint32_t)current_role(c);
+    add_posting(c->b, text, length, &p);
+    return !c->b->failed;
+}
+
+static void index_source(Builder* b, uint32_t file, int file_id) {
+    const SourceFile* f = srcmgr_file(srcmgr_default(), file_id);
+    Collector c;
+    memset(&c, 0, sizeof(c));
+    c.b = b;
+    c.file = file;
+    c.source = f;
+    c.base = f->base;
+    c.length = f->length;
+    ParseEvents events = { on_enter, on_exit, on_token };
+    parse_source_events(file_id, &events, &c);
+    free(c.stack);
+}
+
+// NOTE - 倒排表的编码
+static void put_varint(unsigned char** buf, size_t* len, size_t* cap, uint64_t v, bool* failed) {
+    if (!grow((void**)buf, cap, *len + 10, 1)) {
+        *failed = true;
+        return;
+    }
+    while (v >= 0x80) {
+        (*buf)[(*len)++] = (unsigned char)(v | 0x80);
+        v >>= 7;
+    }
+    (*buf)[(*len)++] = (unsigned char)v;
+}
+
+static bool get_varint(const unsigned char** p, const unsigned char* end, uint64_t* v) {
+    uint64_t result = 0;
+    for (int shift = 0; *p < end && shift < 64; shift += 7) {
+        unsigned char byte = *(*p)++;
+        result |= (uint64_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            *v = result;
+            return true;
+        }
+    }
+    return false;
+}
+
+// 依次解码一个倒排表, visit返回false时停止
+typedef bool (*PostingVisit)(void* user, const Posting* p);
+
+static bool decode_postings(const unsigned char* p, const unsigned char* end, uint32_t count,
+                            PostingVisit visit, void* user) {
+    Posting cur = { 0, 0, 0, 0 };
+    for (uint32_t i = 0; i < count; i++) {
+        uint64_t file_delta, packed, line_delta;
+        if (!get_varint(&p, end, &file_delta) || !get_varint(&p, end, &packed) ||
+            !get_varint(&p, end, &line_delta)) {
+            return false;
+        }
+        if (file_delta > 0 || i == 0) {
+            cur.offset = 0;
+            cur.line = 0;
+        }
+        cur.file += (uint32_t)file_delta;
+        cur.offset += (uint32_t)(packed >> 3);
+        cur.role = (uint32_t)(packed & 7);
+        cur.line += (uint32_t)line_delta;
+        if (!visit(user, &cur)) break;
+    }
+    return true;
+}
+
+// NOTE - 只读映射的索引
+struct SymIndex {
+    unsigned char* map;
+    size_t size;
+    bool mapped;                 // true: mmap映射; false: malloc读入
+    const SymIndexHeader* header;
+    const SymFileEntry* files;
+    const SymTermEntry* terms;
+    const char* strings;
+    size_t strings_size;
+    const unsigned char* postings;
+};
+
+SymIndex* symindex_open(const char* path) {
+    SymIndex* idx = (SymIndex*)calloc(1, sizeof(SymIndex));
+    if (!idx) return NULL;
+#ifdef _WIN32
+    FILE* f = fopen(path, "rb");
+    if (!f) {
+        free(idx);
+        return NULL;
+    }
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    idx->map = size > 0 ? (unsigned char*)malloc((size_t)size) : NULL;
+    if (!idx->map || fread(idx->map, 1, (size_t)size, f) != (size_t)size) {
+        free(idx->map);
+        free(idx);
+        fclose(f);
+        return NULL;
+    }
+    fclose(f);
+    idx->size = (size_t)size;
+    idx->mapped = false;
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        free(idx);
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(SymIndexHeader)) {
+        close(fd);
+        free(idx);
+        return NULL;
+    }
+    void* p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+        free(idx);
+        return NULL;
+    }
+    idx->map = (unsigned char*)p;
+    idx->size = (size_t)st.st_size;
+    idx->mapped = true;
+#endif
+
+    const SymIndexHeader* h = (const SymIndexHeader*)idx->map;
+    bool ok = idx->size >= sizeof(SymIndexHeader) &&
+              h->magic == SYMINDEX_MAGIC &&
+              h->format_version == SYMINDEX_FORMAT_VERSION &&
+              h->file_table_offset + (uint64_t)h->file_count * sizeof(SymFileEntry) <= h->term_table_offset &&
+              h->term_table_offset + (uint64_t)h->term_count * sizeof(SymTermEntry) <= h->strings_offset &&
+              h->strings_offset <= h->postings_offset &&
+              h->postings_offset + h->postings_size <= idx->size;
+    if (!ok) {
+        symindex_close(idx);
+        return NULL;
+    }
+    idx->header = h;
+    idx->files = (const SymFileEntry*)(idx->map + h->file_table_offset);
+    idx->terms = (const SymTermEntry*)(idx->map + h->term_table_offset);
+    idx->strings = (const char*)(idx->map + h->strings_offset);
+    idx->strings_size = (size_t)(h->postings_offset - h->strings_offset);
+    idx->postings = idx->map + h->postings_offset;
+    return idx;
+}
+
+void symindex_close(SymIndex* idx) {
+    if (!idx) return;
+    if (idx->map) {
+#ifndef _WIN32
+        if (idx->mapped) munmap(idx->map, idx->size);
+        else
+#endif
+        free(idx->map);
+    }
+    free(idx);
+}
+
+static const char* index_string(const SymIndex* idx, uint32_t offset) {
+    return offset < idx->strings_size ? idx->strings + offset : "";
+}
+
+static const SymTermEntry* find_term(const SymIndex* idx, const char* name) {
+    uint32_t lo = 0, hi = idx->header->term_count;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        int c = strcmp(index_string(idx, idx->terms[mid].name), name);
+        if (c == 0) return &idx->terms[mid];
+        if (c < 0) lo = mid + 1;
+        else hi = mid;
+    }
+    return NULL;
+}
+
+static bool term_postings(const SymIndex* idx, const SymTermEntry* t,
+                          const unsigned char** begin, const unsigned char** end) {
+    if (t->postings + t->bytes > idx->header->postings_size) return false;
+    *begin = idx->postings + t->postings;
+    *end = *begin + t->bytes;
+    return true;
+}
+
+typedef struct {
+    const SymIndex* idx;
+    uint32_t role_mask;
+    bool (*visit)(void* user, const SymHit* hit);
+    void* user;
+    long hits;
+} QueryState;
+
+static bool query_visit(void* user, const Posting* p) {
+    QueryState* q = (QueryState*)user;
+    if (q->role_mask && !(q->role_mask & (1u << p->role))) return true;
+    if (p->file >= q->idx->header->file_count) return false;
+    SymHit hit;
+    hit.file = index_string(q->idx, q->idx->files[p->file].path);
+    hit.file_index = (int)p->file;
+    hit.offset = p->offset;
+    hit.line = p->line;
+    hit.role = (SymRole)p->role;
+    q->hits++;
+    return q->visit ? q->visit(q->user, &hit) : true;
+}
+
+long symindex_query(const SymIndex* idx, const char* name, uint32_t role_mask,
+                    bool (*visit)(void* user, const SymHit* hit), void* user) {
+    const SymTermEntry* t = find_term(idx, name);
+    const unsigned char *begin, *end;
+    if (!t || (role_mask && !(t->role_mask & role_mask)) || !term_postings(idx, t, &begin, &end)) return 0;
+    QueryState q = { idx, role_mask, visit, user, 0 };
+    decode_postings(begin, end, t->count, query_visit, &q);
+    return q.hits;
+}
+
+// NOTE - 增量更新
+// 新文件列表按路径排序, 用来把旧索引中的文件对应到新的编号
+typedef struct {
+    const char* path;
+    uint32_t file;
+} PathSlot;
+
+static int cmp_path(const void* a, const void* b) {
+    return strcmp(((const PathSlot*)a)->path, ((const PathSlot*)b)->path);
+}
+
+// 路径相同时编号小的在前, 重复列出的文件只保留第一次
+static int cmp_path_file(const void* a, const void* b) {
+    int c = cmp_path(a, b);
+    if (c != 0) return c;
+    return ((const PathSlot*)a)->file < ((const PathSlot*)b)->file ? -1 : 1;
+}
+
+typedef struct {
+    Builder* b;
+    const char* name;
+    size_t name_len;
+    const int32_t* remap;        // 旧文件编号 -> 新编号, -1表示不沿用
+    uint32_t old_count;
+} ReuseState;
+
+static bool reuse_visit(void* user, const Posting* p) {
+    ReuseState* r = (ReuseState*)user;
+    if (p->file >= r->old_count) return false;
+    if (r->remap[p->file] < 0) return true;
+    Posting q = *p;
+    q.file = (uint32_t)r->remap[p->file];
+    add_posting(r->b, r->name, r->name_len, &q);
+    return !r->b->failed;
+}
+
+// 沿用的文件的倒排表从旧索引中解码出来
+static void reuse_old(Builder* b, const SymIndex* old, const int32_t* remap) {
+    const SymIndexHeader* h = old->header;
+    for (uint32_t i = 0; i < h->term_count && !b->failed; i++) {
+        const SymTermEntry* t = &old->terms[i];
+        const unsigned char *begin, *end;
+        if (!term_postings(old, t, &begin, &end)) continue;
+        ReuseState r = { b, index_string(old, t->name), 0, remap, h->file_count };
+        r.name_len = strlen(r.name);
+        decode_postings(begin, end, t->count, reuse_visit, &r);
+    }
+}
+
+static int cmp_posting(const void* a, const void* b) {
+    const Posting* x = (const Posting*)a;
+    const Posting* y = (const Posting*)b;
+    if (x->file != y->file) return x->file < y->file ? -1 : 1;
+    return x->offset < y->offset ? -1 : x->offset > y->offset;
+}
+
+static const Builder* sort_builder;
+
+static int cmp_term(const void* a, const void* b) {
+    const Term* x = &sort_builder->terms[*(const uint32_t*)a];
+    const Term* y = &sort_builder->terms[*(const uint32_t*)b];
+    return strcmp(sort_builder->pool + x->name, sort_builder->pool + y->name);
+}
+
+typedef struct {
+    const char* path;
+    int64_t mtime;
+    uint64_t size;
+    uint64_t content_hash;
+    bool ok;
+} FileInfo;
+
+static bool write_index(const char* path, Builder* b, const FileInfo* files, int count, SymIndexStats* stats) {
+    bool failed = false;
+    uint32_t* order = (uint32_t*)malloc(((size_t)b->term_count + 1) * sizeof(uint32_t));
+    uint32_t* file_ids = (uint32_t*)malloc(((size_t)count + 1) * sizeof(uint32_t));
+    SymTermEntry* terms = (SymTermEntry*)calloc((size_t)b->term_count + 1, sizeof(SymTermEntry));
+    SymFileEntry* entries = (SymFileEntry*)calloc((size_t)count + 1, sizeof(SymFileEntry));
+    unsigned char* strings = NULL;
+    size_t strings_len = 0, strings_cap = 0;
+    unsigned char* data = NULL;
+    size_t data_len = 0, data_cap = 0;
+    if (!order || !file_ids || !terms || !entries) failed = true;
+
+    // 无法读取的文件不进入索引, 其余依次编号
+    uint32_t file_count = 0;
+    for (int i = 0; i < count && !failed; i++) {
+        if (!files[i].ok) continue;
+        file_ids[i] = file_count;
+        SymFileEntry* e = &entries[file_count++];
+        size_t n = strlen(files[i].path) + 1;
+        if (!grow((void**)&strings, &strings_cap, strings_len + n, 1)) {
+            failed = true;
+            break;
+        }
+        e->path = (uint32_t)strings_len;
+        memcpy(strings + strings_len, files[i].path, n);
+        strings_len += n;
+        e->postings = b->file_postings[i];
+        e->mtime = files[i].mtime;
+        e->size = files[i].size;
+        e->content_hash = files[i].content_hash;
+    }
+
+    for (uint32_t i = 0; i < b->term_count && !failed; i++) order[i] = i;
+    if (!failed) {
+        sort_builder = b;
+        qsort(order, b->term_count, sizeof(uint32_t), cmp_term);
+    }
+    uint64_t total = 0;
+    for (uint32_t k = 0; k < b->term_count && !failed; k++) {
+        Term* t = &b->terms[order[k]];
+        qsort(t->items, t->count, sizeof(Posting), cmp_posting);
+        SymTermEntry* e = &terms[k];
+        size_t n = t->name_len + 1;
+        if (!grow((void**)&strings, &strings_cap, strings_len + n, 1)) {
+            failed = true;
+            break;
+        }
+        e->name = (uint32_t)strings_len;
+        memcpy(strings + strings_len, b->pool + t->name, n);
+        strings_len += n;
+        e->count = t->count;
+        e->postings = data_len;
+        Posting prev = { 0, 0, 0, 0 };
+        for (uint32_t j = 0; j < t->count; j++) {
+            Posting p = t->items[j];
+            p.file = file_ids[p.file];
+            if (j == 0 || p.file != prev.file) {
+                e->file_count++;
+                prev.offset = 0;
+                prev.line = 0;
+            }
+            put_varint(&data, &data_len, &data_cap, p.file - prev.file, &failed);
+            put_varint(&data, &data_len, &data_cap, ((uint64_t)(p.offset - prev.offset) << 3) | p.role, &failed);
+            put_varint(&data, &data_len, &data_cap, p.line - prev.line, &failed);
+            e->role_mask |= 1u << p.role;
+            prev = p;
+        }
+        e->bytes = (uint32_t)(data_len - e->postings);
+        total += t->count;
+    }
+
+    SymIndexHeader h;
+    memset(&h, 0, sizeof(h));
+    h.magic = SYMINDEX_MAGIC;
+    h.format_version = SYMINDEX_FORMAT_VERSION;
+    h.file_count = file_count;
+    h.term_count = b->term_count;
+    h.file_table_offset = sizeof(h);
+    h.term_table_offset = h.file_table_offset + (uint64_t)file_count * sizeof(SymFileEntry);
+    h.strings_offset = h.term_table_offset + (uint64_t)b->term_count * sizeof(SymTermEntry);
+    h.postings_offset = h.strings_offset + strings_len;
+    h.postings_size = data_len;
+
+    // 先写临时文件再改名, 查询方不会看到写了一半的索引
+    char tmp[1024];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    FILE* f = failed ? NULL : fopen(tmp, "wb");
+    if (!failed && !f) fprintf(stderr, "Cannot open file: %s\n", tmp);
+    bool ok = f != NULL;
+    if (f) {
+        ok = fwrite(&h, sizeof(h), 1, f) == 1 &&
+             fwrite(entries, sizeof(SymFileEntry), file_count, f) == file_count &&
+             fwrite(terms, sizeof(SymTermEntry), b->term_count, f) == b->term_count &&
+             fwrite(strings, 1, strings_len, f) == strings_len &&
+             fwrite(data, 1, data_len, f) == data_len;
+        if (fclose(f) != 0) ok = false;
+        if (ok) {
+#ifdef _WIN32
+            remove(path);
+#endif
+            ok = rename(tmp, path) == 0;
+        }
+        if (!ok) remove(tmp);
+    }
+    if (failed) fprintf(stderr, "Memory allocation error\n");
+    if (ok) {
+        stats->terms = b->term_count;
+        stats->postings = total;
+        stats->bytes = h.postings_offset + data_len;
+    }
+    free(order);
+    free(file_ids);
+    free(terms);
+    free(entries);
+    free(strings);
+    free(data);
+    return ok;
+}
+
+bool symindex_update(const char* index_path, const char* const* files, int count, SymIndexStats* stats) {
+    memset(stats, 0, sizeof(*stats));
+    SymIndex* old = symindex_open(index_path);
+    uint32_t old_count = old ? old->header->file_count : 0;
+
+    Builder b;
+    memset(&b, 0, sizeof(b));
+    FileInfo* info = (FileInfo*)calloc((size_t)count + 1, sizeof(FileInfo));
+    int* old_of = (int*)malloc(((size_t)count + 1) * sizeof(int));        // 新文件在旧索引中的编号
+    int32_t* remap = (int32_t*)malloc(((size_t)old_count + 1) * sizeof(int32_t));
+    PathSlot* sorted = (PathSlot*)malloc(((size_t)count + 1) * sizeof(PathSlot));
+    b.file_postings = (uint32_t*)calloc((size_t)count + 1, sizeof(uint32_t));
+    if (!info || !old_of || !remap || !sorted || !b.file_postings) {
+        fprintf(stderr, "Memory allocation error\n");
+        free(info);
+        free(old_of);
+        free(remap);
+        free(sorted);
+        builder_free(&b);
+        symindex_close(old);
+        return false;
+    }
+
+    for (int i = 0; i < count; i++) {
+        sorted[i].path = files[i];
+        sorted[i].file = (uint32_t)i;
+        old_of[i] = -1;
+    }
+    qsort(sorted, (size_t)count, sizeof(PathSlot), cmp_path_file);
+    bool* duplicate = (bool*)calloc((size_t)count + 1, sizeof(bool));
+    size_t unique = 0;
+    for (int k = 0; k < count; k++) {
+        if (unique > 0 && strcmp(sorted[unique - 1].path, sorted[k].path) == 0) {
+            if (duplicate) duplicate[sorted[k].file] = true;
+        } else {
+            sorted[unique++] = sorted[k];
+        }
+    }
+    for (uint32_t j = 0; j < old_count; j++) {
+        remap[j] = -1;
+        PathSlot key = { index_string(old, old->files[j].path), 0 };
+        const PathSlot* s = (const PathSlot*)bsearch(&key, sorted, unique, sizeof(PathSlot), cmp_path);
+        if (s && old_of[s->file] < 0) old_of[s->file] = (int)j;
+        else stats->removed++;
+    }
+
+    // 分析时的诊断不是索引的内容
+    FILE* sink = fopen("/dev/null", "w");
+    FILE* saved_output = diag_default()->output;
+    if (sink) diag_default()->output = sink;
+
+    // 改动的文件读入后立即分析并释放, 内存占用和位置空间不随文件数增长
+    SourceManager* sm = srcmgr_default();
+    for (int i = 0; i < count; i++) {
+        FileInfo* fi = &info[i];
+        fi->path = files[i];
+        if (duplicate && duplicate[i]) continue;
+        struct stat st;
+        if (stat(files[i], &st) != 0 || !S_ISREG(st.st_mode)) {
+            fprintf(stderr, "Cannot open file: %s\n", files[i]);
+            stats->failed++;
+            continue;
+        }
+        fi->mtime = (int64_t)st.st_mtime;
+        fi->size = (uint64_t)st.st_size;
+        fi->ok = true;
+        const SymFileEntry* prev = old_of[i] >= 0 ? &old->files[old_of[i]] : NULL;
+        if (prev && prev->mtime == fi->mtime && prev->size == fi->size) {
+            fi->content_hash = prev->content_hash;
+            remap[old_of[i]] = i;
+            stats->reused++;
+            continue;
+        }
+        // 大小或修改时间变了: 读入后比较内容, 只是touch过的文件仍然沿用
+        int first_file = sm->count;
+        int file_id = srcmgr_load(sm, files[i]);
+        if (file_id < 0) {
+            fprintf(stderr, "Cannot open file: %s\n", files[i]);
+            fi->ok = false;
+            stats->failed++;
+            continue;
+        }
+        const SourceFile* sf = srcmgr_file(sm, file_id);
+        fi->content_hash = tokcache_hash(sf->buffer, sf->length, 0);
+        if (prev && prev->size == fi->size && prev->content_hash == fi->content_hash) {
+            remap[old_of[i]] = i;
+            stats->reused++;
+        } else {
+            index_source(&b, (uint32_t)i, file_id);
+            stats->parsed++;
+        }
+        srcmgr_release_from(sm, first_file);
+    }
+    // 沿用的文件直接复制旧索引中的倒排项, 写出时统一排序, 与分析的先后无关
+    if (old) reuse_old(&b, old, remap);
+
+    diag_default()->output = saved_output;
+    if (sink) fclose(sink);
+    // 旧索引的映射要在写新文件之前解除
+    symindex_close(old);
+
+    bool ok = !b.failed && write_index(index_path, &b, info, count, stats);
+    if (b.failed) fprintf(stderr, "Memory allocation error\n");
+    free(info);
+    free(old_of);
+    free(remap);
+    free(sorted);
+    free(duplicate);
+    builder_free(&b);
+    return ok;
+}
@@ -0,0 +1,100 @@
+#ifndef SYMINDEX_H
+#define SYMINDEX_H
+
+#include <stdint.h>
+#include "parser.h"
+
+// NOTE - 跨文件的标识符倒排索引
+// 由事件式解析得到每个标识符出现的位置和语法角色(赋值目标、表达式中的使用、if条件、while/do-while条件),
+// 按标识符建立倒排表, 写入一个文件; 查询时只读映射该文件, 二分查找标识符后解码它的倒排表, 不再做词法分析
+// 文件格式(整数均为本机字节序, 索引不跨机器使用):
+//   头部      SymIndexHeader
+//   文件表    file_count个SymFileEntry
+//   标识符表  term_count个SymTermEntry, 按名字的字节序排序
+//   字符串池  以'\0'结尾的文件路径和标识符名字
+//   倒排表    每个标识符一段, 按(文件, 偏移)排序, 每个出现依次为:
+//             varint 文件编号与上一个出现之差
+//             varint (偏移与同一文件中上一个出现之差) << 3 | 角色
+//             varint 行号与同一文件中上一个出现之差
+// 增量更新时大小、修改时间和内容哈希都未变的文件直接沿用旧索引中的倒排表, 只重新分析变化的文件
+
+#define SYMINDEX_MAGIC 0x58444953u  // "SIDX"
+#define SYMINDEX_FORMAT_VERSION 1
+
+typedef enum {
+    SYM_ASSIGN,       // 赋值语句的左部
+    SYM_USE,          // 赋值右部的表达式中
+    SYM_IF_COND,      // if的条件中
+    SYM_WHILE_COND,   // while / do-while的条件中
+    SYM_OTHER,        // 其他位置(如无法识别的语句中)
+    SYM_ROLE_COUNT
+} SymRole;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t format_version;
+    uint32_t file_count;
+    uint32_t term_count;
+    uint64_t file_table_offset;   // 相对文件开头
+    uint64_t term_table_offset;
+    uint64_t strings_offset;
+    uint64_t postings_offset;
+    uint64_t postings_size;
+} SymIndexHeader;
+
+typedef struct {
+    uint32_t path;                // 在字符串池中的偏移
+    uint32_t postings;            // 该文件中的出现次数
+    int64_t mtime;
+    uint64_t size;
+    uint64_t content_hash;
+} SymFileEntry;
+
+typedef struct {
+    uint32_t name;                // 在字符串池中的偏移
+    uint32_t count;               // 出现次数
+    uint64_t postings;            // 倒排表相对倒排表区开头的偏移
+    uint32_t bytes;               // 倒排表的字节数
+    uint32_t file_count;          // 出现在多少个文件中
+    uint32_t role_mask;           // 出现过的角色, 第r位对应SymRole r
+    uint32_t reserved;
+} SymTermEntry;
+
+const char* sym_role_name(SymRole role);
+// 角色名(assign/use/if/while/other)对应的SymRole, 无法识别时返回-1
+int sym_role_from_name(const char* name);
+
+typedef struct {
+    int parsed;                   // 新增或内容变化, 重新分析的文件数
+    int reused;                   // 沿用旧索引的文件数
+    int removed;                  // 旧索引中有、本次不在列表中的文件数
+    int failed;                   // 无法读取的文件数(不进入索引)
+    uint32_t terms;
+    uint64_t postings;
+    uint64_t bytes;               // 索引文件大小
+} SymIndexStats;
+
+// 为files建立索引写入index_path; index_path已有索引时做增量更新, 不在files中的文件从索引中删除
+// 分析时的诊断不输出; 新文件先写到index_path.tmp再改名, 失败时旧索引保持不变; 成功返回true
+bool symindex_update(const char* index_path, const char* const* files, int count, SymIndexStats* stats);
+
+typedef struct SymIndex SymIndex;
+
+// 只读映射索引文件, 格式不对时返回NULL
+SymIndex* symindex_open(const char* path);
+void symindex_close(SymIndex* idx);
+
+typedef struct {
+    const char* file;             // 指向映射中的字符串, symindex_close()之后失效
+    int file_index;
+    uint32_t offset;              // 在文件中的字节偏移
+    uint32_t line;
+    SymRole role;
+} SymHit;
+
+// 依次回调name的每个出现(按文件、偏移排序), role_mask为0表示所有角色; visit返回false时停止
+// 返回回调的次数, 没有这个标识符时返回0
+long symindex_query(const SymIndex* idx, const char* name, uint32_t role_mask,
+                    bool (*visit)(void* user, const SymHit* hit), void* user);
+
+#endif
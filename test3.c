@@ -0,0 +1,22 @@
+{
+    n = 2;
+    count = 0;
+    while (n < 2000)
+    {
+        d = 2;
+        prime = 1;
+        while (d * d <= n)
+        {
+            if (n % d == 0)
+            {
+                prime = 0;
+                break;
+            }
+            d = d + 1;
+        }
+        if (prime == 1 && (n % 10 == 3 || n % 10 == 7)) count = count + 1;
+        if (prime == 0) sum = sum - n / 3;
+        n = n + 1;
+    }
+    do x = x + -count * 3; while (x > -100000);
+}
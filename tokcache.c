@@ -0,0 +1,480 @@
+#define _POSIX_C_SOURCE 200809L
+#include "tokcache.h"
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static char* cache_dir = NULL;
+
+struct TokenCache {
+    char path[1024];
+    uint64_t content_hash;
+    uint64_t content_length;
+
+    // 回放状态
+    bool replaying;
+    unsigned char* map;          // 映射(或读入)的缓存文件
+    size_t map_size;
+    bool mapped;                 // true: mmap映射; false: malloc读入
+    const unsigned char* cursor;
+    const unsigned char* end;
+    const uint32_t* string_offsets;
+    const char* strings;
+    uint32_t string_count;
+    uint32_t remaining;
+    size_t prev_end;
+
+    // 记录状态
+    bool recording;
+    bool committed;              // 已写出缓存文件, 之后的重新扫描不再记录
+    bool has_error_token;
+    unsigned char* data;         // 编码后的token流
+    size_t data_size;
+    size_t data_cap;
+    uint32_t token_count;
+    size_t rec_prev_end;
+
+    // 字符串驻留表
+    char* str_buf;
+    size_t str_size;
+    size_t str_cap;
+    uint32_t* str_offsets;
+    uint32_t str_count;
+    uint32_t str_cap_count;
+    uint32_t* str_hash;          // 开放寻址, 存 下标+1
+    uint32_t str_hash_cap;
+};
+
+void lexer_set_cache_dir(const char* dir) {
+    free(cache_dir);
+    cache_dir = NULL;
+    if (dir) {
+        cache_dir = (char*)malloc(strlen(dir) + 1);
+        if (cache_dir) strcpy(cache_dir, dir);
+#ifdef _WIN32
+        _mkdir(dir);
+#else
+        mkdir(dir, 0777);
+#endif
+    }
+}
+
+const char* lexer_get_cache_dir(void) {
+    return cache_dir;
+}
+
+// 64位乘法混合
+static uint64_t mix64(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+uint64_t tokcache_hash(const char* data, size_t length, uint64_t seed) {
+    uint64_t h = seed ^ (length * 0x9E3779B97F4A7C15ULL);
+    const unsigned char* p = (const unsigned char*)data;
+    size_t n = length;
+    // 主循环: 4路并行累加, 每轮32字节
+    uint64_t a = h, b = h ^ 0x5bd1e9955bd1e995ULL, c = ~h, d = h * 31;
+    while (n >= 32) {
+        uint64_t k[4];
+        memcpy(k, p, 32);
+        a = (a ^ (k[0] * 0x87c37b91114253d5ULL)) * 0x4cf5ad432745937fULL;
+        b = (b ^ (k[1] * 0x87c37b91114253d5ULL)) * 0x4cf5ad432745937fULL;
+        c = (c ^ (k[2] * 0x87c37b91114253d5ULL)) * 0x4cf5ad432745937fULL;
+        d = (d ^ (k[3] * 0x87c37b91114253d5ULL)) * 0x4cf5ad432745937fULL;
+        a = (a << 31) | (a >> 33);
+        b = (b << 31) | (b >> 33);
+        c = (c << 31) | (c >> 33);
+        d = (d << 31) | (d >> 33);
+        p += 32;
+        n -= 32;
+    }
+    h = mix64(a) ^ mix64(b + 1) ^ mix64(c + 2) ^ mix64(d + 3);
+    while (n >= 8) {
+        uint64_t k;
+        memcpy(&k, p, 8);
+        h = mix64(h ^ k);
+        p += 8;
+        n -= 8;
+    }
+    uint64_t tail = 0;
+    memcpy(&tail, p, n);
+    return mix64(h ^ tail ^ ((uint64_t)n << 56));
+}
+
+// NOTE - 变长整数编码
+
+static void put_bytes(TokenCache* c, const void* src, size_t n) {
+    if (c->data_size + n > c->data_cap) {
+        size_t cap = c->data_cap ? c->data_cap * 2 : 4096;
+        while (cap < c->data_size + n) cap *= 2;
+        unsigned char* p = (unsigned char*)realloc(c->data, cap);
+        if (!p) {
+            c->recording = false;
+            return;
+        }
+        c->data = p;
+        c->data_cap = cap;
+    }
+    memcpy(c->data + c->data_size, src, n);
+    c->data_size += n;
+}
+
+static void put_varint(TokenCache* c, uint64_t v) {
+    unsigned char buf[10];
+    int n = 0;
+    while (v >= 0x80) {
+        buf[n++] = (unsigned char)(v | 0x80);
+        v >>= 7;
+    }
+    buf[n++] = (unsigned char)v;
+    put_bytes(c, buf, (size_t)n);
+}
+
+static uint64_t get_varint(TokenCache* c) {
+    uint64_t v = 0;
+    int shift = 0;
+    while (c->cursor < c->end && shift < 64) {
+        unsigned char b = *c->cursor++;
+        v |= (uint64_t)(b & 0x7f) << shift;
+        if (!(b & 0x80)) break;
+        shift += 7;
+    }
+    return v;
+}
+
+// 把字符串加入驻留表, 返回下标
+static uint32_t intern_string(TokenCache* c, const char* s) {
+    size_t len = strlen(s);
+    uint32_t h = (uint32_t)tokcache_hash(s, len, 0);
+
+    if ((c->str_count + 1) * 2 > c->str_hash_cap) {
+        uint32_t cap = c->str_hash_cap ? c->str_hash_cap * 2 : 256;
+        uint32_t* table = (uint32_t*)calloc(cap, sizeof(uint32_t));
+        if (!table) {
+            c->recording = false;
+            return 0;
+        }
+        for (uint32_t i = 0; i < c->str_count; i++) {
+            const char* t = c->str_buf + c->str_offsets[i];
+            uint32_t j = (uint32_t)tokcache_hash(t, strlen(t), 0) & (cap - 1);
+            while (table[j]) j = (j + 1) & (cap - 1);
+            table[j] = i + 1;
+        }
+        free(c->str_hash);
+        c->str_hash = table;
+        c->str_hash_cap = cap;
+    }
+
+    uint32_t j = h & (c->str_hash_cap - 1);
+    while (c->str_hash[j]) {
+        uint32_t idx = c->str_hash[j] - 1;
+        if (strcmp(c->str_buf + c->str_offsets[idx], s) == 0) return idx;
+        j = (j + 1) & (c->str_hash_cap - 1);
+    }
+
+    if (c->str_size + len + 1 > c->str_cap) {
+        size_t cap = c->str_cap ? c->str_cap * 2 : 4096;
+        while (cap < c->str_size + len + 1) cap *= 2;
+        char* p = (char*)realloc(c->str_buf, cap);
+        if (!p) {
+            c->recording = false;
+            return 0;
+        }
+        c->str_buf = p;
+        c->str_cap = cap;
+    }
+    if (c->str_count == c->str_cap_count) {
+        uint32_t cap = c->str_cap_count ? c->str_cap_count * 2 : 256;
+        uint32_t* p = (uint32_t*)realloc(c->str_offsets, cap * sizeof(uint32_t));
+        if (!p) {
+            c->recording = false;
+            return 0;
+        }
+        c->str_offsets = p;
+        c->str_cap_count = cap;
+    }
+    c->str_offsets[c->str_count] = (uint32_t)c->str_size;
+    memcpy(c->str_buf + c->str_size, s, len + 1);
+    c->str_size += len + 1;
+    c->str_hash[j] = c->str_count + 1;
+    return c->str_count++;
+}
+
+static void reset_recording(TokenCache* c) {
+    c->recording = true;
+    c->has_error_token = false;
+    c->data_size = 0;
+    c->token_count = 0;
+    c->rec_prev_end = 0;
+    c->str_size = 0;
+    c->str_count = 0;
+    if (c->str_hash) memset(c->str_hash, 0, c->str_hash_cap * sizeof(uint32_t));
+}
+
+// 读取并校验缓存文件, 成功时进入回放状态
+static bool load_cache_file(TokenCache* c, const Lexer* lexer, uint64_t hash) {
+#ifdef _WIN32
+    FILE* f = fopen(c->path, "rb");
+    if (!f) return false;
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    if (size < (long)sizeof(TokCacheHeader)) {
+        fclose(f);
+        return false;
+    }
+    c->map = (unsigned char*)malloc((size_t)size);
+    if (!c->map || fread(c->map, 1, (size_t)size, f) != (size_t)size) {
+        free(c->map);
+        c->map = NULL;
+        fclose(f);
+        return false;
+    }
+    fclose(f);
+    c->map_size = (size_t)size;
+    c->mapped = false;
+#else
+    int fd = open(c->path, O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(TokCacheHeader)) {
+        close(fd);
+        return false;
+    }
+    void* p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) return false;
+    c->map = (unsigned char*)p;
+    c->map_size = (size_t)st.st_size;
+    c->mapped = true;
+#endif
+
+    TokCacheHeader h;
+    memcpy(&h, c->map, sizeof(h));
+    bool ok = h.magic == TOKCACHE_MAGIC &&
+              h.format_version == TOKCACHE_FORMAT_VERSION &&
+              h.lexer_version == LEXER_VERSION &&
+              h.content_hash == hash &&
+              h.content_length == lexer->length &&
+              h.string_table_offset % 4 == 0 &&
+              h.string_table_offset + (uint64_t)h.string_count * 4 <= h.token_data_offset &&
+              (uint64_t)h.token_data_offset + h.token_data_size <= c->map_size;
+    if (!ok) return false;
+
+    c->string_offsets = (const uint32_t*)(c->map + h.string_table_offset);
+    c->strings = (const char*)(c->string_offsets + h.string_count);
+    c->string_count = h.string_count;
+    // 字符串区到token数据为止, 以'\0'结尾且每个偏移都在区内时, 回放中的任何下标都能安全地当作字符串使用
+    size_t string_size = (size_t)((const char*)(c->map + h.token_data_offset) - c->strings);
+    if (h.string_count > 0 && (string_size == 0 || c->strings[string_size - 1] != '\0')) return false;
+    for (uint32_t i = 0; i < h.string_count; i++) {
+        if (c->string_offsets[i] >= string_size) return false;
+    }
+    c->cursor = c->map + h.token_data_offset;
+    c->end = c->cursor + h.token_data_size;
+    c->remaining = h.token_count;
+    c->replaying = true;
+    return true;
+}
+
+TokenCache* tokcache_open(const Lexer* lexer) {
+    if (!cache_dir) return NULL;
+    TokenCache* c = (TokenCache*)calloc(1, sizeof(TokenCache));
+    if (!c) return NULL;
+
+    uint64_t hash = tokcache_hash(lexer->buffer, lexer->length, LEXER_VERSION);
+    snprintf(c->path, sizeof(c->path), "%s/%016llx.tok", cache_dir, (unsigned long long)hash);
+    c->content_hash = hash;
+    c->content_length = lexer->length;
+
+    if (load_cache_file(c, lexer, hash)) {
+        tokcache_rewind(c);
+        return c;
+    }
+    // 未命中或缓存无效: 记录本次扫描的结果
+    if (c->map) {
+#ifndef _WIN32
+        if (c->mapped) munmap(c->map, c->map_size);
+        else
+#endif
+        free(c->map);
+        c->map = NULL;
+    }
+    reset_recording(c);
+    c->replaying = false;
+    return c;
+}
+
+void tokcache_close(TokenCache* c) {
+    if (!c) return;
+    if (c->map) {
+#ifndef _WIN32
+        if (c->mapped) munmap(c->map, c->map_size);
+        else
+#endif
+        free(c->map);
+    }
+    free(c->data);
+    free(c->str_buf);
+    free(c->str_offsets);
+    free(c->str_hash);
+    free(c);
+}
+
+bool tokcache_replaying(const TokenCache* c) {
+    return c && c->replaying;
+}
+
+void tokcache_rewind(TokenCache* c) {
+    if (c->replaying) {
+        TokCacheHeader h;
+        memcpy(&h, c->map, sizeof(h));
+        c->cursor = c->map + h.token_data_offset;
+        c->remaining = h.token_count;
+        c->prev_end = 0;
+    } else if (!c->committed) {
+        reset_recording(c);
+    }
+}
+
+Token tokcache_next(TokenCache* c, const Lexer* lexer) {
+    Token token;
+    if (c->remaining == 0 || c->cursor >= c->end) {
+        // 流结束后与词法分析器一样一直返回EOF
+        token.type = TOKEN_EOF;
+        strcpy(token.lexeme, "EOF");
+        token.loc = lexer->base + (SourceLoc)lexer->length;
+        token.length = 0;
+        return token;
+    }
+    c->remaining--;
+
+    uint64_t tag = get_varint(c);
+    token.type = (TokenType)(tag >> 1);
+    size_t offset = c->prev_end + (size_t)get_varint(c);
+    size_t length = (size_t)get_varint(c);
+    token.loc = lexer->base + (SourceLoc)offset;
+    token.length = (unsigned int)length;
+    c->prev_end = offset + length;
+
+    if (tag & 1) {
+        uint64_t idx = get_varint(c);
+        const char* s = idx < c->string_count ? c->strings + c->string_offsets[idx] : "";
+        size_t n = strlen(s);
+        if (n > 255) n = 255;
+        memcpy(token.lexeme, s, n);
+        token.lexeme[n] = '\0';
+    } else {
+        size_t n = length < 255 ? length : 255;
+        if (offset + n > lexer->length) n = offset < lexer->length ? lexer->length - offset : 0;
+        memcpy(token.lexeme, lexer->buffer + offset, n);
+        token.lexeme[n] = '\0';
+    }
+
+    switch (token.type) {
+        case TOKEN_INTEGER:
+        case TOKEN_HEX:
+        case TOKEN_OCTAL:
+            token.value.int_val = (long long)get_varint(c);
+            break;
+        case TOKEN_FLOAT_NUM:
+            if (c->cursor + 8 <= c->end) memcpy(&token.value.float_val, c->cursor, 8);
+            c->cursor += 8;
+            break;
+        case TOKEN_CHAR_CONST:
+            if (c->cursor < c->end) token.value.char_val = (char)*c->cursor;
+            c->cursor++;
+            break;
+        default:
+            break;
+    }
+
+    return token;
+}
+
+// 写出缓存文件: 先写临时文件再改名, 并发的读者不会看到写了一半的文件
+static void write_cache_file(TokenCache* c) {
+    TokCacheHeader h;
+    memset(&h, 0, sizeof(h));
+    h.magic = TOKCACHE_MAGIC;
+    h.format_version = TOKCACHE_FORMAT_VERSION;
+    h.lexer_version = LEXER_VERSION;
+    h.token_count = c->token_count;
+    h.content_hash = c->content_hash;
+    h.content_length = c->content_length;
+    h.string_count = c->str_count;
+    h.string_table_offset = (uint32_t)sizeof(TokCacheHeader);
+    h.token_data_offset = (uint32_t)(sizeof(TokCacheHeader) + c->str_count * 4 + c->str_size);
+    h.token_data_size = (uint32_t)c->data_size;
+
+    char tmp[1100];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", c->path);
+    FILE* f = fopen(tmp, "wb");
+    if (!f) return;
+    bool ok = fwrite(&h, sizeof(h), 1, f) == 1;
+    // 偏移表中的偏移相对于字符串区的开头
+    if (c->str_count) ok = ok && fwrite(c->str_offsets, 4, c->str_count, f) == c->str_count;
+    if (c->str_size) ok = ok && fwrite(c->str_buf, 1, c->str_size, f) == c->str_size;
+    if (c->data_size) ok = ok && fwrite(c->data, 1, c->data_size, f) == c->data_size;
+    ok = (fclose(f) == 0) && ok;
+    if (ok) {
+        remove(c->path);  // Windows下rename不能覆盖已有文件
+        ok = rename(tmp, c->path) == 0;
+    }
+    if (!ok) remove(tmp);
+}
+
+void tokcache_record(TokenCache* c, const Lexer* lexer, const Token* token) {
+    if (!c->recording) return;
+    if (token->type == TOKEN_ERROR) c->has_error_token = true;
+
+    // 词素与源文件片段一致时不必保存, 标识符一律驻留
+    size_t offset = token->loc - lexer->base;
+    size_t n = token->length < 255 ? token->length : 255;
+    bool from_table = token->type == TOKEN_IDENTIFIER ||
+                      strlen(token->lexeme) != n ||
+                      memcmp(token->lexeme, lexer->buffer + offset, n) != 0;
+
+    put_varint(c, ((uint64_t)token->type << 1) | (from_table ? 1 : 0));
+    put_varint(c, offset - c->rec_prev_end);
+    put_varint(c, token->length);
+    c->rec_prev_end = offset + token->length;
+    if (from_table) put_varint(c, intern_string(c, token->lexeme));
+
+    switch (token->type) {
+        case TOKEN_INTEGER:
+        case TOKEN_HEX:
+        case TOKEN_OCTAL:
+            put_varint(c, (uint64_t)token->value.int_val);
+            break;
+        case TOKEN_FLOAT_NUM:
+            put_bytes(c, &token->value.float_val, 8);
+            break;
+        case TOKEN_CHAR_CONST:
+            put_bytes(c, &token->value.char_val, 1);
+            break;
+        default:
+            break;
+    }
+    c->token_count++;
+
+    if (token->type == TOKEN_EOF) {
+        // 有词法错误的文件不缓存: 错误信息需要重新扫描才能输出
+        if (c->recording && !c->has_error_token && !lexer->has_error) {
+            write_cache_file(c);
+        }
+        c->recording = false;
+        c->committed = true;
+    }
+}
@@ -0,0 +1,61 @@
+#ifndef TOKCACHE_H
+#define TOKCACHE_H
+
+#include <stdint.h>
+#include "lexer.h"
+
+// NOTE - 磁盘token缓存
+// 缓存目录下每个文件对应一个 <key>.tok, key由文件内容哈希与LEXER_VERSION共同决定
+// 文件格式(整数均为小端序):
+//   头部      TokCacheHeader
+//   字符串表  string_count个u32偏移, 之后是以'\0'结尾的字符串(标识符与特殊词素)
+//   token流   每个token依次为:
+//             varint 类型(低1位为1时词素取自字符串表, 否则取自源文件)
+//             varint 起始偏移与上一个token结束位置之差
+//             varint 长度
+//             [varint 字符串表下标]
+//             [值: 整数为varint, 浮点为8字节, 字符常量为1字节]
+// 文件以只读方式映射后直接使用, 不做反序列化
+
+#define TOKCACHE_MAGIC 0x434B4F54u  // "TOKC"
+#define TOKCACHE_FORMAT_VERSION 1
+
+typedef struct {
+    uint32_t magic;
+    uint32_t format_version;
+    uint32_t lexer_version;
+    uint32_t token_count;
+    uint64_t content_hash;
+    uint64_t content_length;
+    uint32_t string_count;
+    uint32_t string_table_offset;  // 相对文件开头
+    uint32_t token_data_offset;
+    uint32_t token_data_size;
+} TokCacheHeader;
+
+typedef struct TokenCache TokenCache;
+
+// 设置缓存目录, NULL表示关闭缓存(默认)
+void lexer_set_cache_dir(const char* dir);
+const char* lexer_get_cache_dir(void);
+
+// 文件内容的64位哈希, 每次处理8个字节
+uint64_t tokcache_hash(const char* data, size_t length, uint64_t seed);
+
+// 为已读入内存的源文件打开缓存: 命中时进入回放状态, 否则进入记录状态
+TokenCache* tokcache_open(const Lexer* lexer);
+void tokcache_close(TokenCache* cache);
+
+// 是否正在回放
+bool tokcache_replaying(const TokenCache* cache);
+
+// 回放下一个token
+Token tokcache_next(TokenCache* cache, const Lexer* lexer);
+
+// 记录一个新扫描出的token, 遇到EOF时写入缓存文件
+void tokcache_record(TokenCache* cache, const Lexer* lexer, const Token* token);
+
+// 回到开头: 回放从第一个token重新开始, 未完成的记录作废重来
+void tokcache_rewind(TokenCache* cache);
+
+#endif
@@ -0,0 +1,89 @@
+# 词法规则说明文件, 由 lexgen 生成 lextab.h / lextab.c
+#
+# %define 名字 正规式     正规定义, 在后面的正规式中用 {名字} 引用
+# %keyword 名字 单词      保留字: 同时进入枚举、保留字表, 并作为优先级高于标识符的规则
+# %token 名字 [正规式]    token类型, 枚举顺序即声明顺序; 没有正规式时只占枚举位置
+# %skip 正规式            匹配后直接跳过(空白、注释)
+#
+# 正规式: 字符  "字符串"  [字符类] [^取反]  .(换行以外的任意字符)  ( )  |  *  +  ?  {定义}
+# 转义: \n \t \r \\ \" \' \] \- 以及 \xHH; 引号和字符类之外的空格被忽略
+# 同一位置有多条规则能匹配时取最长的, 一样长时取先声明的
+
+%define digit       [0-9]
+%define octdigit    [0-7]
+%define hexdigit    [0-9a-fA-F]
+%define letter      [a-zA-Z_]
+%define lsuffix     ([lL] | "ll" | "LL")
+%define isuffix     ([uU] {lsuffix}? | {lsuffix} [uU]?)
+%define exponent    [eE] [+\-]? {digit}+
+%define escape      \\ [nt\\'"0]
+
+# 保留字
+%keyword IF         if
+%keyword ELSE       else
+%keyword WHILE      while
+%keyword DO         do
+%keyword MAIN       main
+%keyword INT        int
+%keyword FLOAT      float
+%keyword DOUBLE     double
+%keyword RETURN     return
+%keyword CONST      const
+%keyword VOID       void
+%keyword CONTINUE   continue
+%keyword BREAK      break
+%keyword CHAR       char
+%keyword UNSIGNED   unsigned
+%keyword ENUM       enum
+%keyword LONG       long
+%keyword SWITCH     switch
+%keyword CASE       case
+%keyword AUTO       auto
+%keyword STATIC     static
+
+# 特殊符号
+%token PLUS         "+"
+%token MINUS        "-"
+%token MULTIPLY     "*"
+%token DIVIDE       "/"
+%token MOD          "%"
+%token ASSIGN       "="
+%token LT           "<"
+%token GT           ">"
+%token LE           "<="
+%token GE           ">="
+%token EQ           "=="
+%token NE           "!="
+%token AND          "&&"
+%token OR           "||"
+%token LBRACE       "{"
+%token RBRACE       "}"
+%token LPAREN       "("
+%token RPAREN       ")"
+%token SEMICOLON    ";"
+%token COMMA        ","
+%token QUOTE
+%token DQUOTE
+%token LBRACKET     "["
+%token RBRACKET     "]"
+%token DOT          "."
+%token COLON        ":"
+%token HASH         "#"
+
+# 其他
+%token IDENTIFIER   {letter} ({letter} | {digit})*
+%token INTEGER      ([1-9] {digit}* | "0") {isuffix}?
+%token FLOAT_NUM    ({digit}+ "." {digit}* {exponent}? | {digit}+ {exponent}) [fFlL]?
+%token HEX          "0" [xX] {hexdigit}+ {isuffix}?
+%token OCTAL        "0" {octdigit}+ {isuffix}?
+%token CHAR_CONST   ' ({escape} | [^'\\\n]) '
+%token STRING_CONST \" ({escape} | [^"\\\n])* \"
+
+# 特殊
+%token EOF
+%token ERROR
+
+# 空白和注释
+%skip [ \t\n]+
+%skip "//" [^\n]*
+%skip "/*" ([^*] | "*"+ [^*/])* "*"+ "/"
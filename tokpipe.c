@@ -0,0 +1,284 @@
+#define _POSIX_C_SOURCE 200809L
+#include "tokpipe.h"
+#include "tokcache.h"
+#include "parlex.h"
+#include <pthread.h>
+#include <unistd.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define cpu_relax() _mm_pause()
+#else
+#define cpu_relax() ((void)0)
+#endif
+
+#define TOKPIPE_MASK (TOKPIPE_SIZE - 1)
+#define TOKPIPE_SPIN 2000               // 睡眠之前自旋检查的次数
+
+typedef struct {
+    Token token;
+    size_t diag_end;             // 扫描完这个token时已转交的诊断总数
+} PipeSlot;
+
+struct TokenPipe {
+    Lexer lexer;                 // 词法线程使用的分析器(接管了原分析器的缓存、并行结果和资源上限)
+    DiagEngine local;            // 词法线程私有的收集器, 每个token之后移入outbox
+    DiagEngine* target;          // 主收集器
+    DiagMark local_empty;
+    PipeSlot* slots;
+
+    // 两端的下标各占一个缓存行, 只有公布时才写共享的那一份
+    size_t tail;                 // 已公布的生产位置
+    char pad0[64 - sizeof(size_t)];
+    size_t head;                 // 已公布的消费位置
+    char pad1[64 - sizeof(size_t)];
+    int producer_waiting;        // 正在睡眠的一方, 公布下标之后检查, 需要时才唤醒
+    int consumer_waiting;
+    int stop;                    // 要求词法线程结束(回到开头或释放时)
+    char pad2[64 - 3 * sizeof(int)];
+
+    // 消费者私有
+    size_t next;                 // 下一个要取的位置
+    size_t tail_seen;            // 最近一次读到的tail
+    size_t diag_taken;           // 已并入主收集器的诊断数
+    bool at_eof;
+    Token eof;
+
+    // 生产者私有
+    size_t handed;               // 已移入outbox的诊断数
+
+    pthread_mutex_t lock;
+    pthread_cond_t ready;        // 有新的token
+    pthread_cond_t space;        // 队列有空位或要求结束
+    DiagEngine outbox;           // 转交中的诊断, 受lock保护
+    DiagMark outbox_empty;
+    size_t outbox_base;          // outbox中第一条的序号
+    pthread_t thread;
+    bool running;
+};
+
+// 公布下标; 对方正在睡眠时唤醒它
+static void publish(struct TokenPipe* p, size_t* index, size_t value, int* waiting, pthread_cond_t* cond) {
+    __atomic_store_n(index, value, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(waiting, __ATOMIC_SEQ_CST)) {
+        pthread_mutex_lock(&p->lock);
+        pthread_cond_broadcast(cond);
+        pthread_mutex_unlock(&p->lock);
+    }
+}
+
+// 扫描一个token时产生的诊断移入outbox
+static void hand_over(struct TokenPipe* p) {
+    pthread_mutex_lock(&p->lock);
+    diag_append(&p->outbox, &p->local);
+    pthread_mutex_unlock(&p->lock);
+    p->handed += (size_t)p->local.count;
+    diag_rollback(&p->local, &p->local_empty);
+}
+
+// 等到队列有空位; 要求结束时返回false
+static bool wait_for_space(struct TokenPipe* p, size_t tail) {
+    for (int i = 0; i < TOKPIPE_SPIN; i++) {
+        if (tail - __atomic_load_n(&p->head, __ATOMIC_ACQUIRE) < TOKPIPE_SIZE) return true;
+        if (__atomic_load_n(&p->stop, __ATOMIC_RELAXED)) return false;
+        cpu_relax();
+    }
+    pthread_mutex_lock(&p->lock);
+    __atomic_store_n(&p->producer_waiting, 1, __ATOMIC_SEQ_CST);
+    while (tail - __atomic_load_n(&p->head, __ATOMIC_SEQ_CST) == TOKPIPE_SIZE &&
+           !__atomic_load_n(&p->stop, __ATOMIC_SEQ_CST)) {
+        pthread_cond_wait(&p->space, &p->lock);
+    }
+    __atomic_store_n(&p->producer_waiting, 0, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&p->lock);
+    return !__atomic_load_n(&p->stop, __ATOMIC_RELAXED);
+}
+
+// 词法线程: 扫描到EOF或被要求结束为止
+static void* produce(void* arg) {
+    struct TokenPipe* p = (struct TokenPipe*)arg;
+    size_t tail = 0;
+    size_t published = 0;
+    size_t head_seen = 0;
+    for (;;) {
+        if (tail - head_seen == TOKPIPE_SIZE) {
+            head_seen = __atomic_load_n(&p->head, __ATOMIC_ACQUIRE);
+            if (tail - head_seen == TOKPIPE_SIZE) {
+                // 队列满: 先把已写好的公布出去, 再等语法分析取走
+                if (published != tail) {
+                    publish(p, &p->tail, tail, &p->consumer_waiting, &p->ready);
+                    published = tail;
+                }
+                if (!wait_for_space(p, tail)) break;
+                head_seen = __atomic_load_n(&p->head, __ATOMIC_ACQUIRE);
+            }
+        }
+        PipeSlot* slot = &p->slots[tail & TOKPIPE_MASK];
+        slot->token = get_token(&p->lexer);
+        if (p->local.count > 0) hand_over(p);
+        slot->diag_end = p->handed;
+        tail++;
+        bool eof = slot->token.type == TOKEN_EOF;
+        if (eof || tail - published >= TOKPIPE_BATCH) {
+            publish(p, &p->tail, tail, &p->consumer_waiting, &p->ready);
+            published = tail;
+        }
+        if (eof || __atomic_load_n(&p->stop, __ATOMIC_RELAXED)) break;
+    }
+    return NULL;
+}
+
+// 等到有新的token
+static void wait_for_tokens(struct TokenPipe* p) {
+    for (int i = 0; i < TOKPIPE_SPIN; i++) {
+        p->tail_seen = __atomic_load_n(&p->tail, __ATOMIC_ACQUIRE);
+        if (p->tail_seen != p->next) return;
+        cpu_relax();
+    }
+    pthread_mutex_lock(&p->lock);
+    __atomic_store_n(&p->consumer_waiting, 1, __ATOMIC_SEQ_CST);
+    while ((p->tail_seen = __atomic_load_n(&p->tail, __ATOMIC_SEQ_CST)) == p->next) {
+        pthread_cond_wait(&p->ready, &p->lock);
+    }
+    __atomic_store_n(&p->consumer_waiting, 0, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&p->lock);
+}
+
+// 把序号在[diag_taken, end)中的诊断并入主收集器
+static void take_diags(struct TokenPipe* p, DiagEngine* dst, size_t end) {
+    pthread_mutex_lock(&p->lock);
+    for (size_t i = p->diag_taken; i < end; i++) {
+        const Diagnostic* e = &p->outbox.entries[i - p->outbox_base];
+        diag_report(dst, (DiagCode)e->code, e->loc, e->arg0, e->arg1,
+                    e->text >= 0 ? p->outbox.pool + e->text : NULL);
+    }
+    p->diag_taken = end;
+    // 全部取走后清空, outbox不会一直增长
+    if (p->diag_taken == p->outbox_base + (size_t)p->outbox.count) {
+        p->outbox_base = p->diag_taken;
+        diag_rollback(&p->outbox, &p->outbox_empty);
+    }
+    pthread_mutex_unlock(&p->lock);
+}
+
+// 从队列中取出下一个token
+static void pop(struct TokenPipe* p, Lexer* lexer, Token* token) {
+    if (p->next == p->tail_seen) {
+        // 取完了已公布的部分: 先把消费位置公布出去, 让等待的词法线程继续
+        publish(p, &p->head, p->next, &p->producer_waiting, &p->space);
+        p->tail_seen = __atomic_load_n(&p->tail, __ATOMIC_ACQUIRE);
+        if (p->next == p->tail_seen) wait_for_tokens(p);
+    }
+    const PipeSlot* slot = &p->slots[p->next & TOKPIPE_MASK];
+    if (slot->diag_end > p->diag_taken) take_diags(p, lexer->diag, slot->diag_end);
+    *token = slot->token;
+    p->next++;
+    if ((p->next & (TOKPIPE_BATCH - 1)) == 0) {
+        publish(p, &p->head, p->next, &p->producer_waiting, &p->space);
+    }
+}
+
+void tokpipe_next(struct TokenPipe* p, Lexer* lexer, Token* token) {
+    if (p->at_eof) {
+        *token = p->eof;
+        return;
+    }
+    if (!p->running) {
+        // 回到开头后没能重新创建线程: 在当前线程中顺序扫描
+        *token = get_token(&p->lexer);
+    } else {
+        pop(p, lexer, token);
+    }
+    if (token->type == TOKEN_EOF) {
+        // 结束状态转给原分析器
+        p->at_eof = true;
+        p->eof = *token;
+        if (p->lexer.has_error) lexer->has_error = true;
+        lexer->limit_hit = p->lexer.limit_hit;
+        lexer->limit_loc = p->lexer.limit_loc;
+    }
+}
+
+static bool start_thread(struct TokenPipe* p) {
+    p->tail = p->head = 0;
+    p->next = p->tail_seen = 0;
+    p->producer_waiting = p->consumer_waiting = p->stop = 0;
+    p->diag_taken = p->handed = p->outbox_base = 0;
+    p->at_eof = false;
+    p->running = pthread_create(&p->thread, NULL, produce, p) == 0;
+    return p->running;
+}
+
+static void stop_thread(struct TokenPipe* p) {
+    if (!p->running) return;
+    __atomic_store_n(&p->stop, 1, __ATOMIC_SEQ_CST);
+    pthread_mutex_lock(&p->lock);
+    pthread_cond_broadcast(&p->space);
+    pthread_mutex_unlock(&p->lock);
+    pthread_join(p->thread, NULL);
+    p->running = false;
+    // 未被取走的诊断作废, 重新扫描时会再次报告
+    diag_rollback(&p->local, &p->local_empty);
+    diag_rollback(&p->outbox, &p->outbox_empty);
+}
+
+bool tokpipe_start(Lexer* lexer) {
+    if (lexer->pipe || lexer->pp || lexer->push || lexer->length - lexer->start < TOKPIPE_MIN_BYTES) return false;
+    // 只有一个核时两个线程只能轮流执行, 流水线只剩同步的开销
+    if (sysconf(_SC_NPROCESSORS_ONLN) < 2) return false;
+    struct TokenPipe* p = (struct TokenPipe*)calloc(1, sizeof(struct TokenPipe));
+    PipeSlot* slots = (PipeSlot*)malloc(TOKPIPE_SIZE * sizeof(PipeSlot));
+    if (!p || !slots) {
+        fprintf(stderr, "Memory allocation error\n");
+        free(p);
+        free(slots);
+        return false;
+    }
+    p->slots = slots;
+    diag_init(&p->local);
+    diag_init(&p->outbox);
+    p->local.raw = true;
+    p->outbox.raw = true;
+    diag_mark(&p->local, &p->local_empty);
+    diag_mark(&p->outbox, &p->outbox_empty);
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->ready, NULL);
+    pthread_cond_init(&p->space, NULL);
+
+    // 内部的分析器接着原分析器的状态扫描; 缓存、并行结果和资源上限都转给它
+    p->lexer = *lexer;
+    p->target = lexer->diag;
+    p->lexer.diag = &p->local;
+    if (!start_thread(p)) {
+        p->lexer.cache = NULL;
+        p->lexer.parallel = NULL;
+        tokpipe_free(p);
+        return false;
+    }
+    lexer->cache = NULL;
+    lexer->parallel = NULL;
+    lexer->limits = NULL;
+    lexer->pipe = p;
+    return true;
+}
+
+void tokpipe_rewind(struct TokenPipe* p) {
+    stop_thread(p);
+    reset_lexer(&p->lexer);
+    diag_rollback(&p->local, &p->local_empty);
+    if (!start_thread(p)) p->lexer.diag = p->target;
+}
+
+void tokpipe_free(struct TokenPipe* p) {
+    if (!p) return;
+    stop_thread(p);
+    tokcache_close(p->lexer.cache);
+    parlex_free(p->lexer.parallel);
+    pthread_mutex_destroy(&p->lock);
+    pthread_cond_destroy(&p->ready);
+    pthread_cond_destroy(&p->space);
+    diag_free(&p->local);
+    diag_free(&p->outbox);
+    free(p->slots);
+    free(p);
+}
@@ -0,0 +1,29 @@
+#ifndef TOKPIPE_H
+#define TOKPIPE_H
+
+#include "lexer.h"
+
+// NOTE - 词法分析与语法分析流水线
+// 词法分析在单独的线程中进行, 成批写入单生产者/单消费者的无锁环形队列, 语法分析从队列中取token,
+// 两者在不同的核上重叠执行. 队列满时词法线程等待(背压), 队列空时取token的一方等待; 都先自旋再睡眠
+// 词法线程的诊断先记在私有的收集器里, 随token转交: 取到某个token时才把扫描它时产生的诊断并入
+// 主收集器, 诊断的顺序和合并结果与顺序调用get_token()完全一致
+// 已启用预处理时不启用(载入头文件会改动源文件管理器)
+
+#define TOKPIPE_SIZE 1024               // 队列容量(token数), 必须是2的幂
+#define TOKPIPE_BATCH 32                // 每生产/消费这么多token公布一次下标
+#define TOKPIPE_MIN_BYTES (64 * 1024)   // 更小的文件线程的开销得不偿失
+
+struct TokenPipe;
+
+// 启动词法线程, 之后get_token()从队列中按顺序取token; 应在lexer_set_limits()之后调用
+// 文件太小、已启用预处理、只有一个核或无法创建线程时不启用, 返回false
+bool tokpipe_start(Lexer* lexer);
+
+// 取出下一个token, 直接写入调用者的token
+void tokpipe_next(struct TokenPipe* p, Lexer* lexer, Token* token);
+// 回到开头: 停下词法线程, 从文件开头重新启动
+void tokpipe_rewind(struct TokenPipe* p);
+void tokpipe_free(struct TokenPipe* p);
+
+#endif
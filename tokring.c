@@ -0,0 +1,88 @@
+#include "tokring.h"
+
+bool tokring_init(TokenRing* r, Lexer* lexer) {
+    memset(r, 0, sizeof(TokenRing));
+    r->slots = (Token*)malloc(TOKRING_SIZE * sizeof(Token));
+    if (!r->slots) {
+        fprintf(stderr, "Memory allocation error\n");
+        return false;
+    }
+    r->lexer = lexer;
+    r->cap = TOKRING_SIZE;
+    return true;
+}
+
+void tokring_free(TokenRing* r) {
+    free(r->slots);
+    r->slots = NULL;
+}
+
+// 容量加倍: 仍需保留的token按新的下标放入新数组
+static bool grow(TokenRing* r, size_t keep) {
+    size_t cap = r->cap * 2;
+    Token* slots = (Token*)malloc(cap * sizeof(Token));
+    if (!slots) {
+        fprintf(stderr, "Memory allocation error\n");
+        return false;
+    }
+    for (size_t i = keep; i < r->tail; i++) {
+        slots[i & (cap - 1)] = r->slots[i & (r->cap - 1)];
+    }
+    free(r->slots);
+    r->slots = slots;
+    r->cap = cap;
+    return true;
+}
+
+// 取入token直到已取入的数目达到need(或遇到EOF)
+static bool fill(TokenRing* r, size_t need) {
+    while (r->tail < need) {
+        if (r->at_eof) return false;
+        // head之前的token已经用过, 有mark时从mark起都要保留
+        size_t keep = r->marks ? r->pin : r->head;
+        if (r->tail - keep == r->cap && !grow(r, keep)) return false;
+        // 直接写入槽位, 不经过临时变量
+        size_t room = r->cap - (r->tail - keep);
+        size_t n = need - r->tail < room ? need - r->tail : room;
+        for (size_t i = 0; i < n; i++) {
+            Token* slot = &r->slots[r->tail & (r->cap - 1)];
+            *slot = get_token(r->lexer);
+            r->tail++;
+            if (slot->type == TOKEN_EOF) {
+                r->at_eof = true;
+                break;
+            }
+        }
+    }
+    return true;
+}
+
+const Token* tokring_peek(TokenRing* r, size_t k) {
+    if (!fill(r, r->head + k + 1)) {
+        // 超过EOF: 最后取入的就是EOF
+        return &r->slots[(r->tail - 1) & (r->cap - 1)];
+    }
+    return &r->slots[(r->head + k) & (r->cap - 1)];
+}
+
+void tokring_consume(TokenRing* r) {
+    if (tokring_peek(r, 0)->type != TOKEN_EOF) r->head++;
+}
+
+TokenMark tokring_mark(TokenRing* r) {
+    if (r->marks++ == 0) r->pin = r->head;
+    return r->head;
+}
+
+void tokring_rewind(TokenRing* r, TokenMark m) {
+    r->head = m;
+}
+
+void tokring_release(TokenRing* r, TokenMark m) {
+    (void)m;
+    if (r->marks > 0 && --r->marks == 0) r->pin = 0;
+}
+
+void tokring_seek(TokenRing* r, size_t pos) {
+    if (pos > r->head && pos < r->tail) r->head = pos;
+}
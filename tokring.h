@@ -0,0 +1,44 @@
+#ifndef TOKRING_H
+#define TOKRING_H
+
+#include "lexer.h"
+
+// NOTE - 语法分析器的向前看缓冲区
+// 环形缓冲区保存将要读到的token; peek(k)查看第k个(0为当前token), 缺少的token一次取入,
+// consume()只移动下标, 不再整体复制Token
+// 只取入用到的token, 不预先多取: 词法错误在取token时报告, 多取会让它排到前面token的语法错误之前
+// mark/rewind用于推测性的分析: mark之后的token在release之前不会被覆盖,
+// 推测超出容量时缓冲区加倍(之前peek得到的指针随之失效)
+
+#define TOKRING_SIZE 64        // 初始容量, 必须是2的幂
+
+typedef struct {
+    Lexer* lexer;
+    Token* slots;
+    size_t cap;
+    size_t head;               // 当前token的序号(从0开始单调增加)
+    size_t tail;               // 已取入的token数
+    size_t pin;                // 最外层mark的位置, 之后的token不能覆盖
+    int marks;                 // 尚未release的mark数
+    bool at_eof;               // 已取到EOF, 之后不再调用词法分析器
+} TokenRing;
+
+typedef size_t TokenMark;
+
+bool tokring_init(TokenRing* r, Lexer* lexer);
+void tokring_free(TokenRing* r);
+
+// 第k个向前看token; 超过EOF时返回EOF
+const Token* tokring_peek(TokenRing* r, size_t k);
+// 前进一个token, 停在EOF上
+void tokring_consume(TokenRing* r);
+
+// 记下当前位置; mark必须按后进先出的顺序release
+TokenMark tokring_mark(TokenRing* r);
+// 回到m处(m仍然有效, 可以再次回退)
+void tokring_rewind(TokenRing* r, TokenMark m);
+void tokring_release(TokenRing* r, TokenMark m);
+// 直接前进到序号pos处; pos之前的token必须已经取入(如推测时读过), 用于跳过已知结果的部分
+void tokring_seek(TokenRing* r, size_t pos);
+
+#endif
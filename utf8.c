@@ -0,0 +1,78 @@
+#include "utf8.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+int utf8_sequence_length(const char* s, size_t avail) {
+    const unsigned char* p = (const unsigned char*)s;
+    if (avail == 0) return 0;
+    unsigned char c = p[0];
+    if (c < 0x80) return 1;
+
+    // 第二个字节的范围因首字节而异, 用来排除过长编码(E0 80..9F, F0 80..8F)、
+    // 代理项(ED A0..BF)和超出U+10FFFF的字符(F4 90..BF)
+    int n;
+    unsigned char lo = 0x80, hi = 0xBF;
+    if (c >= 0xC2 && c <= 0xDF) {
+        n = 2;
+    } else if (c >= 0xE0 && c <= 0xEF) {
+        n = 3;
+        if (c == 0xE0) lo = 0xA0;
+        if (c == 0xED) hi = 0x9F;
+    } else if (c >= 0xF0 && c <= 0xF4) {
+        n = 4;
+        if (c == 0xF0) lo = 0x90;
+        if (c == 0xF4) hi = 0x8F;
+    } else {
+        return 0;  // 续字节、C0/C1(过长编码)或F5以上
+    }
+    if (avail < (size_t)n) return 0;
+    if (p[1] < lo || p[1] > hi) return 0;
+    for (int i = 2; i < n; i++) {
+        if ((p[i] & 0xC0) != 0x80) return 0;
+    }
+    return n;
+}
+
+size_t utf8_invalid_length(const char* s, size_t avail) {
+    size_t n = 1;
+    while (n < avail && n < 4 && ((unsigned char)s[n] & 0xC0) == 0x80) n++;
+    return n;
+}
+
+// 一块中只要有一个字节的最高位为1就不是全ASCII, movemask直接取出各字节的最高位
+size_t utf8_ascii_end(const char* buf, size_t pos, size_t len) {
+#if defined(__AVX2__)
+    for (; pos + 32 <= len; pos += 32) {
+        __m256i chunk = _mm256_loadu_si256((const __m256i*)(buf + pos));
+        unsigned int mask = (unsigned int)_mm256_movemask_epi8(chunk);
+        if (mask) return pos + (size_t)__builtin_ctz(mask);
+    }
+#endif
+#if defined(__SSE2__)
+    for (; pos + 16 <= len; pos += 16) {
+        __m128i chunk = _mm_loadu_si128((const __m128i*)(buf + pos));
+        unsigned int mask = (unsigned int)_mm_movemask_epi8(chunk);
+        if (mask) return pos + (size_t)__builtin_ctz(mask);
+    }
+#endif
+    while (pos < len && (unsigned char)buf[pos] < 0x80) pos++;
+    return pos;
+}
+
+size_t utf8_next_invalid(const char* buf, size_t pos, size_t len) {
+    while (pos < len) {
+        pos = utf8_ascii_end(buf, pos, len);
+        if (pos == len) break;
+        // 中文等连续的多字节字符逐个解码, 遇到ASCII后回到按块跳过
+        while (pos < len && (unsigned char)buf[pos] >= 0x80) {
+            int n = utf8_sequence_length(buf + pos, len - pos);
+            if (n == 0) return pos;
+            pos += (size_t)n;
+        }
+    }
+    return len;
+}
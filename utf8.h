@@ -0,0 +1,23 @@
+#ifndef UTF8_H
+#define UTF8_H
+
+#include <stddef.h>
+
+// NOTE - UTF-8校验
+// 源文件按UTF-8处理: 载入时整体校验一遍, 全ASCII的16/32字节块用SIMD一次跳过,
+// 只有含非ASCII字节的位置才逐个解码; 词法分析器据此在注释和字符串中直接跳过多字节字符
+
+// s处一个合法UTF-8字符的字节数(1~4), 不合法(含过长编码、代理项、超出U+10FFFF)返回0
+// avail为s之后可用的字节数
+int utf8_sequence_length(const char* s, size_t avail);
+
+// s处非法序列的长度: 出错的字节及紧跟其后的续字节(最多共4个), 报告一次错误后整体跳过
+size_t utf8_invalid_length(const char* s, size_t avail);
+
+// 从pos开始第一个非ASCII字节的下标, 没有时返回len
+size_t utf8_ascii_end(const char* buf, size_t pos, size_t len);
+
+// 从pos(必须在字符边界上)开始第一个非法序列的下标, 全部合法时返回len
+size_t utf8_next_invalid(const char* buf, size_t pos, size_t len);
+
+#endif